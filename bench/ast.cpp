@@ -0,0 +1,79 @@
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "bench/bench.hpp"
+
+#include "main/token.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+
+using namespace std;
+
+// every operator new in the bench binary goes through here so the live
+// heap footprint of a parse can be read off the counters, each block carries
+// its size in a header for the matching delete
+static atomic<size_t> heapBytes{0};
+static atomic<size_t> heapAllocations{0};
+static const size_t HEADER = alignof(max_align_t);
+
+void* operator new(size_t size){
+    heapBytes.fetch_add(size, memory_order_relaxed);
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if(auto p = static_cast<char*>(malloc(size + HEADER))){
+        *reinterpret_cast<size_t*>(p) = size;
+        return p + HEADER;
+    }
+    throw bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    if(p == nullptr)
+        return;
+    auto block = static_cast<char*>(p) - HEADER;
+    heapBytes.fetch_sub(*reinterpret_cast<size_t*>(block), memory_order_relaxed);
+    free(block);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+BENCH(ast){
+    report("ast", "sizeof Identifier", sizeof(Identifier), "bytes");
+    report("ast", "sizeof NumberLiteral", sizeof(NumberLiteral), "bytes");
+    report("ast", "sizeof InfixExpression", sizeof(InfixExpression), "bytes");
+    report("ast", "sizeof LetStatement", sizeof(LetStatement), "bytes");
+
+    auto script = generateScript(8 << 20);
+    double megabytes = script.size() / (1024.0 * 1024.0);
+    size_t nodes = 0;
+
+    // arena first, its object count is the node count of both layouts
+    for(auto allocation: {AstAllocation::ARENA, AstAllocation::HEAP}){
+        string name = allocation == AstAllocation::ARENA ? "arena" : "heap";
+        Lexer lexer{script};
+        Parser parser{lexer, allocation};
+        size_t bytes = heapBytes, allocations = heapAllocations;
+        auto program = parser.parseProgram();
+        bytes = heapBytes - bytes; // still live after the parse
+        allocations = heapAllocations - allocations;
+        if(auto arena = parser.getArena(); arena != nullptr){
+            nodes = arena->arena.objectCount();
+            bytes += arena->arena.bytesUsed();
+        }
+        report("ast", name + " bytes", (double)bytes / nodes, "bytes/node");
+        report("ast", name + " allocations", (double)allocations / nodes, "allocations/node");
+
+        double elapsed = timeIt([&](){
+            Lexer lexer{script};
+            Parser parser{lexer, allocation};
+            parser.parseProgram();
+        });
+        report("ast", name + " Lexer + Parser::parseProgram", megabytes / elapsed, "MB/s");
+    }
+    report("ast", "nodes", (double)nodes, "");
+}
@@ -0,0 +1,30 @@
+#if !defined(BENCH_H)
+#define BENCH_H
+
+#include <string>
+#include <chrono>
+#include <functional>
+
+// Tiny benchmark registry, run with `bench [name...]`
+int registerBench(std::string, std::function<void()>);
+
+#define BENCH(name) \
+    static void name##_bench(); \
+    static int name##_registered = registerBench(#name, name##_bench); \
+    static void name##_bench()
+
+// Wall clock seconds spent in fn
+template <typename F>
+double timeIt(F fn){
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Machine generated looking Monkey script of roughly the given size
+std::string generateScript(size_t);
+
+void report(std::string, std::string, double, std::string);
+
+#endif // BENCH_H
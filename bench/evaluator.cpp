@@ -0,0 +1,256 @@
+#include <string>
+#include <memory>
+#include <functional>
+#include <utility>
+
+#include "bench/bench.hpp"
+
+#include "main/token.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/object.hpp"
+#include "main/environment.hpp"
+#include "main/evaluator.hpp"
+#include "main/optimizer.hpp"
+
+using namespace std;
+
+// scripts the benchmarks below run
+static const string FIB = R"(
+let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+fib(25);
+)";
+
+static const string SCOPES = R"(
+let make = fn(a, b) {
+    let c = a * b;
+    fn(n) {
+        let walk = fn(k) { if (k < 2) { a + c } else { walk(k - 1) + walk(k - 2) - b } };
+        walk(n)
+    }
+};
+make(1, 2)(22);
+)";
+
+static const string CONSTANTS = R"(
+let step = fn(n) {
+    let secondsPerDay = 60 * 60 * 24;
+    let limits = {"low": [1, 2, 3], "high": [4, 5, 6]};
+    let factor = if (secondsPerDay > 1000) { 2 * 3 } else { 1 };
+    limits["high"][2] * factor + secondsPerDay / (24 * 60) + n
+};
+let run = fn(n) { if (n < 1) { step(n) } else { run(n - 1) + run(n - 1) } };
+run(12);
+)";
+
+static const string HELPERS = R"(
+let add = fn(a, b) { a + b };
+let sq = fn(x) { x * x };
+let run = fn(n) { if (n < 1) { add(sq(n), 1) } else { add(run(n - 1), run(n - 1)) } };
+run(14);
+)";
+
+static const string FEEDBACK = R"(
+let xs = [1, 2, 3, 4, 5, 6, 7, 8];
+let sum = fn(i, acc) { if (i == len(xs)) { acc } else { sum(i + 1, acc + xs[i]) } };
+let run = fn(n) { if (n < 1) { sum(0, 0) } else { run(n - 1) + run(n - 1) } };
+run(12);
+)";
+
+static const string TAIL_LOOP = R"(
+let loop = fn(n, acc) { if (n == 0) { acc } else { loop(n - 1, acc + n) } };
+loop(1000000, 0);
+)";
+
+static const string POLYNOMIAL = R"(
+let poly = fn(x) { ((3 * x - 2) * x + 5) * x - 7 / (x * x + 1) };
+let run = fn(n, x) { if (n < 1) { poly(x) } else { run(n - 1, x * 3 / 4) + run(n - 1, x + 1 / 4) } };
+run(16, 1);
+)";
+
+static Object run(const string& script, Optimization optimization = Optimization::ON, Backend backend = Backend::TREE){
+    Lexer lexer{script};
+    Parser parser{lexer};
+    Evaluator evaluator{parser.parseProgram(), optimization, backend};
+    return evaluator.execute(make_shared<Environment>());
+}
+
+BENCH(fib){
+    const string& script = FIB;
+    Object result;
+    double elapsed = timeIt([&](){ result = run(script); });
+    report("fib", "fib(25)", elapsed * 1e3, "ms");
+    report("fib", "result", any_cast<double>(result.value), "");
+}
+
+// recursion two closures deep, every call reads names of the outer frames
+BENCH(scopes){
+    const string& script = SCOPES;
+    Object result;
+    double elapsed = timeIt([&](){ result = run(script); });
+    report("scopes", "closure walk(22)", elapsed * 1e3, "ms");
+    report("scopes", "result", any_cast<double>(result.value), "");
+}
+
+// constant arithmetic, a constant hash and a constant condition in a body
+// that runs 4096 times, with and without the optimizer
+BENCH(optimizer){
+    const string& script = CONSTANTS;
+    string fib = R"(
+let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+fib(22);
+)";
+    for(auto optimization: {Optimization::OFF, Optimization::ON}){
+        string name = optimization == Optimization::ON ? "optimized" : "plain";
+        Object result;
+        double elapsed = timeIt([&](){ result = run(script, optimization); });
+        report("optimizer", name + " constant-heavy run(12)", elapsed * 1e3, "ms");
+        elapsed = timeIt([&](){ run(fib, optimization); });
+        report("optimizer", name + " fib(22)", elapsed * 1e3, "ms");
+        report("optimizer", name + " result", any_cast<double>(result.value), "");
+    }
+}
+
+// small helpers called on every step of a recursion, with and without
+// inlining them
+BENCH(inlining){
+    const string& script = HELPERS;
+    for(auto optimization: {Optimization::OFF, Optimization::ON}){
+        string name = optimization == Optimization::ON ? "inlined" : "called";
+        Object result;
+        double elapsed = timeIt([&](){ result = run(script, optimization); });
+        report("inlining", name + " helpers run(14)", elapsed * 1e3, "ms");
+        report("inlining", name + " result", any_cast<double>(result.value), "");
+    }
+}
+
+// share of the arithmetic sites of the scripts above that type inference
+// proves to be on numbers
+BENCH(types){
+    size_t sites = 0, specialized = 0;
+    std::function<void(AstNode*)> count = [&](AstNode* node){
+        if(node->kind == NodeKind::INFIX){
+            sites++;
+            specialized += static_cast<InfixExpression*>(node)->numeric;
+        } else if(node->kind == NodeKind::PREFIX && static_cast<PrefixExpression*>(node)->opcode == Opcode::NEGATE){
+            sites++;
+            specialized += static_cast<PrefixExpression*>(node)->specialized;
+        } else if(node->kind == NodeKind::FUNCTION && static_cast<FunctionLiteral*>(node)->body != nullptr){
+            count(static_cast<FunctionLiteral*>(node)->body.get());
+        }
+        forEachChild(node, [&](auto& child){ count(child.get()); });
+    };
+    for(auto& script: {FIB, SCOPES, CONSTANTS, HELPERS}){
+        Lexer lexer{script};
+        Parser parser{lexer};
+        auto program = parser.parseProgram();
+        PassManager{Optimization::ON}.run(*program);
+        count(program.get());
+    }
+    report("types", "arithmetic sites", sites, "");
+    report("types", "specialized", specialized * 100.0 / sites, "%");
+
+    for(auto optimization: {Optimization::OFF, Optimization::ON}){
+        string name = optimization == Optimization::ON ? "optimized" : "plain";
+        double elapsed = timeIt([&](){ run(FIB, optimization); });
+        report("types", name + " fib(25)", elapsed * 1e3, "ms");
+    }
+}
+
+// values type inference cannot follow through an array, the nodes
+// specialize on what they see instead; not optimizing turns that off too
+BENCH(feedback){
+    for(auto optimization: {Optimization::OFF, Optimization::ON}){
+        string name = optimization == Optimization::ON ? "specializing" : "plain";
+        Object result;
+        double elapsed = timeIt([&](){ result = run(FEEDBACK, optimization); });
+        report("feedback", name + " array sums run(12)", elapsed * 1e3, "ms");
+        report("feedback", name + " result", any_cast<double>(result.value), "");
+    }
+    double elapsed = timeIt([&](){ run(FIB); });
+    report("feedback", "fib(25)", elapsed * 1e3, "ms");
+}
+
+// the recursive scripts above on the tree-walker and on the bytecode
+// virtual machine, compile time included
+BENCH(vm){
+    std::pair<const char*, const string*> scripts[] = {
+        {"fib(25)", &FIB}, {"closure walk(22)", &SCOPES}, {"helpers run(14)", &HELPERS},
+    };
+    for(auto& [name, script]: scripts){
+        double tree = timeIt([&](){ run(*script); });
+        Object result;
+        double vm = timeIt([&](){ result = run(*script, Optimization::ON, Backend::BYTECODE); });
+        report("vm", string("tree ") + name, tree * 1e3, "ms");
+        report("vm", string("bytecode ") + name, vm * 1e3, "ms");
+        report("vm", string("speedup ") + name, tree / vm, "x");
+        report("vm", string("result ") + name, any_cast<double>(result.value), "");
+    }
+}
+
+// same scripts on the ClosureCompiler's callables
+BENCH(closures){
+    std::pair<const char*, const string*> scripts[] = {
+        {"fib(25)", &FIB}, {"closure walk(22)", &SCOPES}, {"helpers run(14)", &HELPERS},
+    };
+    for(auto& [name, script]: scripts){
+        double tree = timeIt([&](){ run(*script); });
+        Object result;
+        double closures = timeIt([&](){ result = run(*script, Optimization::ON, Backend::CLOSURES); });
+        report("closures", string("tree ") + name, tree * 1e3, "ms");
+        report("closures", string("closures ") + name, closures * 1e3, "ms");
+        report("closures", string("speedup ") + name, tree / closures, "x");
+        report("closures", string("result ") + name, any_cast<double>(result.value), "");
+    }
+}
+
+// numeric scripts on the tree-walker and with their functions compiled to
+// machine code, compile time included
+BENCH(jit){
+    std::pair<const char*, const string*> scripts[] = {
+        {"fib(25)", &FIB}, {"polynomial run(16)", &POLYNOMIAL},
+    };
+    for(auto& [name, script]: scripts){
+        double tree = timeIt([&](){ run(*script); });
+        Object result;
+        double jit = timeIt([&](){ result = run(*script, Optimization::ON, Backend::JIT); });
+        report("jit", string("tree ") + name, tree * 1e3, "ms");
+        report("jit", string("jit ") + name, jit * 1e3, "ms");
+        report("jit", string("speedup ") + name, tree / jit, "x");
+        report("jit", string("result ") + name, any_cast<double>(result.value), "");
+    }
+}
+
+// a million tail calls running in one frame, per call against the nested
+// calls of fib(25)
+BENCH(tailcalls){
+    Object result;
+    double loop = timeIt([&](){ result = run(TAIL_LOOP); });
+    double fib = timeIt([&](){ run(FIB); });
+    report("tailcalls", "loop(1000000)", loop * 1e3, "ms");
+    report("tailcalls", "per tail call", loop * 1e9 / 1e6, "ns");
+    report("tailcalls", "per call fib(25)", fib * 1e9 / 242785, "ns");
+    report("tailcalls", "result", any_cast<double>(result.value), "");
+}
+
+// the tree-walker's scripts again on the StackMachine, then a recursion
+// far deeper than the native stack holds
+BENCH(stack){
+    std::pair<const char*, const string*> scripts[] = {
+        {"fib(25)", &FIB}, {"closure walk(22)", &SCOPES}, {"helpers run(14)", &HELPERS},
+    };
+    for(auto& [name, script]: scripts){
+        double tree = timeIt([&](){ run(*script); });
+        double stack = timeIt([&](){ run(*script, Optimization::ON, Backend::STACK); });
+        report("stack", string("tree ") + name, tree * 1e3, "ms");
+        report("stack", string("stack ") + name, stack * 1e3, "ms");
+    }
+    Object result;
+    double deep = timeIt([&](){
+        result = run("let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; sum(50000);",
+            Optimization::ON, Backend::STACK);
+    });
+    report("stack", "stack sum(50000)", deep * 1e3, "ms");
+    report("stack", "result sum(50000)", any_cast<double>(result.value), "");
+}
@@ -0,0 +1,75 @@
+#include <string>
+#include <thread>
+
+#include "bench/bench.hpp"
+
+#include "main/source.hpp"
+#include "main/token.hpp"
+#include "main/tokens.hpp"
+#include "main/lexer.hpp"
+#include "main/scan.hpp"
+
+using namespace std;
+
+BENCH(lexer){
+    auto script = generateScript(8 << 20);
+    double megabytes = script.size() / (1024.0 * 1024.0);
+
+    size_t tokens = 0;
+    double elapsed = timeIt([&](){
+        Lexer lexer{script};
+        while(lexer.nextToken().type != TokenType::EOS)
+            tokens++;
+    });
+    report("lexer", "Lexer::nextToken", megabytes / elapsed, "MB/s");
+
+    auto best = scanPath();
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    for(auto path: {ScanPath::SCALAR, ScanPath::SSE2, ScanPath::AVX2}){
+        if(setScanPath(path) != path)
+            continue;
+        size_t views = 0;
+        elapsed = timeIt([&](){
+            ViewLexer lexer{script};
+            while(lexer.nextToken().type != TokenType::EOS)
+                views++;
+        });
+        report("lexer", string("ViewLexer::nextToken ") + names[static_cast<int>(path)], megabytes / elapsed, 
+            views == tokens ? "MB/s" : "MB/s (TOKEN MISMATCH)");
+    }
+    setScanPath(best);
+}
+
+BENCH(keywords){
+    const int lines = 1000000;
+    size_t tokens = 0;
+    double elapsed = timeIt([&](){
+        for(int i = 0; i < lines; ++i){
+            Lexer lexer{"let x = fn(y) { return y; };"};
+            while(lexer.nextToken().type != TokenType::EOS)
+                tokens++;
+        }
+    });
+    report("keywords", "REPL sized Lexer construct + lex", elapsed * 1e9 / lines, "ns/line");
+}
+
+BENCH(parallel){
+    auto source = Source::fromString(generateScript(64 << 20));
+    double megabytes = source->text().size() / (1024.0 * 1024.0);
+
+    size_t tokens = 0;
+    double elapsed = timeIt([&](){
+        tokens = TokenStream::tokenize(source).size();
+    });
+    report("parallel", "TokenStream::tokenize", megabytes / elapsed, "MB/s");
+
+    for(unsigned threads: {2, 4, 8}){
+        size_t parallelTokens = 0;
+        elapsed = timeIt([&](){
+            parallelTokens = TokenStream::tokenizeParallel(source, threads).size();
+        });
+        report("parallel", "TokenStream::tokenizeParallel " + to_string(threads) + " threads", megabytes / elapsed,
+            parallelTokens == tokens ? "MB/s" : "MB/s (TOKEN MISMATCH)");
+    }
+    report("parallel", "hardware threads", thread::hardware_concurrency(), "");
+}
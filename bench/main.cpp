@@ -0,0 +1,60 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "bench/bench.hpp"
+#include "main/utils.hpp"
+
+using namespace std;
+
+static vector<pair<string, function<void()>>>& registry(){
+    static vector<pair<string, function<void()>>> benches;
+    return benches;
+}
+
+int registerBench(string name, function<void()> fn){
+    registry().push_back(make_pair(name, fn));
+    return (int)registry().size();
+}
+
+// identifiers cannot hold digits, number them in base 26 letters
+static string letters(size_t i){
+    string name;
+    do {
+        name += char('a' + i % 26);
+        i /= 26;
+    } while(i > 0);
+    return name;
+}
+
+string generateScript(size_t bytes){
+    string script;
+    script.reserve(bytes + 128);
+    size_t i = 0;
+    while(script.size() < bytes){
+        auto id = letters(i);
+        script += format("let rule_threshold_", id, " = fn(score_value, weight_factor) {\n",
+            "    if (score_value > ", i % 97, ") { score_value * weight_factor + ", i, " } else { 0 - weight_factor }\n",
+            "};\n",
+            "let rule_config_", id, " = {\"name\": \"rule number ", i, "\", \"enabled\": true, \"limits\": [1, 2, ", i, "]};\n");
+        i++;
+    }
+    return script;
+}
+
+void report(string bench, string metric, double value, string unit){
+    cout << bench << ": " << metric << " = " << toStringWithPrecicion(value, 2) << " " << unit << endl;
+}
+
+int main(int argc, char const *argv[]){
+    for(auto& bench: registry()){
+        bool selected = argc <= 1;
+        for(int i = 1; i < argc; ++i)
+            selected = selected || bench.first == argv[i];
+        if(selected)
+            bench.second();
+    }
+    return 0;
+}
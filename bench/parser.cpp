@@ -0,0 +1,103 @@
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <filesystem>
+
+#include "bench/bench.hpp"
+
+#include "main/source.hpp"
+#include "main/token.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/object.hpp"
+#include "main/environment.hpp"
+#include "main/evaluator.hpp"
+#include "main/cache.hpp"
+
+using namespace std;
+
+BENCH(parser){
+    auto script = generateScript(8 << 20);
+    double megabytes = script.size() / (1024.0 * 1024.0);
+
+    size_t statements = 0;
+    double elapsed = timeIt([&](){
+        Lexer lexer{script};
+        Parser parser{lexer};
+        statements = parser.parseProgram()->statements.size();
+    });
+    report("parser", "Lexer + Parser::parseProgram", megabytes / elapsed, "MB/s");
+    report("parser", "statements", (double)statements, "");
+}
+
+BENCH(expressions){
+    string inputs[] = {
+        "-a * b",
+        "a + b * c + d / e - f",
+        "3 + 4 * 5 == 3 * 1 + 4 * 5",
+        "add(a, b, 1, 2 * 3, 4 + 5, add(6, 7 * 8))",
+        "a * [1, 2, 3, 4][b * c] * d",
+        "if (x < y) { x } else { y }",
+    };
+    const int rounds = 100000;
+    size_t statements = 0;
+    double elapsed = timeIt([&](){
+        for(int i = 0; i < rounds; ++i){
+            for(auto& input: inputs){
+                Lexer lexer{input};
+                Parser parser{lexer};
+                statements += parser.parseProgram()->statements.size();
+            }
+        }
+    });
+    report("expressions", "construct + parse", elapsed * 1e9 / statements, "ns/expression");
+}
+
+BENCH(lazy){
+    // a library of rules of which a run only calls one
+    auto script = generateScript(8 << 20) + "rule_threshold_h(50, 2);\n";
+    double megabytes = script.size() / (1024.0 * 1024.0);
+
+    for(auto bodies: {FunctionBodies::EAGER, FunctionBodies::LAZY}){
+        string name = bodies == FunctionBodies::EAGER ? "eager" : "lazy";
+        double parse = timeIt([&](){
+            Lexer lexer{script};
+            Parser parser{lexer, AstAllocation::ARENA, bodies};
+            parser.parseProgram();
+        });
+        report("lazy", name + " Lexer + Parser::parseProgram", megabytes / parse, "MB/s");
+
+        double run = timeIt([&](){
+            Lexer lexer{script};
+            Parser parser{lexer, AstAllocation::ARENA, bodies};
+            Evaluator evaluator{parser.parseProgram()};
+            evaluator.execute(make_shared<Environment>());
+        });
+        report("lazy", name + " parse + run", run * 1e3, "ms");
+    }
+}
+
+BENCH(cache){
+    auto source = Source::fromString(generateScript(8 << 20));
+    double megabytes = source->text().size() / (1024.0 * 1024.0);
+    auto path = (std::filesystem::temp_directory_path() / "monkey-bench.mkc").string();
+
+    shared_ptr<Program> program;
+    double parse = timeIt([&](){
+        Lexer lexer{source};
+        Parser parser{lexer, AstAllocation::ARENA, FunctionBodies::LAZY};
+        program = parser.parseProgram();
+    });
+    report("cache", "Lexer + lazy Parser::parseProgram", parse * 1e3, "ms");
+
+    double store = timeIt([&](){ ScriptCache::store(path, *program, *source); });
+    report("cache", "ScriptCache::store", store * 1e3, "ms");
+
+    shared_ptr<Program> loaded;
+    double load = timeIt([&](){ loaded = ScriptCache::load(path, source); });
+    report("cache", "ScriptCache::load", load * 1e3, "ms");
+    report("cache", "load", megabytes / load, "MB/s of script");
+    report("cache", "statements", (double)loaded->statements.size(), "");
+    remove(path.c_str());
+}
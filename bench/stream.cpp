@@ -0,0 +1,92 @@
+#include <string>
+#include <streambuf>
+#include <istream>
+#include <iterator>
+#include <memory>
+
+#include <sys/resource.h>
+
+#include "bench/bench.hpp"
+
+#include "main/token.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/object.hpp"
+#include "main/environment.hpp"
+#include "main/evaluator.hpp"
+#include "main/pipeline.hpp"
+
+using namespace std;
+
+// Replays one generated block until total bytes were produced, so the input
+// is never held in memory
+class ScriptBuf: public streambuf {
+public:
+    ScriptBuf(size_t total): remaining{total}, script{generateScript(64 * 1024)} {}
+protected:
+    int_type underflow() override {
+        if(remaining == 0)
+            return traits_type::eof();
+        block = script.substr(0, remaining);
+        remaining -= block.size();
+        setg(&block[0], &block[0], &block[0] + block.size());
+        return traits_type::to_int_type(block[0]);
+    }
+private:
+    size_t remaining;
+    string script;
+    string block;
+};
+
+static double peakRssMb(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+BENCH(stream){
+    for(size_t megabytes: {64, 256}){
+        ScriptBuf buf{megabytes << 20};
+        istream in{&buf};
+        size_t tokens = 0;
+        StreamLexer lexer{in};
+        double elapsed = timeIt([&](){
+            while(lexer.nextToken().type != TokenType::EOS)
+                tokens++;
+        });
+        auto label = "StreamLexer " + to_string(megabytes) + "MB";
+        report("stream", label, megabytes / elapsed, "MB/s");
+        report("stream", label + " buffer", lexer.capacity() / 1024.0, "KB");
+        report("stream", label + " peak RSS", peakRssMb(), "MB");
+    }
+}
+
+BENCH(pipeline){
+    const size_t megabytes = 32;
+    // peak RSS only grows, the whole program run has to come last
+    for(bool background: {false, true}){
+        ScriptBuf buf{megabytes << 20};
+        istream in{&buf};
+        StatementStream stream{in};
+        Evaluator evaluator{nullptr};
+        double elapsed = timeIt([&](){
+            runStream(stream, evaluator, make_shared<Environment>(), background);
+        });
+        string label = background ? "streaming, parser thread" : "streaming";
+        report("pipeline", label, megabytes / elapsed, "MB/s");
+        report("pipeline", label + " peak RSS", peakRssMb(), "MB");
+    }
+
+    double elapsed = timeIt([&](){
+        ScriptBuf buf{megabytes << 20};
+        istream in{&buf};
+        string script{istreambuf_iterator<char>{in}, istreambuf_iterator<char>{}};
+        Lexer lexer{std::move(script)};
+        Parser parser{lexer, AstAllocation::ARENA, FunctionBodies::LAZY};
+        Evaluator evaluator{parser.parseProgram()};
+        evaluator.execute(make_shared<Environment>());
+    });
+    report("pipeline", "whole program", megabytes / elapsed, "MB/s");
+    report("pipeline", "whole program peak RSS", peakRssMb(), "MB");
+}
@@ -7,4 +7,33 @@ macro(subdirlist result curdir)
     endif()
   endforeach()
   set(${result} ${dirlist})
-endmacro()
\ No newline at end of file
+endmacro()
+
+# add_monkey_program(<target> <script> [SHARED])
+# Translates a Monkey script with mkc and builds the C++ against the runtime:
+# an executable running the script, or with SHARED a library exporting
+# `Object <target>(Runtime&, const std::shared_ptr<Environment>&)`, the target
+# name made a C identifier
+function(add_monkey_program target script)
+  cmake_parse_arguments(MONKEY "SHARED" "" "" ${ARGN})
+  get_filename_component(script ${script} ABSOLUTE)
+  set(generated ${CMAKE_CURRENT_BINARY_DIR}/${target}.cpp)
+  string(MAKE_C_IDENTIFIER ${target} entry)
+  if(MONKEY_SHARED)
+    set(flags --entry ${entry})
+  else()
+    set(flags --main --entry ${entry})
+  endif()
+  add_custom_command(
+    OUTPUT ${generated}
+    COMMAND mkc ${flags} ${script} ${generated}
+    DEPENDS mkc ${script}
+    COMMENT "Translating ${script} to C++"
+    VERBATIM)
+  if(MONKEY_SHARED)
+    add_library(${target} SHARED ${generated})
+  else()
+    add_executable(${target} ${generated})
+  endif()
+  target_link_libraries(${target} monkey)
+endfunction()
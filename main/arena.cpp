@@ -0,0 +1,40 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include "arena.hpp"
+
+Arena::Arena(size_t size): blocks{}, cursor{nullptr}, limit{nullptr}, blockSize{size},
+    used{0}, reserved{0}, objects{0}, destructors{nullptr} {
+}
+
+Arena::~Arena(){
+    for(auto d = destructors; d != nullptr; d = d->next)
+        d->destroy(d->object);
+    for(auto block: blocks)
+        std::free(block);
+}
+
+void* Arena::allocate(size_t size, size_t align){
+    auto aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+    if(cursor == nullptr || aligned + size > reinterpret_cast<uintptr_t>(limit)){
+        // oversized requests get a block of their own
+        size_t len = size + align > blockSize ? size + align : blockSize;
+        char* block = static_cast<char*>(std::malloc(len));
+        if(block == nullptr)
+            throw std::bad_alloc{};
+        blocks.push_back(block);
+        reserved += len;
+        cursor = block;
+        limit = block + len;
+        aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    used += size;
+    cursor = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+void Arena::onDestroy(void* object, void (*destroy)(void*)){
+    auto d = static_cast<Destructor*>(allocate(sizeof(Destructor), alignof(Destructor)));
+    *d = Destructor{destroy, object, destructors};
+    destructors = d;
+}
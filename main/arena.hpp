@@ -0,0 +1,63 @@
+#if !defined(ARENA_H)
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+// Bump allocator, everything made from it is released together when the
+// arena goes away. Objects that need a destructor get it run at that point,
+// in reverse order of construction.
+class Arena {
+public:
+    Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t, size_t);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args){
+        T* obj = makeWithoutDestructor<T>(std::forward<Args>(args)...);
+        if constexpr(!std::is_trivially_destructible_v<T>)
+            onDestroy(obj, [](void* p){ static_cast<T*>(p)->~T(); });
+        return obj;
+    }
+
+    // For objects whose destructor has nothing to release, saves the
+    // bookkeeping record make keeps per object
+    template <typename T, typename... Args>
+    T* makeWithoutDestructor(Args&&... args){
+        void* mem = allocate(sizeof(T), alignof(T));
+        T* obj = new (mem) T(std::forward<Args>(args)...);
+        objects++;
+        return obj;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+    size_t objectCount() const { return objects; }
+
+private:
+    struct Destructor {
+        void (*destroy)(void*);
+        void* object;
+        Destructor* next;
+    };
+
+    void onDestroy(void*, void (*)(void*));
+
+    std::vector<char*> blocks;
+    char* cursor;
+    char* limit;
+    size_t blockSize;
+    size_t used;
+    size_t reserved;
+    size_t objects;
+    Destructor* destructors;
+};
+
+#endif // ARENA_H
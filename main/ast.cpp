@@ -5,6 +5,7 @@
 
 
 #include "token.hpp"
+#include "source.hpp"
 #include "ast.hpp"
 
 using namespace std;
@@ -27,7 +28,7 @@ string Program::toString(){
 void Identifier::expressionNode(){
 }
 string Identifier::toString(){
-    return value;
+    return string(value);
 }
 
 // LetStatement class
@@ -192,7 +193,10 @@ string FunctionLiteral::toString(){
             ss << ",";
     }
     ss << ")";
-    ss << body->toString();
+    if(isLazy())
+        ss << source->text().substr(bodyBegin, bodyEnd - bodyBegin);
+    else
+        ss << body->toString();
     return ss.str();
 }
 
@@ -219,4 +223,47 @@ string IndexExpression::toString(){
     stringstream ss;
     ss << "(" << left->toString() << "[" << index->toString() << "])";
     return ss.str();
-}
\ No newline at end of file
+}
+
+// Constant class
+void Constant::expressionNode(){
+}
+string Constant::toString(){
+    return value.inspect();
+}
+
+// TypeAssumptions
+void TypeAssumptions::drop(){
+    for(auto node: nodes){
+        switch(node->kind){
+        case NodeKind::PREFIX:
+            static_cast<PrefixExpression*>(node)->specialized = false;
+            break;
+        case NodeKind::INFIX:
+            static_cast<InfixExpression*>(node)->numeric = false;
+            break;
+        case NodeKind::IF:
+            static_cast<IfExpression*>(node)->booleanCondition = false;
+            break;
+        case NodeKind::INDEX:
+            static_cast<IndexExpression*>(node)->arrayIndex = false;
+            break;
+        default:
+            break;
+        }
+    }
+    nodes.clear();
+    // the last reference may be one of these
+    auto functions = std::move(this->functions);
+    for(auto fn: functions){
+        fn->signature.clear();
+        fn->assumptions = nullptr;
+    }
+}
+
+// InlineCall class
+void InlineCall::expressionNode(){
+}
+string InlineCall::toString(){
+    return call->toString();
+}
@@ -1,69 +1,148 @@
 #if !defined(AST_H)
 #define AST_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
+#include <type_traits>
+
+#include "arena.hpp"
+#include "symbols.hpp"
+#include "object.hpp"
+
+class Source;
+struct AstArena;
+class FunctionLiteral;
+
+
+// Concrete node type, lets the evaluator switch on a tag instead of probing
+// with dynamic casts
+enum class NodeKind {
+    PROGRAM,
+    IDENTIFIER,
+    LET,
+    RETURN,
+    EXPRESSION_STATEMENT,
+    BLOCK,
+    NUMBER,
+    STRING,
+    BOOLEAN,
+    ARRAY,
+    HASH,
+    PREFIX,
+    INFIX,
+    IF,
+    FUNCTION,
+    CALL,
+    INDEX,
+    CONSTANT,
+    INLINE,
+};
+
+// Operators as resolved by the parser, the binary ones come first so they
+// index the evaluator tables directly
+enum class Opcode {
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    GREATER,
+    LESS,
+    EQUAL,
+    NOT_EQUAL,
+    NOT,
+    NEGATE,
+};
 
-class Token;
+// What a node has seen of its operands at run time. It starts UNSEEN,
+// specializes on the first operands it sees when they have a fast path and
+// turns GENERIC for good the first time later ones break the guard.
+enum class Feedback: uint8_t {
+    UNSEEN,
+    SPECIALIZED,
+    GENERIC,
+};
 
+inline constexpr size_t INFIX_OPCODE_COUNT = static_cast<size_t>(Opcode::NOT_EQUAL) + 1;
+inline constexpr size_t PREFIX_OPCODE_COUNT = static_cast<size_t>(Opcode::NEGATE) - INFIX_OPCODE_COUNT + 1;
 
 class AstNode {
 public:
+    AstNode(NodeKind kind): kind{kind} {};
     virtual ~AstNode() = default;
     virtual std::string tokenLiteral() = 0;
     virtual std::string toString() = 0;
+
+    NodeKind kind;
 };
 
-class ExpressionNode: public virtual AstNode {
+// Nodes keep a span of the source for their token instead of a copy of it.
+// The source stays alive through Program and FunctionLiteral (heap nodes)
+// or through the AstArena that owns the nodes.
+class ExpressionNode: public AstNode {
 public:
-    ExpressionNode() = default;
-    ExpressionNode(Token token):token{token} {};
+    ExpressionNode(NodeKind kind): AstNode{kind} {};
+    ExpressionNode(NodeKind kind, std::string_view literal): AstNode{kind}, literal{literal} {};
     virtual ~ExpressionNode() = default;
-    virtual std::string tokenLiteral(){return token.literal;};
+    virtual std::string tokenLiteral(){return std::string(literal);};
     virtual void expressionNode() = 0;
     virtual std::string toString() = 0;
+    std::string_view span() const { return literal; }
 protected:
-    Token token;
+    std::string_view literal;
 };
 
-class StatementNode: public virtual AstNode {
+class StatementNode: public AstNode {
 public:
-    StatementNode() = default;
-    StatementNode(Token token):token{token} {};
+    StatementNode(NodeKind kind): AstNode{kind} {};
+    StatementNode(NodeKind kind, std::string_view literal): AstNode{kind}, literal{literal} {};
     virtual ~StatementNode() = default;
-    virtual std::string tokenLiteral(){return token.literal;};
+    virtual std::string tokenLiteral(){return std::string(literal);};
     virtual void statementNode() = 0;
     virtual std::string toString() = 0;
 
-    Token token;
+    std::string_view literal;
 };
 
-class Program: public virtual AstNode {
+class Program: public AstNode {
 public:
-    Program(): statements{} {};
+    Program(): AstNode{NodeKind::PROGRAM}, statements{} {};
     virtual ~Program() = default;
     virtual std::string tokenLiteral();
     virtual std::string toString();
 
     std::vector<std::shared_ptr<StatementNode>> statements;
+    std::shared_ptr<const Source> source;
+    std::weak_ptr<AstArena> arena; // where rewritten nodes go, null for heap nodes
 };
 
-class Identifier: public virtual ExpressionNode {
+class Identifier: public ExpressionNode {
 public:
-    Identifier() = default;
-    Identifier(Token token, std::string val): ExpressionNode{token}, value{val} {};
+    // depth values that are not a frame count, set by the resolver
+    static constexpr int16_t GLOBAL = -1; // bound in no frame, only in the global table
+    static constexpr int16_t DYNAMIC = -2; // not resolved, looked up by symbol
+
+    Identifier(): ExpressionNode{NodeKind::IDENTIFIER} {};
+    Identifier(std::string_view name, Symbol symbol): ExpressionNode{NodeKind::IDENTIFIER, name}, value{name}, symbol{symbol} {};
     virtual ~Identifier() = default;
     virtual void expressionNode();
     virtual std::string toString();
     
-    std::string value;
+    std::string_view value;
+    Symbol symbol; // what environments are keyed by
+    int16_t depth = DYNAMIC; // frames up from the one in use, or GLOBAL or DYNAMIC
+    uint16_t slot = 0; // in that frame
+    // builtin a global name turned out to be, used while nothing binds it
+    const Object* builtin = nullptr;
 };
 
-class LetStatement: public virtual StatementNode {
+class LetStatement: public StatementNode {
 public:
-    LetStatement() = default;
-    LetStatement(Token token): StatementNode{token} {};
+    LetStatement(): StatementNode{NodeKind::LET} {};
+    LetStatement(std::string_view literal): StatementNode{NodeKind::LET, literal} {};
     virtual ~LetStatement() = default;
     virtual void statementNode();
     virtual std::string toString();
@@ -72,10 +151,10 @@ public:
     std::shared_ptr<ExpressionNode> value;
 };
 
-class ReturnStatement: public virtual StatementNode {
+class ReturnStatement: public StatementNode {
 public:
-    ReturnStatement() = default;
-    ReturnStatement(Token token): StatementNode{token} {};
+    ReturnStatement(): StatementNode{NodeKind::RETURN} {};
+    ReturnStatement(std::string_view literal): StatementNode{NodeKind::RETURN, literal} {};
     virtual ~ReturnStatement() = default;
     virtual void statementNode();
     virtual std::string toString();
@@ -83,10 +162,10 @@ public:
     std::shared_ptr<ExpressionNode> value;
 };
 
-class ExpressionStatement: public virtual StatementNode {
+class ExpressionStatement: public StatementNode {
 public:
-    ExpressionStatement() = default;
-    ExpressionStatement(Token token): StatementNode{token} {};
+    ExpressionStatement(): StatementNode{NodeKind::EXPRESSION_STATEMENT} {};
+    ExpressionStatement(std::string_view literal): StatementNode{NodeKind::EXPRESSION_STATEMENT, literal} {};
     virtual ~ExpressionStatement() = default;
     virtual void statementNode();
     virtual std::string toString();
@@ -94,10 +173,10 @@ public:
     std::shared_ptr<ExpressionNode> expression;
 };
 
-class BlockStatement: public virtual StatementNode {
+class BlockStatement: public StatementNode {
 public:
-    BlockStatement() = default;
-    BlockStatement(Token token): StatementNode{token} {};
+    BlockStatement(): StatementNode{NodeKind::BLOCK} {};
+    BlockStatement(std::string_view literal): StatementNode{NodeKind::BLOCK, literal} {};
     virtual ~BlockStatement() = default;
     virtual void statementNode();
     virtual std::string toString();
@@ -105,10 +184,10 @@ public:
     std::vector<std::shared_ptr<StatementNode>> statements;
 };
 
-class NumberLiteral: public virtual ExpressionNode {
+class NumberLiteral: public ExpressionNode {
 public:
-    NumberLiteral() = default;
-    NumberLiteral(Token token, double val): ExpressionNode{token}, value{val} {};
+    NumberLiteral(): ExpressionNode{NodeKind::NUMBER} {};
+    NumberLiteral(std::string_view literal, double val): ExpressionNode{NodeKind::NUMBER, literal}, value{val} {};
     virtual ~NumberLiteral() = default;
     virtual void expressionNode();
     virtual std::string toString();
@@ -116,21 +195,21 @@ public:
     double value;
 };
 
-class StringLiteral: public virtual ExpressionNode {
+class StringLiteral: public ExpressionNode {
 public:
-    StringLiteral() = default;
-    StringLiteral(Token token, std::string val): ExpressionNode{token}, value{val} {};
+    StringLiteral(): ExpressionNode{NodeKind::STRING} {};
+    StringLiteral(std::string_view val): ExpressionNode{NodeKind::STRING, val}, value{val} {};
     virtual ~StringLiteral() = default;
     virtual void expressionNode();
     virtual std::string toString();
 
-    std::string value;
+    std::string_view value;
 };
 
-class BooleanLiteral: public virtual ExpressionNode {
+class BooleanLiteral: public ExpressionNode {
 public:
-    BooleanLiteral() = default;
-    BooleanLiteral(Token token, bool val): ExpressionNode{token}, value{val} {};
+    BooleanLiteral(): ExpressionNode{NodeKind::BOOLEAN} {};
+    BooleanLiteral(std::string_view literal, bool val): ExpressionNode{NodeKind::BOOLEAN, literal}, value{val} {};
     virtual ~BooleanLiteral() = default;
     virtual void expressionNode();
     virtual std::string toString();
@@ -138,10 +217,10 @@ public:
     bool value;
 };
 
-class ArrayLiteral: public virtual ExpressionNode {
+class ArrayLiteral: public ExpressionNode {
 public:
-    ArrayLiteral() = default;
-    ArrayLiteral(Token token): ExpressionNode{token} {};
+    ArrayLiteral(): ExpressionNode{NodeKind::ARRAY} {};
+    ArrayLiteral(std::string_view literal): ExpressionNode{NodeKind::ARRAY, literal} {};
     virtual ~ArrayLiteral() = default;
     virtual void expressionNode();
     virtual std::string toString();
@@ -149,10 +228,10 @@ public:
     std::vector<std::shared_ptr<ExpressionNode>> items;
 };
 
-class HashLiteral: public virtual ExpressionNode {
+class HashLiteral: public ExpressionNode {
 public:
-    HashLiteral() = default;
-    HashLiteral(Token token): ExpressionNode{token} {};
+    HashLiteral(): ExpressionNode{NodeKind::HASH} {};
+    HashLiteral(std::string_view literal): ExpressionNode{NodeKind::HASH, literal} {};
     virtual ~HashLiteral() = default;
     virtual void expressionNode();
     virtual std::string toString();
@@ -161,37 +240,44 @@ public:
 };
 
 
-class PrefixExpression: public virtual ExpressionNode {
+class PrefixExpression: public ExpressionNode {
 public:
-    PrefixExpression() = default;
-    PrefixExpression(Token token, std::string op): ExpressionNode{token}, oprator{op} {};
+    PrefixExpression(): ExpressionNode{NodeKind::PREFIX} {};
+    PrefixExpression(std::string_view op, Opcode code): ExpressionNode{NodeKind::PREFIX, op}, oprator{op}, opcode{code} {};
     virtual ~PrefixExpression() = default;
     virtual void expressionNode();
     virtual std::string toString();
 
-    std::string oprator;
+    std::string_view oprator;
+    Opcode opcode;
     std::shared_ptr<ExpressionNode> right;
+    // set by type inference: the operand is a number for -, a boolean for !
+    bool specialized = false;
+    Feedback feedback = Feedback::UNSEEN; // same as specialized, seen at run time
 };
 
-class InfixExpression: public virtual ExpressionNode {
+class InfixExpression: public ExpressionNode {
 public:
     using ExprNode = std::shared_ptr<ExpressionNode>;
 
-    InfixExpression() = default;
-    InfixExpression(Token token, std::string op, ExprNode l): ExpressionNode{token}, oprator{op}, left{l} {};
+    InfixExpression(): ExpressionNode{NodeKind::INFIX} {};
+    InfixExpression(std::string_view op, Opcode code, ExprNode l): ExpressionNode{NodeKind::INFIX, op}, left{l}, oprator{op}, opcode{code} {};
     virtual ~InfixExpression() = default;
     virtual void expressionNode();
     virtual std::string toString();
 
     std::shared_ptr<ExpressionNode> left;
-    std::string oprator;
+    std::string_view oprator;
+    Opcode opcode;
     std::shared_ptr<ExpressionNode> right;
+    bool numeric = false; // set by type inference: both operands are numbers
+    Feedback feedback = Feedback::UNSEEN; // SPECIALIZED: only numbers seen
 };
 
-class IfExpression: public virtual ExpressionNode {
+class IfExpression: public ExpressionNode {
 public:
-    IfExpression() = default;
-    IfExpression(Token token): ExpressionNode{token} {};
+    IfExpression(): ExpressionNode{NodeKind::IF} {};
+    IfExpression(std::string_view literal): ExpressionNode{NodeKind::IF, literal} {};
     virtual ~IfExpression() = default;
     virtual void expressionNode();
     virtual std::string toString();
@@ -199,47 +285,236 @@ public:
     std::shared_ptr<ExpressionNode> condition;
     std::shared_ptr<BlockStatement> consequence;
     std::shared_ptr<BlockStatement> alternative;
+    bool booleanCondition = false; // set by type inference
 };
 
-class FunctionLiteral: public virtual ExpressionNode {
+// Nodes type inference specialized, valid as long as every function is
+// called with parameters of the types it assumed. A call that breaks one
+// drops all of them at once, the program goes back to checked paths. Only
+// kept for arena trees, where every node lives as long as any function.
+struct CompiledBody;
+struct NativeFunction;
+
+struct TypeAssumptions {
+    std::vector<AstNode*> nodes;
+    std::vector<FunctionLiteral*> functions;
+
+    void drop();
+};
+
+class FunctionLiteral: public ExpressionNode {
 public:
-    FunctionLiteral() = default;
-    FunctionLiteral(Token token): ExpressionNode{token} {};
+    FunctionLiteral(): ExpressionNode{NodeKind::FUNCTION} {};
+    FunctionLiteral(std::string_view literal): ExpressionNode{NodeKind::FUNCTION, literal} {};
     virtual ~FunctionLiteral() = default;
     virtual void expressionNode();
     virtual std::string toString();
 
+    // body is null until the first call when the preparser skipped it,
+    // bodyBegin and bodyEnd then delimit its braces in source
+    bool isLazy() const { return body == nullptr && bodyEnd > bodyBegin; }
+
     std::shared_ptr<std::vector<Identifier>> params;
     std::shared_ptr<BlockStatement> body;
+    // slot layout of the frames of this function: parameters then every let
+    // of the body, null until the resolver has run over it
+    std::shared_ptr<const std::vector<Symbol>> locals;
+    std::shared_ptr<const Source> source;
+    std::weak_ptr<const void> owner; // whatever keeps this node alive
+    std::weak_ptr<AstArena> arena; // where a lazy body goes, null for heap nodes
+    // types each parameter may have, one bit per ObjectType, checked on
+    // every call while there are assumptions
+    std::vector<uint32_t> signature;
+    std::shared_ptr<TypeAssumptions> assumptions;
+    std::shared_ptr<const CompiledBody> compiled; // by the ClosureCompiler, on first call
+    // by the Jit on first call, null when some value in the body is not a number
+    std::shared_ptr<const NativeFunction> native;
+    bool jitTried = false;
+    size_t bodyBegin = 0;
+    size_t bodyEnd = 0;
 };
 
-class CallExpression: public virtual ExpressionNode {
+class CallExpression: public ExpressionNode {
 public:
     using ExprNode = std::shared_ptr<ExpressionNode>;
     using ExprNodeList = std::vector<ExprNode>;
     
-    CallExpression() = default;
-    CallExpression(Token token, ExprNode func): ExpressionNode{token}, function{func} {};
+    CallExpression(): ExpressionNode{NodeKind::CALL} {};
+    CallExpression(std::string_view literal, ExprNode func): ExpressionNode{NodeKind::CALL, literal}, function{func} {};
     virtual ~CallExpression() = default;
     virtual void expressionNode();
     virtual std::string toString();
 
     ExprNode function;
     std::shared_ptr<ExprNodeList> arguments;
+    // SPECIALIZED: only this function seen, its arguments go straight to
+    // the slots of the new frame
+    Feedback feedback = Feedback::UNSEEN;
+    FunctionLiteral* target = nullptr;
+    bool tail = false; // set by the resolver: its value is what the function returns
 };
 
-class IndexExpression: public virtual ExpressionNode {
+class IndexExpression: public ExpressionNode {
 public:
     using ExprNode = std::shared_ptr<ExpressionNode>;
 
-    IndexExpression() = default;
-    IndexExpression(Token token, ExprNode l): ExpressionNode{token}, left{l} {};
+    IndexExpression(): ExpressionNode{NodeKind::INDEX} {};
+    IndexExpression(std::string_view literal, ExprNode l): ExpressionNode{NodeKind::INDEX, literal}, left{l} {};
     virtual ~IndexExpression() = default;
     virtual void expressionNode();
     virtual std::string toString();
 
     std::shared_ptr<ExpressionNode> left;
     std::shared_ptr<ExpressionNode> index;
+    bool arrayIndex = false; // set by type inference: an array and a number
+    Feedback feedback = Feedback::UNSEEN; // SPECIALIZED: only arrays and numbers seen
+};
+
+// Value the optimizer computed ahead of time, standing in for the
+// expression it came from. Evaluates to a copy of the prebuilt object.
+class Constant: public ExpressionNode {
+public:
+    Constant(Object val): ExpressionNode{NodeKind::CONSTANT}, value{std::move(val)} {};
+    virtual ~Constant() = default;
+    virtual std::string tokenLiteral(){ return toString(); }
+    virtual void expressionNode();
+    virtual std::string toString();
+
+    Object value;
+};
+
+// Call of a helper the optimizer copied in place. The arguments go to slots
+// of the calling frame the copied body reads as its parameters. The callee
+// name is still looked up, when it no longer holds that function (a later
+// REPL line rebound it) the original call runs instead.
+class InlineCall: public ExpressionNode {
+public:
+    InlineCall(std::shared_ptr<CallExpression> call, std::shared_ptr<FunctionLiteral> fn):
+        ExpressionNode{NodeKind::INLINE}, call{call}, function{fn} {};
+    virtual ~InlineCall() = default;
+    virtual std::string tokenLiteral(){ return call->tokenLiteral(); }
+    virtual void expressionNode();
+    virtual std::string toString();
+
+    std::shared_ptr<CallExpression> call;
+    std::shared_ptr<FunctionLiteral> function; // what the callee has to be
+    uint16_t slot = 0; // of the first argument, the others follow
+    std::shared_ptr<ExpressionNode> body;
+};
+
+// Calls fn on each non-null link below node that is evaluated in the same
+// frame, passing the link itself so passes can replace it. Names of lets
+// and parameters are not links and function bodies are left to the caller.
+template <typename F>
+void forEachChild(AstNode* node, F&& fn){
+    auto visit = [&](auto& child){
+        if(child != nullptr)
+            fn(child);
+    };
+    switch(node->kind){
+    case NodeKind::PROGRAM:
+        for(auto& stmt: static_cast<Program*>(node)->statements)
+            visit(stmt);
+        break;
+    case NodeKind::BLOCK:
+        for(auto& stmt: static_cast<BlockStatement*>(node)->statements)
+            visit(stmt);
+        break;
+    case NodeKind::LET:
+        visit(static_cast<LetStatement*>(node)->value);
+        break;
+    case NodeKind::RETURN:
+        visit(static_cast<ReturnStatement*>(node)->value);
+        break;
+    case NodeKind::EXPRESSION_STATEMENT:
+        visit(static_cast<ExpressionStatement*>(node)->expression);
+        break;
+    case NodeKind::ARRAY:
+        for(auto& item: static_cast<ArrayLiteral*>(node)->items)
+            visit(item);
+        break;
+    case NodeKind::HASH:
+        // keys are const in the map, only values can be replaced in place
+        for(auto& entry: static_cast<HashLiteral*>(node)->entries){
+            visit(entry.first);
+            visit(entry.second);
+        }
+        break;
+    case NodeKind::PREFIX:
+        visit(static_cast<PrefixExpression*>(node)->right);
+        break;
+    case NodeKind::INFIX:
+        visit(static_cast<InfixExpression*>(node)->left);
+        visit(static_cast<InfixExpression*>(node)->right);
+        break;
+    case NodeKind::IF:
+        visit(static_cast<IfExpression*>(node)->condition);
+        visit(static_cast<IfExpression*>(node)->consequence);
+        visit(static_cast<IfExpression*>(node)->alternative);
+        break;
+    case NodeKind::CALL: {
+        auto call = static_cast<CallExpression*>(node);
+        visit(call->function);
+        if(call->arguments != nullptr)
+            for(auto& argument: *call->arguments)
+                visit(argument);
+        break;
+    }
+    case NodeKind::INDEX:
+        visit(static_cast<IndexExpression*>(node)->left);
+        visit(static_cast<IndexExpression*>(node)->index);
+        break;
+    case NodeKind::INLINE:
+        visit(static_cast<InlineCall*>(node)->call);
+        visit(static_cast<InlineCall*>(node)->body);
+        break;
+    case NodeKind::IDENTIFIER:
+    case NodeKind::NUMBER:
+    case NodeKind::STRING:
+    case NodeKind::BOOLEAN:
+    case NodeKind::FUNCTION:
+    case NodeKind::CONSTANT:
+        break;
+    }
+}
+
+// Arena nodes made only of spans, numbers and links to other arena nodes
+// hold nothing to release, their destructors are skipped. Containers and
+// FunctionLiteral (owning source) still get destroyed with the arena.
+template <typename T>
+inline constexpr bool holdsNoResources =
+    std::is_same_v<T, Identifier> || std::is_same_v<T, NumberLiteral> ||
+    std::is_same_v<T, StringLiteral> || std::is_same_v<T, BooleanLiteral> ||
+    std::is_same_v<T, PrefixExpression> || std::is_same_v<T, InfixExpression> ||
+    std::is_same_v<T, IfExpression> || std::is_same_v<T, CallExpression> ||
+    std::is_same_v<T, IndexExpression> || std::is_same_v<T, LetStatement> ||
+    std::is_same_v<T, ReturnStatement> || std::is_same_v<T, ExpressionStatement>;
+
+// Owner of every node of a program parsed in arena mode and of the source
+// their spans point into. Links between arena nodes are non-owning
+// shared_ptrs (no control block, no refcount traffic); only the Program
+// handed out by the parser and FunctionObjects keep the arena alive.
+struct AstArena {
+    AstArena(std::shared_ptr<const Source> src): arena{}, source{src} {};
+
+    // non-owning link to a node that lives as long as the arena
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&... args){
+        return std::shared_ptr<T>(std::shared_ptr<T>{}, arena.make<T>(std::forward<Args>(args)...));
+    }
+
+    // same for nodes as the parser builds them, skipping the destructor of
+    // those that hold nothing to release
+    template <typename T, typename... Args>
+    std::shared_ptr<T> makeNode(Args&&... args){
+        if constexpr(holdsNoResources<T>)
+            return std::shared_ptr<T>(std::shared_ptr<T>{}, arena.makeWithoutDestructor<T>(std::forward<Args>(args)...));
+        else
+            return make<T>(std::forward<Args>(args)...);
+    }
+
+    Arena arena;
+    std::shared_ptr<const Source> source;
 };
 
 #endif // AST_H
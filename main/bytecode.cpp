@@ -0,0 +1,192 @@
+#include <iostream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <any>
+
+#include "utils.hpp"
+#include "ast.hpp"
+#include "object.hpp"
+#include "fobject.hpp"
+#include "symbols.hpp"
+#include "bytecode.hpp"
+
+using namespace std;
+
+Value Value::error(std::string message){
+    return Value{ObjectType::ERROR, make_shared<std::string>(std::move(message))};
+}
+
+string Value::hashKey() const {
+    switch(type){
+    case ObjectType::NUMBER:
+        return Object{type, number}.hashKey();
+    case ObjectType::BOOLEAN:
+        return number != 0 ? "1" : "0";
+    case ObjectType::STRING:
+        return str();
+    default:
+        return "";
+    }
+}
+
+Object toObject(const Value& value){
+    switch(value.type){
+    case ObjectType::NUMBER:
+        return Object{ObjectType::NUMBER, value.number};
+    case ObjectType::BOOLEAN:
+        return Object{ObjectType::BOOLEAN, value.number != 0};
+    case ObjectType::STRING:
+    case ObjectType::ERROR:
+        return Object{value.type, value.str()};
+    case ObjectType::ARRAY: {
+        vector<Object> items;
+        items.reserve(value.items().size());
+        for(auto& item: value.items())
+            items.push_back(toObject(item));
+        return Object{ObjectType::ARRAY, items};
+    }
+    case ObjectType::HASH: {
+        unordered_map<string, pair<Object, Object>> entries;
+        for(auto& entry: value.entries())
+            entries[entry.first] = make_pair(toObject(entry.second.first), toObject(entry.second.second));
+        return Object{ObjectType::HASH, entries};
+    }
+    case ObjectType::FUNCTION: {
+        auto closure = static_pointer_cast<const Closure>(value.ref);
+        if(closure == nullptr)
+            return Object{ObjectType::NIL, 0.0};
+        auto obj = Object{ObjectType::FUNCTION, FunctionObject{closure->code->literal, closure}};
+        obj._tag = closure->code->literal->tokenLiteral();
+        return obj;
+    }
+    case ObjectType::BUILTIN_FUNCTION: {
+        auto builtin = value.builtin();
+        auto obj = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction{
+            [builtin](vector<Object> args) -> Object {
+                vector<Value> values;
+                for(auto& arg: args)
+                    values.push_back(toValue(arg));
+                return toObject(builtin->call(values.data(), values.size()));
+            }
+        }};
+        obj._tag = builtin->name;
+        return obj;
+    }
+    default:
+        return Object{ObjectType::NIL, 0.0};
+    }
+}
+
+Value toValue(const Object& obj){
+    switch(obj.type){
+    case ObjectType::NUMBER:
+        return Value{any_cast<double>(obj.value)};
+    case ObjectType::BOOLEAN:
+        return Value::boolean(any_cast<bool>(obj.value));
+    case ObjectType::STRING:
+    case ObjectType::ERROR:
+        return Value{obj.type, make_shared<string>(any_cast<string>(obj.value))};
+    case ObjectType::ARRAY: {
+        auto items = make_shared<vector<Value>>();
+        for(auto& item: *any_cast<vector<Object>>(&obj.value))
+            items->push_back(toValue(item));
+        return Value{ObjectType::ARRAY, items};
+    }
+    case ObjectType::HASH: {
+        auto entries = make_shared<Hash>();
+        for(auto& entry: *any_cast<unordered_map<string, pair<Object, Object>>>(&obj.value))
+            (*entries)[entry.first] = make_pair(toValue(entry.second.first), toValue(entry.second.second));
+        return Value{ObjectType::HASH, entries};
+    }
+    case ObjectType::FUNCTION: {
+        // a function of the tree-walker has no code to run, calls fail
+        auto closure = any_cast<FunctionObject>(&obj.value)->closure;
+        return Value{ObjectType::FUNCTION, const_pointer_cast<Closure>(closure)};
+    }
+    case ObjectType::BUILTIN_FUNCTION:
+        if(auto builtin = findBuiltin(intern(obj._tag)))
+            return *builtin;
+        return Value{};
+    case ObjectType::BUILTIN_OBJECT:
+        return toValue(any_cast<Object>(obj.value));
+    case ObjectType::UNDEFINED:
+        return Value::undefined();
+    default:
+        return Value{};
+    }
+}
+
+// builtins, with the messages of the tree-walker's
+
+static Value wrongArguments(size_t got, size_t want){
+    return Value::error(format("wrong number of argument. got=", got, ", want=", want));
+}
+
+static Value len(const Value* args, size_t count){
+    if(count != 1)
+        return wrongArguments(count, 1);
+    switch(args[0].type){
+    case ObjectType::ARRAY:
+        return Value{(double)args[0].items().size()};
+    case ObjectType::STRING:
+        return Value{(double)args[0].str().size()};
+    default:
+        return Value::error(format("argument to len not supported, got ", to_string(args[0].type)));
+    }
+}
+
+static Value first(const Value* args, size_t count){
+    if(count != 1)
+        return wrongArguments(count, 1);
+    if(args[0].type != ObjectType::ARRAY)
+        return Value::error(format("argument to first must be ARRAY, got ", to_string(args[0].type)));
+    auto& items = args[0].items();
+    return items.empty() ? Value{} : items.front();
+}
+
+static Value last(const Value* args, size_t count){
+    if(count != 1)
+        return wrongArguments(count, 1);
+    if(args[0].type != ObjectType::ARRAY)
+        return Value::error(format("argument to first must be ARRAY, got ", to_string(args[0].type)));
+    auto& items = args[0].items();
+    return items.empty() ? Value{} : items.back();
+}
+
+static Value push(const Value* args, size_t count){
+    if(count != 2)
+        return wrongArguments(count, 2);
+    if(args[0].type != ObjectType::ARRAY)
+        return Value::error(format("argument to first must be ARRAY, got ", to_string(args[0].type)));
+    auto items = make_shared<vector<Value>>(args[0].items());
+    items->push_back(args[1]);
+    return Value{ObjectType::ARRAY, items};
+}
+
+static Value print(const Value* args, size_t count){
+    for(size_t i = 0; i < count; ++i)
+        cout << toObject(args[i]).inspect() << endl;
+    return Value{};
+}
+
+const Value* findBuiltin(Symbol name){
+    static Builtin functions[] = {
+        {"len", len},
+        {"first", first},
+        {"last", last},
+        {"push", push},
+        {"print", print},
+    };
+    static const unordered_map<Symbol, Value> builtins = [](){
+        unordered_map<Symbol, Value> table;
+        table[intern("PI")] = Value{3.14};
+        // static entries, linked without ownership
+        for(auto& fn: functions)
+            table[intern(fn.name)] = Value{ObjectType::BUILTIN_FUNCTION, shared_ptr<void>(shared_ptr<void>{}, &fn)};
+        return table;
+    }();
+    auto it = builtins.find(name);
+    return it != builtins.end() ? &it->second : nullptr;
+}
@@ -0,0 +1,146 @@
+#if !defined(BYTECODE_H)
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "object.hpp"
+#include "symbols.hpp"
+
+class FunctionLiteral;
+
+// Instructions of the virtual machine. Operands follow the opcode byte
+// unaligned: slots, free variable indexes and argument counts take two
+// bytes, constants, symbols, counts and jump targets four. A jump target is
+// an offset from the start of the code.
+enum class Op: uint8_t {
+    CONSTANT,       // u32 constant
+    NIL,
+    TRUE,
+    FALSE,
+    POP,
+    GET_LOCAL,      // u16 slot
+    GET_LOCAL_OR,   // u16 slot, u32 target: pushes and jumps unless undefined
+    SET_LOCAL,      // u16 slot, the value stays on the stack
+    GET_CELL,       // u16 slot holding a cell
+    GET_CELL_OR,    // u16 slot, u32 target
+    SET_CELL,       // u16 slot
+    GET_FREE,       // u16 cell of the closure
+    GET_FREE_OR,    // u16 cell, u32 target
+    GET_GLOBAL,     // u32 symbol, then builtins, an error when unbound
+    SET_GLOBAL,     // u32 symbol
+    ADD,            // binary operators in Opcode order
+    SUB,
+    MUL,
+    DIV,
+    GREATER,
+    LESS,
+    EQUAL,
+    NOT_EQUAL,
+    NOT,
+    NEGATE,
+    JUMP,           // u32 target
+    JUMP_IF_FALSE,  // u32 target, pops the condition
+    ARRAY,          // u32 items
+    HASH_KEY,       // checks the key on top can be hashed
+    HASH,           // u32 entries, key and value each
+    INDEX,
+    CLOSURE,        // u32 function
+    CALL,           // u16 arguments
+    TAIL_CALL,      // u16 arguments, a function called takes over the frame
+    RETURN,
+    HALT,           // end of top-level code
+};
+
+inline constexpr size_t OP_COUNT = static_cast<size_t>(Op::HALT) + 1;
+
+struct Cell;
+struct Closure;
+struct Builtin;
+struct Value;
+
+using Hash = std::unordered_map<std::string, std::pair<Value, Value>>;
+
+// What the virtual machine computes with. Numbers, booleans and nil are
+// held inline and copy without touching a reference count; strings and
+// errors point at a std::string, arrays at a std::vector<Value>, hashes at a
+// Hash, functions at a Closure and builtins at a Builtin. Nothing behind
+// ref is changed once shared, except the value of a Cell.
+struct Value {
+    Value(): type{ObjectType::NIL}, number{0} {};
+    Value(double value): type{ObjectType::NUMBER}, number{value} {};
+    Value(ObjectType type, std::shared_ptr<void> ref): type{type}, number{0}, ref{std::move(ref)} {};
+    static Value boolean(bool value){ Value v; v.type = ObjectType::BOOLEAN; v.number = value; return v; }
+    static Value undefined(){ Value v; v.type = ObjectType::UNDEFINED; return v; }
+    static Value error(std::string);
+
+    bool isTruthy() const {
+        return type == ObjectType::BOOLEAN ? number != 0 : type != ObjectType::NIL;
+    }
+    const std::string& str() const { return *static_cast<const std::string*>(ref.get()); }
+    const std::vector<Value>& items() const { return *static_cast<const std::vector<Value>*>(ref.get()); }
+    const Hash& entries() const { return *static_cast<const Hash*>(ref.get()); }
+    const Closure* closure() const { return static_cast<const Closure*>(ref.get()); }
+    const Builtin* builtin() const { return static_cast<const Builtin*>(ref.get()); }
+    Cell* cell() const { return static_cast<Cell*>(ref.get()); }
+
+    // same key the tree-walker files hash entries under
+    std::string hashKey() const;
+
+    ObjectType type;
+    double number; // the number, or 0 and 1 for booleans
+    std::shared_ptr<void> ref;
+};
+
+// Binding of a frame slot that a closure captured, shared by the frame and
+// every closure reading it
+struct Cell {
+    Value value;
+};
+
+struct Builtin {
+    const char* name;
+    Value (*call)(const Value*, size_t);
+};
+
+// Code of one function, or of a program's top-level statements.
+struct CodeObject {
+    // where each cell of a closure made from this code comes from, in the
+    // frame running the CLOSURE instruction
+    struct Capture {
+        bool local; // a cell slot of that frame, else one of its own cells
+        uint16_t index;
+    };
+
+    std::vector<uint8_t> code;
+    std::vector<Value> constants;
+    std::vector<std::shared_ptr<const CodeObject>> functions;
+    std::vector<Capture> captures;
+    std::vector<uint16_t> paramSlots; // slot of each argument, in order
+    std::vector<uint16_t> cellSlots; // boxed on entry, captured by some closure
+    uint16_t params = 0; // distinct parameter slots, first in the frame
+    uint32_t slots = 0;
+    uint32_t maxStack = 0; // operands on top of the slots
+    bool directParams = true; // argument i goes to slot i
+    std::shared_ptr<FunctionLiteral> literal; // null for top-level code
+    std::string error; // raised on call, the body did not parse
+};
+
+struct Closure {
+    std::shared_ptr<const CodeObject> code;
+    std::vector<std::shared_ptr<Cell>> cells;
+};
+
+// Conversions at the edges of the VM: results handed out, globals kept in
+// an Environment and constants the optimizer prebuilt.
+Object toObject(const Value&);
+Value toValue(const Object&);
+
+// builtin bound to a name, null when there is none
+const Value* findBuiltin(Symbol);
+
+#endif // BYTECODE_H
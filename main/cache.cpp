@@ -0,0 +1,573 @@
+#include <cstdint>
+#include <array>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+
+#include "ast.hpp"
+#include "source.hpp"
+#include "resolver.hpp"
+#include "symbols.hpp"
+#include "cache.hpp"
+
+using namespace std;
+
+static const char MAGIC[4] = {'M', 'K', 'C', '\0'};
+static constexpr uint8_t NO_NODE = 0xff;
+static constexpr uint32_t NO_LIST = 0xffffffff;
+
+// Image layout: magic, version, 128-bit source hash and size, the name
+// table as spans of the source, the number of top-level statements, then the
+// nodes. A node is its kind followed by its fields and children in preorder,
+// a missing one is NO_NODE.
+
+class ImageWriter {
+public:
+    ImageWriter(string_view text): text{text} {};
+
+    bool write(const Program& program, string& out){
+        put<uint32_t>(body, program.statements.size());
+        for(auto& stmt: program.statements)
+            node(stmt.get());
+        if(!ok)
+            return false;
+
+        out.append(MAGIC, sizeof(MAGIC));
+        put<uint32_t>(out, ScriptCache::VERSION);
+        for(auto word: ScriptCache::hash(text))
+            put<uint64_t>(out, word);
+        put<uint64_t>(out, text.size());
+        put<uint32_t>(out, names.size());
+        for(auto name: names){
+            put<uint32_t>(out, name.data() - text.data());
+            put<uint32_t>(out, name.size());
+        }
+        out += body;
+        return true;
+    }
+
+private:
+    string_view text;
+    string body;
+    vector<string_view> names;
+    unordered_map<string_view, uint32_t> nameIndex;
+    bool ok = true;
+
+    template <typename T>
+    static void put(string& into, T value){
+        into.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void put(T value){
+        put<T>(body, value);
+    }
+
+    // spans not in the script belong to nodes made after parsing
+    bool inScript(string_view literal) const {
+        return literal.data() >= text.data() && literal.data() + literal.size() <= text.data() + text.size();
+    }
+
+    void span(string_view literal){
+        if(literal.empty()){
+            put<uint32_t>(0);
+            put<uint32_t>(0);
+            return;
+        }
+        if(!inScript(literal)){
+            ok = false;
+            return;
+        }
+        put<uint32_t>(literal.data() - text.data());
+        put<uint32_t>(literal.size());
+    }
+
+    // each distinct name is stored and interned once
+    void name(const Identifier& ident){
+        auto it = nameIndex.find(ident.value);
+        if(it == nameIndex.end()){
+            if(!inScript(ident.value) || ident.value.empty()){
+                ok = false;
+                return;
+            }
+            it = nameIndex.emplace(ident.value, names.size()).first;
+            names.push_back(ident.value);
+        }
+        put<uint32_t>(it->second);
+    }
+
+    void list(size_t size){
+        put<uint32_t>(size);
+    }
+
+    void node(AstNode* node){
+        if(node == nullptr){
+            put<uint8_t>(NO_NODE);
+            return;
+        }
+        put<uint8_t>(static_cast<uint8_t>(node->kind));
+        switch(node->kind){
+        case NodeKind::LET: {
+            auto let = static_cast<LetStatement*>(node);
+            span(let->literal);
+            name(let->name);
+            this->node(let->value.get());
+            break;
+        }
+        case NodeKind::RETURN:
+            span(static_cast<ReturnStatement*>(node)->literal);
+            this->node(static_cast<ReturnStatement*>(node)->value.get());
+            break;
+        case NodeKind::EXPRESSION_STATEMENT:
+            span(static_cast<ExpressionStatement*>(node)->literal);
+            this->node(static_cast<ExpressionStatement*>(node)->expression.get());
+            break;
+        case NodeKind::BLOCK: {
+            auto block = static_cast<BlockStatement*>(node);
+            span(block->literal);
+            list(block->statements.size());
+            for(auto& stmt: block->statements)
+                this->node(stmt.get());
+            break;
+        }
+        case NodeKind::IDENTIFIER:
+            name(*static_cast<Identifier*>(node));
+            break;
+        case NodeKind::NUMBER:
+            span(static_cast<NumberLiteral*>(node)->span());
+            put<double>(static_cast<NumberLiteral*>(node)->value);
+            break;
+        case NodeKind::STRING:
+            span(static_cast<StringLiteral*>(node)->value);
+            break;
+        case NodeKind::BOOLEAN:
+            span(static_cast<BooleanLiteral*>(node)->span());
+            put<uint8_t>(static_cast<BooleanLiteral*>(node)->value);
+            break;
+        case NodeKind::ARRAY: {
+            auto array = static_cast<ArrayLiteral*>(node);
+            span(array->span());
+            list(array->items.size());
+            for(auto& item: array->items)
+                this->node(item.get());
+            break;
+        }
+        case NodeKind::HASH: {
+            auto hash = static_cast<HashLiteral*>(node);
+            span(hash->span());
+            list(hash->entries.size());
+            for(auto& entry: hash->entries){
+                this->node(entry.first.get());
+                this->node(entry.second.get());
+            }
+            break;
+        }
+        case NodeKind::PREFIX: {
+            auto expr = static_cast<PrefixExpression*>(node);
+            span(expr->oprator);
+            put<uint8_t>(static_cast<uint8_t>(expr->opcode));
+            this->node(expr->right.get());
+            break;
+        }
+        case NodeKind::INFIX: {
+            auto expr = static_cast<InfixExpression*>(node);
+            span(expr->oprator);
+            put<uint8_t>(static_cast<uint8_t>(expr->opcode));
+            this->node(expr->left.get());
+            this->node(expr->right.get());
+            break;
+        }
+        case NodeKind::IF: {
+            auto expr = static_cast<IfExpression*>(node);
+            span(expr->span());
+            this->node(expr->condition.get());
+            this->node(expr->consequence.get());
+            this->node(expr->alternative.get());
+            break;
+        }
+        case NodeKind::FUNCTION: {
+            auto fn = static_cast<FunctionLiteral*>(node);
+            span(fn->span());
+            list(fn->params != nullptr ? fn->params->size() : NO_LIST);
+            if(fn->params != nullptr)
+                for(auto& param: *fn->params)
+                    name(param);
+            put<uint64_t>(fn->bodyBegin);
+            put<uint64_t>(fn->bodyEnd);
+            this->node(fn->body.get());
+            break;
+        }
+        case NodeKind::CALL: {
+            auto call = static_cast<CallExpression*>(node);
+            span(call->span());
+            this->node(call->function.get());
+            list(call->arguments != nullptr ? call->arguments->size() : NO_LIST);
+            if(call->arguments != nullptr)
+                for(auto& argument: *call->arguments)
+                    this->node(argument.get());
+            break;
+        }
+        case NodeKind::INDEX: {
+            auto expr = static_cast<IndexExpression*>(node);
+            span(expr->span());
+            this->node(expr->left.get());
+            this->node(expr->index.get());
+            break;
+        }
+        default:
+            ok = false; // rewritten by a pass
+        }
+    }
+};
+
+class ImageReader {
+public:
+    ImageReader(string_view image, shared_ptr<const Source> source):
+        at{image.data()}, end{image.data() + image.size()}, text{source->text()},
+        source{source}, arena{make_shared<AstArena>(source)} {};
+
+    shared_ptr<Program> read(){
+        char magic[sizeof(MAGIC)];
+        if(end - at < (ptrdiff_t)sizeof(MAGIC))
+            return nullptr;
+        memcpy(magic, at, sizeof(MAGIC));
+        at += sizeof(MAGIC);
+        if(memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || get<uint32_t>() != ScriptCache::VERSION)
+            return nullptr;
+        ScriptCache::Digest hash;
+        for(auto& word: hash)
+            word = get<uint64_t>();
+        if(get<uint64_t>() != text.size() || hash != ScriptCache::hash(text))
+            return nullptr;
+
+        auto count = get<uint32_t>();
+        if(count > (size_t)(end - at) / (2 * sizeof(uint32_t)))
+            return nullptr;
+        names.reserve(count);
+        symbols.reserve(count);
+        for(uint32_t i = 0; ok && i < count; ++i){
+            auto name = span();
+            names.push_back(name);
+            symbols.push_back(intern(name));
+        }
+
+        auto program = arena->makeNode<Program>();
+        program->source = source;
+        program->arena = arena;
+        count = get<uint32_t>();
+        for(uint32_t i = 0; ok && i < count; ++i)
+            program->statements.push_back(required(statement()));
+        if(!ok || at != end)
+            return nullptr;
+
+        Resolver::resolve(*program);
+        return shared_ptr<Program>(arena, program.get());
+    }
+
+private:
+    const char* at;
+    const char* end;
+    string_view text;
+    shared_ptr<const Source> source;
+    shared_ptr<AstArena> arena;
+    vector<string_view> names;
+    vector<Symbol> symbols;
+    bool ok = true;
+
+    template <typename T>
+    T get(){
+        T value{};
+        if(end - at < (ptrdiff_t)sizeof(T)){
+            ok = false;
+            return value;
+        }
+        memcpy(&value, at, sizeof(T));
+        at += sizeof(T);
+        return value;
+    }
+
+    string_view span(){
+        auto offset = get<uint32_t>();
+        auto size = get<uint32_t>();
+        if((uint64_t)offset + size > text.size()){
+            ok = false;
+            return {};
+        }
+        return text.substr(offset, size);
+    }
+
+    template <typename T>
+    T name(){
+        auto index = get<uint32_t>();
+        if(index >= names.size()){
+            ok = false;
+            return T{};
+        }
+        return T{names[index], symbols[index]};
+    }
+
+    // links the parser never leaves null
+    template <typename T>
+    shared_ptr<T> required(shared_ptr<T> node){
+        if(node == nullptr)
+            ok = false;
+        return node;
+    }
+
+    // kind of the next node, false for a missing one or one of the wrong sort
+    bool next(NodeKind& kind){
+        auto tag = get<uint8_t>();
+        if(!ok || tag == NO_NODE)
+            return false;
+        if(tag > static_cast<uint8_t>(NodeKind::INDEX)){
+            ok = false;
+            return false;
+        }
+        kind = static_cast<NodeKind>(tag);
+        return true;
+    }
+
+    shared_ptr<StatementNode> statement(){
+        NodeKind kind;
+        if(!next(kind))
+            return nullptr;
+        switch(kind){
+        case NodeKind::LET: {
+            auto let = arena->makeNode<LetStatement>(span());
+            let->name = name<Identifier>();
+            let->value = expression();
+            return let;
+        }
+        case NodeKind::RETURN: {
+            auto stmt = arena->makeNode<ReturnStatement>(span());
+            stmt->value = expression();
+            return stmt;
+        }
+        case NodeKind::EXPRESSION_STATEMENT: {
+            auto stmt = arena->makeNode<ExpressionStatement>(span());
+            stmt->expression = expression();
+            return stmt;
+        }
+        case NodeKind::BLOCK:
+            return block(kind);
+        default:
+            ok = false;
+            return nullptr;
+        }
+    }
+
+    shared_ptr<BlockStatement> block(){
+        NodeKind kind;
+        if(!next(kind))
+            return nullptr;
+        return block(kind);
+    }
+
+    shared_ptr<BlockStatement> block(NodeKind kind){
+        if(kind != NodeKind::BLOCK){
+            ok = false;
+            return nullptr;
+        }
+        auto block = arena->makeNode<BlockStatement>(span());
+        auto count = get<uint32_t>();
+        for(uint32_t i = 0; ok && i < count; ++i)
+            block->statements.push_back(required(statement()));
+        return block;
+    }
+
+    shared_ptr<ExpressionNode> expression(){
+        NodeKind kind;
+        if(!next(kind))
+            return nullptr;
+        switch(kind){
+        case NodeKind::IDENTIFIER: {
+            auto index = get<uint32_t>();
+            if(index >= names.size()){
+                ok = false;
+                return nullptr;
+            }
+            return arena->makeNode<Identifier>(names[index], symbols[index]);
+        }
+        case NodeKind::NUMBER: {
+            auto literal = span();
+            return arena->makeNode<NumberLiteral>(literal, get<double>());
+        }
+        case NodeKind::STRING:
+            return arena->makeNode<StringLiteral>(span());
+        case NodeKind::BOOLEAN: {
+            auto literal = span();
+            return arena->makeNode<BooleanLiteral>(literal, get<uint8_t>() != 0);
+        }
+        case NodeKind::ARRAY: {
+            auto array = arena->makeNode<ArrayLiteral>(span());
+            auto count = get<uint32_t>();
+            for(uint32_t i = 0; ok && i < count; ++i)
+                array->items.push_back(required(expression()));
+            return array;
+        }
+        case NodeKind::HASH: {
+            auto hash = arena->makeNode<HashLiteral>(span());
+            auto count = get<uint32_t>();
+            for(uint32_t i = 0; ok && i < count; ++i){
+                auto key = required(expression());
+                auto value = required(expression());
+                hash->entries[key] = value;
+            }
+            return hash;
+        }
+        case NodeKind::PREFIX: {
+            auto op = span();
+            auto expr = arena->makeNode<PrefixExpression>(op, opcode());
+            expr->right = required(expression());
+            return expr;
+        }
+        case NodeKind::INFIX: {
+            auto op = span();
+            auto code = opcode();
+            auto expr = arena->makeNode<InfixExpression>(op, code, required(expression()));
+            expr->right = required(expression());
+            return expr;
+        }
+        case NodeKind::IF: {
+            auto expr = arena->makeNode<IfExpression>(span());
+            expr->condition = required(expression());
+            expr->consequence = required(block());
+            expr->alternative = block();
+            return expr;
+        }
+        case NodeKind::FUNCTION: {
+            auto fn = arena->makeNode<FunctionLiteral>(span());
+            auto count = get<uint32_t>();
+            if(count != NO_LIST){
+                fn->params = arena->makeNode<vector<Identifier>>();
+                for(uint32_t i = 0; ok && i < count; ++i)
+                    fn->params->push_back(name<Identifier>());
+            }
+            fn->bodyBegin = get<uint64_t>();
+            fn->bodyEnd = get<uint64_t>();
+            if(fn->bodyBegin > fn->bodyEnd || fn->bodyEnd > text.size())
+                ok = false;
+            fn->body = block();
+            fn->source = source;
+            fn->arena = arena;
+            fn->owner = arena;
+            return fn;
+        }
+        case NodeKind::CALL: {
+            auto literal = span();
+            auto call = arena->makeNode<CallExpression>(literal, required(expression()));
+            auto count = get<uint32_t>();
+            if(count != NO_LIST){
+                call->arguments = arena->makeNode<CallExpression::ExprNodeList>();
+                for(uint32_t i = 0; ok && i < count; ++i)
+                    call->arguments->push_back(required(expression()));
+            }
+            return call;
+        }
+        case NodeKind::INDEX: {
+            auto literal = span();
+            auto expr = arena->makeNode<IndexExpression>(literal, required(expression()));
+            expr->index = required(expression());
+            return expr;
+        }
+        default:
+            ok = false;
+            return nullptr;
+        }
+    }
+
+    Opcode opcode(){
+        auto code = get<uint8_t>();
+        if(code > static_cast<uint8_t>(Opcode::NEGATE))
+            ok = false;
+        return static_cast<Opcode>(code);
+    }
+};
+
+// xxHash64's constants, round and avalanche
+static constexpr uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+static constexpr uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+static constexpr uint64_t PRIME3 = 0x165667b19e3779f9ull;
+
+static uint64_t rotl(uint64_t x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t mixWord(uint64_t acc, uint64_t word){
+    return rotl(acc + word * PRIME2, 31) * PRIME1;
+}
+
+static uint64_t avalanche(uint64_t hash){
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Two lanes of multiply-rotate rounds a word at a time, each word spread
+// over the whole lane before the next one comes in, so no change to the
+// text cancels out in a later word. The whole script is hashed on every run.
+ScriptCache::Digest ScriptCache::hash(string_view text){
+    uint64_t first = PRIME1 + PRIME2;
+    uint64_t second = PRIME3;
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= text.size(); i += sizeof(uint64_t)){
+        uint64_t word;
+        memcpy(&word, text.data() + i, sizeof(word));
+        first = mixWord(first, word);
+        second = mixWord(second, rotl(word, 32) ^ first);
+    }
+    uint64_t last = 0;
+    if(i < text.size())
+        memcpy(&last, text.data() + i, text.size() - i);
+    first = mixWord(first, last) ^ text.size();
+    second = mixWord(second, rotl(last, 32) ^ first) ^ text.size();
+    return Digest{avalanche(first), avalanche(second)};
+}
+
+string ScriptCache::pathFor(const string& script, const Source& source){
+    if(auto dir = getenv("MONKEY_CACHE_DIR"); dir != nullptr && *dir != '\0'){
+        auto digest = hash(source.text());
+        char name[48];
+        snprintf(name, sizeof(name), "%016llx%016llx.mkc", (unsigned long long)digest[0], (unsigned long long)digest[1]);
+        return string(dir) + "/" + name;
+    }
+    auto base = script;
+    if(base.size() > 3 && base.compare(base.size() - 3, 3, ".mk") == 0)
+        base.resize(base.size() - 3);
+    return base + ".mkc";
+}
+
+shared_ptr<Program> ScriptCache::load(const string& path, shared_ptr<const Source> source){
+    auto image = Source::fromFile(path);
+    if(image == nullptr)
+        return nullptr;
+    return ImageReader{image->text(), source}.read();
+}
+
+bool ScriptCache::store(const string& path, const Program& program, const Source& source){
+    string image;
+    if(!ImageWriter{source.text()}.write(program, image))
+        return false;
+
+    // written aside and renamed, a reader never maps half an image
+    auto temp = path + ".tmp";
+    {
+        ofstream out{temp, ios::binary | ios::trunc};
+        if(!out || !out.write(image.data(), image.size()))
+            return false;
+    }
+    if(rename(temp.c_str(), path.c_str()) != 0){
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
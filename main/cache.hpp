@@ -0,0 +1,37 @@
+#if !defined(CACHE_H)
+#define CACHE_H
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <string_view>
+#include <memory>
+
+class Program;
+class Source;
+
+// Parsed programs kept on disk (.mkc images) so running an unchanged script
+// again skips the lexer and the parser. An image holds the tree as the
+// parser hands it out with lazy bodies, before resolution and optimization,
+// in preorder. Nodes point into the script by offsets and at names by index
+// in a table interned once on load, so loading is one pass over a mapping
+// that builds arena nodes, no pointers to fix up. Images are native endian
+// and only valid for the exact text they were made from.
+class ScriptCache {
+public:
+    static const uint32_t VERSION = 2;
+    // 128 bits of the script text, what an image is checked against
+    using Digest = std::array<uint64_t, 2>;
+
+    // next to the script, or named after its hash in $MONKEY_CACHE_DIR
+    static std::string pathFor(const std::string&, const Source&);
+    // null when there is no image, or it was made from other text or by
+    // another version
+    static std::shared_ptr<Program> load(const std::string&, std::shared_ptr<const Source>);
+    // false when the tree holds nodes made after parsing or writing fails
+    static bool store(const std::string&, const Program&, const Source&);
+
+    static Digest hash(std::string_view);
+};
+
+#endif // CACHE_H
@@ -0,0 +1,435 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <any>
+
+#include "utils.hpp"
+#include "ast.hpp"
+#include "object.hpp"
+#include "fobject.hpp"
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "symbols.hpp"
+#include "closures.hpp"
+
+using namespace std;
+
+static const Object NIL_OBJ = Object{ObjectType::NIL, 0.0};
+static const Object TRUE_OBJ = Object{ObjectType::BOOLEAN, true};
+static const Object FALSE_OBJ = Object{ObjectType::BOOLEAN, false};
+
+static vector<Compiled> compileAll(const vector<shared_ptr<StatementNode>>& nodes){
+    vector<Compiled> compiled;
+    compiled.reserve(nodes.size());
+    for(auto& node: nodes)
+        compiled.push_back(ClosureCompiler::compile(node.get()));
+    return compiled;
+}
+
+static vector<Compiled> compileAll(const vector<shared_ptr<ExpressionNode>>& nodes){
+    vector<Compiled> compiled;
+    compiled.reserve(nodes.size());
+    for(auto& node: nodes)
+        compiled.push_back(ClosureCompiler::compile(node.get()));
+    return compiled;
+}
+
+// builtins, then the error, for a name bound nowhere
+Object ClosureCompiler::unbound(Evaluator& evaluator, Symbol name){
+    auto& builtins = Evaluator::builtinTable();
+    if(auto builtin = builtins.find(name); builtin != builtins.end()){
+        auto& obj = builtin->second;
+        if(obj.type == ObjectType::BUILTIN_OBJECT)
+            return any_cast<Object>(obj.value);
+        return obj;
+    }
+    return evaluator.raiseError(format("identifier not found: ", symbolName(name)));
+}
+
+Compiled ClosureCompiler::identifier(Identifier* ident){
+    auto name = ident->symbol;
+    auto slot = ident->slot;
+
+    if(ident->depth >= 0){
+        size_t depth = ident->depth;
+        return [depth, slot, name](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto value = env->get(depth, slot, name);
+            return value.type != ObjectType::UNDEFINED ? value : unbound(evaluator, name);
+        };
+    }
+    if(ident->depth == Identifier::GLOBAL){
+        return [name](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            if(auto value = env->findGlobal(name))
+                return *value;
+            return unbound(evaluator, name);
+        };
+    }
+    return [name](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+        auto value = env->get(name);
+        return value.type != ObjectType::UNDEFINED ? value : unbound(evaluator, name);
+    };
+}
+
+// one callable per operator, two numbers never reach the operator table
+template <Opcode op>
+Compiled ClosureCompiler::infix(Compiled left, Compiled right, string_view oprator){
+    return [left, right, oprator](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+        auto leftObj = left(evaluator, env);
+        if(leftObj.type == ObjectType::ERROR)
+            return leftObj;
+        auto rightObj = right(evaluator, env);
+        if(rightObj.type == ObjectType::ERROR)
+            return rightObj;
+        if(leftObj.type == ObjectType::NUMBER && rightObj.type == ObjectType::NUMBER){
+            auto l = *any_cast<double>(&leftObj.value);
+            auto r = *any_cast<double>(&rightObj.value);
+            if constexpr(op == Opcode::ADD)
+                return Object{ObjectType::NUMBER, l + r};
+            else if constexpr(op == Opcode::SUB)
+                return Object{ObjectType::NUMBER, l - r};
+            else if constexpr(op == Opcode::MUL)
+                return Object{ObjectType::NUMBER, l * r};
+            else if constexpr(op == Opcode::DIV)
+                return Object{ObjectType::NUMBER, l / r};
+            else if constexpr(op == Opcode::GREATER)
+                return l > r ? TRUE_OBJ : FALSE_OBJ;
+            else if constexpr(op == Opcode::LESS)
+                return l < r ? TRUE_OBJ : FALSE_OBJ;
+            else if constexpr(op == Opcode::EQUAL)
+                return l == r ? TRUE_OBJ : FALSE_OBJ;
+            else
+                return l != r ? TRUE_OBJ : FALSE_OBJ;
+        }
+        return evaluator.evalInfixExpression(op, oprator, leftObj, rightObj);
+    };
+}
+
+Compiled ClosureCompiler::compile(AstNode* node){
+    if(node == nullptr)
+        return [](Evaluator&, const shared_ptr<Environment>&) -> Object { return NIL_OBJ; };
+
+    switch(node->kind){
+    case NodeKind::PROGRAM: {
+        auto stmts = compileAll(static_cast<Program*>(node)->statements);
+        return [stmts](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            Object result;
+            for(auto& stmt: stmts){
+                result = stmt(evaluator, env);
+                if(result.type == ObjectType::RETURN)
+                    return any_cast<Object>(result.value);
+                if(result.type == ObjectType::ERROR)
+                    return result;
+            }
+            return result;
+        };
+    }
+
+    case NodeKind::EXPRESSION_STATEMENT:
+        return compile(static_cast<ExpressionStatement*>(node)->expression.get());
+
+    case NodeKind::BLOCK: {
+        auto stmts = compileAll(static_cast<BlockStatement*>(node)->statements);
+        if(stmts.size() == 1)
+            return stmts[0];
+        return [stmts](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            Object result;
+            for(auto& stmt: stmts){
+                result = stmt(evaluator, env);
+                if(result.type == ObjectType::RETURN || result.type == ObjectType::ERROR)
+                    return result;
+            }
+            return result;
+        };
+    }
+
+    case NodeKind::FUNCTION: {
+        // the owner is locked on every closure made, a reference held here
+        // would keep the tree alive from inside itself
+        auto funLit = static_cast<FunctionLiteral*>(node);
+        return [funLit](Evaluator&, const shared_ptr<Environment>& env) -> Object {
+            auto fn = shared_ptr<FunctionLiteral>(funLit->owner.lock(), funLit);
+            auto obj = Object{ObjectType::FUNCTION, FunctionObject{fn, env}};
+            obj._tag = funLit->tokenLiteral();
+            return obj;
+        };
+    }
+
+    case NodeKind::CALL: {
+        auto callExpr = static_cast<CallExpression*>(node);
+        auto function = compile(callExpr->function.get());
+        auto arguments = callExpr->arguments != nullptr ? compileAll(*callExpr->arguments) : vector<Compiled>{};
+        bool tail = callExpr->tail;
+        return [function, arguments, tail](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto callee = function(evaluator, env);
+            if(callee.type == ObjectType::ERROR)
+                return callee;
+            vector<Object> args;
+            args.reserve(arguments.size());
+            for(auto& argument: arguments){
+                auto value = argument(evaluator, env);
+                if(value.type == ObjectType::ERROR)
+                    return value;
+                args.push_back(std::move(value));
+            }
+            // made by the call running this body, as on the tree-walker
+            if(tail)
+                return evaluator.tailCallTo(callee, std::move(args));
+            return call(evaluator, callee, std::move(args));
+        };
+    }
+
+    case NodeKind::INLINE: {
+        auto inlined = static_cast<InlineCall*>(node);
+        auto callee = static_cast<Identifier*>(inlined->call->function.get());
+        auto original = compile(inlined->call.get());
+        auto body = compile(inlined->body.get());
+        auto arguments = compileAll(*inlined->call->arguments);
+        auto function = inlined->function.get();
+        int depth = callee->depth;
+        auto slot = callee->slot;
+        auto name = callee->symbol;
+        auto first = inlined->slot;
+        return [=](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto bound = depth >= 0 ? &env->at(depth, slot) : env->findGlobal(name);
+            auto funcObject = bound != nullptr && bound->type == ObjectType::FUNCTION ?
+                any_cast<FunctionObject>(&bound->value) : nullptr;
+            if(funcObject == nullptr || funcObject->func.get() != function)
+                return original(evaluator, env);
+            for(size_t i = 0; i < arguments.size(); ++i){
+                auto value = arguments[i](evaluator, env);
+                if(value.type == ObjectType::ERROR)
+                    return value;
+                env->at(first + i) = std::move(value);
+            }
+            return body(evaluator, env);
+        };
+    }
+
+    case NodeKind::LET: {
+        auto letStmt = static_cast<LetStatement*>(node);
+        auto value = compile(letStmt->value.get());
+        auto slot = letStmt->name.slot;
+        auto name = letStmt->name.symbol;
+        if(letStmt->name.depth == 0){
+            return [value, slot](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+                auto obj = value(evaluator, env);
+                if(obj.type != ObjectType::ERROR)
+                    env->at(slot) = obj;
+                return obj;
+            };
+        }
+        return [value, name](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto obj = value(evaluator, env);
+            if(obj.type != ObjectType::ERROR)
+                env->set(name, obj);
+            return obj;
+        };
+    }
+
+    case NodeKind::IDENTIFIER:
+        return identifier(static_cast<Identifier*>(node));
+
+    case NodeKind::IF: {
+        auto expr = static_cast<IfExpression*>(node);
+        auto condition = compile(expr->condition.get());
+        auto consequence = compile(expr->consequence.get());
+        auto alternative = compile(expr->alternative.get());
+        return [condition, consequence, alternative](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto value = condition(evaluator, env);
+            if(value.type == ObjectType::ERROR)
+                return value;
+            if(evaluator.isTruthy(value))
+                return consequence(evaluator, env);
+            return alternative(evaluator, env);
+        };
+    }
+
+    case NodeKind::RETURN: {
+        auto value = compile(static_cast<ReturnStatement*>(node)->value.get());
+        return [value](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto obj = value(evaluator, env);
+            if(obj.type == ObjectType::ERROR)
+                return obj;
+            return Object{ObjectType::RETURN, obj};
+        };
+    }
+
+    case NodeKind::CONSTANT:
+    case NodeKind::NUMBER:
+    case NodeKind::STRING:
+    case NodeKind::BOOLEAN: {
+        // literals are built once, each run hands out a copy
+        Object value;
+        if(node->kind == NodeKind::CONSTANT)
+            value = static_cast<Constant*>(node)->value;
+        else if(node->kind == NodeKind::NUMBER)
+            value = Object{ObjectType::NUMBER, static_cast<NumberLiteral*>(node)->value};
+        else if(node->kind == NodeKind::STRING)
+            value = Object{ObjectType::STRING, string(static_cast<StringLiteral*>(node)->value)};
+        else
+            value = static_cast<BooleanLiteral*>(node)->value ? TRUE_OBJ : FALSE_OBJ;
+        return [value](Evaluator&, const shared_ptr<Environment>&) -> Object { return value; };
+    }
+
+    case NodeKind::PREFIX: {
+        auto prefixExpr = static_cast<PrefixExpression*>(node);
+        auto right = compile(prefixExpr->right.get());
+        auto op = prefixExpr->opcode;
+        auto oprator = prefixExpr->oprator;
+        if(op == Opcode::NOT){
+            return [right](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+                auto value = right(evaluator, env);
+                if(value.type == ObjectType::BOOLEAN)
+                    return *any_cast<bool>(&value.value) ? FALSE_OBJ : TRUE_OBJ;
+                if(value.type == ObjectType::ERROR)
+                    return value;
+                return value.type == ObjectType::NIL ? TRUE_OBJ : FALSE_OBJ;
+            };
+        }
+        return [right, op, oprator](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto value = right(evaluator, env);
+            if(value.type == ObjectType::NUMBER)
+                return Object{ObjectType::NUMBER, -*any_cast<double>(&value.value)};
+            if(value.type == ObjectType::ERROR)
+                return value;
+            return evaluator.evalPrefixExpression(op, oprator, value);
+        };
+    }
+
+    case NodeKind::INFIX: {
+        auto infixExpr = static_cast<InfixExpression*>(node);
+        auto left = compile(infixExpr->left.get());
+        auto right = compile(infixExpr->right.get());
+        auto oprator = infixExpr->oprator;
+        switch(infixExpr->opcode){
+        case Opcode::ADD:
+            return infix<Opcode::ADD>(left, right, oprator);
+        case Opcode::SUB:
+            return infix<Opcode::SUB>(left, right, oprator);
+        case Opcode::MUL:
+            return infix<Opcode::MUL>(left, right, oprator);
+        case Opcode::DIV:
+            return infix<Opcode::DIV>(left, right, oprator);
+        case Opcode::GREATER:
+            return infix<Opcode::GREATER>(left, right, oprator);
+        case Opcode::LESS:
+            return infix<Opcode::LESS>(left, right, oprator);
+        case Opcode::EQUAL:
+            return infix<Opcode::EQUAL>(left, right, oprator);
+        default:
+            return infix<Opcode::NOT_EQUAL>(left, right, oprator);
+        }
+    }
+
+    case NodeKind::ARRAY: {
+        auto items = compileAll(static_cast<ArrayLiteral*>(node)->items);
+        return [items](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            vector<Object> objects;
+            objects.reserve(items.size());
+            for(auto& item: items){
+                auto value = item(evaluator, env);
+                if(value.type == ObjectType::ERROR)
+                    return value;
+                objects.push_back(std::move(value));
+            }
+            return Object{ObjectType::ARRAY, std::move(objects)};
+        };
+    }
+
+    case NodeKind::HASH: {
+        vector<pair<Compiled, Compiled>> entries;
+        for(auto& entry: static_cast<HashLiteral*>(node)->entries)
+            entries.emplace_back(compile(entry.first.get()), compile(entry.second.get()));
+        return [entries](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto hash = unordered_map<string, pair<Object, Object>>{};
+            for(auto& entry: entries){
+                auto key = entry.first(evaluator, env);
+                if(key.type == ObjectType::ERROR)
+                    return key;
+                if(key.type != ObjectType::NUMBER && key.type != ObjectType::STRING && key.type != ObjectType::BOOLEAN)
+                    return evaluator.raiseError(format("unusable as hash key: ", key.getType()));
+                auto value = entry.second(evaluator, env);
+                if(value.type == ObjectType::ERROR)
+                    return value;
+                hash[key.hashKey()] = make_pair(key, value);
+            }
+            return Object{ObjectType::HASH, hash};
+        };
+    }
+
+    case NodeKind::INDEX: {
+        auto idxExpr = static_cast<IndexExpression*>(node);
+        auto left = compile(idxExpr->left.get());
+        auto index = compile(idxExpr->index.get());
+        return [left, index](Evaluator& evaluator, const shared_ptr<Environment>& env) -> Object {
+            auto leftObj = left(evaluator, env);
+            if(leftObj.type == ObjectType::ERROR)
+                return leftObj;
+            auto idx = index(evaluator, env);
+            if(idx.type == ObjectType::ERROR)
+                return idx;
+            if(leftObj.type == ObjectType::ARRAY && idx.type == ObjectType::NUMBER){
+                auto& items = *any_cast<vector<Object>>(&leftObj.value);
+                auto i = (int)*any_cast<double>(&idx.value);
+                if(i < 0 || i >= (int)items.size())
+                    return NIL_OBJ;
+                return items[i];
+            }
+            return evaluator.evalIndexExpression(leftObj, idx);
+        };
+    }
+    }
+
+    return [](Evaluator&, const shared_ptr<Environment>&) -> Object { return NIL_OBJ; };
+}
+
+// Tail calls the body ends in are made here in turn, in constant stack
+Object ClosureCompiler::call(Evaluator& evaluator, const Object& func, vector<Object> args){
+    Object callee;
+    auto current = &func;
+    while(true){
+        auto value = callOnce(evaluator, *current, args);
+        if(!evaluator.isTailCall(value))
+            return value;
+        evaluator.takeTailCall(callee, args);
+        current = &callee;
+    }
+}
+
+Object ClosureCompiler::callOnce(Evaluator& evaluator, const Object& func, vector<Object>& args){
+    if(func.type == ObjectType::FUNCTION){
+        auto funcObject = any_cast<FunctionObject>(&func.value);
+        auto& fn = *funcObject->func;
+        if(fn.compiled == nullptr){
+            Object error;
+            if(!evaluator.prepare(*funcObject, error))
+                return error;
+            fn.compiled = make_shared<CompiledBody>(CompiledBody{compile(fn.body.get())});
+        }
+
+        auto env = fn.locals != nullptr ? make_shared<Environment>(funcObject->env, fn.locals)
+            : make_shared<Environment>(funcObject->env);
+        size_t i = 0;
+        for(auto& param: *fn.params){
+            auto value = i < args.size() ? std::move(args[i]) : NIL_OBJ;
+            ++i;
+            if(param.depth == 0)
+                env->at(param.slot) = std::move(value);
+            else
+                env->set(param.symbol, std::move(value));
+        }
+
+        auto value = fn.compiled->body(evaluator, env);
+        if(value.type == ObjectType::RETURN)
+            return any_cast<Object>(value.value);
+        return value;
+    }
+
+    if(func.type == ObjectType::BUILTIN_FUNCTION){
+        auto funcLamda = any_cast<Object::BuiltInFunction>(&func.value);
+        return (*funcLamda)(std::move(args));
+    }
+
+    return evaluator.raiseError(format("not a function ", func.getType()));
+}
@@ -0,0 +1,46 @@
+#if !defined(CLOSURES_H)
+#define CLOSURES_H
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <string_view>
+
+#include "object.hpp"
+#include "symbols.hpp"
+
+class AstNode;
+class Identifier;
+class Environment;
+class Evaluator;
+enum class Opcode;
+
+// A node turned into a callable once, with its operator, slots and
+// children bound in. Runs against the evaluator whose builtins and passes
+// it uses and the environment of the frame it is in.
+using Compiled = std::function<Object(Evaluator&, const std::shared_ptr<Environment>&)>;
+
+// Body of a function as compiled on its first call, kept on the literal
+// for every closure made from it
+struct CompiledBody {
+    Compiled body;
+};
+
+// Engine between the tree-walker and the VirtualMachine: the tree is
+// walked once to build a tree of callables, running them needs no dispatch
+// on node kinds. Values, environments and function objects are the
+// tree-walker's, so either can call functions the other made.
+class ClosureCompiler {
+public:
+    static Compiled compile(AstNode*);
+    static Object call(Evaluator&, const Object&, std::vector<Object>);
+
+private:
+    static Object callOnce(Evaluator&, const Object&, std::vector<Object>&);
+    static Compiled identifier(Identifier*);
+    template <Opcode>
+    static Compiled infix(Compiled, Compiled, std::string_view);
+    static Object unbound(Evaluator&, Symbol);
+};
+
+#endif // CLOSURES_H
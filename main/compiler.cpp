@@ -0,0 +1,401 @@
+#include <cstring>
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "ast.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "optimizer.hpp"
+#include "bytecode.hpp"
+#include "compiler.hpp"
+
+using namespace std;
+
+// bodies the preparser skipped, parsed now so every function is compiled
+// with the program; ones that do not parse keep their first error
+static void parseBodies(AstNode* node, unordered_map<FunctionLiteral*, string>& broken, bool& parsed){
+    if(node->kind == NodeKind::FUNCTION){
+        auto& fn = *static_cast<FunctionLiteral*>(node);
+        if(fn.isLazy()){
+            auto errors = Parser::parseBody(fn);
+            if(!errors.empty()){
+                broken[&fn] = errors[0];
+                return;
+            }
+            parsed = true;
+        }
+        if(fn.body != nullptr)
+            parseBodies(fn.body.get(), broken, parsed);
+        return;
+    }
+    forEachChild(node, [&](auto& child){ parseBodies(child.get(), broken, parsed); });
+}
+
+shared_ptr<const CodeObject> Compiler::compile(Program& program, PassManager& passes){
+    Compiler compiler;
+    bool parsed = false;
+    parseBodies(&program, compiler.broken, parsed);
+    // the passes rely on resolved bodies, and are only run once over them
+    if(parsed)
+        Resolver::resolve(program);
+    passes.run(program);
+
+    auto code = make_shared<CodeObject>();
+    compiler.scopes.push_back(Scope{nullptr, code.get()});
+    compiler.statements(program.statements);
+    compiler.emit(Op::HALT);
+    return code;
+}
+
+shared_ptr<CodeObject> Compiler::function(FunctionLiteral& fn){
+    auto code = make_shared<CodeObject>();
+    // arena nodes are linked without ownership, the code keeps the tree
+    code->literal = shared_ptr<FunctionLiteral>(fn.owner.lock(), &fn);
+    if(fn.body == nullptr){
+        auto it = broken.find(&fn);
+        code->error = format("parse error in function body: ", it != broken.end() ? it->second : "");
+        return code;
+    }
+    // frames past what a slot index holds bind by symbol, only the
+    // tree-walker has those
+    if(fn.locals == nullptr){
+        code->error = "function has too many locals for the virtual machine";
+        return code;
+    }
+
+    auto& locals = *fn.locals;
+    Scope scope{&fn, code.get()};
+    for(size_t slot = 0; slot < locals.size(); ++slot)
+        scope.slots.emplace(locals[slot], slot);
+    scope.cells.assign(locals.size(), false);
+    markCells(fn.body.get(), 0, scope);
+
+    if(fn.params != nullptr){
+        for(auto& param: *fn.params){
+            code->paramSlots.push_back(param.slot);
+            code->directParams = code->directParams && param.slot == code->paramSlots.size() - 1;
+            code->params = max<uint16_t>(code->params, param.slot + 1);
+        }
+    }
+    code->slots = locals.size();
+    for(size_t slot = 0; slot < scope.cells.size(); ++slot)
+        if(scope.cells[slot])
+            code->cellSlots.push_back(slot);
+
+    scopes.push_back(std::move(scope));
+    block(fn.body.get());
+    emit(Op::RETURN);
+    scopes.pop_back();
+    return code;
+}
+
+// Slots of the frame a nested function reads: the binding it resolved to,
+// or one its read falls back to while the binding further in is undefined
+void Compiler::markCells(AstNode* node, int level, Scope& scope){
+    if(node->kind == NodeKind::FUNCTION){
+        auto fn = static_cast<FunctionLiteral*>(node);
+        if(fn->body != nullptr)
+            markCells(fn->body.get(), level + 1, scope);
+        return;
+    }
+    if(node->kind == NodeKind::IDENTIFIER && level > 0){
+        auto ident = static_cast<Identifier*>(node);
+        if(ident->depth == level){
+            scope.cells[ident->slot] = true;
+        } else if(ident->depth >= 0 && ident->depth < level){
+            if(auto it = scope.slots.find(ident->symbol); it != scope.slots.end())
+                scope.cells[it->second] = true;
+        }
+        return;
+    }
+    forEachChild(node, [&](auto& child){ markCells(child.get(), level, scope); });
+}
+
+// every statement leaves its value, only the last one's is kept
+void Compiler::statements(const vector<shared_ptr<StatementNode>>& stmts){
+    if(stmts.empty()){
+        emit(Op::NIL, 1);
+        return;
+    }
+    for(size_t i = 0; i < stmts.size(); ++i){
+        if(i > 0)
+            emit(Op::POP, -1);
+        statement(stmts[i].get());
+    }
+}
+
+void Compiler::block(BlockStatement* block){
+    if(block == nullptr)
+        emit(Op::NIL, 1);
+    else
+        statements(block->statements);
+}
+
+void Compiler::statement(AstNode* node){
+    switch(node->kind){
+    case NodeKind::LET: {
+        auto let = static_cast<LetStatement*>(node);
+        expression(let->value.get());
+        auto& scope = scopes.back();
+        if(scope.fn != nullptr && let->name.depth == 0){
+            emit(scope.cells[let->name.slot] ? Op::SET_CELL : Op::SET_LOCAL);
+            emit16(let->name.slot);
+        } else {
+            emit(Op::SET_GLOBAL);
+            emit32(let->name.symbol);
+        }
+        break;
+    }
+    case NodeKind::RETURN:
+        // counted as the value of the statement, nothing after it runs
+        expression(static_cast<ReturnStatement*>(node)->value.get());
+        emit(Op::RETURN);
+        break;
+    case NodeKind::EXPRESSION_STATEMENT:
+        expression(static_cast<ExpressionStatement*>(node)->expression.get());
+        break;
+    case NodeKind::BLOCK:
+        block(static_cast<BlockStatement*>(node));
+        break;
+    default:
+        expression(node);
+    }
+}
+
+void Compiler::expression(AstNode* node){
+    if(node == nullptr){
+        emit(Op::NIL, 1);
+        return;
+    }
+
+    switch(node->kind){
+    case NodeKind::IDENTIFIER:
+        read(*static_cast<Identifier*>(node));
+        break;
+
+    case NodeKind::NUMBER:
+        emit(Op::CONSTANT, 1);
+        emit32(constant(Value{static_cast<NumberLiteral*>(node)->value}));
+        break;
+
+    case NodeKind::STRING:
+        emit(Op::CONSTANT, 1);
+        emit32(constant(Value{ObjectType::STRING, make_shared<string>(static_cast<StringLiteral*>(node)->value)}));
+        break;
+
+    case NodeKind::BOOLEAN:
+        emit(static_cast<BooleanLiteral*>(node)->value ? Op::TRUE : Op::FALSE, 1);
+        break;
+
+    case NodeKind::CONSTANT:
+        emit(Op::CONSTANT, 1);
+        emit32(constant(toValue(static_cast<Constant*>(node)->value)));
+        break;
+
+    case NodeKind::PREFIX: {
+        auto prefix = static_cast<PrefixExpression*>(node);
+        expression(prefix->right.get());
+        emit(prefix->opcode == Opcode::NOT ? Op::NOT : Op::NEGATE);
+        break;
+    }
+
+    case NodeKind::INFIX: {
+        auto infix = static_cast<InfixExpression*>(node);
+        expression(infix->left.get());
+        expression(infix->right.get());
+        emit(static_cast<Op>(static_cast<uint8_t>(Op::ADD) + static_cast<uint8_t>(infix->opcode)), -1);
+        break;
+    }
+
+    case NodeKind::IF: {
+        auto expr = static_cast<IfExpression*>(node);
+        expression(expr->condition.get());
+        auto otherwise = jump(Op::JUMP_IF_FALSE, -1);
+        block(expr->consequence.get());
+        auto end = jump(Op::JUMP);
+        adjust(-1); // the other branch starts without the value
+        patch(otherwise);
+        block(expr->alternative.get());
+        patch(end);
+        break;
+    }
+
+    case NodeKind::FUNCTION: {
+        auto code = function(*static_cast<FunctionLiteral*>(node));
+        auto& functions = scopes.back().code->functions;
+        functions.push_back(code);
+        emit(Op::CLOSURE, 1);
+        emit32(functions.size() - 1);
+        break;
+    }
+
+    case NodeKind::CALL: {
+        auto call = static_cast<CallExpression*>(node);
+        expression(call->function.get());
+        size_t count = 0;
+        if(call->arguments != nullptr){
+            for(auto& argument: *call->arguments)
+                expression(argument.get());
+            count = call->arguments->size();
+        }
+        emit(call->tail ? Op::TAIL_CALL : Op::CALL, -(int)count);
+        emit16(count);
+        break;
+    }
+
+    case NodeKind::INLINE:
+        // calls are cheap here, the call the helper was copied from is run
+        expression(static_cast<InlineCall*>(node)->call.get());
+        break;
+
+    case NodeKind::ARRAY: {
+        auto& items = static_cast<ArrayLiteral*>(node)->items;
+        for(auto& item: items)
+            expression(item.get());
+        emit(Op::ARRAY, 1 - (int)items.size());
+        emit32(items.size());
+        break;
+    }
+
+    case NodeKind::HASH: {
+        auto& entries = static_cast<HashLiteral*>(node)->entries;
+        for(auto& entry: entries){
+            expression(entry.first.get());
+            emit(Op::HASH_KEY);
+            expression(entry.second.get());
+        }
+        emit(Op::HASH, 1 - 2 * (int)entries.size());
+        emit32(entries.size());
+        break;
+    }
+
+    case NodeKind::INDEX: {
+        auto expr = static_cast<IndexExpression*>(node);
+        expression(expr->left.get());
+        expression(expr->index.get());
+        emit(Op::INDEX, -1);
+        break;
+    }
+
+    case NodeKind::LET:
+    case NodeKind::RETURN:
+    case NodeKind::EXPRESSION_STATEMENT:
+    case NodeKind::BLOCK:
+        // statements in expression position leave their value as well
+        statement(node);
+        break;
+
+    case NodeKind::PROGRAM:
+        emit(Op::NIL, 1);
+        break;
+    }
+}
+
+void Compiler::read(Identifier& ident){
+    size_t k = scopes.size() - 1;
+    if(ident.depth < 0 || (size_t)ident.depth >= k){
+        emit(Op::GET_GLOBAL, 1);
+        emit32(ident.symbol);
+        return;
+    }
+
+    // the binding, then the frames further out binding the same name
+    vector<pair<int, uint16_t>> chain{{ident.depth, ident.slot}};
+    for(size_t depth = ident.depth + 1; depth < k; ++depth)
+        if(auto it = scopes[k - depth].slots.find(ident.symbol); it != scopes[k - depth].slots.end())
+            chain.emplace_back(depth, it->second);
+
+    vector<size_t> found;
+    bool defined = false;
+    for(auto [depth, slot]: chain){
+        // parameters are bound from the moment the frame exists
+        defined = slot < scopes[k - depth].code->params;
+        if(depth == 0){
+            bool cell = scopes[k].cells[slot];
+            emit(defined ? (cell ? Op::GET_CELL : Op::GET_LOCAL) : (cell ? Op::GET_CELL_OR : Op::GET_LOCAL_OR));
+            emit16(slot);
+        } else {
+            auto index = free(k, depth, slot);
+            emit(defined ? Op::GET_FREE : Op::GET_FREE_OR);
+            emit16(index);
+        }
+        if(defined)
+            break;
+        // where to go once the value is pushed, the end of the chain
+        found.push_back(scopes.back().code->code.size());
+        emit32(0);
+    }
+    if(!defined){
+        emit(Op::GET_GLOBAL);
+        emit32(ident.symbol);
+    }
+    adjust(1);
+    for(auto at: found)
+        patch(at);
+}
+
+// cell of the closure of scope k holding the slot of the frame depth out,
+// threaded through the closures in between
+uint16_t Compiler::free(size_t k, int depth, uint16_t slot){
+    auto key = make_pair(depth, slot);
+    if(auto it = scopes[k].frees.find(key); it != scopes[k].frees.end())
+        return it->second;
+    CodeObject::Capture capture{true, slot};
+    if(depth > 1)
+        capture = CodeObject::Capture{false, free(k - 1, depth - 1, slot)};
+    auto& captures = scopes[k].code->captures;
+    captures.push_back(capture);
+    scopes[k].frees.emplace(key, captures.size() - 1);
+    return captures.size() - 1;
+}
+
+void Compiler::emit(Op op, int effect){
+    scopes.back().code->code.push_back(static_cast<uint8_t>(op));
+    adjust(effect);
+}
+
+void Compiler::emit16(uint16_t operand){
+    auto& code = scopes.back().code->code;
+    code.resize(code.size() + sizeof(operand));
+    memcpy(code.data() + code.size() - sizeof(operand), &operand, sizeof(operand));
+}
+
+void Compiler::emit32(uint32_t operand){
+    auto& code = scopes.back().code->code;
+    code.resize(code.size() + sizeof(operand));
+    memcpy(code.data() + code.size() - sizeof(operand), &operand, sizeof(operand));
+}
+
+// offset of the target operand, patched once the target is known
+size_t Compiler::jump(Op op, int effect){
+    emit(op, effect);
+    emit32(0);
+    return scopes.back().code->code.size() - sizeof(uint32_t);
+}
+
+void Compiler::patch(size_t at){
+    auto& code = scopes.back().code->code;
+    uint32_t target = code.size();
+    memcpy(code.data() + at, &target, sizeof(target));
+}
+
+void Compiler::adjust(int effect){
+    auto& scope = scopes.back();
+    scope.depth += effect;
+    scope.code->maxStack = max(scope.code->maxStack, scope.depth);
+}
+
+uint32_t Compiler::constant(Value value){
+    auto& scope = scopes.back();
+    auto& constants = scope.code->constants;
+    if(value.type == ObjectType::NUMBER){
+        auto [it, added] = scope.numbers.emplace(value.number, constants.size());
+        if(!added)
+            return it->second;
+    }
+    constants.push_back(std::move(value));
+    return constants.size() - 1;
+}
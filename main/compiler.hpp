@@ -0,0 +1,69 @@
+#if !defined(COMPILER_H)
+#define COMPILER_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "bytecode.hpp"
+#include "symbols.hpp"
+
+class AstNode;
+class Program;
+class StatementNode;
+class BlockStatement;
+class Identifier;
+class FunctionLiteral;
+class PassManager;
+
+// Turns a resolved program into code objects for the VirtualMachine, one
+// for the top-level statements and one per function literal. Frame slots
+// are the resolver's; slots some nested function reads are boxed in cells
+// its closures share. A read of a let that may not have run yet falls back
+// to the next frame out binding the name, then to the globals, as the
+// tree-walker's lookup by symbol does.
+class Compiler {
+public:
+    // Programs are compiled whole: bodies the preparser skipped are parsed
+    // now and resolved with the rest before the passes run. A body that
+    // does not parse raises its error when called.
+    static std::shared_ptr<const CodeObject> compile(Program&, PassManager&);
+
+private:
+    struct Scope {
+        FunctionLiteral* fn; // null for top-level code
+        CodeObject* code;
+        std::unordered_map<Symbol, uint16_t> slots;
+        std::vector<bool> cells;
+        std::map<std::pair<int, uint16_t>, uint16_t> frees; // (depth, slot) to cell of the closure
+        std::unordered_map<double, uint32_t> numbers; // constants already pooled
+        uint32_t depth = 0; // operands on the stack at this point
+    };
+
+    std::vector<Scope> scopes; // top-level code first, innermost function last
+    std::unordered_map<FunctionLiteral*, std::string> broken;
+
+    Compiler() = default;
+    std::shared_ptr<CodeObject> function(FunctionLiteral&);
+    void markCells(AstNode*, int, Scope&);
+    void statements(const std::vector<std::shared_ptr<StatementNode>>&);
+    void block(BlockStatement*);
+    void statement(AstNode*);
+    void expression(AstNode*);
+    void read(Identifier&);
+    uint16_t free(size_t, int, uint16_t);
+
+    void emit(Op, int = 0);
+    void emit16(uint16_t);
+    void emit32(uint32_t);
+    size_t jump(Op, int = 0);
+    void patch(size_t);
+    void adjust(int);
+    uint32_t constant(Value);
+};
+
+#endif // COMPILER_H
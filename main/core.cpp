@@ -1,14 +1,18 @@
 #include <iostream>
 #include <string>
 #include <memory>
+#include <fstream>
 
 #include "core.hpp"
+#include "source.hpp"
 #include "token.hpp"
 #include "lexer.hpp"
 #include "ast.hpp"
 #include "parser.hpp"
 #include "environment.hpp"
 #include "evaluator.hpp"
+#include "pipeline.hpp"
+#include "cache.hpp"
 
 using namespace std;
 
@@ -49,7 +53,7 @@ const string MONKEY_FACE= R"STRING(
             continue;
         }
 
-        Evaluator evaluator{program};
+        Evaluator evaluator{program, optimization, backend};
         auto evaluated = evaluator.execute(env);
         cout << evaluated.inspect() << endl;
 
@@ -64,6 +68,51 @@ const string MONKEY_FACE= R"STRING(
 
 
 void Runner::runFile(string file){
-    //TODO
-    cout<< "TODO: read and run file!" << endl;
-}
\ No newline at end of file
+    auto source = Source::fromFile(file);
+    if(source == nullptr){
+        cout<< "Could not read file: " << file << endl;
+        return;
+    }
+
+    // an image of the same text skips lexing and parsing altogether
+    auto cache = caching ? ScriptCache::pathFor(file, *source) : "";
+    shared_ptr<Program> program = caching ? ScriptCache::load(cache, source) : nullptr;
+    if(program == nullptr){
+        Lexer lexer{source};
+        // scripts only pay for the function bodies they call
+        Parser parser{lexer, AstAllocation::ARENA, FunctionBodies::LAZY};
+        program = parser.parseProgram();
+        if(parser.getErrors().size() > 0) {
+            for(auto str : parser.getErrors()){
+                cout<< str << endl;
+            }
+            return;
+        }
+        if(caching)
+            ScriptCache::store(cache, *program, *source);
+    }
+
+    Evaluator evaluator{program, optimization, backend};
+    auto evaluated = evaluator.execute(std::make_shared<Environment>());
+    if(evaluated.type == ObjectType::ERROR)
+        cout << evaluated.inspect() << endl;
+}
+
+void Runner::runStream(string file, bool background){
+    ifstream in;
+    if(file != "-"){
+        in.open(file, ios::binary);
+        if(!in){
+            cout<< "Could not read file: " << file << endl;
+            return;
+        }
+    }
+
+    StatementStream stream{file == "-" ? cin : in};
+    Evaluator evaluator{nullptr, optimization, backend};
+    auto evaluated = ::runStream(stream, evaluator, std::make_shared<Environment>(), background);
+    for(auto str : stream.getErrors())
+        cout<< str << endl;
+    if(evaluated.type == ObjectType::ERROR)
+        cout << evaluated.inspect() << endl;
+}
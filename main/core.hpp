@@ -3,16 +3,28 @@
 
 #include <string>
 
+#include "optimizer.hpp"
+#include "evaluator.hpp"
+
 int add(int, int);
 
 class Runner {
 private:
     bool hasError;
+    Optimization optimization;
+    Backend backend;
+    bool caching;
     void run();
 
 public:
+    Runner(Optimization opt = Optimization::ON, Backend back = Backend::TREE, bool cache = true):
+        hasError{false}, optimization{opt}, backend{back}, caching{cache} {};
     void runRepl(std::string);
+    // with caching on, the parsed script is kept in a .mkc image (see
+    // ScriptCache) and read from there while the text is unchanged
     void runFile(std::string);
+    // parse and run one statement group at a time, "-" reads stdin
+    void runStream(std::string, bool);
 };
 
 #endif // CORE_H
@@ -1,21 +1,54 @@
 
-
 #include "object.hpp"
 #include "environment.hpp"
 
 using namespace std;
 
-Object Environment::set(string name, Object value) {
+Environment::Environment(shared_ptr<Environment> outer, shared_ptr<const vector<Symbol>> layout):
+    slots(layout->size(), Object{ObjectType::UNDEFINED, 0}), names{layout}, store{}, parent{outer} {
+}
+
+void Environment::clear(){
+    for(auto& slot: slots){
+        slot.type = ObjectType::UNDEFINED;
+        slot.value.reset();
+    }
+    if(!store.empty())
+        store.clear();
+}
+
+Object Environment::set(Symbol name, Object value) {
     store[name]= value;
-    return value; 
+    return value;
 }
 
 
-Object Environment::get(string name) {
-    if (store.find(name) == store.end()){
-        if(parent == nullptr)
-            return Object{ObjectType::UNDEFINED, 0};
-        return parent->get(name);
+Object Environment::get(Symbol name) const {
+    for(auto env = this; env != nullptr; env = env->parent.get()){
+        if(env->names != nullptr){
+            auto& names = *env->names;
+            for(size_t slot = 0; slot < names.size(); ++slot)
+                if(names[slot] == name && env->slots[slot].type != ObjectType::UNDEFINED)
+                    return env->slots[slot];
+        }
+        if(auto it = env->store.find(name); it != env->store.end())
+            return it->second;
     }
-    return store[name]; 
-}
\ No newline at end of file
+    return Object{ObjectType::UNDEFINED, 0};
+}
+
+Object Environment::getGlobal(Symbol name) const {
+    if(auto value = findGlobal(name))
+        return *value;
+    return Object{ObjectType::UNDEFINED, 0};
+}
+
+const Object* Environment::findGlobal(Symbol name) const {
+    for(auto env = this; env != nullptr; env = env->parent.get()){
+        if(env->store.empty())
+            continue;
+        if(auto it = env->store.find(name); it != env->store.end())
+            return &it->second;
+    }
+    return nullptr;
+}
@@ -3,22 +3,57 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <unordered_map>
 
 #include "object.hpp"
+#include "symbols.hpp"
 
+// A frame of a resolved function keeps its locals in slots laid out by the
+// resolver, everything else (globals, REPL lines, unresolved code) binds by
+// symbol in the table.
 class Environment {
 public:
     Environment(): store{} {};
     Environment(std::shared_ptr<Environment> outer): store{}, parent{outer} {};
+    Environment(std::shared_ptr<Environment>, std::shared_ptr<const std::vector<Symbol>>);
     virtual ~Environment() = default;
-    Object set(std::string, Object);
-    Object get(std::string);
+    Object set(Symbol, Object);
+    // any binding visible from here, slot or table
+    Object get(Symbol) const;
+    // a resolved name's slot; read before the let of that frame ran, an
+    // outer binding of the name still counts
+    Object get(size_t depth, size_t slot, Symbol name) const {
+        auto env = this;
+        while(depth-- > 0)
+            env = env->parent.get();
+        auto& value = env->slots[slot];
+        return value.type != ObjectType::UNDEFINED ? value : get(name);
+    }
+    // table bindings only, enough for names the resolver found in no frame
+    Object getGlobal(Symbol) const;
+    // same without the copy, null when unbound
+    const Object* findGlobal(Symbol) const;
+
+    Object& at(size_t depth, size_t slot){
+        auto env = this;
+        while(depth-- > 0)
+            env = env->parent.get();
+        return env->slots[slot];
+    }
+    Object& at(size_t slot){ return slots[slot]; }
+    // unbinds everything, for a frame a tail call runs in again
+    void clear();
+
+    std::shared_ptr<const std::vector<Symbol>> getNames() const { return names; }
+    const Environment* getParent() const { return parent.get(); }
 
 private:
-    std::unordered_map<std::string, Object> store;
+    std::vector<Object> slots;
+    std::shared_ptr<const std::vector<Symbol>> names; // symbol of each slot
+    std::unordered_map<Symbol, Object> store;
     std::shared_ptr<Environment> parent;
 };
 
 
-#endif // ENVIRONMENT_H
\ No newline at end of file
+#endif // ENVIRONMENT_H
@@ -1,6 +1,8 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <array>
+#include <utility>
 #include <any>
 #include <typeinfo>
 
@@ -9,193 +11,331 @@
 #include "utils.hpp"
 #include "token.hpp"
 #include "ast.hpp"
+#include "tokens.hpp"
+#include "parser.hpp"
 #include "object.hpp"
 #include "fobject.hpp"
 #include "evaluator.hpp"
 #include "environment.hpp"
+#include "resolver.hpp"
+#include "optimizer.hpp"
+#include "symbols.hpp"
+#include "bytecode.hpp"
+#include "compiler.hpp"
+#include "vm.hpp"
+#include "closures.hpp"
+#include "jit.hpp"
+#include "stackmachine.hpp"
 
 using namespace std;
 
-Evaluator::Evaluator(std::shared_ptr<Program> ast): program{ast}, builtins{} {
-    builtins["PI"] = Object(ObjectType::BUILTIN_OBJECT, Object{ObjectType::NUMBER, 3.14});
-    
-    builtins["len"] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
-            [this](vector<Object> args) -> Object {
-                if(args.size() != 1)
-                    return raiseError(format("wrong number of argument. got=", args.size(), ", want=1"));
-                switch (args[0].type){
-                case ObjectType::ARRAY:
-                    return Object{ObjectType::NUMBER, (double)(any_cast<vector<Object>>(args[0].value).size())};
-                case ObjectType::STRING:
-                    return Object{ObjectType::NUMBER, (double)(any_cast<string>(args[0].value).size())};
-                default:
-                    return raiseError(format("argument to len not supported, got ", args[0].getType()));
+// Objects copy when moved, this only hands the value over
+static void take(Object& to, Object& from){
+    to.type = from.type;
+    to._tag.swap(from._tag);
+    to.value.swap(from.value);
+}
+
+static constexpr size_t prefixIdx(Opcode op, ObjectType type){
+    return (static_cast<size_t>(op) - INFIX_OPCODE_COUNT) * OBJECT_TYPE_COUNT + static_cast<size_t>(type);
+}
+
+static constexpr size_t infixIdx(Opcode op, ObjectType ltype, ObjectType rtype){
+    return (static_cast<size_t>(op) * OBJECT_TYPE_COUNT + static_cast<size_t>(ltype)) * OBJECT_TYPE_COUNT
+        + static_cast<size_t>(rtype);
+}
+
+template <size_t... I, typename F>
+static constexpr void forEachIndex(index_sequence<I...>, F&& fn){
+    (fn(integral_constant<size_t, I>{}), ...);
+}
+
+// The body was specialized for arguments of the types in its signature,
+// called with others (or too few) it drops what it assumed of them
+template <typename TypeOf>
+static void checkSignature(const FunctionLiteral& fn, size_t count, TypeOf typeOf){
+    if(fn.assumptions == nullptr)
+        return;
+    bool holds = count >= fn.signature.size();
+    for(size_t i = 0; holds && i < fn.signature.size(); ++i)
+        holds = (fn.signature[i] >> static_cast<size_t>(typeOf(i))) & 1;
+    if(!holds){
+        auto assumptions = fn.assumptions;
+        assumptions->drop();
+    }
+}
+
+// Records operands a node sees, true while it is specialized on ones like
+// these. Checked after the cheaper static marks of type inference.
+static bool observe(Feedback& feedback, bool matches){
+    if(feedback == Feedback::SPECIALIZED && matches)
+        return true;
+    if(feedback == Feedback::UNSEEN && matches){
+        feedback = Feedback::SPECIALIZED;
+        return true;
+    }
+    feedback = Feedback::GENERIC;
+    return false;
+}
+
+Evaluator::Evaluator(std::shared_ptr<Program> ast, Optimization optimization, Backend backend):
+    program{ast}, passes{optimization}, backend{backend}, specialize{optimization == Optimization::ON} {
+    if(backend == Backend::BYTECODE)
+        vm = std::make_unique<VirtualMachine>();
+    if(backend == Backend::STACK)
+        machine = std::make_unique<StackMachine>(*this);
+}
+
+// shared by every evaluator, nodes may keep pointers to the entries
+const unordered_map<Symbol, Object>& Evaluator::builtinTable(){
+    static const unordered_map<Symbol, Object> builtins = [](){
+        unordered_map<Symbol, Object> table;
+        table[intern("PI")] = Object(ObjectType::BUILTIN_OBJECT, Object{ObjectType::NUMBER, 3.14});
+
+        table[intern("len")] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
+                [](vector<Object> args) -> Object {
+                    if(args.size() != 1)
+                        return raiseError(format("wrong number of argument. got=", args.size(), ", want=1"));
+                    switch (args[0].type){
+                    case ObjectType::ARRAY:
+                        return Object{ObjectType::NUMBER, (double)(any_cast<vector<Object>>(args[0].value).size())};
+                    case ObjectType::STRING:
+                        return Object{ObjectType::NUMBER, (double)(any_cast<string>(args[0].value).size())};
+                    default:
+                        return raiseError(format("argument to len not supported, got ", args[0].getType()));
+                    }
                 }
-            }
-        }};
-    builtins["first"] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
-            [this](vector<Object> args) -> Object {
-                if(args.size() != 1)
-                    return raiseError(format("wrong number of argument. got=", args.size(), ", want=1"));
-                
-                if(args[0].type != ObjectType::ARRAY)
-                    return raiseError(format("argument to first must be ARRAY, got ", args[0].getType()));
-                
-                auto arr = any_cast<vector<Object>>(args[0].value);
-                if(arr.size() > 0) 
-                    return arr[0];
-
-                return NIL_OBJ;
-            }
-        }};
-    builtins["last"] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
-            [this](vector<Object> args) -> Object {
-                if(args.size() != 1)
-                    return raiseError(format("wrong number of argument. got=", args.size(), ", want=1"));
-                
-                if(args[0].type != ObjectType::ARRAY)
-                    return raiseError(format("argument to first must be ARRAY, got ", args[0].getType()));
-                
-                auto arr = any_cast<vector<Object>>(args[0].value);
-                int size = arr.size();
-                if(size > 0) 
-                    return arr[size - 1];
-                    
-                return NIL_OBJ;
-            }
-        }};
-    builtins["push"] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
-            [this](vector<Object> args) -> Object {
-                if(args.size() != 2)
-                    return raiseError(format("wrong number of argument. got=", args.size(), ", want=2"));
-                
-                if(args[0].type != ObjectType::ARRAY)
-                    return raiseError(format("argument to first must be ARRAY, got ", args[0].getType()));
-                
-                auto arr = any_cast<vector<Object>>(args[0].value);
-                arr.push_back(args[1]);
-
-                return Object{ObjectType::ARRAY, arr};
-            }
-        }};
+            }};
+        table[intern("first")] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
+                [](vector<Object> args) -> Object {
+                    if(args.size() != 1)
+                        return raiseError(format("wrong number of argument. got=", args.size(), ", want=1"));
 
-    builtins["print"] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
-            [this](vector<Object> args) -> Object {
-                for(auto itm: args)
-                    cout << itm.inspect() << endl;
-                return NIL_OBJ;
-            }
-        }};
-    
-};
+                    if(args[0].type != ObjectType::ARRAY)
+                        return raiseError(format("argument to first must be ARRAY, got ", args[0].getType()));
+
+                    auto arr = any_cast<vector<Object>>(args[0].value);
+                    if(arr.size() > 0) 
+                        return arr[0];
+
+                    return Object{ObjectType::NIL, 0.0};
+                }
+            }};
+        table[intern("last")] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
+                [](vector<Object> args) -> Object {
+                    if(args.size() != 1)
+                        return raiseError(format("wrong number of argument. got=", args.size(), ", want=1"));
+
+                    if(args[0].type != ObjectType::ARRAY)
+                        return raiseError(format("argument to first must be ARRAY, got ", args[0].getType()));
 
-Object Evaluator::eval(std::shared_ptr<AstNode> node, std::shared_ptr<Environment> env) {
-    // Program
-    if(auto program = dynamic_pointer_cast<Program>(node);  program != nullptr)
-        return evalProgram(program->statements, env);
+                    auto arr = any_cast<vector<Object>>(args[0].value);
+                    int size = arr.size();
+                    if(size > 0) 
+                        return arr[size - 1];
 
-    // Statements
-    if(auto exprStmt = dynamic_pointer_cast<ExpressionStatement>(node); exprStmt != nullptr)
-        return eval(exprStmt->expression, env);
+                    return Object{ObjectType::NIL, 0.0};
+                }
+            }};
+        table[intern("push")] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
+                [](vector<Object> args) -> Object {
+                    if(args.size() != 2)
+                        return raiseError(format("wrong number of argument. got=", args.size(), ", want=2"));
+
+                    if(args[0].type != ObjectType::ARRAY)
+                        return raiseError(format("argument to first must be ARRAY, got ", args[0].getType()));
+
+                    auto arr = any_cast<vector<Object>>(args[0].value);
+                    arr.push_back(args[1]);
+
+                    return Object{ObjectType::ARRAY, arr};
+                }
+            }};
+
+        table[intern("print")] = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction {
+                [](vector<Object> args) -> Object {
+                    for(auto itm: args)
+                        cout << itm.inspect() << endl;
+                    return Object{ObjectType::NIL, 0.0};
+                }
+            }};
+        return table;
+    }();
+    return builtins;
+}
 
-    // Block
-    if(auto blockStmt = dynamic_pointer_cast<BlockStatement>(node); blockStmt != nullptr)
-        return evalBlockStatement(blockStmt->statements, env);
+Evaluator::~Evaluator() = default;
 
-    // Function Literal
-    if(auto funLit = dynamic_pointer_cast<FunctionLiteral>(node); funLit != nullptr){
-        auto obj = Object{ObjectType::FUNCTION, FunctionObject{funLit, env}};
+Object Evaluator::eval(AstNode* node, const std::shared_ptr<Environment>& env) {
+    if(node == nullptr)
+        return NIL_OBJ;
+
+    switch(node->kind){
+    case NodeKind::PROGRAM:
+        return evalProgram(static_cast<Program*>(node)->statements, env);
+
+    case NodeKind::EXPRESSION_STATEMENT:
+        return eval(static_cast<ExpressionStatement*>(node)->expression.get(), env);
+
+    case NodeKind::BLOCK:
+        return evalBlockStatement(static_cast<BlockStatement*>(node)->statements, env);
+
+    case NodeKind::FUNCTION: {
+        auto funLit = static_cast<FunctionLiteral*>(node);
+        // arena nodes are linked without ownership, the closure has to keep
+        // the whole tree alive through the owner
+        auto fn = shared_ptr<FunctionLiteral>(funLit->owner.lock(), funLit);
+        auto obj = Object{ObjectType::FUNCTION, FunctionObject{fn, env}};
         obj._tag = funLit->tokenLiteral();
         return obj;
     }
 
-    // Call
-    if(auto callExpr = dynamic_pointer_cast<CallExpression>(node); callExpr != nullptr){
-        auto function = eval(callExpr->function, env);
+    case NodeKind::CALL: {
+        auto callExpr = static_cast<CallExpression*>(node);
+        auto function = eval(callExpr->function.get(), env);
         if(function.type == ObjectType::ERROR)
             return function;
+
+        // the caller's applyFunction makes the call once this one returned
+        if(callExpr->tail){
+            auto args = evalExpressions(*callExpr->arguments, env);
+            if(args.size() == 1 && args[0].type == ObjectType::ERROR)
+                return args[0];
+            return tailCallTo(function, std::move(args));
+        }
         
-        auto args = evalExpressions(callExpr->arguments, env);
+        if(specialize){
+            auto funcObject = function.type == ObjectType::FUNCTION ? any_cast<FunctionObject>(&function.value) : nullptr;
+            auto fn = funcObject != nullptr ? funcObject->func.get() : nullptr;
+            // a body not parsed or resolved yet goes through applyFunction
+            // first, the call site specializes on a later call
+            // with the JIT a function's first call decides whether it runs
+            // natively, only interpreted ones are called directly
+            bool interpreted = backend != Backend::JIT || (fn != nullptr && fn->jitTried && fn->native == nullptr);
+            if(callExpr->feedback == Feedback::UNSEEN && fn != nullptr && fn->locals != nullptr && interpreted){
+                callExpr->feedback = Feedback::SPECIALIZED;
+                callExpr->target = fn;
+            } else if(callExpr->feedback == Feedback::UNSEEN && fn == nullptr){
+                callExpr->feedback = Feedback::GENERIC;
+            }
+            if(callExpr->feedback == Feedback::SPECIALIZED){
+                if(fn == callExpr->target && fn->locals != nullptr)
+                    return callDirect(*funcObject, *callExpr->arguments, env);
+                callExpr->feedback = Feedback::GENERIC;
+            }
+        }
+
+        auto args = evalExpressions(*callExpr->arguments, env);
         if(args.size() == 1 && args[0].type == ObjectType::ERROR)
             return args[0];
 
-        return applyFunction(function, args);
+        return applyFunction(function, std::move(args));
+    }
+
+    case NodeKind::INLINE: {
+        auto inlined = static_cast<InlineCall*>(node);
+        auto callee = static_cast<Identifier*>(inlined->call->function.get());
+        auto bound = callee->depth >= 0 ? &env->at(callee->depth, callee->slot) : env->findGlobal(callee->symbol);
+        auto funcObject = bound != nullptr && bound->type == ObjectType::FUNCTION ?
+            any_cast<FunctionObject>(&bound->value) : nullptr;
+        if(funcObject == nullptr || funcObject->func.get() != inlined->function.get())
+            return eval(inlined->call.get(), env);
+
+        auto& arguments = *inlined->call->arguments;
+        for(size_t i = 0; i < arguments.size(); ++i){
+            auto value = eval(arguments[i].get(), env);
+            if(value.type == ObjectType::ERROR)
+                return value;
+            env->at(inlined->slot + i) = std::move(value);
+        }
+        return eval(inlined->body.get(), env);
     }
 
-    // Let 
-    if(auto letStmt = dynamic_pointer_cast<LetStatement>(node); letStmt != nullptr){
-        auto value = eval(letStmt->value, env);
+    case NodeKind::LET: {
+        auto letStmt = static_cast<LetStatement*>(node);
+        auto value = eval(letStmt->value.get(), env);
         if(value.type == ObjectType::ERROR)
             return value;
-        env->set(letStmt->name.value, value);
+        if(letStmt->name.depth == 0)
+            env->at(letStmt->name.slot) = value;
+        else
+            env->set(letStmt->name.symbol, value);
         return value;
     }
 
-    // Identifier
-    if(auto ident = dynamic_pointer_cast<Identifier>(node); ident != nullptr){
-        auto value = env->get(ident->value);
+    case NodeKind::IDENTIFIER: {
+        auto ident = static_cast<Identifier*>(node);
+        Object value;
+        if(ident->depth >= 0){
+            value = env->get(ident->depth, ident->slot, ident->symbol);
+        } else if(ident->depth == Identifier::GLOBAL){
+            if(auto bound = env->findGlobal(ident->symbol))
+                return *bound;
+            // nothing binds the name yet, it still is the builtin seen before
+            if(ident->builtin != nullptr)
+                return *ident->builtin;
+            value = Object{ObjectType::UNDEFINED, 0};
+        } else {
+            value = env->get(ident->symbol);
+        }
         if(value.type != ObjectType::UNDEFINED)
             return value;
         
-        if (auto btinObj = builtins.find(ident->value); btinObj != builtins.end()){
-            auto obj = btinObj->second;
-            if(obj.type == ObjectType::BUILTIN_OBJECT){
-                auto val = any_cast<double>(any_cast<Object>(obj.value).value);
-                return any_cast<Object>(obj.value);
-            }
-            return obj; // BUILTIN_FUNCTIOMN
+        auto& builtins = builtinTable();
+        if (auto btinObj = builtins.find(ident->symbol); btinObj != builtins.end()){
+            auto& obj = btinObj->second;
+            auto& resolved = obj.type == ObjectType::BUILTIN_OBJECT ? *any_cast<Object>(&obj.value) : obj;
+            if(specialize && ident->depth == Identifier::GLOBAL)
+                ident->builtin = &resolved;
+            return resolved;
         }
         
         return raiseError(format("identifier not found: ", ident->value));
     }
 
-    // If Else
-    if(auto ifExpr = dynamic_pointer_cast<IfExpression>(node); ifExpr != nullptr)
-        return evalIfExpression(ifExpr, env);
+    case NodeKind::IF:
+        return evalIfExpression(static_cast<IfExpression*>(node), env);
 
-    // Return
-    if(auto returnStmt = dynamic_pointer_cast<ReturnStatement>(node); returnStmt != nullptr){
-        auto value = eval(returnStmt->value, env);
+    case NodeKind::RETURN: {
+        auto value = eval(static_cast<ReturnStatement*>(node)->value.get(), env);
         if(value.type == ObjectType::ERROR)
             return value;
         return Object{ObjectType::RETURN, value};
     }
 
-    // Number
-    if(auto number = dynamic_pointer_cast<NumberLiteral>(node); number != nullptr)
-        return Object{ObjectType::NUMBER, number->value};
+    case NodeKind::CONSTANT:
+        return static_cast<Constant*>(node)->value;
 
-    // String 
-    if(auto str = dynamic_pointer_cast<StringLiteral>(node); str != nullptr)
-        return Object{ObjectType::STRING, str->value};
+    case NodeKind::NUMBER:
+        return Object{ObjectType::NUMBER, static_cast<NumberLiteral*>(node)->value};
 
-    // Boolean
-    if(auto boolean = dynamic_pointer_cast<BooleanLiteral>(node); boolean != nullptr)
-        return boolean->value? TRUE_OBJ : FALSE_OBJ;
+    case NodeKind::STRING:
+        return Object{ObjectType::STRING, string(static_cast<StringLiteral*>(node)->value)};
 
-    // Prefix
-    if(auto prefixExpr = dynamic_pointer_cast<PrefixExpression>(node); prefixExpr != nullptr){
-        auto right = eval(prefixExpr->right, env);
+    case NodeKind::BOOLEAN:
+        return static_cast<BooleanLiteral*>(node)->value? TRUE_OBJ : FALSE_OBJ;
+
+    case NodeKind::PREFIX: {
+        auto prefixExpr = static_cast<PrefixExpression*>(node);
+        auto right = eval(prefixExpr->right.get(), env);
         if(right.type == ObjectType::ERROR)
             return right;
-        return evalPrefixExpression(prefixExpr->oprator, right);
+        return evalPrefixExpression(prefixExpr, right);
     }
 
-    // Infix 
-    if(auto infixExpr = dynamic_pointer_cast<InfixExpression>(node); infixExpr != nullptr){
-        auto left = eval(infixExpr->left, env);
+    case NodeKind::INFIX: {
+        auto infixExpr = static_cast<InfixExpression*>(node);
+        auto left = eval(infixExpr->left.get(), env);
         if(left.type == ObjectType::ERROR)
             return left;
-        auto right = eval(infixExpr->right, env);
+        auto right = eval(infixExpr->right.get(), env);
         if(right.type == ObjectType::ERROR)
             return right;
-        return evalInfixExpression(infixExpr->oprator, left, right);
+        return evalInfixExpression(infixExpr, left, right);
     }
 
-    // Array
-    if(auto arrExpr = dynamic_pointer_cast<ArrayLiteral>(node); arrExpr != nullptr){
-        auto items  = make_shared<std::vector<std::shared_ptr<ExpressionNode>>>(arrExpr->items);
-        auto objects = evalExpressions(items, env);
+    case NodeKind::ARRAY: {
+        auto objects = evalExpressions(static_cast<ArrayLiteral*>(node)->items, env);
 
         if(objects.size() == 1 && objects[0].type == ObjectType::ERROR)
             return objects[0];
@@ -203,18 +343,17 @@ Object Evaluator::eval(std::shared_ptr<AstNode> node, std::shared_ptr<Environmen
         return Object{ObjectType::ARRAY, objects};
     }
 
-    // Hash
-    if(auto hashExpr = dynamic_pointer_cast<HashLiteral>(node); hashExpr != nullptr){
+    case NodeKind::HASH: {
         auto entries = unordered_map<string, std::pair<Object, Object>>{};
-        for(auto entry: hashExpr->entries){
-            auto key = eval(entry.first, env);
+        for(auto& entry: static_cast<HashLiteral*>(node)->entries){
+            auto key = eval(entry.first.get(), env);
             if(key.type == ObjectType::ERROR)
                 return key;
 
             if(key.type != ObjectType::NUMBER && key.type != ObjectType::STRING && key.type != ObjectType::BOOLEAN)
                 return raiseError(format("unusable as hash key: ", key.getType()));
         
-            auto value = eval(entry.second, env);
+            auto value = eval(entry.second.get(), env);
             if(value.type == ObjectType::ERROR)
                 return value;
             
@@ -223,25 +362,69 @@ Object Evaluator::eval(std::shared_ptr<AstNode> node, std::shared_ptr<Environmen
         return Object{ObjectType::HASH, entries};
     }
 
-    // Index
-    if(auto idxExpr = dynamic_pointer_cast<IndexExpression>(node); idxExpr != nullptr) {
-        auto left = eval(idxExpr->left, env);
+    case NodeKind::INDEX: {
+        auto idxExpr = static_cast<IndexExpression*>(node);
+        auto left = eval(idxExpr->left.get(), env);
         if(left.type == ObjectType::ERROR)
             return left;
-        auto idx = eval(idxExpr->index, env);
+        auto idx = eval(idxExpr->index.get(), env);
         if(idx.type == ObjectType::ERROR)
             return idx;
-        return evalIndexExpression(left, idx);
+        return evalIndexExpression(idxExpr, left, idx);
+    }
     }
 
     return NIL_OBJ;
 }
 
 
-Object Evaluator::evalProgram(std::vector<std::shared_ptr<StatementNode>> stmts, std::shared_ptr<Environment> env){
+Object Evaluator::execute(std::shared_ptr<Environment> env){
+    if(vm != nullptr){
+        bool returned;
+        return vm->run(*Compiler::compile(*program, passes), env, returned);
+    }
+    passes.run(*program);
+    if(backend == Backend::CLOSURES)
+        return ClosureCompiler::compile(program.get())(*this, env);
+    if(machine != nullptr)
+        return machine->run(program.get(), env);
+    return eval(program.get(), env);
+}
+
+Object Evaluator::step(std::shared_ptr<Program> part, std::shared_ptr<Environment> env){
+    if(vm != nullptr){
+        bool returned;
+        auto result = vm->run(*Compiler::compile(*part, passes), env, returned);
+        if(returned)
+            return Object{ObjectType::RETURN, result};
+        return result;
+    }
+    passes.run(*part);
+    Object result = NIL_OBJ;
+    for(auto& stmt : part->statements){
+        if(backend == Backend::CLOSURES)
+            result = ClosureCompiler::compile(stmt.get())(*this, env);
+        else
+            result = machine != nullptr ? machine->run(stmt.get(), env) : eval(stmt.get(), env);
+        if(result.type == ObjectType::RETURN || result.type == ObjectType::ERROR)
+            return result;
+    }
+    return result;
+}
+
+Object Evaluator::evalConstant(AstNode* node){
+    return eval(node, std::make_shared<Environment>());
+}
+
+void Evaluator::setMaxDepth(size_t depth){
+    if(machine != nullptr)
+        machine->setMaxDepth(depth);
+}
+
+Object Evaluator::evalProgram(const std::vector<std::shared_ptr<StatementNode>>& stmts, const std::shared_ptr<Environment>& env){
     Object result;
-    for(auto stmt : stmts){
-        result = eval(stmt, env);
+    for(auto& stmt : stmts){
+        result = eval(stmt.get(), env);
 
         if(result.type == ObjectType::RETURN)
             return any_cast<Object>(result.value);
@@ -252,10 +435,10 @@ Object Evaluator::evalProgram(std::vector<std::shared_ptr<StatementNode>> stmts,
     return result;
 }
 
-Object Evaluator::evalBlockStatement(std::vector<std::shared_ptr<StatementNode>> stmts, std::shared_ptr<Environment> env){
+Object Evaluator::evalBlockStatement(const std::vector<std::shared_ptr<StatementNode>>& stmts, const std::shared_ptr<Environment>& env){
     Object result;
-    for(auto stmt : stmts){
-        result = eval(stmt, env);
+    for(auto& stmt : stmts){
+        result = eval(stmt.get(), env);
 
         if(result.type == ObjectType::RETURN || result.type == ObjectType::ERROR)
             return result;
@@ -263,64 +446,91 @@ Object Evaluator::evalBlockStatement(std::vector<std::shared_ptr<StatementNode>>
     return result;
 }
 
-Object Evaluator::evalPrefixExpression(std::string oprator, Object right){
-    if(oprator == "!")
-        return evalBangOperatorExpression(right);
-    if(oprator == "-")
-        return evalMinusOperatorExpression(right);
-
-    return raiseError(format("unknown operator: ", oprator, right.getType()));
+// Operators of a node once its operands are there, through the types the
+// node is specialized on when they match
+Object Evaluator::evalPrefixExpression(PrefixExpression* node, const Object& right){
+    bool matches = right.type == (node->opcode == Opcode::NOT ? ObjectType::BOOLEAN : ObjectType::NUMBER);
+    if(node->specialized || (specialize && observe(node->feedback, matches))){
+        if(node->opcode == Opcode::NOT)
+            return nativeToBoolean(!*any_cast<bool>(&right.value));
+        return Object{ObjectType::NUMBER, -*any_cast<double>(&right.value)};
+    }
+    return evalPrefixExpression(node->opcode, node->oprator, right);
 }
 
-Object Evaluator::evalInfixExpression(std::string oprator, Object left, Object right){
-    if(left.type == ObjectType::NUMBER && right.type == ObjectType::NUMBER)
-        return evalIntegerInfixExpression(oprator, left, right); 
-    
-    if(left.type == ObjectType::STRING && right.type == ObjectType::STRING)
-        return evalStringInfixExpression(oprator, left, right);
+Object Evaluator::evalInfixExpression(InfixExpression* node, const Object& left, const Object& right){
+    bool numbers = left.type == ObjectType::NUMBER && right.type == ObjectType::NUMBER;
+    if(node->numeric || (specialize && observe(node->feedback, numbers)))
+        return evalNumericInfix(node->opcode, *any_cast<double>(&left.value), *any_cast<double>(&right.value));
+    return evalInfixExpression(node->opcode, node->oprator, left, right);
+}
 
-    // std::addressof(left) cannot work as these values are passed by value
-    // therefore copied around
-    if(oprator == "=="){
-        auto r = left.type == ObjectType::BOOLEAN && left.type == right.type 
-            && any_cast<bool>(left.value) == any_cast<bool>(right.value);
-        return nativeToBoolean(r);
+Object Evaluator::evalIndexExpression(IndexExpression* node, const Object& left, const Object& idx){
+    bool arrayIndex = left.type == ObjectType::ARRAY && idx.type == ObjectType::NUMBER;
+    if(node->arrayIndex || (specialize && observe(node->feedback, arrayIndex))){
+        auto& items = *any_cast<vector<Object>>(&left.value);
+        auto i = (int) *any_cast<double>(&idx.value);
+        if(i < 0 || i >= (int)items.size())
+            return NIL_OBJ;
+        return items[i];
     }
+    return evalIndexExpression(left, idx);
+}
 
-    if(oprator == "!="){
-        return nativeToBoolean(std::addressof(left) != std::addressof(right));
-        auto r = (left.type == ObjectType::BOOLEAN || right.type == ObjectType::BOOLEAN) 
-            && left.type != right.type || any_cast<bool>(left.value) != any_cast<bool>(right.value);
-        return nativeToBoolean(r);
-    }
+Object Evaluator::evalPrefixExpression(Opcode op, std::string_view oprator, const Object& right){
+    auto fn = prefixFuncs[prefixIdx(op, right.type)];
+    return (this->*fn)(oprator, right);
+}
 
-    if(left.type != right.type)
-        return raiseError(format("type mismatch: ", left.getType(), " ", oprator, " ", right.getType()));
-        
-    return raiseError(format("unknown operator: ", left.getType(), " ", oprator, " ", right.getType()));
+Object Evaluator::evalInfixExpression(Opcode op, std::string_view oprator, const Object& left, const Object& right){
+    auto fn = infixFuncs[infixIdx(op, left.type, right.type)];
+    return (this->*fn)(oprator, left, right);
 }
 
-Object Evaluator::evalIfExpression(std::shared_ptr<IfExpression> expr, std::shared_ptr<Environment> env){
-    auto condition = eval(expr->condition, env);
+// operands type inference proved to be numbers, no table to go through
+Object Evaluator::evalNumericInfix(Opcode op, double left, double right){
+    switch(op){
+    case Opcode::ADD:
+        return Object{ObjectType::NUMBER, left + right};
+    case Opcode::SUB:
+        return Object{ObjectType::NUMBER, left - right};
+    case Opcode::MUL:
+        return Object{ObjectType::NUMBER, left * right};
+    case Opcode::DIV:
+        return Object{ObjectType::NUMBER, left / right};
+    case Opcode::GREATER:
+        return nativeToBoolean(left > right);
+    case Opcode::LESS:
+        return nativeToBoolean(left < right);
+    case Opcode::EQUAL:
+        return nativeToBoolean(left == right);
+    default:
+        return nativeToBoolean(left != right);
+    }
+}
+
+Object Evaluator::evalIfExpression(IfExpression* expr, const std::shared_ptr<Environment>& env){
+    auto condition = eval(expr->condition.get(), env);
     if(condition.type == ObjectType::ERROR)
         return condition;
 
-    if(isTruthy(condition))
-        return eval(expr->consequence, env);
+    bool truthy = expr->booleanCondition ? *any_cast<bool>(&condition.value) : isTruthy(condition);
+    if(truthy)
+        return eval(expr->consequence.get(), env);
     else if(expr->alternative != nullptr)
-        return eval(expr->alternative, env);
+        return eval(expr->alternative.get(), env);
     
     return NIL_OBJ;
 }
 
-std::vector<Object> Evaluator::evalExpressions(std::shared_ptr<std::vector<std::shared_ptr<ExpressionNode>>> arguments, std::shared_ptr<Environment> env){
+std::vector<Object> Evaluator::evalExpressions(const std::vector<std::shared_ptr<ExpressionNode>>& arguments, const std::shared_ptr<Environment>& env){
     std::vector<Object> args{};
-    auto t = arguments.get();
-    for(auto arg : *arguments){
-        auto value = eval(arg, env);
+    args.reserve(arguments.size());
+    for(auto& arg : arguments){
+        auto value = eval(arg.get(), env);
         if(value.type == ObjectType::ERROR)
-            return std::vector<Object>{ Object{ObjectType::ERROR, 0} };
-        args.push_back(value);
+            return std::vector<Object>{ value };
+        args.push_back(std::move(value));
     }
     return args;
 }
@@ -329,75 +539,108 @@ std::vector<Object> Evaluator::evalExpressions(std::shared_ptr<std::vector<std::
 
 // helpers
 
-Object Evaluator::evalBangOperatorExpression(Object right){
-    if(right.type == TRUE_OBJ.type 
-        && any_cast<bool>(right.value) == any_cast<bool>(TRUE_OBJ.value))
-        return FALSE_OBJ;
-    if(right.type == FALSE_OBJ.type 
-        && any_cast<bool>(right.value) == any_cast<bool>(FALSE_OBJ.value))
-        return TRUE_OBJ;
-
-    if(right.type == NIL_OBJ.type 
-        && any_cast<double>(right.value) == any_cast<double>(NIL_OBJ.value))
-        return TRUE_OBJ;
-
-    return FALSE_OBJ;
-}
-
 Object Evaluator::nativeToBoolean(bool value){
     if(value)
         return TRUE_OBJ;
     return FALSE_OBJ;
 }
 
-Object Evaluator::evalMinusOperatorExpression(Object right){
-    if(right.type != ObjectType::NUMBER)
-        return raiseError(format("unknown operator: -", right.getType()));
-
-    return Object{ObjectType::NUMBER, -(any_cast<double>(right.value))};
+// operators, one instance per (opcode, operand types)
+template <Opcode op, ObjectType type>
+Object Evaluator::prefix(std::string_view oprator, const Object& right){
+    if constexpr(op == Opcode::NOT){
+        if constexpr(type == ObjectType::BOOLEAN)
+            return nativeToBoolean(!*any_cast<bool>(&right.value));
+        else if constexpr(type == ObjectType::NIL)
+            return TRUE_OBJ;
+        else
+            return FALSE_OBJ;
+    } else {
+        if constexpr(type == ObjectType::NUMBER)
+            return Object{ObjectType::NUMBER, -*any_cast<double>(&right.value)};
+        else
+            return raiseError(format("unknown operator: ", oprator, right.getType()));
+    }
 }
 
-Object Evaluator::evalIntegerInfixExpression(std::string oprator, Object left, Object right){
-    auto leftVal = any_cast<double>(left.value);
-    auto rightVal = any_cast<double>(right.value);
-    
-    if(oprator == "+")
-        return Object{ObjectType::NUMBER, (leftVal + rightVal)};
-    
-    if(oprator == "-")
-        return Object{ObjectType::NUMBER, (leftVal - rightVal)};
-    
-    if(oprator == "*")
-        return Object{ObjectType::NUMBER, (leftVal * rightVal)};
-
-    if(oprator == "/")
-        return Object{ObjectType::NUMBER, (leftVal / rightVal)};
-    
-    if(oprator == ">")
-        return nativeToBoolean(leftVal > rightVal);
-    
-    if(oprator == "<")
-        return nativeToBoolean(leftVal < rightVal);
-
-    if(oprator == "==")
-        return nativeToBoolean(leftVal == rightVal);
-
-    if(oprator == "!=")
-        return nativeToBoolean(leftVal != rightVal);
-
-    return raiseError(format("unknown operator: ", left.getType(), " ", oprator, " ", right.getType()));
+template <Opcode op, ObjectType ltype, ObjectType rtype>
+Object Evaluator::infix(std::string_view oprator, const Object& left, const Object& right){
+    if constexpr(ltype == ObjectType::NUMBER && rtype == ObjectType::NUMBER){
+        auto leftVal = *any_cast<double>(&left.value);
+        auto rightVal = *any_cast<double>(&right.value);
+        if constexpr(op == Opcode::ADD)
+            return Object{ObjectType::NUMBER, (leftVal + rightVal)};
+        else if constexpr(op == Opcode::SUB)
+            return Object{ObjectType::NUMBER, (leftVal - rightVal)};
+        else if constexpr(op == Opcode::MUL)
+            return Object{ObjectType::NUMBER, (leftVal * rightVal)};
+        else if constexpr(op == Opcode::DIV)
+            return Object{ObjectType::NUMBER, (leftVal / rightVal)};
+        else if constexpr(op == Opcode::GREATER)
+            return nativeToBoolean(leftVal > rightVal);
+        else if constexpr(op == Opcode::LESS)
+            return nativeToBoolean(leftVal < rightVal);
+        else if constexpr(op == Opcode::EQUAL)
+            return nativeToBoolean(leftVal == rightVal);
+        else
+            return nativeToBoolean(leftVal != rightVal);
+    } else if constexpr(ltype == ObjectType::STRING && rtype == ObjectType::STRING){
+        if constexpr(op == Opcode::ADD)
+            return Object{ObjectType::STRING, *any_cast<string>(&left.value) + *any_cast<string>(&right.value)};
+        else
+            return raiseError(format("unknown operator: ", left.getType(), " ", oprator, " ", right.getType()));
+    } else if constexpr(ltype == ObjectType::BOOLEAN && rtype == ObjectType::BOOLEAN
+            && (op == Opcode::EQUAL || op == Opcode::NOT_EQUAL)){
+        bool equal = *any_cast<bool>(&left.value) == *any_cast<bool>(&right.value);
+        return nativeToBoolean(op == Opcode::EQUAL ? equal : !equal);
+    } else {
+        return mixedInfix<op>(oprator, left, right);
+    }
 }
 
-Object Evaluator::evalStringInfixExpression(std::string oprator, Object left, Object right) {
-    if(oprator != "+")
+// everything but two numbers, two strings or two booleans compared
+template <Opcode op>
+Object Evaluator::mixedInfix(std::string_view oprator, const Object& left, const Object& right){
+    if constexpr(op == Opcode::EQUAL)
+        return FALSE_OBJ;
+    else if constexpr(op == Opcode::NOT_EQUAL)
+        return TRUE_OBJ;
+    else if(left.type != right.type)
+        return raiseError(format("type mismatch: ", left.getType(), " ", oprator, " ", right.getType()));
+    else
         return raiseError(format("unknown operator: ", left.getType(), " ", oprator, " ", right.getType()));
-    
-    auto leftStr = any_cast<string>(left.value);
-    auto rightStr = any_cast<string>(right.value);
-    return Object{ObjectType::STRING, (leftStr + rightStr)};
 }
 
-Object Evaluator::evalIndexExpression(Object left, Object idx){
+constexpr array<Evaluator::PrefixFn, PREFIX_OPCODE_COUNT * OBJECT_TYPE_COUNT> Evaluator::prefixFuncs = [](){
+    array<PrefixFn, PREFIX_OPCODE_COUNT * OBJECT_TYPE_COUNT> table{};
+    forEachIndex(make_index_sequence<OBJECT_TYPE_COUNT>{}, [&](auto t){
+        constexpr auto type = static_cast<ObjectType>(decltype(t)::value);
+        table[prefixIdx(Opcode::NOT, type)] = &Evaluator::prefix<Opcode::NOT, type>;
+        table[prefixIdx(Opcode::NEGATE, type)] = &Evaluator::prefix<Opcode::NEGATE, type>;
+    });
+    return table;
+}();
+
+constexpr array<Evaluator::InfixFn, INFIX_OPCODE_COUNT * OBJECT_TYPE_COUNT * OBJECT_TYPE_COUNT> Evaluator::infixFuncs = [](){
+    array<InfixFn, INFIX_OPCODE_COUNT * OBJECT_TYPE_COUNT * OBJECT_TYPE_COUNT> table{};
+    forEachIndex(make_index_sequence<INFIX_OPCODE_COUNT>{}, [&](auto o){
+        constexpr auto op = static_cast<Opcode>(decltype(o)::value);
+        for(size_t l = 0; l < OBJECT_TYPE_COUNT; ++l)
+            for(size_t r = 0; r < OBJECT_TYPE_COUNT; ++r)
+                table[infixIdx(op, static_cast<ObjectType>(l), static_cast<ObjectType>(r))] = &Evaluator::mixedInfix<op>;
+
+        // only these operand pairs have operators of their own
+        constexpr ObjectType typed[] = {ObjectType::NUMBER, ObjectType::STRING, ObjectType::BOOLEAN};
+        forEachIndex(make_index_sequence<3 * 3>{}, [&](auto pair){
+            constexpr auto ltype = typed[decltype(pair)::value / 3];
+            constexpr auto rtype = typed[decltype(pair)::value % 3];
+            table[infixIdx(op, ltype, rtype)] = &Evaluator::infix<op, ltype, rtype>;
+        });
+    });
+    return table;
+}();
+
+Object Evaluator::evalIndexExpression(const Object& left, const Object& idx){
     if(left.type == ObjectType::ARRAY && idx.type == ObjectType::NUMBER){
         auto arrayObj = any_cast<vector<Object>>(left.value);
         auto  i = (int) any_cast<double>(idx.value);
@@ -422,36 +665,186 @@ Object Evaluator::evalIndexExpression(Object left, Object idx){
     return raiseError(format("index operator not supported: ", left.getType()));
 }
 
-Object Evaluator::applyFunction(Object func, std::vector<Object> args){
+// The call a body ends in, left for the applyFunction running the body
+Object Evaluator::tailCallTo(Object& function, std::vector<Object> args){
+    take(tailCall.function, function);
+    tailCall.args = std::move(args);
+    tailCall.pending = true;
+    return TAIL_CALL_OBJ;
+}
+
+void Evaluator::takeTailCall(Object& function, std::vector<Object>& args){
+    tailCall.pending = false;
+    take(function, tailCall.function);
+    args = std::move(tailCall.args);
+}
+
+// Trampoline: a body ending in a tail call comes back with it in tailCall
+// and the loop makes it, so tail recursion runs in constant stack. Calls of
+// the same closure reuse its frame when nothing captured it.
+Object Evaluator::applyFunction(const Object& func, std::vector<Object> args, std::shared_ptr<Environment> frame){
+    Object callee;
+    auto current = &func;
+    while(true){
+        auto value = applyOnce(*current, args, frame);
+        if(!isTailCall(value))
+            return value;
+        takeTailCall(callee, args);
+        current = &callee;
+    }
+}
+
+Object Evaluator::applyOnce(const Object& func, std::vector<Object>& args, std::shared_ptr<Environment>& frame){
     if(func.type == ObjectType::FUNCTION) {
         // create new env & bind params values
-        auto funcObject = any_cast<FunctionObject>(func.value);
-        auto env = std::make_shared<Environment>(funcObject.env);
-        int i = 0;
-        for(auto param: *funcObject.func->params){
-            env->set(param.value, args[i++]);
+        auto funcObject = any_cast<FunctionObject>(&func.value);
+        auto& fn = *funcObject->func;
+        Object error;
+        if(!prepare(*funcObject, error))
+            return error;
+        bool overflowedHere = false;
+        if(backend == Backend::JIT){
+            if(!fn.jitTried){
+                fn.jitTried = true;
+                if(funcObject->env != nullptr)
+                    fn.native = Jit::compile(fn, *funcObject->env, passes);
+            }
+            // the call the budget ran out in and the calls it makes are all
+            // interpreted, retrying at every level would go quadratic
+            Object result;
+            if(fn.native != nullptr && !nativeOverflowed){
+                if(callNative(*fn.native, *funcObject, args, result))
+                    return result;
+                overflowedHere = nativeOverflowed;
+            }
         }
+        auto env = enter(*funcObject, args, frame);
 
-        auto value = eval(funcObject.func->body, env);
+        auto value = eval(fn.body.get(), env);
+        if(overflowedHere)
+            nativeOverflowed = false;
+        frame = std::move(env);
         if(value.type == ObjectType::RETURN)
-            return any_cast<Object>(value);
+            return any_cast<Object>(value.value);
         return value;
     } 
 
     if(func.type == ObjectType::BUILTIN_FUNCTION){
-        auto funcLamda = any_cast<Object::BuiltInFunction>(func.value);
-        auto t = funcLamda(args);
-        return funcLamda(args);
+        auto funcLamda = any_cast<Object::BuiltInFunction>(&func.value);
+        return (*funcLamda)(std::move(args));
     }
     
     return raiseError(format("not a function ", func.getType()));  
 }
 
+// Parses and resolves a lazily parsed body on the first call
+bool Evaluator::prepare(const FunctionObject& function, Object& error){
+    auto& fn = *function.func;
+    if(fn.isLazy()){
+        auto errors = Parser::parseBody(fn);
+        if(!errors.empty()){
+            error = raiseError(format("parse error in function body: ", errors[0]));
+            return false;
+        }
+        Resolver::resolveBody(fn, function.env.get());
+        passes.run(fn);
+    }
+    return true;
+}
+
+// Frame of a call with the arguments bound in; a frame reused is taken
+// over when it was the same closure's and nothing kept it
+std::shared_ptr<Environment> Evaluator::enter(const FunctionObject& function, std::vector<Object>& args,
+        std::shared_ptr<Environment>& reused){
+    auto& fn = *function.func;
+    checkSignature(fn, args.size(), [&](size_t i){ return args[i].type; });
+    std::shared_ptr<Environment> env;
+    if(reused != nullptr && reused.use_count() == 1 && fn.locals != nullptr
+            && reused->getNames() == fn.locals && reused->getParent() == function.env.get()){
+        env = std::move(reused);
+        env->clear();
+    } else if(fn.locals != nullptr){
+        env = std::make_shared<Environment>(function.env, fn.locals);
+    } else {
+        env = std::make_shared<Environment>(function.env);
+    }
+    auto& params = *fn.params;
+    for(size_t i = 0; i < params.size(); ++i){
+        auto& param = params[i];
+        if(param.depth != 0)
+            env->set(param.symbol, i < args.size() ? args[i] : NIL_OBJ);
+        else if(i < args.size())
+            env->at(param.slot) = std::move(args[i]);
+        else
+            env->at(param.slot) = NIL_OBJ;
+    }
+    return env;
+}
+
+// Runs machine code of a function when the arguments are all numbers, the
+// callees it was compiled against are still bound and its stack suffices,
+// noting when it did not
+bool Evaluator::callNative(const NativeFunction& native, const FunctionObject& function, const std::vector<Object>& args,
+        Object& result){
+    if(args.size() != native.params)
+        return false;
+    std::array<double, 16> small;
+    std::vector<double> large;
+    double* values = small.data();
+    if(args.size() > small.size()){
+        large.resize(args.size());
+        values = large.data();
+    }
+    for(size_t i = 0; i < args.size(); ++i){
+        if(args[i].type != ObjectType::NUMBER)
+            return false;
+        values[i] = *any_cast<double>(&args[i].value);
+    }
+    double value;
+    auto outcome = Jit::call(native, *function.env, values, value);
+    nativeOverflowed = outcome == NativeCall::OVERFLOWED;
+    if(outcome != NativeCall::DONE)
+        return false;
+    result = Object{ObjectType::NUMBER, value};
+    return true;
+}
+
+// Call of the one function a call site has seen, the arguments go
+// straight into the slots of the new frame without a vector in between
+Object Evaluator::callDirect(const FunctionObject& function, const std::vector<std::shared_ptr<ExpressionNode>>& arguments,
+        const std::shared_ptr<Environment>& env){
+    auto& fn = *function.func;
+    auto frame = std::make_shared<Environment>(function.env, fn.locals);
+    auto& params = *fn.params;
+    for(size_t i = 0; i < arguments.size(); ++i){
+        auto value = eval(arguments[i].get(), env);
+        if(value.type == ObjectType::ERROR)
+            return value;
+        if(i < params.size())
+            frame->at(params[i].slot) = std::move(value);
+    }
+    for(size_t i = arguments.size(); i < params.size(); ++i)
+        frame->at(params[i].slot) = NIL_OBJ;
+    // a signature has a type per parameter, those given are in their slots
+    checkSignature(fn, arguments.size(), [&](size_t i){ return frame->at(params[i].slot).type; });
+
+    auto value = eval(fn.body.get(), frame);
+    if(value.type == ObjectType::RETURN)
+        value = any_cast<Object>(value.value);
+    if(isTailCall(value)){
+        Object callee;
+        std::vector<Object> args;
+        takeTailCall(callee, args);
+        return applyFunction(callee, std::move(args), std::move(frame));
+    }
+    return value;
+}
+
 Object Evaluator::raiseError(std::string msg) {
     return Object{ObjectType::ERROR, msg};
 }
 
-bool Evaluator::isTruthy(Object obj){
+bool Evaluator::isTruthy(const Object& obj){
     if(obj.type == ObjectType::NIL)
         return false;
 
@@ -3,46 +3,122 @@
 
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
+#include <array>
 #include <any>
 
 #include "ast.hpp"
 #include "object.hpp"
 #include "environment.hpp"
+#include "optimizer.hpp"
+
+class VirtualMachine;
+class StackMachine;
+class FunctionObject;
+struct NativeFunction;
+
+// What runs the program: the tree-walker below, the ClosureCompiler's
+// callables or the Compiler and VirtualMachine. All give the same results
+// and errors, deep recursion aside.
+enum class Backend {
+    TREE,
+    CLOSURES,
+    BYTECODE,
+    JIT, // the tree-walker, running numeric functions as machine code
+    STACK, // the tree-walker's nodes on the StackMachine's heap stacks
+};
 
 class Evaluator {
+    // compiled code reuses the operator tables, builtins and passes
+    friend class ClosureCompiler;
+    friend class Runtime;
+    friend class StackMachine;
+
 public:
-    Evaluator(std::shared_ptr<Program>);
-    virtual ~Evaluator() = default;
-    Object execute(std::shared_ptr<Environment> env){ return eval(this->program, env); }
+    // With optimization on, programs and lazily parsed function bodies go
+    // through the standard passes before they run
+    Evaluator(std::shared_ptr<Program>, Optimization = Optimization::ON, Backend = Backend::TREE);
+    virtual ~Evaluator();
+    Object execute(std::shared_ptr<Environment>);
+    // Runs one more part of a program fed in pieces, a top-level return
+    // comes back as a RETURN object so the caller knows to stop
+    Object step(std::shared_ptr<Program>, std::shared_ptr<Environment>);
+    // Value of an expression that reads no names, for the optimizer
+    Object evalConstant(AstNode*);
+    // calls nested deeper end in a stack overflow error, STACK backend only
+    void setMaxDepth(size_t);
     
 private:
     const Object NIL_OBJ = Object{ObjectType::NIL, 0.0};
     const Object TRUE_OBJ = Object{ObjectType::BOOLEAN, true};
     const Object FALSE_OBJ = Object{ObjectType::BOOLEAN, false};
+    // what a call in tail position evaluates to, the call itself is left
+    // in tailCall for applyFunction to run in place of the caller's
+    const Object TAIL_CALL_OBJ = Object{ObjectType::UNDEFINED, 0.0};
+
+    struct TailCall {
+        Object function;
+        std::vector<Object> args;
+        bool pending = false;
+    };
 
     std::shared_ptr<Program> program;
-    std::unordered_map<std::string, Object> builtins;
-
-    Object eval(std::shared_ptr<AstNode>, std::shared_ptr<Environment>);
-    Object evalProgram(std::vector<std::shared_ptr<StatementNode>>, std::shared_ptr<Environment>);
-    Object evalBlockStatement(std::vector<std::shared_ptr<StatementNode>>, std::shared_ptr<Environment>);
-    Object evalPrefixExpression(std::string, Object);
-    Object evalInfixExpression(std::string, Object, Object);
-    Object evalIfExpression(std::shared_ptr<IfExpression>, std::shared_ptr<Environment>);
-    std::vector<Object> evalExpressions(std::shared_ptr<std::vector<std::shared_ptr<ExpressionNode>>>, 
-        std::shared_ptr<Environment>);
-
-    Object evalBangOperatorExpression(Object);
+    PassManager passes;
+    Backend backend;
+    bool specialize; // nodes adapt to the types they see, off when not optimizing
+    std::unique_ptr<VirtualMachine> vm; // null unless the backend is BYTECODE
+    std::unique_ptr<StackMachine> machine; // null unless the backend is STACK
+    TailCall tailCall;
+    bool nativeOverflowed = false; // machine code is skipped until that call returns
+
+    // nodes and environments are borrowed for the duration of the call,
+    // dispatch is a switch on the node kind
+    Object eval(AstNode*, const std::shared_ptr<Environment>&);
+    Object evalProgram(const std::vector<std::shared_ptr<StatementNode>>&, const std::shared_ptr<Environment>&);
+    Object evalBlockStatement(const std::vector<std::shared_ptr<StatementNode>>&, const std::shared_ptr<Environment>&);
+    Object evalPrefixExpression(PrefixExpression*, const Object&);
+    Object evalInfixExpression(InfixExpression*, const Object&, const Object&);
+    Object evalIndexExpression(IndexExpression*, const Object&, const Object&);
+    Object evalPrefixExpression(Opcode, std::string_view, const Object&);
+    Object evalInfixExpression(Opcode, std::string_view, const Object&, const Object&);
+    Object evalNumericInfix(Opcode, double, double);
+    Object evalIfExpression(IfExpression*, const std::shared_ptr<Environment>&);
+    std::vector<Object> evalExpressions(const std::vector<std::shared_ptr<ExpressionNode>>&, 
+        const std::shared_ptr<Environment>&);
+
     Object nativeToBoolean(bool);
-    Object evalMinusOperatorExpression(Object);
-    Object evalIntegerInfixExpression(std::string, Object, Object);
-    Object evalStringInfixExpression(std::string, Object, Object);
-    Object evalIndexExpression(Object, Object);
-    Object applyFunction(Object, std::vector<Object>);
-    Object raiseError(std::string);
-    bool isTruthy(Object);
+
+    // Operator tables indexed by opcode and operand types, built at compile
+    // time from the templates below. The operator text is only used for
+    // error messages.
+    using PrefixFn = Object (Evaluator::*)(std::string_view, const Object&);
+    using InfixFn = Object (Evaluator::*)(std::string_view, const Object&, const Object&);
+    static const std::array<PrefixFn, PREFIX_OPCODE_COUNT * OBJECT_TYPE_COUNT> prefixFuncs;
+    static const std::array<InfixFn, INFIX_OPCODE_COUNT * OBJECT_TYPE_COUNT * OBJECT_TYPE_COUNT> infixFuncs;
+
+    template <Opcode, ObjectType>
+    Object prefix(std::string_view, const Object&);
+    template <Opcode, ObjectType, ObjectType>
+    Object infix(std::string_view, const Object&, const Object&);
+    template <Opcode>
+    Object mixedInfix(std::string_view, const Object&, const Object&);
+    Object evalIndexExpression(const Object&, const Object&);
+    // frame is one of a finished call a tail call may run in again
+    Object applyFunction(const Object&, std::vector<Object>, std::shared_ptr<Environment> frame = nullptr);
+    Object applyOnce(const Object&, std::vector<Object>&, std::shared_ptr<Environment>&);
+    bool isTailCall(const Object& obj) const { return tailCall.pending && obj.type == ObjectType::UNDEFINED; }
+    Object tailCallTo(Object&, std::vector<Object>);
+    void takeTailCall(Object&, std::vector<Object>&);
+    bool prepare(const FunctionObject&, Object&);
+    std::shared_ptr<Environment> enter(const FunctionObject&, std::vector<Object>&, std::shared_ptr<Environment>&);
+    Object callDirect(const FunctionObject&, const std::vector<std::shared_ptr<ExpressionNode>>&,
+        const std::shared_ptr<Environment>&);
+    bool callNative(const NativeFunction&, const FunctionObject&, const std::vector<Object>&, Object&);
+    static Object raiseError(std::string);
+    static const std::unordered_map<Symbol, Object>& builtinTable();
+    bool isTruthy(const Object&);
     
     
 };
@@ -7,9 +7,13 @@
 #include "ast.hpp"
 #include "environment.hpp"
 #include "fobject.hpp"
+#include "bytecode.hpp"
 
 FunctionObject::FunctionObject(std::shared_ptr<FunctionLiteral> fn, std::shared_ptr<Environment> env):
     func{fn}, env{env} {
         
     };
-    
\ No newline at end of file
+    
+FunctionObject::FunctionObject(std::shared_ptr<FunctionLiteral> fn, std::shared_ptr<const Closure> closure):
+    func{fn}, env{}, closure{closure} {
+}
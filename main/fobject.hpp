@@ -5,14 +5,18 @@
 
 class Environment;
 class FunctionLiteral;
+struct Closure;
 
 class FunctionObject {
 public:
     FunctionObject(std::shared_ptr<FunctionLiteral>, std::shared_ptr<Environment>);
+    FunctionObject(std::shared_ptr<FunctionLiteral>, std::shared_ptr<const Closure>);
     virtual ~FunctionObject() = default;
 
     std::shared_ptr<FunctionLiteral> func;
     std::shared_ptr<Environment> env;
+    // what the virtual machine runs, null for functions of the tree-walker
+    std::shared_ptr<const Closure> closure;
 };
 
 
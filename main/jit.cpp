@@ -0,0 +1,532 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <any>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include "object.hpp"
+#include "fobject.hpp"
+#include "environment.hpp"
+#include "resolver.hpp"
+#include "optimizer.hpp"
+#include "jit.hpp"
+
+using namespace std;
+
+#if defined(__x86_64__) && defined(__linux__)
+
+NativeCode::NativeCode(): pages{nullptr}, size{0}, context{} {}
+
+NativeCode::~NativeCode(){
+    if(pages != nullptr)
+        munmap(pages, size);
+}
+
+namespace {
+
+// Machine code being built, with the few instruction forms the templates use
+class Assembler {
+public:
+    vector<uint8_t> code;
+
+    void emit(initializer_list<uint8_t> bytes){ code.insert(code.end(), bytes); }
+    void imm32(int32_t value){ bytes(&value, 4); }
+    void imm64(uint64_t value){ bytes(&value, 8); }
+    // rel32 left to patch, returns where it is
+    size_t rel32(){
+        imm32(0);
+        return code.size() - 4;
+    }
+    void patch(size_t at, size_t target){
+        int32_t offset = static_cast<int32_t>(target) - static_cast<int32_t>(at + 4);
+        memcpy(&code[at], &offset, 4);
+    }
+
+    void loadConstant(double value, int xmm){
+        uint64_t bits;
+        memcpy(&bits, &value, 8);
+        emit({0x48, 0xB8}); imm64(bits); // mov rax, bits
+        emit({0x66, 0x48, 0x0F, 0x6E, static_cast<uint8_t>(xmm == 0 ? 0xC0 : 0xC8)}); // movq xmm, rax
+    }
+    void loadArgument(size_t slot, int xmm){
+        emit({0xF2, 0x0F, 0x10, static_cast<uint8_t>(xmm == 0 ? 0x83 : 0x8B)}); // movsd xmm, [rbx + disp]
+        imm32(static_cast<int32_t>(8 * slot));
+    }
+    void storeArgument(size_t slot){
+        emit({0xF2, 0x0F, 0x11, 0x83}); // movsd [rbx + disp], xmm0
+        imm32(static_cast<int32_t>(8 * slot));
+    }
+    void loadFrame(int32_t disp, int xmm){
+        emit({0xF2, 0x0F, 0x10, static_cast<uint8_t>(xmm == 0 ? 0x85 : 0x8D)}); // movsd xmm, [rbp + disp]
+        imm32(disp);
+    }
+    void storeFrame(int32_t disp){
+        emit({0xF2, 0x0F, 0x11, 0x85}); // movsd [rbp + disp], xmm0
+        imm32(disp);
+    }
+    void epilogue(){
+        emit({0x48, 0x8D, 0x65, 0xF8}); // lea rsp, [rbp - 8]
+        emit({0x5B, 0x5D, 0xC3}); // pop rbx; pop rbp; ret
+    }
+
+private:
+    void bytes(const void* data, size_t size){
+        auto begin = static_cast<const uint8_t*>(data);
+        code.insert(code.end(), begin, begin + size);
+    }
+};
+
+// frame slot of an intermediate value at a nesting level, below saved rbx
+int32_t temporary(size_t level){
+    return -16 - 8 * static_cast<int32_t>(level + 1);
+}
+
+// The code of a unit: a trampoline and a stack overflow exit shared by
+// every function in it, then the functions, each calling the others with
+// a near call. A function gets the address of its arguments in rdi and
+// keeps it in rbx, values go through xmm0 with xmm1 as the right operand.
+// Intermediate values and the arguments of calls are kept in the frame
+// below rbp, one slot per level of nesting.
+class UnitCompiler {
+public:
+    UnitCompiler(const Environment& env, PassManager& passes, NativeCode::Context* context):
+        env{env}, passes{passes}, context{context} {};
+
+    bool compile(FunctionLiteral&, const Environment*);
+    const vector<uint8_t>& code() const { return as.code; }
+    size_t entry() const { return entries[0]; }
+    vector<pair<Symbol, weak_ptr<const FunctionLiteral>>> takeCallees(){ return std::move(callees); }
+
+private:
+    const Environment& env;
+    PassManager& passes;
+    NativeCode::Context* context;
+    Assembler as;
+    vector<FunctionLiteral*> functions; // in the unit, the one compiled first
+    unordered_map<const FunctionLiteral*, size_t> indices;
+    vector<size_t> entries; // offset of each function
+    vector<pair<size_t, size_t>> calls; // rel32 to patch, callee index
+    vector<pair<Symbol, weak_ptr<const FunctionLiteral>>> callees;
+    size_t overflow = 0; // offset of the overflow exit
+    FunctionLiteral* current = nullptr;
+    size_t deepest = 0; // nesting levels the current function uses
+
+    bool prepare(FunctionLiteral&, const Environment*);
+    bool function(FunctionLiteral&);
+    bool block(BlockStatement*, size_t, bool);
+    bool statement(StatementNode*, size_t, bool);
+    bool expression(AstNode*, size_t, bool);
+    bool condition(AstNode*, size_t, vector<size_t>&);
+    bool operands(InfixExpression*, size_t);
+    bool simple(AstNode*, int);
+    bool call(CallExpression*, size_t);
+    void use(size_t levels){ deepest = max(deepest, levels); }
+    bool parameter(AstNode*) const;
+};
+
+bool UnitCompiler::prepare(FunctionLiteral& fn, const Environment* closure){
+    if(fn.isLazy()){
+        if(!Parser::parseBody(fn).empty())
+            return false;
+        Resolver::resolveBody(fn, closure);
+        passes.run(fn);
+    }
+    if(fn.body == nullptr || fn.locals == nullptr || fn.params == nullptr)
+        return false;
+    // arguments are read by slot, a repeated name would read the wrong one
+    auto& params = *fn.params;
+    for(size_t i = 0; i < params.size(); ++i)
+        if(params[i].depth != 0 || params[i].slot != i)
+            return false;
+    return true;
+}
+
+bool UnitCompiler::parameter(AstNode* node) const {
+    if(node->kind != NodeKind::IDENTIFIER)
+        return false;
+    auto identifier = static_cast<Identifier*>(node);
+    return identifier->depth == 0 && identifier->slot < current->params->size();
+}
+
+// operand loaded into xmm0 or xmm1 without using the frame
+bool UnitCompiler::simple(AstNode* node, int xmm){
+    if(node->kind == NodeKind::NUMBER){
+        as.loadConstant(static_cast<NumberLiteral*>(node)->value, xmm);
+        return true;
+    }
+    if(node->kind == NodeKind::CONSTANT && static_cast<Constant*>(node)->value.type == ObjectType::NUMBER){
+        as.loadConstant(*any_cast<double>(&static_cast<Constant*>(node)->value.value), xmm);
+        return true;
+    }
+    if(parameter(node)){
+        as.loadArgument(static_cast<Identifier*>(node)->slot, xmm);
+        return true;
+    }
+    return false;
+}
+
+// left operand into xmm0, right into xmm1
+bool UnitCompiler::operands(InfixExpression* infix, size_t level){
+    if(!expression(infix->left.get(), level, true))
+        return false;
+    if(simple(infix->right.get(), 1))
+        return true;
+    use(level + 1);
+    as.storeFrame(temporary(level));
+    if(!expression(infix->right.get(), level + 1, true))
+        return false;
+    as.emit({0xF2, 0x0F, 0x10, 0xC8}); // movsd xmm1, xmm0
+    as.loadFrame(temporary(level), 0);
+    return true;
+}
+
+// jumps to the rel32s added to falses when the condition does not hold
+bool UnitCompiler::condition(AstNode* node, size_t level, vector<size_t>& falses){
+    if(node->kind == NodeKind::BOOLEAN || (node->kind == NodeKind::CONSTANT &&
+            static_cast<Constant*>(node)->value.type == ObjectType::BOOLEAN)){
+        bool value = node->kind == NodeKind::BOOLEAN ? static_cast<BooleanLiteral*>(node)->value :
+            *any_cast<bool>(&static_cast<Constant*>(node)->value.value);
+        if(!value){
+            as.emit({0xE9}); // jmp
+            falses.push_back(as.rel32());
+        }
+        return true;
+    }
+    if(node->kind != NodeKind::INFIX)
+        return false;
+    auto infix = static_cast<InfixExpression*>(node);
+    // ucomisd leaves CF and ZF set for unordered operands, a NaN compares
+    // false as it does in the interpreter
+    switch(infix->opcode){
+    case Opcode::GREATER:
+        if(!operands(infix, level))
+            return false;
+        as.emit({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+        as.emit({0x0F, 0x86}); // jbe
+        falses.push_back(as.rel32());
+        return true;
+    case Opcode::LESS:
+        if(!operands(infix, level))
+            return false;
+        as.emit({0x66, 0x0F, 0x2E, 0xC8}); // ucomisd xmm1, xmm0
+        as.emit({0x0F, 0x86}); // jbe
+        falses.push_back(as.rel32());
+        return true;
+    case Opcode::EQUAL:
+        if(!operands(infix, level))
+            return false;
+        as.emit({0x66, 0x0F, 0x2E, 0xC1});
+        as.emit({0x0F, 0x85}); // jne
+        falses.push_back(as.rel32());
+        as.emit({0x0F, 0x8A}); // jp
+        falses.push_back(as.rel32());
+        return true;
+    case Opcode::NOT_EQUAL: {
+        if(!operands(infix, level))
+            return false;
+        as.emit({0x66, 0x0F, 0x2E, 0xC1});
+        as.emit({0x0F, 0x8A}); // jp, unordered is not equal
+        auto holds = as.rel32();
+        as.emit({0x0F, 0x84}); // je
+        falses.push_back(as.rel32());
+        as.patch(holds, as.code.size());
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool UnitCompiler::call(CallExpression* callExpr, size_t level){
+    if(callExpr->function->kind != NodeKind::IDENTIFIER)
+        return false;
+    auto name = static_cast<Identifier*>(callExpr->function.get());
+    if(name->depth != Identifier::GLOBAL)
+        return false;
+    auto bound = env.findGlobal(name->symbol);
+    if(bound == nullptr || bound->type != ObjectType::FUNCTION)
+        return false;
+    auto funcObject = any_cast<FunctionObject>(&bound->value);
+    auto callee = funcObject->func.get();
+    if(callee == nullptr || !prepare(*callee, funcObject->env.get()))
+        return false;
+    auto& arguments = *callExpr->arguments;
+    if(arguments.size() != callee->params->size())
+        return false;
+
+    size_t index;
+    auto found = indices.find(callee);
+    if(found != indices.end()){
+        index = found->second;
+    } else {
+        index = functions.size();
+        indices[callee] = index;
+        functions.push_back(callee);
+    }
+    auto seen = [&](auto& entry){ return entry.first == name->symbol && entry.second.lock().get() == callee; };
+    if(none_of(callees.begin(), callees.end(), seen))
+        callees.emplace_back(name->symbol, funcObject->func);
+
+    // the arguments take the next levels, lowest address first
+    size_t count = arguments.size();
+    use(level + count);
+    int32_t base = -16 - 8 * static_cast<int32_t>(level + count);
+    for(size_t i = 0; i < count; ++i){
+        if(!expression(arguments[i].get(), level + count, true))
+            return false;
+        as.storeFrame(base + 8 * static_cast<int32_t>(i));
+    }
+    // a tail call with room for its arguments where ours are leaves our
+    // frame first, the callee returns to our caller
+    if(callExpr->tail && count <= current->params->size()){
+        for(size_t i = 0; i < count; ++i){
+            as.loadFrame(base + 8 * static_cast<int32_t>(i), 0);
+            as.storeArgument(i);
+        }
+        as.emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+        as.emit({0x48, 0x8D, 0x65, 0xF8, 0x5B, 0x5D}); // lea rsp, [rbp - 8]; pop rbx; pop rbp
+        as.emit({0xE9}); // jmp
+        calls.emplace_back(as.rel32(), index);
+        return true;
+    }
+    as.emit({0x48, 0x8D, 0xBD}); // lea rdi, [rbp + base]
+    as.imm32(base);
+    as.emit({0xE8}); // call
+    calls.emplace_back(as.rel32(), index);
+    return true;
+}
+
+// value into xmm0, unless not needed and the node leaves none (an if
+// without else)
+bool UnitCompiler::expression(AstNode* node, size_t level, bool needed){
+    if(simple(node, 0))
+        return true;
+
+    switch(node->kind){
+    case NodeKind::PREFIX: {
+        auto prefix = static_cast<PrefixExpression*>(node);
+        if(prefix->opcode != Opcode::NEGATE || !expression(prefix->right.get(), level, true))
+            return false;
+        as.loadConstant(-0.0, 1);
+        as.emit({0x66, 0x0F, 0x57, 0xC1}); // xorpd xmm0, xmm1
+        return true;
+    }
+
+    case NodeKind::INFIX: {
+        auto infix = static_cast<InfixExpression*>(node);
+        uint8_t op;
+        switch(infix->opcode){
+        case Opcode::ADD: op = 0x58; break;
+        case Opcode::SUB: op = 0x5C; break;
+        case Opcode::MUL: op = 0x59; break;
+        case Opcode::DIV: op = 0x5E; break;
+        // comparisons only make conditions, booleans are not values here
+        default: return false;
+        }
+        if(!operands(infix, level))
+            return false;
+        as.emit({0xF2, 0x0F, op, 0xC1}); // op xmm0, xmm1
+        return true;
+    }
+
+    case NodeKind::IF: {
+        auto ifExpr = static_cast<IfExpression*>(node);
+        if(needed && ifExpr->alternative == nullptr)
+            return false;
+        vector<size_t> falses;
+        if(!condition(ifExpr->condition.get(), level, falses) || !block(ifExpr->consequence.get(), level, needed))
+            return false;
+        if(ifExpr->alternative == nullptr){
+            for(auto at: falses)
+                as.patch(at, as.code.size());
+            return true;
+        }
+        as.emit({0xE9}); // jmp
+        auto end = as.rel32();
+        for(auto at: falses)
+            as.patch(at, as.code.size());
+        if(!block(ifExpr->alternative.get(), level, needed))
+            return false;
+        as.patch(end, as.code.size());
+        return true;
+    }
+
+    case NodeKind::CALL:
+        return call(static_cast<CallExpression*>(node), level);
+
+    // the copied body reads slots past the parameters, the call is kept
+    case NodeKind::INLINE:
+        return call(static_cast<InlineCall*>(node)->call.get(), level);
+
+    default:
+        return false;
+    }
+}
+
+bool UnitCompiler::statement(StatementNode* node, size_t level, bool needed){
+    switch(node->kind){
+    case NodeKind::EXPRESSION_STATEMENT:
+        return expression(static_cast<ExpressionStatement*>(node)->expression.get(), level, needed);
+    case NodeKind::RETURN: {
+        auto value = static_cast<ReturnStatement*>(node)->value.get();
+        if(value == nullptr || !expression(value, level, true))
+            return false;
+        as.epilogue();
+        return true;
+    }
+    case NodeKind::BLOCK:
+        return block(static_cast<BlockStatement*>(node), level, needed);
+    default:
+        return false;
+    }
+}
+
+bool UnitCompiler::block(BlockStatement* node, size_t level, bool needed){
+    auto& statements = node->statements;
+    if(statements.empty())
+        return !needed;
+    for(size_t i = 0; i < statements.size(); ++i)
+        if(!statement(statements[i].get(), level, needed && i + 1 == statements.size()))
+            return false;
+    return true;
+}
+
+bool UnitCompiler::function(FunctionLiteral& fn){
+    current = &fn;
+    deepest = 0;
+    entries.push_back(as.code.size());
+    // push rbp; mov rbp, rsp; push rbx; sub rsp, frame
+    as.emit({0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x81, 0xEC});
+    auto frame = as.code.size();
+    as.imm32(0);
+    // mov rax, &context->limit; cmp rsp, [rax]; jb overflow
+    as.emit({0x48, 0xB8});
+    as.imm64(reinterpret_cast<uint64_t>(&context->limit));
+    as.emit({0x48, 0x3B, 0x20, 0x0F, 0x82});
+    as.patch(as.rel32(), overflow);
+    as.emit({0x48, 0x89, 0xFB}); // mov rbx, rdi
+
+    if(!block(fn.body.get(), 0, true))
+        return false;
+    as.epilogue();
+
+    // saved rbx and the levels, keeping rsp 16 byte aligned at calls
+    int32_t size = 8 * static_cast<int32_t>(deepest + 1);
+    if(size % 16 == 0)
+        size += 8;
+    memcpy(&as.code[frame], &size, 4);
+    return true;
+}
+
+bool UnitCompiler::compile(FunctionLiteral& root, const Environment* closure){
+    if(!prepare(root, closure))
+        return false;
+
+    // trampoline(arguments, entry): saves the stack for the overflow exit
+    as.emit({0x55, 0x53, 0x48, 0xB8}); // push rbp; push rbx; mov rax, context
+    as.imm64(reinterpret_cast<uint64_t>(context));
+    as.emit({0x48, 0x89, 0x60, offsetof(NativeCode::Context, stack)}); // mov [rax + stack], rsp
+    as.emit({0x48, 0x83, 0xEC, 0x08, 0xFF, 0xD6, 0x48, 0x83, 0xC4, 0x08}); // sub rsp, 8; call rsi; add rsp, 8
+    as.emit({0x5B, 0x5D, 0xC3});
+    // overflow exit: back to the trampoline's frame, flagged
+    overflow = as.code.size();
+    as.emit({0x48, 0xB8});
+    as.imm64(reinterpret_cast<uint64_t>(context));
+    as.emit({0x48, 0x8B, 0x60, offsetof(NativeCode::Context, stack)}); // mov rsp, [rax + stack]
+    as.emit({0xC6, 0x40, offsetof(NativeCode::Context, overflowed), 0x01}); // mov byte [rax + overflowed], 1
+    as.emit({0x5B, 0x5D, 0xC3});
+
+    indices[&root] = 0;
+    functions.push_back(&root);
+    // callees are appended as calls to them are found
+    for(size_t i = 0; i < functions.size(); ++i)
+        if(!function(*functions[i]))
+            return false;
+    for(auto& [at, index]: calls)
+        as.patch(at, entries[index]);
+    return true;
+}
+
+} // namespace
+
+bool Jit::available(){
+    return true;
+}
+
+shared_ptr<const NativeFunction> Jit::compile(FunctionLiteral& fn, const Environment& env, PassManager& passes){
+    auto code = make_shared<NativeCode>();
+    UnitCompiler unit{env, passes, &code->context};
+    if(!unit.compile(fn, &env))
+        return nullptr;
+
+    auto& bytes = unit.code();
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (bytes.size() + page - 1) / page * page;
+    void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pages == MAP_FAILED)
+        return nullptr;
+    memcpy(pages, bytes.data(), bytes.size());
+    // never writable and executable at once
+    if(mprotect(pages, size, PROT_READ | PROT_EXEC) != 0){
+        munmap(pages, size);
+        return nullptr;
+    }
+    code->pages = static_cast<uint8_t*>(pages);
+    code->size = size;
+
+    auto native = make_shared<NativeFunction>();
+    native->code = code;
+    native->trampoline = code->pages;
+    native->entry = code->pages + unit.entry();
+    native->params = fn.params->size();
+    native->callees = unit.takeCallees();
+    return native;
+}
+
+NativeCall Jit::call(const NativeFunction& native, const Environment& env, const double* args, double& result){
+    for(auto& [symbol, literal]: native.callees){
+        auto bound = env.findGlobal(symbol);
+        if(bound == nullptr || bound->type != ObjectType::FUNCTION)
+            return NativeCall::REBOUND;
+        auto held = literal.lock();
+        if(held == nullptr || any_cast<FunctionObject>(&bound->value)->func.get() != held.get())
+            return NativeCall::REBOUND;
+    }
+    auto& context = native.code->context;
+    context.limit = reinterpret_cast<uint64_t>(__builtin_frame_address(0)) - STACK_BUDGET;
+    context.overflowed = 0;
+    using Trampoline = double (*)(const double*, const uint8_t*);
+    result = reinterpret_cast<Trampoline>(native.trampoline)(args, native.entry);
+    return context.overflowed == 0 ? NativeCall::DONE : NativeCall::OVERFLOWED;
+}
+
+#else
+
+NativeCode::NativeCode(): pages{nullptr}, size{0}, context{} {}
+
+NativeCode::~NativeCode(){}
+
+bool Jit::available(){
+    return false;
+}
+
+shared_ptr<const NativeFunction> Jit::compile(FunctionLiteral&, const Environment&, PassManager&){
+    return nullptr;
+}
+
+NativeCall Jit::call(const NativeFunction&, const Environment&, const double*, double&){
+    return NativeCall::REBOUND;
+}
+
+#endif
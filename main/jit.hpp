@@ -0,0 +1,75 @@
+#if !defined(JIT_H)
+#define JIT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "symbols.hpp"
+
+class FunctionLiteral;
+class FunctionObject;
+class Environment;
+class PassManager;
+
+// Executable pages holding the machine code of one or more functions,
+// unmapped with the last function using them
+struct NativeCode {
+    // what the code reads and writes while it runs
+    struct Context {
+        uint64_t limit; // lowest stack address a frame may reach
+        uint64_t stack; // of the trampoline, restored on overflow
+        uint8_t overflowed;
+    };
+
+    NativeCode();
+    ~NativeCode();
+    NativeCode(const NativeCode&) = delete;
+    NativeCode& operator=(const NativeCode&) = delete;
+
+    uint8_t* pages;
+    size_t size;
+    Context context;
+};
+
+// Machine code of a function body where every value is a number. It takes
+// the arguments as doubles and calls the numeric functions it calls
+// directly, as bound when it was compiled.
+struct NativeFunction {
+    std::shared_ptr<NativeCode> code;
+    const uint8_t* entry;
+    const uint8_t* trampoline;
+    size_t params;
+    // global names of the functions called, each with the literal it held;
+    // weak, a literal freed since may have its address reused by another
+    std::vector<std::pair<Symbol, std::weak_ptr<const FunctionLiteral>>> callees;
+};
+
+// What came of running machine code, the interpreter makes the call
+// unless it is DONE
+enum class NativeCall {
+    DONE,
+    REBOUND, // a callee is no longer the function compiled against
+    OVERFLOWED, // the stack budget ran out
+};
+
+// Baseline template JIT for x86-64 Linux, SSE2 doubles. Bodies made only of
+// number literals, parameters, arithmetic, comparisons in conditions, ifs,
+// returns and calls to such functions are compiled; anything else leaves
+// the function to the tree-walker.
+class Jit {
+public:
+    // stack the machine code may use below the call into it, past that it
+    // gives up and the interpreter runs the call instead
+    static const size_t STACK_BUDGET = 1 << 20;
+
+    static bool available();
+    // null when the body is not purely numeric; lazily parsed bodies of
+    // the function and its callees are parsed and passed on the way
+    static std::shared_ptr<const NativeFunction> compile(FunctionLiteral&, const Environment&, PassManager&);
+    static NativeCall call(const NativeFunction&, const Environment&, const double*, double&);
+};
+
+#endif // JIT_H
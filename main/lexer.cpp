@@ -1,8 +1,18 @@
 #include <string>
+#include <string_view>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <istream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 
 #include "token.hpp"
+#include "source.hpp"
 #include "lexer.hpp"
+#include "scan.hpp"
 #include "utils.hpp"
 
 #include <iostream>
@@ -10,162 +20,169 @@
 using namespace std;
 
 
-Lexer::Lexer(string src): input{src} {
-    keywords = makeKeywords();
-    pos = 0;
-    rpos = 0;
-    ch = 0;
-    readChar();
+ViewLexer::ViewLexer(string_view src): input{src}, pos{0} {
 }
 
-Lexer::~Lexer(){
+TokenView ViewLexer::nextToken(){
+    const char* begin = input.data();
+    const char* end = begin + input.size();
+    pos = skipWhitespaceRun(begin + pos, end) - begin;
 
-}
+    if(pos >= input.size())
+        return TokenView{TokenType::EOS, input.substr(pos, 0), 0};
+
+    size_t start = pos;
+    char ch = input[pos++];
+    auto single = [&](TokenType type){
+        return TokenView{type, input.substr(start, 1), 0};
+    };
 
-Token Lexer::nextToken(){
-    Token token;
-    skipWhitespace();
     switch (ch){
         case '"':{
-            string str{};
-            do {
-                readChar();
-                if(ch != '"') 
-                   str.push_back(ch);
-            } while (ch != '"');
-            token = makeToken(TokenType::STRING, str); 
-            break;
+            // unterminated strings take the rest of the input
+            size_t close = findQuote(begin + pos, end) - begin;
+            auto str = input.substr(pos, close - pos);
+            pos = close < input.size() ? close + 1 : close;
+            return TokenView{TokenType::STRING, str, 0};
             }
         case '=':
             if(peekChar() == '='){
-                string str{ch};
-                readChar();
-                str.push_back(ch);
-                token = makeToken(TokenType::EQUAL_EQUAL, str);
-            } else {
-                token = makeToken(TokenType::EQUAL, ch);
+                pos++;
+                return TokenView{TokenType::EQUAL_EQUAL, input.substr(start, 2), 0};
             }
-            break;
+            return single(TokenType::EQUAL);
+        case '!':
+            if(peekChar() == '='){
+                pos++;
+                return TokenView{TokenType::BANG_EQUAL, input.substr(start, 2), 0};
+            }
+            return single(TokenType::BANG);
         case '+':
-            token = makeToken(TokenType::PLUS, ch);
-            break;
+            return single(TokenType::PLUS);
         case '-':
-            token = makeToken(TokenType::MINUS, ch);
-            break;
+            return single(TokenType::MINUS);
         case '*':
-            token = makeToken(TokenType::STAR, ch);
-            break;
+            return single(TokenType::STAR);
         case '/':
-            token = makeToken(TokenType::SLASH, ch);
-            break;
-        case '!':
-            if(peekChar() == '='){
-                string str{ch};
-                readChar();
-                str.push_back(ch);
-                token = makeToken(TokenType::BANG_EQUAL, str);
-            } else {
-                token = makeToken(TokenType::BANG, ch);
-            }
-            break;
+            return single(TokenType::SLASH);
         case '<':
-            token = makeToken(TokenType::LESS, ch);
-            break;
+            return single(TokenType::LESS);
         case '>':
-            token = makeToken(TokenType::GREATER, ch);
-            break;
+            return single(TokenType::GREATER);
         case ':':
-            token = makeToken(TokenType::COLON, ch);
-            break;
+            return single(TokenType::COLON);
         case ';':
-            token = makeToken(TokenType::SEMICOLON, ch);
-            break;
+            return single(TokenType::SEMICOLON);
         case ',':
-            token = makeToken(TokenType::COMMA, ch);
-            break;
+            return single(TokenType::COMMA);
         case '(':
-            token = makeToken(TokenType::LEFT_PAREN, ch);
-            break;
+            return single(TokenType::LEFT_PAREN);
         case ')':
-            token = makeToken(TokenType::RIGHT_PAREN, ch);
-            break;
+            return single(TokenType::RIGHT_PAREN);
         case '[':
-            token = makeToken(TokenType::LEFT_BRACKET, ch);
-            break;
+            return single(TokenType::LEFT_BRACKET);
         case ']':
-            token = makeToken(TokenType::RIGHT_BRACKET, ch);
-            break;
+            return single(TokenType::RIGHT_BRACKET);
         case '{':
-            token = makeToken(TokenType::LEFT_BRACE, ch);
-            break;
+            return single(TokenType::LEFT_BRACE);
         case '}':
-            token = makeToken(TokenType::RIGHT_BRACE, ch);
-            break;
+            return single(TokenType::RIGHT_BRACE);
         case 0:
-            token = makeToken(TokenType::EOS, "");
-            break;
+            pos = start;
+            return TokenView{TokenType::EOS, input.substr(start, 0), 0};
         default:
             if(isLetter(ch)){
-                string word = readIdentifier();
-                return makeToken(getTokenType(word), word);
+                pos = skipLetterRun(begin + pos, end) - begin;
+                auto word = input.substr(start, pos - start);
+                return TokenView{lookupKeyword(word), word, 0};
             } else if(isDigit(ch)){
-                return makeToken(TokenType::NUMBER, readNumber());
-            } else {
-                token = makeToken(TokenType::ILLEGAL, "");
+                pos = skipDigitRun(begin + pos, end) - begin;
+                auto digits = input.substr(start, pos - start);
+                return TokenView{TokenType::NUMBER, digits, parseNumber(digits)};
             }
-            break;
+            return single(TokenType::ILLEGAL);
     }
-
-    readChar();
-    return token;
 }
 
+char ViewLexer::peekChar() const {
+    if(pos >= input.size())
+        return 0;
+    return input[pos];
+}
 
-void Lexer::readChar(){
-    if(rpos >= input.length()){
-        ch = 0;
-    } else {
-        ch = input.at(rpos);
-    }
-
-    pos = rpos;
-    rpos++;
+StreamLexer::StreamLexer(istream& in, size_t chunk):
+    buffer(chunk), chunkSize{chunk}, start{0}, filled{0}, eof{false} {
+    read = [&in](char* dst, size_t len) -> ptrdiff_t {
+        in.read(dst, len);
+        if(in.bad())
+            return -1;
+        return in.gcount();
+    };
 }
 
-char Lexer::peekChar(){
-    if(rpos >= input.length())
+StreamLexer::StreamLexer(int fd, size_t chunk):
+    buffer(chunk), chunkSize{chunk}, start{0}, filled{0}, eof{false} {
+    read = [fd](char* dst, size_t len) -> ptrdiff_t {
+#if defined(__unix__) || defined(__APPLE__)
+        while(true){
+            auto n = ::read(fd, dst, len);
+            // a signal before any byte came in is not the end
+            if(n >= 0 || errno != EINTR)
+                return n;
+        }
+#else
         return 0;
-    else 
-        return input.at(rpos);
+#endif
+    };
 }
 
-string Lexer::readIdentifier() {
-    string str;
-    while(isLetter(ch)){
-        str.push_back(ch);
-        readChar();
+TokenView StreamLexer::nextToken(){
+    while(true){
+        ViewLexer lexer{string_view{buffer.data() + start, filled - start}};
+        auto token = lexer.nextToken();
+        size_t end = start + lexer.position();
+        // a token reaching the end of the buffer (or peeking past it)
+        // may continue in the next chunk, read more and scan it again
+        if(end >= filled && !eof){
+            refill();
+            continue;
+        }
+        start = end;
+        return token;
     }
-    return str;
 }
 
-string Lexer::readNumber(){
-    string str;
-    while(isDigit(ch)){
-        str.push_back(ch);
-        readChar();
+void StreamLexer::refill(){
+    // drop consumed bytes and whitespace so only a partial token is kept
+    start = skipWhitespaceRun(buffer.data() + start, buffer.data() + filled) - buffer.data();
+    size_t pending = filled - start;
+    memmove(buffer.data(), buffer.data() + start, pending);
+    start = 0;
+    filled = pending;
+
+    if(buffer.size() - filled < chunkSize)
+        buffer.resize(filled + chunkSize);
+
+    errno = 0;
+    auto n = read(buffer.data() + filled, chunkSize);
+    if(n < 0){
+        error = format("read error: ", errno != 0 ? strerror(errno) : "stream failed");
+        n = 0;
     }
-    return str;
+    filled += n;
+    eof = n == 0;
 }
 
-void Lexer::skipWhitespace(){
-    while(isWhitespace(ch))
-        readChar();
+Lexer::Lexer(string src): Lexer{Source::fromString(std::move(src))} {
 }
 
-TokenType Lexer::getTokenType(string ident){
-    auto it = keywords.find(ident);
-    if(it != keywords.end())
-        return (*it).second; //
-    return TokenType::IDENT;
+Lexer::Lexer(shared_ptr<const Source> src): source{src}, cursor{src->text()} {
 }
 
+Lexer::~Lexer(){
+
+}
+
+Token Lexer::nextToken(){
+    return makeToken(cursor.nextToken());
+}
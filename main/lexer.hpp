@@ -1,34 +1,76 @@
 #if !defined(LEXER_H)
 #define LEXER_H
 
+#include <cstddef>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <istream>
+#include <functional>
 
+class Source;
 class Token;
+struct TokenView;
 enum class TokenType;
 
+// Zero-copy lexer over a caller-owned buffer, tokens are views into it.
+class ViewLexer {
+private:
+    std::string_view input;
+    size_t pos; // current position in input
+
+    char peekChar() const;
+
+public:
+    ViewLexer(std::string_view);
+
+    TokenView nextToken();
+    size_t position() const { return pos; }
+};
+
+// Lexer over a file descriptor or stream read in fixed size chunks, for
+// inputs too big to hold in memory. The buffer only grows past the chunk size
+// for a single token longer than that. Returned views stay valid until the
+// next call to nextToken. A failed read ends the input early with an error.
+class StreamLexer {
+private:
+    // bytes read, 0 at the end of input, -1 when reading failed
+    std::function<std::ptrdiff_t(char*, size_t)> read;
+    std::vector<char> buffer;
+    size_t chunkSize;
+    size_t start; // first unconsumed byte in buffer
+    size_t filled; // end of valid bytes in buffer
+    bool eof;
+    std::string error;
+
+    void refill();
+
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    StreamLexer(std::istream&, size_t = DEFAULT_CHUNK_SIZE);
+    StreamLexer(int, size_t = DEFAULT_CHUNK_SIZE);
+
+    TokenView nextToken();
+    size_t capacity() const { return buffer.size(); }
+    // empty unless reading failed
+    std::string getError() const { return error; }
+};
+
 class Lexer {
 private:
-    std::string input;
-    std::unordered_map<std::string, TokenType> keywords;
-    int pos; // current position in input
-    int rpos; // current reading pos
-    char ch; // current character
-
-    
-    void readChar();
-    char peekChar();
-    std::string readIdentifier();
-    std::string readNumber();
-    void skipWhitespace();
-    TokenType getTokenType(std::string);
-    
+    std::shared_ptr<const Source> source;
+    ViewLexer cursor;
+
 public:
     Lexer(std::string);
+    Lexer(std::shared_ptr<const Source>);
     ~Lexer();
 
-    Token nextToken();    
+    Token nextToken();
+    std::shared_ptr<const Source> getSource() const { return source; }
 };
 
 
-#endif //  LEXER_H
\ No newline at end of file
+#endif //  LEXER_H
@@ -7,10 +7,35 @@ using namespace std;
 
 
 int main(int argc, char const *argv[]){
-	Runner runner;
+	// --no-optimize runs the tree as parsed, --vm compiles it to bytecode,
+	// --closures to a tree of callables, --jit runs numeric functions as
+	// machine code, --stack walks the tree without native recursion,
+	// --no-cache neither reads nor writes the script's .mkc image
+	bool optimize = true;
+	bool cache = true;
+	Backend backend = Backend::TREE;
+	for(; argc > 1; argv++, argc--){
+		if(string(argv[1]) == "--no-optimize")
+			optimize = false;
+		else if(string(argv[1]) == "--vm")
+			backend = Backend::BYTECODE;
+		else if(string(argv[1]) == "--closures")
+			backend = Backend::CLOSURES;
+		else if(string(argv[1]) == "--jit")
+			backend = Backend::JIT;
+		else if(string(argv[1]) == "--stack")
+			backend = Backend::STACK;
+		else if(string(argv[1]) == "--no-cache")
+			cache = false;
+		else
+			break;
+	}
+	Runner runner{optimize ? Optimization::ON : Optimization::OFF, backend, cache};
 
 	if(argc <= 1){
 		runner.runRepl("cMK/> ");
+	} else if(string(argv[1]) == "--stream" || string(argv[1]) == "--stream-parallel"){
+		runner.runStream(argc > 2 ? argv[2] : "-", string(argv[1]) == "--stream-parallel");
 	} else {
 		string file = argv[1];
 		runner.runFile(file);
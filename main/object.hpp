@@ -23,6 +23,8 @@ enum class ObjectType {
 
 };
 
+inline constexpr size_t OBJECT_TYPE_COUNT = static_cast<size_t>(ObjectType::HASH) + 1;
+
 std::string to_string(const ObjectType& type);
 
 class Object {
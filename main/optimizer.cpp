@@ -0,0 +1,934 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <type_traits>
+#include <any>
+#include <limits>
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "symbols.hpp"
+#include "object.hpp"
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "optimizer.hpp"
+
+using namespace std;
+
+using ExprNode = shared_ptr<ExpressionNode>;
+
+static bool isConstant(const AstNode* node){
+    return node->kind == NodeKind::NUMBER || node->kind == NodeKind::STRING ||
+        node->kind == NodeKind::BOOLEAN || node->kind == NodeKind::CONSTANT;
+}
+
+// Shared by the passes: evaluates constant subtrees with the evaluator
+// itself, so folding can't disagree with running, and allocates new nodes
+// next to the ones they replace.
+class Rewriter {
+public:
+    Rewriter(shared_ptr<AstArena> arena): arena{arena}, evaluator{nullptr, Optimization::OFF} {};
+
+    // null when evaluating raises an error, that is left for runtime
+    ExprNode constant(AstNode* node){
+        auto value = evaluator.evalConstant(node);
+        if(value.type == ObjectType::ERROR)
+            return nullptr;
+        return constant(std::move(value));
+    }
+
+    ExprNode constant(Object value){
+        return make<Constant>(std::move(value));
+    }
+
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args){
+        if(arena != nullptr)
+            return arena->make<T>(std::forward<Args>(args)...);
+        return make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    bool isTruthy(AstNode* node){
+        auto value = evaluator.evalConstant(node);
+        if(value.type == ObjectType::NIL)
+            return false;
+        if(value.type == ObjectType::BOOLEAN)
+            return any_cast<bool>(value.value);
+        return true;
+    }
+
+    // Walks everything below node, function bodies included, and hands every
+    // expression link to fn after its own subtree
+    template <typename F>
+    void postOrder(AstNode* node, F&& fn){
+        if(node->kind == NodeKind::FUNCTION){
+            auto& body = static_cast<FunctionLiteral*>(node)->body;
+            if(body != nullptr)
+                postOrder(body.get(), fn);
+            return;
+        }
+        forEachChild(node, [&](auto& child){
+            postOrder(child.get(), fn);
+            if constexpr(is_same_v<remove_reference_t<decltype(child)>, ExprNode>)
+                fn(child);
+        });
+    }
+
+private:
+    shared_ptr<AstArena> arena;
+    Evaluator evaluator;
+};
+
+// Names a frame binds: the global frame keys them by symbol, function
+// frames by slot
+static bool frameKey(bool global, const Identifier& name, uint32_t& out){
+    if(global && name.depth == Identifier::GLOBAL)
+        out = name.symbol;
+    else if(!global && name.depth == 0)
+        out = name.slot;
+    else
+        return false;
+    return true;
+}
+
+static void countLets(AstNode* node, bool global, unordered_map<uint32_t, int>& lets){
+    if(node->kind == NodeKind::FUNCTION)
+        return;
+    uint32_t name;
+    if(node->kind == NodeKind::LET && frameKey(global, static_cast<LetStatement*>(node)->name, name))
+        lets[name]++;
+    forEachChild(node, [&](auto& child){ countLets(child.get(), global, lets); });
+}
+
+// InlineFunctions
+
+// Most nodes a helper body may have to be copied into its callers
+static constexpr size_t INLINE_BUDGET = 24;
+// Top-level helpers the preparser skipped are parsed ahead when their body
+// is no longer than this in source, they would never be inlined otherwise
+static constexpr size_t INLINE_SOURCE_BUDGET = 160;
+
+class Inliner: public Rewriter {
+public:
+    using Rewriter::Rewriter;
+
+    void program(Program& program){
+        frames.push_back(Frame{nullptr, {}, {}, 0});
+        countLets(&program, true, frames.back().lets);
+        statements(program.statements, true);
+        frames.pop_back();
+    }
+
+    void function(FunctionLiteral& fn){
+        if(fn.body == nullptr || fn.locals == nullptr)
+            return;
+        frames.push_back(Frame{&fn, {}, {}, 0});
+        auto& frame = frames.back();
+        for(auto& param: *fn.params)
+            if(param.depth == 0)
+                frame.lets[param.slot] += 2;
+        countLets(fn.body.get(), false, frame.lets);
+        statements(fn.body->statements, true);
+
+        // argument slots of the calls inlined here go after the locals,
+        // under a name no identifier has
+        if(auto temps = frames.back().temps; temps > 0){
+            auto layout = make_shared<vector<Symbol>>(*fn.locals);
+            layout->resize(layout->size() + temps, intern(""));
+            fn.locals = layout;
+        }
+        frames.pop_back();
+    }
+
+private:
+    struct Callee {
+        shared_ptr<FunctionLiteral> fn;
+        bool closesOver; // reads names of the frame it was made in
+    };
+
+    struct Frame {
+        FunctionLiteral* fn; // null for the global frame
+        unordered_map<uint32_t, int> lets;
+        unordered_map<uint32_t, Callee> callees; // inlinable lets already passed
+        size_t temps; // argument slots taken so far
+    };
+    vector<Frame> frames;
+    bool tail = false; // the call being inlined is a tail call, the body's own ones stay so
+
+    void statements(vector<shared_ptr<StatementNode>>& stmts, bool frameLevel){
+        for(auto& stmt: stmts){
+            auto let = stmt->kind == NodeKind::LET ? static_cast<LetStatement*>(stmt.get()) : nullptr;
+            bool candidate = frameLevel && let != nullptr && let->value != nullptr && let->value->kind == NodeKind::FUNCTION;
+            // a top-level helper closes over the global frame only, it can
+            // be resolved without one
+            if(candidate && frames.size() == 1 && frames[0].fn == nullptr){
+                auto& fn = *static_cast<FunctionLiteral*>(let->value.get());
+                if(fn.isLazy() && fn.bodyEnd - fn.bodyBegin <= INLINE_SOURCE_BUDGET && Parser::parseBody(fn).empty())
+                    Resolver::resolveBody(fn, nullptr);
+            }
+            visit(stmt.get());
+            if(!candidate)
+                continue;
+            auto& frame = frames.back();
+            uint32_t name;
+            if(!frameKey(frame.fn == nullptr, let->name, name) || frame.lets[name] != 1)
+                continue;
+            Callee callee{static_pointer_cast<FunctionLiteral>(let->value), false};
+            if(inlinable(callee, let->name.symbol))
+                frame.callees.emplace(name, std::move(callee));
+        }
+    }
+
+    void visit(AstNode* node){
+        switch(node->kind){
+        case NodeKind::FUNCTION:
+            function(*static_cast<FunctionLiteral*>(node));
+            break;
+        case NodeKind::BLOCK:
+            statements(static_cast<BlockStatement*>(node)->statements, false);
+            break;
+        case NodeKind::INLINE:
+            // copies are not inlined into again, a helper calling a helper
+            // keeps the inner call
+            visit(static_cast<InlineCall*>(node)->call.get());
+            break;
+        default:
+            forEachChild(node, [&](auto& child){
+                visit(child.get());
+                if constexpr(is_same_v<remove_reference_t<decltype(child)>, ExprNode>)
+                    inlineCall(child);
+            });
+        }
+    }
+
+    // a single expression, small, with no frame of its own to bind into
+    // and no call to itself
+    bool inlinable(Callee& callee, Symbol self){
+        auto& fn = *callee.fn;
+        if(fn.body == nullptr || fn.locals == nullptr || fn.params == nullptr || fn.locals->size() != fn.params->size())
+            return false;
+        if(fn.body->statements.size() != 1 || fn.body->statements[0]->kind != NodeKind::EXPRESSION_STATEMENT)
+            return false;
+        size_t size = 0;
+        return fits(fn.body->statements[0].get(), self, callee, size);
+    }
+
+    bool fits(AstNode* node, Symbol self, Callee& callee, size_t& size){
+        if(++size > INLINE_BUDGET)
+            return false;
+        switch(node->kind){
+        case NodeKind::IDENTIFIER: {
+            auto ident = static_cast<Identifier*>(node);
+            if(ident->symbol == self || ident->depth == Identifier::DYNAMIC)
+                return false;
+            if(ident->depth > 0)
+                callee.closesOver = true;
+            return true;
+        }
+        case NodeKind::EXPRESSION_STATEMENT:
+            if(static_cast<ExpressionStatement*>(node)->expression == nullptr)
+                return false;
+            break;
+        case NodeKind::BLOCK:
+            for(auto& stmt: static_cast<BlockStatement*>(node)->statements)
+                if(stmt->kind != NodeKind::EXPRESSION_STATEMENT)
+                    return false;
+            break;
+        case NodeKind::CALL:
+            if(static_cast<CallExpression*>(node)->arguments == nullptr)
+                return false;
+            break;
+        case NodeKind::PROGRAM:
+        case NodeKind::LET:
+        case NodeKind::RETURN:
+        case NodeKind::FUNCTION:
+        case NodeKind::INLINE:
+            return false;
+        default:
+            break;
+        }
+        bool fit = true;
+        forEachChild(node, [&](auto& child){ fit = fit && fits(child.get(), self, callee, size); });
+        return fit;
+    }
+
+    void inlineCall(ExprNode& link){
+        if(link->kind != NodeKind::CALL)
+            return;
+        auto call = static_cast<CallExpression*>(link.get());
+        if(call->function->kind != NodeKind::IDENTIFIER)
+            return;
+        auto& name = *static_cast<Identifier*>(call->function.get());
+
+        // the frame binding the callee, as in constant propagation except
+        // that globals are fine anywhere: the call checks what it finds
+        Frame* owner = nullptr;
+        uint32_t key = 0;
+        if(name.depth >= 0 && (size_t)name.depth < frames.size()){
+            owner = &frames[frames.size() - 1 - name.depth];
+            key = name.slot;
+        } else if(name.depth == Identifier::GLOBAL){
+            owner = &frames[0];
+            key = name.symbol;
+        }
+        if(owner == nullptr || (owner->fn == nullptr) != (name.depth == Identifier::GLOBAL))
+            return;
+        auto it = owner->callees.find(key);
+        if(it == owner->callees.end())
+            return;
+        auto& callee = it->second;
+
+        // top-level code has no slots for the arguments
+        auto& frame = frames.back();
+        if(frame.fn == nullptr || call->arguments->size() != callee.fn->params->size())
+            return;
+        // names of the callee's frame are only the same ones when called
+        // from that frame, further down others may shadow them
+        if(callee.closesOver && name.depth != 0)
+            return;
+        size_t slot = frame.fn->locals->size() + frame.temps;
+        if(slot + call->arguments->size() > numeric_limits<uint16_t>::max())
+            return;
+        frame.temps += call->arguments->size();
+
+        auto inlined = make<InlineCall>(static_pointer_cast<CallExpression>(link), callee.fn);
+        inlined->slot = slot;
+        auto body = static_cast<ExpressionStatement*>(callee.fn->body->statements[0].get());
+        tail = call->tail;
+        inlined->body = copy(body->expression, slot);
+        link = inlined;
+    }
+
+    // The callee body as the calling frame sees it: parameters are the
+    // argument slots, its frame is the caller's own
+    ExprNode copy(const ExprNode& link, uint16_t slot){
+        switch(link->kind){
+        case NodeKind::IDENTIFIER: {
+            auto ident = make<Identifier>(*static_cast<Identifier*>(link.get()));
+            if(ident->depth == 0)
+                ident->slot += slot;
+            else if(ident->depth > 0)
+                ident->depth--;
+            return ident;
+        }
+        case NodeKind::PREFIX: {
+            auto expr = make<PrefixExpression>(*static_cast<PrefixExpression*>(link.get()));
+            expr->right = copy(expr->right, slot);
+            return expr;
+        }
+        case NodeKind::INFIX: {
+            auto expr = make<InfixExpression>(*static_cast<InfixExpression*>(link.get()));
+            expr->left = copy(expr->left, slot);
+            expr->right = copy(expr->right, slot);
+            return expr;
+        }
+        case NodeKind::INDEX: {
+            auto expr = make<IndexExpression>(*static_cast<IndexExpression*>(link.get()));
+            expr->left = copy(expr->left, slot);
+            expr->index = copy(expr->index, slot);
+            return expr;
+        }
+        case NodeKind::CALL: {
+            auto expr = make<CallExpression>(*static_cast<CallExpression*>(link.get()));
+            expr->tail = expr->tail && tail;
+            expr->function = copy(expr->function, slot);
+            auto arguments = make<CallExpression::ExprNodeList>();
+            for(auto& argument: *expr->arguments)
+                arguments->push_back(copy(argument, slot));
+            expr->arguments = arguments;
+            return expr;
+        }
+        case NodeKind::ARRAY: {
+            auto expr = make<ArrayLiteral>(*static_cast<ArrayLiteral*>(link.get()));
+            for(auto& item: expr->items)
+                item = copy(item, slot);
+            return expr;
+        }
+        case NodeKind::HASH: {
+            auto expr = make<HashLiteral>();
+            for(auto& entry: static_cast<HashLiteral*>(link.get())->entries)
+                expr->entries.emplace(copy(entry.first, slot), copy(entry.second, slot));
+            return expr;
+        }
+        case NodeKind::IF: {
+            auto expr = make<IfExpression>(*static_cast<IfExpression*>(link.get()));
+            expr->condition = copy(expr->condition, slot);
+            expr->consequence = copy(expr->consequence, slot);
+            expr->alternative = copy(expr->alternative, slot);
+            return expr;
+        }
+        default:
+            return link; // constants, nothing frame dependent
+        }
+    }
+
+    shared_ptr<BlockStatement> copy(const shared_ptr<BlockStatement>& block, uint16_t slot){
+        if(block == nullptr)
+            return nullptr;
+        auto copied = make<BlockStatement>(*block);
+        for(auto& stmt: copied->statements){
+            auto expr = make<ExpressionStatement>(*static_cast<ExpressionStatement*>(stmt.get()));
+            expr->expression = copy(expr->expression, slot);
+            stmt = expr;
+        }
+        return copied;
+    }
+};
+
+void InlineFunctions::run(Program& program){
+    Inliner{program.arena.lock()}.program(program);
+}
+
+void InlineFunctions::run(FunctionLiteral& fn){
+    Inliner{fn.arena.lock()}.function(fn);
+}
+
+// FoldConstants
+
+class Folder: public Rewriter {
+public:
+    using Rewriter::Rewriter;
+
+    void program(Program& program){
+        frames.push_back(Frame{true, {}, {}});
+        countLets(&program, true, frames.back().lets);
+        statements(program.statements, true);
+        frames.pop_back();
+    }
+
+    void function(FunctionLiteral& fn){
+        // not parsed or not resolved yet, nothing is known about its frame
+        if(fn.body == nullptr || fn.locals == nullptr)
+            return;
+        frames.push_back(Frame{false, {}, {}});
+        auto& frame = frames.back();
+        // parameters are bound on every call, never constant
+        for(auto& param: *fn.params)
+            if(param.depth == 0)
+                frame.lets[param.slot] += 2;
+        countLets(fn.body.get(), false, frame.lets);
+        statements(fn.body->statements, true);
+        frames.pop_back();
+    }
+
+private:
+    // global frame keyed by symbol, function frames by slot
+    struct Frame {
+        bool global;
+        unordered_map<uint32_t, int> lets; // bindings of each name
+        unordered_map<uint32_t, ExprNode> constants; // lets already passed
+    };
+    vector<Frame> frames;
+
+    // lets straight in the frame's statement list run before anything
+    // after them, those in an if may not
+    void statements(vector<shared_ptr<StatementNode>>& stmts, bool frameLevel){
+        for(auto& stmt: stmts){
+            visit(stmt.get());
+            if(!frameLevel || stmt->kind != NodeKind::LET)
+                continue;
+            auto let = static_cast<LetStatement*>(stmt.get());
+            auto& frame = frames.back();
+            uint32_t name;
+            if(let->value != nullptr && isConstant(let->value.get()) && frameKey(frame.global, let->name, name) && frame.lets[name] == 1)
+                frame.constants[name] = let->value;
+        }
+    }
+
+    void visit(AstNode* node){
+        switch(node->kind){
+        case NodeKind::FUNCTION:
+            function(*static_cast<FunctionLiteral*>(node));
+            break;
+        case NodeKind::BLOCK:
+            statements(static_cast<BlockStatement*>(node)->statements, false);
+            break;
+        default:
+            forEachChild(node, [&](auto& child){
+                visit(child.get());
+                if constexpr(is_same_v<remove_reference_t<decltype(child)>, ExprNode>)
+                    fold(child);
+            });
+        }
+    }
+
+    void fold(ExprNode& link){
+        auto node = link.get();
+        switch(node->kind){
+        case NodeKind::IDENTIFIER:
+            if(auto value = propagated(*static_cast<Identifier*>(node)))
+                link = value;
+            break;
+        case NodeKind::PREFIX:
+            if(isConstant(static_cast<PrefixExpression*>(node)->right.get()))
+                if(auto value = constant(node))
+                    link = value;
+            break;
+        case NodeKind::INFIX: {
+            auto infix = static_cast<InfixExpression*>(node);
+            if(isConstant(infix->left.get()) && isConstant(infix->right.get()))
+                if(auto value = constant(node))
+                    link = value;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    ExprNode propagated(const Identifier& ident){
+        const Frame* frame = nullptr;
+        uint32_t name = 0;
+        if(ident.depth >= 0 && (size_t)ident.depth < frames.size()){
+            frame = &frames[frames.size() - 1 - ident.depth];
+            name = ident.slot;
+        } else if(ident.depth == Identifier::GLOBAL && frames.size() == 1){
+            frame = &frames[0]; // top-level code only
+            name = ident.symbol;
+        }
+        if(frame == nullptr || frame->global != (ident.depth == Identifier::GLOBAL))
+            return nullptr;
+        auto it = frame->constants.find(name);
+        return it != frame->constants.end() ? it->second : nullptr;
+    }
+};
+
+void FoldConstants::run(Program& program){
+    Folder{program.arena.lock()}.program(program);
+}
+
+void FoldConstants::run(FunctionLiteral& fn){
+    Folder{fn.arena.lock()}.function(fn);
+}
+
+// PruneBranches
+
+static void pruneBranches(AstNode* node, shared_ptr<AstArena> arena){
+    Rewriter rewriter{arena};
+    rewriter.postOrder(node, [&](ExprNode& link){
+        if(link->kind != NodeKind::IF)
+            return;
+        auto expr = static_cast<IfExpression*>(link.get());
+        if(!isConstant(expr->condition.get()))
+            return;
+        bool truthy = rewriter.isTruthy(expr->condition.get());
+        auto taken = truthy ? expr->consequence : expr->alternative;
+        if(taken == nullptr){
+            link = rewriter.constant(Object{ObjectType::NIL, 0.0});
+            return;
+        }
+        // a lone expression is what the block evaluates to
+        if(taken->statements.size() == 1 && taken->statements[0]->kind == NodeKind::EXPRESSION_STATEMENT){
+            if(auto value = static_cast<ExpressionStatement*>(taken->statements[0].get())->expression){
+                link = value;
+                return;
+            }
+        }
+        expr->condition = rewriter.constant(Object{ObjectType::BOOLEAN, true});
+        expr->consequence = taken;
+        expr->alternative = nullptr;
+    });
+}
+
+void PruneBranches::run(Program& program){
+    pruneBranches(&program, program.arena.lock());
+}
+
+void PruneBranches::run(FunctionLiteral& fn){
+    if(fn.body != nullptr)
+        pruneBranches(fn.body.get(), fn.arena.lock());
+}
+
+// HoistLiterals
+
+static void hoistLiterals(AstNode* node, shared_ptr<AstArena> arena){
+    Rewriter rewriter{arena};
+    rewriter.postOrder(node, [&](ExprNode& link){
+        bool constant = false;
+        if(link->kind == NodeKind::ARRAY){
+            constant = true;
+            for(auto& item: static_cast<ArrayLiteral*>(link.get())->items)
+                constant = constant && item != nullptr && isConstant(item.get());
+        } else if(link->kind == NodeKind::HASH){
+            constant = true;
+            for(auto& entry: static_cast<HashLiteral*>(link.get())->entries)
+                constant = constant && isConstant(entry.first.get()) && isConstant(entry.second.get());
+        }
+        if(constant)
+            if(auto value = rewriter.constant(link.get()))
+                link = value;
+    });
+}
+
+void HoistLiterals::run(Program& program){
+    hoistLiterals(&program, program.arena.lock());
+}
+
+void HoistLiterals::run(FunctionLiteral& fn){
+    if(fn.body != nullptr)
+        hoistLiterals(fn.body.get(), fn.arena.lock());
+}
+
+// InferTypes
+
+using Types = uint32_t; // one bit per ObjectType, none until a value flows in
+static constexpr Types ANY_TYPE = ~Types{0};
+
+static constexpr Types typeBit(ObjectType type){
+    return Types{1} << static_cast<size_t>(type);
+}
+
+class Typer {
+public:
+    void program(Program& program){
+        solve([&](){
+            frames.push_back(Frame{nullptr, {}, {}, {}});
+            countLets(&program, true, frames.back().lets);
+            statements(program.statements, true);
+            frames.pop_back();
+        });
+    }
+
+    void function(FunctionLiteral& fn){
+        if(fn.body == nullptr || fn.locals == nullptr)
+            return;
+        // called from places not known here
+        signatures[&fn].params.assign(fn.params->size(), ANY_TYPE);
+        solve([&](){ visitFunction(fn); });
+    }
+
+private:
+    struct Signature {
+        vector<Types> params;
+        Types result = 0;
+    };
+
+    struct Frame {
+        FunctionLiteral* fn; // null for the global frame
+        unordered_map<uint32_t, int> lets;
+        unordered_set<uint32_t> defined; // bound by the time code here runs
+        unordered_map<uint32_t, FunctionLiteral*> callees; // functions bound once
+    };
+
+    vector<Frame> frames;
+    unordered_map<FunctionLiteral*, Signature> signatures;
+    map<pair<FunctionLiteral*, uint32_t>, Types> bindings; // of every let, by frame and key
+    bool changed = false;
+    shared_ptr<TypeAssumptions> assumptions; // while marking nodes
+
+    // Walks until no type grows, starting from none at all, so recursion
+    // only adds what its base cases bring. Parameters no call was seen for
+    // may get anything.
+    template <typename F>
+    void solve(F&& walk){
+        do {
+            changed = false;
+            walk();
+        } while(changed);
+        for(auto& entry: signatures)
+            for(auto& param: entry.second.params)
+                if(param == 0)
+                    param = ANY_TYPE;
+        do {
+            changed = false;
+            walk();
+        } while(changed);
+
+        assumptions = make_shared<TypeAssumptions>();
+        walk();
+        if(assumptions->nodes.empty())
+            return;
+        for(auto& [fn, signature]: signatures){
+            bool any = true;
+            for(auto param: signature.params)
+                any = any && param == ANY_TYPE;
+            if(any || fn->body == nullptr || fn->locals == nullptr)
+                continue;
+            fn->signature = signature.params;
+            fn->assumptions = assumptions;
+            assumptions->functions.push_back(fn);
+        }
+    }
+
+    void join(Types& into, Types types){
+        if((into | types) != into){
+            into |= types;
+            changed = true;
+        }
+    }
+
+    void mark(AstNode* node, bool& flag, bool proven){
+        if(assumptions == nullptr)
+            return;
+        flag = proven;
+        if(proven)
+            assumptions->nodes.push_back(node);
+    }
+
+    void visitFunction(FunctionLiteral& fn){
+        if(fn.body == nullptr || fn.locals == nullptr)
+            return;
+        auto& signature = signatures[&fn];
+        if(signature.params.size() != fn.params->size())
+            signature.params.assign(fn.params->size(), 0);
+        frames.push_back(Frame{&fn, {}, {}, {}});
+        auto& frame = frames.back();
+        for(auto& param: *fn.params){
+            if(param.depth == 0){
+                frame.lets[param.slot] += 2;
+                frame.defined.insert(param.slot);
+            }
+        }
+        countLets(fn.body.get(), false, frame.lets);
+        auto value = statements(fn.body->statements, true);
+        join(signature.result, value & ~typeBit(ObjectType::RETURN));
+        frames.pop_back();
+    }
+
+    // type of what the block evaluates to, a return in it makes it a
+    // RETURN object that is passed up
+    Types statements(vector<shared_ptr<StatementNode>>& stmts, bool frameLevel){
+        Types value = ANY_TYPE, returns = 0;
+        for(auto& stmt: stmts){
+            value = statement(stmt.get());
+            returns |= value & typeBit(ObjectType::RETURN);
+            if(!frameLevel || stmt->kind != NodeKind::LET)
+                continue;
+            auto let = static_cast<LetStatement*>(stmt.get());
+            auto& frame = frames.back();
+            uint32_t name;
+            if(!frameKey(frame.fn == nullptr, let->name, name))
+                continue;
+            frame.defined.insert(name);
+            if(let->value != nullptr && let->value->kind == NodeKind::FUNCTION && frame.lets[name] == 1)
+                frame.callees[name] = static_cast<FunctionLiteral*>(let->value.get());
+        }
+        return value | returns;
+    }
+
+    Types statement(AstNode* node){
+        switch(node->kind){
+        case NodeKind::LET: {
+            auto let = static_cast<LetStatement*>(node);
+            auto value = type(let->value.get());
+            auto& frame = frames.back();
+            uint32_t name;
+            if(frameKey(frame.fn == nullptr, let->name, name))
+                join(bindings[{frame.fn, name}], value);
+            return value;
+        }
+        case NodeKind::RETURN: {
+            auto value = type(static_cast<ReturnStatement*>(node)->value.get());
+            if(auto fn = frames.back().fn)
+                join(signatures[fn].result, value);
+            return typeBit(ObjectType::RETURN);
+        }
+        case NodeKind::EXPRESSION_STATEMENT:
+            return type(static_cast<ExpressionStatement*>(node)->expression.get());
+        default:
+            return ANY_TYPE;
+        }
+    }
+
+    Types type(AstNode* node){
+        if(node == nullptr)
+            return typeBit(ObjectType::NIL);
+        switch(node->kind){
+        case NodeKind::IDENTIFIER:
+            return read(*static_cast<Identifier*>(node));
+        case NodeKind::NUMBER:
+            return typeBit(ObjectType::NUMBER);
+        case NodeKind::STRING:
+            return typeBit(ObjectType::STRING);
+        case NodeKind::BOOLEAN:
+            return typeBit(ObjectType::BOOLEAN);
+        case NodeKind::CONSTANT:
+            return typeBit(static_cast<Constant*>(node)->value.type);
+        case NodeKind::ARRAY:
+            for(auto& item: static_cast<ArrayLiteral*>(node)->items)
+                type(item.get());
+            return typeBit(ObjectType::ARRAY);
+        case NodeKind::HASH:
+            for(auto& entry: static_cast<HashLiteral*>(node)->entries){
+                type(entry.first.get());
+                type(entry.second.get());
+            }
+            return typeBit(ObjectType::HASH);
+        case NodeKind::FUNCTION:
+            visitFunction(*static_cast<FunctionLiteral*>(node));
+            return typeBit(ObjectType::FUNCTION);
+        case NodeKind::PREFIX: {
+            auto expr = static_cast<PrefixExpression*>(node);
+            auto right = type(expr->right.get());
+            if(expr->opcode == Opcode::NOT){
+                mark(expr, expr->specialized, right == typeBit(ObjectType::BOOLEAN));
+                return typeBit(ObjectType::BOOLEAN);
+            }
+            mark(expr, expr->specialized, right == typeBit(ObjectType::NUMBER));
+            if(right == 0 || right == typeBit(ObjectType::NUMBER))
+                return right;
+            return ANY_TYPE;
+        }
+        case NodeKind::INFIX: {
+            auto expr = static_cast<InfixExpression*>(node);
+            auto left = type(expr->left.get());
+            auto right = type(expr->right.get());
+            bool numbers = left == typeBit(ObjectType::NUMBER) && right == typeBit(ObjectType::NUMBER);
+            mark(expr, expr->numeric, numbers);
+            if(left == 0 || right == 0)
+                return 0;
+            if(numbers){
+                if(expr->opcode == Opcode::ADD || expr->opcode == Opcode::SUB ||
+                        expr->opcode == Opcode::MUL || expr->opcode == Opcode::DIV)
+                    return typeBit(ObjectType::NUMBER);
+                return typeBit(ObjectType::BOOLEAN);
+            }
+            if(expr->opcode == Opcode::ADD && left == typeBit(ObjectType::STRING) && right == typeBit(ObjectType::STRING))
+                return typeBit(ObjectType::STRING);
+            return ANY_TYPE;
+        }
+        case NodeKind::IF: {
+            auto expr = static_cast<IfExpression*>(node);
+            auto condition = type(expr->condition.get());
+            mark(expr, expr->booleanCondition, condition == typeBit(ObjectType::BOOLEAN));
+            auto value = statements(expr->consequence->statements, false);
+            if(expr->alternative != nullptr)
+                return value | statements(expr->alternative->statements, false);
+            return value | typeBit(ObjectType::NIL);
+        }
+        case NodeKind::INDEX: {
+            auto expr = static_cast<IndexExpression*>(node);
+            auto left = type(expr->left.get());
+            auto index = type(expr->index.get());
+            mark(expr, expr->arrayIndex, left == typeBit(ObjectType::ARRAY) && index == typeBit(ObjectType::NUMBER));
+            return ANY_TYPE;
+        }
+        case NodeKind::CALL:
+            return call(*static_cast<CallExpression*>(node));
+        case NodeKind::INLINE: {
+            auto inlined = static_cast<InlineCall*>(node);
+            // the call is what runs when the guard fails
+            auto value = call(*inlined->call);
+            auto& frame = frames.back();
+            auto& arguments = *inlined->call->arguments;
+            for(size_t i = 0; i < arguments.size(); ++i){
+                join(bindings[{frame.fn, inlined->slot + i}], type(arguments[i].get()));
+                frame.defined.insert(inlined->slot + i);
+            }
+            return value | type(inlined->body.get());
+        }
+        default:
+            return ANY_TYPE;
+        }
+    }
+
+    Types read(const Identifier& ident){
+        if(ident.depth >= 0 && (size_t)ident.depth < frames.size()){
+            auto& frame = frames[frames.size() - 1 - ident.depth];
+            // before the let ran the read falls back to outer bindings
+            if(frame.fn == nullptr || frame.defined.count(ident.slot) == 0)
+                return ANY_TYPE;
+            Types types = bindings[{frame.fn, ident.slot}];
+            auto& params = *frame.fn->params;
+            auto& signature = signatures[frame.fn];
+            for(size_t i = 0; i < params.size(); ++i)
+                if(params[i].depth == 0 && params[i].slot == ident.slot)
+                    types |= signature.params[i];
+            return types;
+        }
+        // globals only hold still for top-level code
+        if(ident.depth == Identifier::GLOBAL && frames.size() == 1 && frames[0].fn == nullptr &&
+                frames[0].defined.count(ident.symbol) != 0)
+            return bindings[{nullptr, ident.symbol}];
+        return ANY_TYPE;
+    }
+
+    // Parameters take the types of the arguments of every call through the
+    // name of the function, the result is only known where the name can't
+    // have been rebound
+    Types call(CallExpression& call){
+        type(call.function.get());
+        vector<Types> arguments;
+        if(call.arguments != nullptr)
+            for(auto& argument: *call.arguments)
+                arguments.push_back(type(argument.get()));
+        if(call.function->kind != NodeKind::IDENTIFIER)
+            return ANY_TYPE;
+
+        auto& name = *static_cast<Identifier*>(call.function.get());
+        const Frame* owner = nullptr;
+        uint32_t key = 0;
+        if(name.depth >= 0 && (size_t)name.depth < frames.size()){
+            owner = &frames[frames.size() - 1 - name.depth];
+            key = name.slot;
+        } else if(name.depth == Identifier::GLOBAL && frames[0].fn == nullptr){
+            owner = &frames[0];
+            key = name.symbol;
+        }
+        if(owner == nullptr || (owner->fn == nullptr) != (name.depth == Identifier::GLOBAL))
+            return ANY_TYPE;
+        auto it = owner->callees.find(key);
+        if(it == owner->callees.end() || it->second->body == nullptr || it->second->locals == nullptr)
+            return ANY_TYPE;
+
+        auto& signature = signatures[it->second];
+        if(signature.params.size() != it->second->params->size())
+            signature.params.assign(it->second->params->size(), 0);
+        for(size_t i = 0; i < signature.params.size(); ++i)
+            join(signature.params[i], i < arguments.size() ? arguments[i] : ANY_TYPE);
+        if(name.depth == Identifier::GLOBAL && frames.size() != 1)
+            return ANY_TYPE;
+        return signature.result;
+    }
+};
+
+void InferTypes::run(Program& program){
+    if(program.arena.lock() != nullptr)
+        Typer{}.program(program);
+}
+
+void InferTypes::run(FunctionLiteral& fn){
+    if(fn.arena.lock() != nullptr)
+        Typer{}.function(fn);
+}
+
+// PassManager
+
+PassManager::PassManager(Optimization optimization): passes{} {
+    if(optimization == Optimization::OFF)
+        return;
+    // inlining first so the copied bodies get folded with their callers,
+    // folding before the other two so conditions and items are constants
+    // by the time they look at them
+    add(make_unique<InlineFunctions>());
+    add(make_unique<FoldConstants>());
+    add(make_unique<PruneBranches>());
+    add(make_unique<HoistLiterals>());
+    // last, it types what the others left
+    add(make_unique<InferTypes>());
+}
+
+void PassManager::add(unique_ptr<Pass> pass){
+    passes.push_back(std::move(pass));
+}
+
+void PassManager::run(Program& program){
+    for(auto& pass: passes)
+        pass->run(program);
+}
+
+void PassManager::run(FunctionLiteral& fn){
+    for(auto& pass: passes)
+        pass->run(fn);
+}
+
+vector<string> PassManager::names() const {
+    vector<string> names;
+    for(auto& pass: passes)
+        names.push_back(pass->name());
+    return names;
+}
@@ -0,0 +1,95 @@
+#if !defined(OPTIMIZER_H)
+#define OPTIMIZER_H
+
+#include <string>
+#include <memory>
+#include <vector>
+
+class Program;
+class FunctionLiteral;
+
+enum class Optimization {
+    OFF,
+    ON,
+};
+
+// A rewrite of a parsed and resolved tree. Passes run once per program, and
+// once per function body the preparser skipped, right after it is parsed.
+// Running a pass again over its own output changes nothing.
+class Pass {
+public:
+    virtual ~Pass() = default;
+    virtual std::string name() const = 0;
+    virtual void run(Program&) = 0;
+    virtual void run(FunctionLiteral&) = 0;
+};
+
+// Copies the body of small helpers into their calls: functions bound once
+// by a let, whose body is one expression with no let, return or function
+// in it and no call to themselves. The arguments go to slots of the
+// calling frame, so each is still evaluated once and in order. Calls keep
+// checking that the name holds that function and make the call when not.
+class InlineFunctions: public Pass {
+public:
+    std::string name() const { return "inline-functions"; }
+    void run(Program&);
+    void run(FunctionLiteral&);
+};
+
+// Folds operators with constant operands and reads of lets bound once to a
+// constant, in evaluation order so a read only sees lets that ran before it.
+// Globals are only propagated into top-level code, functions may run after
+// a later REPL line or stream group rebinds them.
+class FoldConstants: public Pass {
+public:
+    std::string name() const { return "fold-constants"; }
+    void run(Program&);
+    void run(FunctionLiteral&);
+};
+
+// Replaces an if with a constant condition by the branch it takes.
+class PruneBranches: public Pass {
+public:
+    std::string name() const { return "prune-branches"; }
+    void run(Program&);
+    void run(FunctionLiteral&);
+};
+
+// Builds array and hash literals made only of constants once, evaluation
+// copies the prebuilt object instead of evaluating every item again.
+class HoistLiterals: public Pass {
+public:
+    std::string name() const { return "hoist-literals"; }
+    void run(Program&);
+    void run(FunctionLiteral&);
+};
+
+// Flow-insensitive type inference. Every let and parameter gets the union
+// of the types of all values it is bound to, parameters from the calls the
+// program makes through the name of the function. Operators whose operand
+// types come out as the ones their fast path takes are marked for the
+// evaluator to run it without dispatching on the types. Functions check
+// their arguments against the parameter types assumed, a call that breaks
+// them undoes all the marks. Only arena trees are specialized.
+class InferTypes: public Pass {
+public:
+    std::string name() const { return "infer-types"; }
+    void run(Program&);
+    void run(FunctionLiteral&);
+};
+
+class PassManager {
+public:
+    PassManager(): passes{} {};
+    PassManager(Optimization);
+
+    void add(std::unique_ptr<Pass>);
+    void run(Program&);
+    void run(FunctionLiteral&);
+    std::vector<std::string> names() const;
+
+private:
+    std::vector<std::unique_ptr<Pass>> passes;
+};
+
+#endif // OPTIMIZER_H
@@ -3,78 +3,142 @@
 #include <memory>
 
 #include "token.hpp"
+#include "source.hpp"
 #include "lexer.hpp"
+#include "tokens.hpp"
 #include "ast.hpp"
 #include "parser.hpp"
+#include "resolver.hpp"
+#include "symbols.hpp"
 #include "utils.hpp"
 
 using namespace std;
 
-Parser::Parser(Lexer& lexer): lexer{lexer} {
-    errors = {};
-    nextToken();
-    nextToken();
-
-    // Pratt Parser (Operator Precedence parser)
-    // setup precedence table
-    precedences = {
-        {TokenType::EQUAL_EQUAL, static_cast<int>(PrecedenceLevel::EQUALS)},
-        {TokenType::BANG_EQUAL, static_cast<int>(PrecedenceLevel::EQUALS)},
-        {TokenType::LESS, static_cast<int>(PrecedenceLevel::LESSGREATER)},
-        {TokenType::GREATER, static_cast<int>(PrecedenceLevel::LESSGREATER)},
-        {TokenType::PLUS, static_cast<int>(PrecedenceLevel::SUM)},
-        {TokenType::MINUS, static_cast<int>(PrecedenceLevel::SUM)},
-        {TokenType::STAR, static_cast<int>(PrecedenceLevel::PRODUCT)},
-        {TokenType::SLASH, static_cast<int>(PrecedenceLevel::PRODUCT)},
-        {TokenType::LEFT_PAREN, static_cast<int>(PrecedenceLevel::CALL)},
-        {TokenType::LEFT_BRACKET, static_cast<int>(PrecedenceLevel::INDEX)}
-    };
-
-    //register prefix functions 
-    registerPrefix(TokenType::IDENT, std::bind(&Parser::parseIdentifier, this));
-    registerPrefix(TokenType::NUMBER, std::bind(&Parser::parseNumberLiteral, this));
-    registerPrefix(TokenType::STRING, std::bind(&Parser::parseStringLiteral, this));
-    registerPrefix(TokenType::BANG, std::bind(&Parser::parsePrefixExpression, this));
-    registerPrefix(TokenType::MINUS, std::bind(&Parser::parsePrefixExpression, this));
-    registerPrefix(TokenType::TRUE, std::bind(&Parser::parseBooleanLiteral, this));
-    registerPrefix(TokenType::LEFT_BRACKET, std::bind(&Parser::parseArrayLiteral, this));
-    registerPrefix(TokenType::LEFT_BRACE, std::bind(&Parser::parseHashLiteral, this));
-    registerPrefix(TokenType::FALSE, std::bind(&Parser::parseBooleanLiteral, this));
-    registerPrefix(TokenType::LEFT_PAREN, std::bind(&Parser::parseGroupedExpression, this));
-    registerPrefix(TokenType::IF, std::bind(&Parser::parseIfExpression, this));
-    registerPrefix(TokenType::FUNC, std::bind(&Parser::parseFunctionLiteral, this));
-
-    // register infix functions
-    registerInfix(TokenType::PLUS, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::MINUS, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::STAR, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::SLASH, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::EQUAL_EQUAL, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::BANG_EQUAL, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::LESS, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::GREATER, std::bind(&Parser::parseInfixExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::LEFT_PAREN, std::bind(&Parser::parseCallExpression, this, std::placeholders::_1));
-    registerInfix(TokenType::LEFT_BRACKET, std::bind(&Parser::parseIndexExpression, this, std::placeholders::_1));
+Parser::Parser(Lexer& lexer, AstAllocation allocation, FunctionBodies bodies):
+    Parser{TokenStream::tokenize(lexer.getSource()), allocation, bodies} {
+}
+
+// Pratt Parser (Operator Precedence parser) tables
+static constexpr size_t idx(TokenType type){
+    return static_cast<size_t>(type);
+}
+
+constexpr array<Parser::PrefixParseFn, TOKEN_TYPE_COUNT> Parser::prefixParseFuncs = [](){
+    array<PrefixParseFn, TOKEN_TYPE_COUNT> table{};
+    table[idx(TokenType::IDENT)] = &Parser::parseIdentifier;
+    table[idx(TokenType::NUMBER)] = &Parser::parseNumberLiteral;
+    table[idx(TokenType::STRING)] = &Parser::parseStringLiteral;
+    table[idx(TokenType::BANG)] = &Parser::parsePrefixExpression;
+    table[idx(TokenType::MINUS)] = &Parser::parsePrefixExpression;
+    table[idx(TokenType::TRUE)] = &Parser::parseBooleanLiteral;
+    table[idx(TokenType::LEFT_BRACKET)] = &Parser::parseArrayLiteral;
+    table[idx(TokenType::LEFT_BRACE)] = &Parser::parseHashLiteral;
+    table[idx(TokenType::FALSE)] = &Parser::parseBooleanLiteral;
+    table[idx(TokenType::LEFT_PAREN)] = &Parser::parseGroupedExpression;
+    table[idx(TokenType::IF)] = &Parser::parseIfExpression;
+    table[idx(TokenType::FUNC)] = &Parser::parseFunctionLiteral;
+    return table;
+}();
+
+constexpr array<Parser::InfixParseFn, TOKEN_TYPE_COUNT> Parser::infixParseFuncs = [](){
+    array<InfixParseFn, TOKEN_TYPE_COUNT> table{};
+    table[idx(TokenType::PLUS)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::MINUS)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::STAR)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::SLASH)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::EQUAL_EQUAL)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::BANG_EQUAL)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::LESS)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::GREATER)] = &Parser::parseInfixExpression;
+    table[idx(TokenType::LEFT_PAREN)] = &Parser::parseCallExpression;
+    table[idx(TokenType::LEFT_BRACKET)] = &Parser::parseIndexExpression;
+    return table;
+}();
+
+constexpr array<Opcode, TOKEN_TYPE_COUNT> Parser::infixOpcodes = [](){
+    array<Opcode, TOKEN_TYPE_COUNT> table{};
+    table[idx(TokenType::PLUS)] = Opcode::ADD;
+    table[idx(TokenType::MINUS)] = Opcode::SUB;
+    table[idx(TokenType::STAR)] = Opcode::MUL;
+    table[idx(TokenType::SLASH)] = Opcode::DIV;
+    table[idx(TokenType::EQUAL_EQUAL)] = Opcode::EQUAL;
+    table[idx(TokenType::BANG_EQUAL)] = Opcode::NOT_EQUAL;
+    table[idx(TokenType::LESS)] = Opcode::LESS;
+    table[idx(TokenType::GREATER)] = Opcode::GREATER;
+    return table;
+}();
+
+constexpr array<int, TOKEN_TYPE_COUNT> Parser::precedences = [](){
+    array<int, TOKEN_TYPE_COUNT> table{};
+    for(auto& level: table)
+        level = static_cast<int>(PrecedenceLevel::LOWEST);
+    table[idx(TokenType::EQUAL_EQUAL)] = static_cast<int>(PrecedenceLevel::EQUALS);
+    table[idx(TokenType::BANG_EQUAL)] = static_cast<int>(PrecedenceLevel::EQUALS);
+    table[idx(TokenType::LESS)] = static_cast<int>(PrecedenceLevel::LESSGREATER);
+    table[idx(TokenType::GREATER)] = static_cast<int>(PrecedenceLevel::LESSGREATER);
+    table[idx(TokenType::PLUS)] = static_cast<int>(PrecedenceLevel::SUM);
+    table[idx(TokenType::MINUS)] = static_cast<int>(PrecedenceLevel::SUM);
+    table[idx(TokenType::STAR)] = static_cast<int>(PrecedenceLevel::PRODUCT);
+    table[idx(TokenType::SLASH)] = static_cast<int>(PrecedenceLevel::PRODUCT);
+    table[idx(TokenType::LEFT_PAREN)] = static_cast<int>(PrecedenceLevel::CALL);
+    table[idx(TokenType::LEFT_BRACKET)] = static_cast<int>(PrecedenceLevel::INDEX);
+    return table;
+}();
+
+Parser::Parser(TokenStream stream, AstAllocation allocation, FunctionBodies bodies):
+    tokens{std::move(stream)}, curr{0}, errors{}, arena{}, bodies{bodies} {
+    // token offsets would wrap, the stream holds nothing of it
+    if(auto size = tokens.getSource()->text().size(); size > TokenStream::MAX_SOURCE_SIZE)
+        errors.push_back(format("source too large: ", size, " bytes, at most ", TokenStream::MAX_SOURCE_SIZE));
+    if(allocation == AstAllocation::ARENA)
+        arena = make_shared<AstArena>(tokens.getSource());
+}
+
+Parser::Parser(TokenStream stream, shared_ptr<AstArena> arena, FunctionBodies bodies):
+    tokens{std::move(stream)}, curr{0}, errors{}, arena{arena}, bodies{bodies} {
+}
+
+vector<string> Parser::parseBody(FunctionLiteral& fn){
+    if(!fn.isLazy())
+        return {};
+    auto stream = TokenStream::tokenize(fn.source, fn.bodyBegin, fn.bodyEnd);
+    Parser parser{std::move(stream), fn.arena.lock(), FunctionBodies::LAZY};
+    auto body = parser.parseBlockStatement();
+    if(parser.errors.empty())
+        fn.body = body;
+    return parser.errors;
+}
+
+template <typename T, typename... Args>
+shared_ptr<T> Parser::make(Args&&... args){
+    if(arena == nullptr)
+        return make_shared<T>(std::forward<Args>(args)...);
+    // non-owning alias, the arena is kept alive by the Program
+    return arena->makeNode<T>(std::forward<Args>(args)...);
 }
 
 void Parser::nextToken(){
-    currToken = peekToken;
-    peekToken = lexer.nextToken();
+    curr++;
 }
 
 shared_ptr<Program> Parser::parseProgram(){
-    auto program = Program();
+    auto program = make<Program>();
+    program->source = tokens.getSource();
+    program->arena = arena;
     while(!currentTokenIs(TokenType::EOS)){
         auto stmt = parseStatement();
         if(stmt != nullptr)
-            program.statements.push_back(stmt);
+            program->statements.push_back(stmt);
         nextToken();
     }
-    return make_shared<Program>(program);
+    Resolver::resolve(*program);
+    if(arena != nullptr)
+        return shared_ptr<Program>(arena, program.get());
+    return program;
 }
 
 shared_ptr<StatementNode> Parser::parseStatement(){
-    switch (currToken.type){
+    switch (tokens.type(curr)){
     case TokenType::LET:
         return parseLetStatement();
     case TokenType::RETURN:
@@ -85,163 +149,185 @@ shared_ptr<StatementNode> Parser::parseStatement(){
 }
 
 shared_ptr<LetStatement> Parser::parseLetStatement(){
-    auto stmt = LetStatement{currToken};
+    auto stmt = make<LetStatement>(tokens.literal(curr));
     if(!expectPeek(TokenType::IDENT))
         return nullptr;
 
-    stmt.name = Identifier{currToken, currToken.literal};
+    stmt->name = Identifier{tokens.literal(curr), tokens.identifier(curr)};
     if(!expectPeek(TokenType::EQUAL))
         return nullptr;
 
     nextToken();
-    stmt.value = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
+    stmt->value = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
 
     while(!currentTokenIs(TokenType::SEMICOLON) && !currentTokenIs(TokenType::EOS))
         nextToken();
 
-    return make_shared<LetStatement>(stmt);
+    return stmt;
 }
 
 shared_ptr<ReturnStatement> Parser::parseReturnStatement(){
-    auto stmt = ReturnStatement{currToken};
+    auto stmt = make<ReturnStatement>(tokens.literal(curr));
 
     nextToken();
 
-    stmt.value = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
+    stmt->value = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
 
-    while(!currentTokenIs(TokenType::SEMICOLON))
+    while(!currentTokenIs(TokenType::SEMICOLON) && !currentTokenIs(TokenType::EOS))
         nextToken();
 
-    return make_shared<ReturnStatement>(stmt);
+    return stmt;
 }
 
 shared_ptr<ExpressionStatement> Parser::parseExpressionStatement(){
-    auto stmt = ExpressionStatement{currToken};
-    stmt.expression = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
+    auto stmt = make<ExpressionStatement>(tokens.literal(curr));
+    stmt->expression = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
     if(peekTokenIs(TokenType::SEMICOLON))
         nextToken();
-    return make_shared<ExpressionStatement>(stmt);
+    return stmt;
 }
 
 shared_ptr<ExpressionNode> Parser::parseExpression(int precedence){
-    auto prefixFn = prefixParseFuncs[currToken.type];
-    if(!prefixFn){
-        putError(format("No prefix found for token '", ::to_string(currToken.type), "'"));
+    auto prefixFn = prefixParseFuncs[idx(tokens.type(curr))];
+    if(prefixFn == nullptr){
+        putError(format("No prefix found for token '", ::to_string(tokens.type(curr)), "'"));
         return nullptr;
     }
-    auto leftExpr = prefixFn();
+    auto leftExpr = (this->*prefixFn)();
 
     while(!peekTokenIs(TokenType::SEMICOLON) && precedence < peekPrecedence()){
-        auto infixFn = infixParseFuncs[peekToken.type];
-        if(!infixFn)
+        auto infixFn = infixParseFuncs[idx(tokens.type(curr + 1))];
+        if(infixFn == nullptr)
             return leftExpr;
         nextToken();
-        leftExpr = infixFn(leftExpr);
+        leftExpr = (this->*infixFn)(leftExpr);
     }
 
     return leftExpr;
 }
 
 shared_ptr<BlockStatement> Parser::parseBlockStatement(){
-    auto block = BlockStatement{currToken};
+    auto block = make<BlockStatement>(tokens.literal(curr));
     nextToken();
     while(!currentTokenIs(TokenType::RIGHT_BRACE) && !currentTokenIs(TokenType::EOS)){
         auto stmt = parseStatement();
         if(stmt != nullptr)
-            block.statements.push_back(stmt);
+            block->statements.push_back(stmt);
         nextToken();
     }
-    return make_shared<BlockStatement>(block);
+    return block;
+}
+
+// Preparser: moves to the matching right brace and records the byte span,
+// an unbalanced block is left for parseBlockStatement to report
+bool Parser::skipBlockStatement(FunctionLiteral& fn){
+    size_t depth = 0;
+    for(size_t i = curr; i < tokens.size(); ++i){
+        auto type = tokens.type(i);
+        if(type == TokenType::LEFT_BRACE){
+            depth++;
+        } else if(type == TokenType::RIGHT_BRACE && --depth == 0){
+            fn.bodyBegin = tokens.offset(curr);
+            fn.bodyEnd = tokens.offset(i) + tokens.length(i);
+            curr = i;
+            return true;
+        }
+    }
+    return false;
 }
 
 shared_ptr<vector<Identifier>> Parser::parseFunctionParameters(){
-    vector<Identifier> params{};
+    auto params = make<vector<Identifier>>();
     if(peekTokenIs(TokenType::RIGHT_PAREN)){
         nextToken();
-        return make_shared<vector<Identifier>>(params);
+        return params;
     }
 
+    // parameters are not checked to be identifiers, anything else is bound
+    // under its own text
+    auto param = [&](){
+        auto literal = tokens.literal(curr);
+        params->emplace_back(literal, currentTokenIs(TokenType::IDENT) ? tokens.identifier(curr) : intern(literal));
+    };
     nextToken();
-    auto iden = Identifier{currToken, currToken.literal};
-    params.push_back(iden);
+    param();
 
     while(peekTokenIs(TokenType::COMMA)){
         nextToken();
         nextToken();
-        iden =  Identifier{currToken, currToken.literal};
-        params.push_back(iden);
+        param();
     }
 
     if(!expectPeek(TokenType::RIGHT_PAREN))
         return nullptr;
 
-    return make_shared<vector<Identifier>>(params);
+    return params;
 }
 
 std::shared_ptr<CallExpression::ExprNodeList> Parser::parseCallArguments(){
-    CallExpression::ExprNodeList arguments{};
+    auto arguments = make<CallExpression::ExprNodeList>();
     if(peekTokenIs(TokenType::RIGHT_PAREN)){
         nextToken();
-        return make_shared<CallExpression::ExprNodeList>(arguments);
+        return arguments;
     }
 
     nextToken();
-    arguments.push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
+    arguments->push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
     while(peekTokenIs(TokenType::COMMA)){
         nextToken();
         nextToken();
-        arguments.push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
+        arguments->push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
     }
 
     if(!expectPeek(TokenType::RIGHT_PAREN))
         return nullptr;
 
-    return make_shared<CallExpression::ExprNodeList>(arguments);
+    return arguments;
 }
 
 
 // Partt functions
 shared_ptr<ExpressionNode> Parser::parseIdentifier(){
     //auto expr = Identifier{currToken, currToken.literal};
-    return make_shared<Identifier>(currToken, currToken.literal);
+    return make<Identifier>(tokens.literal(curr), tokens.identifier(curr));
 }
 
 shared_ptr<ExpressionNode> Parser::parseNumberLiteral(){
     //auto expr = NumberLiteral{currToken, ::get<double>(currToken.value)};
-    return make_shared<NumberLiteral>(currToken, std::get<double>(currToken.value));
+    return make<NumberLiteral>(tokens.literal(curr), tokens.number(curr));
 }
 
 shared_ptr<ExpressionNode> Parser::parseStringLiteral(){
-    return make_shared<StringLiteral>(currToken, std::get<string>(currToken.value));
+    return make<StringLiteral>(tokens.literal(curr));
 }
 
 shared_ptr<ExpressionNode> Parser::parseBooleanLiteral(){
-    return make_shared<BooleanLiteral>(currToken, std::get<bool>(currToken.value));
+    return make<BooleanLiteral>(tokens.literal(curr), currentTokenIs(TokenType::TRUE));
 }
 
 shared_ptr<ExpressionNode> Parser::parseArrayLiteral(){
-    auto arrayExpr = ArrayLiteral{currToken};
+    auto arrayExpr = make<ArrayLiteral>(tokens.literal(curr));
     if(peekTokenIs(TokenType::RIGHT_BRACKET)){
         nextToken();
-        return make_shared<ArrayLiteral>(arrayExpr);
+        return arrayExpr;
     }
 
     nextToken();
-    arrayExpr.items.push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
+    arrayExpr->items.push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
     while(peekTokenIs(TokenType::COMMA)){
         nextToken();
         nextToken();
-        arrayExpr.items.push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
+        arrayExpr->items.push_back(parseExpression(static_cast<int>(PrecedenceLevel::LOWEST)));
     }
 
     if(!expectPeek(TokenType::RIGHT_BRACKET))
         return nullptr;
     
-    return make_shared<ArrayLiteral>(arrayExpr);
+    return arrayExpr;
 }
 
 shared_ptr<ExpressionNode> Parser::parseHashLiteral(){
-    auto hashExpr = HashLiteral{currToken};
+    auto hashExpr = make<HashLiteral>(tokens.literal(curr));
     while(!peekTokenIs(TokenType::RIGHT_BRACE)){
         nextToken();
         auto key = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
@@ -251,7 +337,7 @@ shared_ptr<ExpressionNode> Parser::parseHashLiteral(){
         nextToken();
         auto value = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
 
-        hashExpr.entries[key] = value;
+        hashExpr->entries[key] = value;
 
         if(!peekTokenIs(TokenType::RIGHT_BRACE) && !expectPeek(TokenType::COMMA))
             return nullptr;
@@ -260,23 +346,24 @@ shared_ptr<ExpressionNode> Parser::parseHashLiteral(){
     if(!expectPeek(TokenType::RIGHT_BRACE))
         return nullptr;
     
-    return make_shared<HashLiteral>(hashExpr);
+    return hashExpr;
 }
 
 shared_ptr<ExpressionNode> Parser::parsePrefixExpression(){
-    auto expr = PrefixExpression{currToken, currToken.literal};
+    auto opcode = currentTokenIs(TokenType::BANG) ? Opcode::NOT : Opcode::NEGATE;
+    auto expr = make<PrefixExpression>(tokens.literal(curr), opcode);
     nextToken();
-    expr.right = parseExpression(static_cast<int>(PrecedenceLevel::PREFIX));
+    expr->right = parseExpression(static_cast<int>(PrecedenceLevel::PREFIX));
 
-    return make_shared<PrefixExpression>(expr);
+    return expr;
 }
 
 shared_ptr<ExpressionNode> Parser::parseInfixExpression(shared_ptr<ExpressionNode> left) {
-    auto expr = InfixExpression{currToken, currToken.literal, left};
+    auto expr = make<InfixExpression>(tokens.literal(curr), infixOpcodes[idx(tokens.type(curr))], left);
     int precedence = currentPrecedence();
     nextToken();
-    expr.right = parseExpression(precedence);
-    return make_shared<InfixExpression>(expr);
+    expr->right = parseExpression(precedence);
+    return expr;
 }
 
 shared_ptr<ExpressionNode> Parser::parseGroupedExpression(){
@@ -288,93 +375,88 @@ shared_ptr<ExpressionNode> Parser::parseGroupedExpression(){
 }
 
 shared_ptr<ExpressionNode> Parser::parseIfExpression(){
-    auto expr = IfExpression{currToken};
+    auto expr = make<IfExpression>(tokens.literal(curr));
     if(!expectPeek(TokenType::LEFT_PAREN))
         return nullptr;
 
     nextToken();
-    expr.condition = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
+    expr->condition = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
 
     if(!expectPeek(TokenType::RIGHT_PAREN))
         return nullptr;
     if(!expectPeek(TokenType::LEFT_BRACE))
         return nullptr;
 
-    expr.consequence = parseBlockStatement();
+    expr->consequence = parseBlockStatement();
 
     if(peekTokenIs(TokenType::ELSE)){
         nextToken();
         if(!expectPeek(TokenType::LEFT_BRACE))
             return nullptr;
-        expr.alternative = parseBlockStatement();
+        expr->alternative = parseBlockStatement();
     }
 
-    return make_shared<IfExpression>(expr);
+    return expr;
 }
 
 shared_ptr<ExpressionNode> Parser::parseFunctionLiteral(){
-    auto expr = FunctionLiteral{currToken};
+    auto expr = make<FunctionLiteral>(tokens.literal(curr));
     if(!expectPeek(TokenType::LEFT_PAREN))
         return nullptr;
 
-    expr.params = parseFunctionParameters();
+    expr->params = parseFunctionParameters();
 
     if(!expectPeek(TokenType::LEFT_BRACE))
         return nullptr;
 
-    expr.body = parseBlockStatement();
+    if(bodies == FunctionBodies::EAGER || !skipBlockStatement(*expr))
+        expr->body = parseBlockStatement();
+    expr->source = tokens.getSource();
+    expr->arena = arena;
+    if(arena != nullptr)
+        expr->owner = arena;
+    else
+        expr->owner = expr;
 
-    return make_shared<FunctionLiteral>(expr);
+    return expr;
 }
 
 shared_ptr<ExpressionNode> Parser::parseCallExpression(shared_ptr<ExpressionNode> func){
-    auto expr = CallExpression{currToken, func};
-    expr.arguments = parseCallArguments();
-    return make_shared<CallExpression>(expr);
+    auto expr = make<CallExpression>(tokens.literal(curr), func);
+    expr->arguments = parseCallArguments();
+    return expr;
 }
 
 shared_ptr<ExpressionNode> Parser::parseIndexExpression(shared_ptr<ExpressionNode> left){
-    auto expr = IndexExpression{currToken, left};
+    auto expr = make<IndexExpression>(tokens.literal(curr), left);
     nextToken();
-    expr.index = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
+    expr->index = parseExpression(static_cast<int>(PrecedenceLevel::LOWEST));
 
     if(!expectPeek(TokenType::RIGHT_BRACKET))
         return nullptr;
 
-    return make_shared<IndexExpression>(expr);
+    return expr;
 }
 
 // helpers
-void Parser::registerPrefix(TokenType type, PrefixParseFn fn){
-    prefixParseFuncs[type] = fn;
-}
-
-void Parser::registerInfix(TokenType type, InfixParseFn fn){
-    infixParseFuncs[type] = fn;
-}
-
 int Parser::currentPrecedence(){
-    if(precedences.find(currToken.type) == precedences.end())
-        return static_cast<int>(PrecedenceLevel::LOWEST);
-    return precedences[currToken.type];
+    return precedences[idx(tokens.type(curr))];
 }
 
 int Parser::peekPrecedence(){
-    if(precedences.find(peekToken.type) == precedences.end())
-        return static_cast<int>(PrecedenceLevel::LOWEST);
-    return precedences[peekToken.type];
+    return precedences[idx(tokens.type(curr + 1))];
 }
 
 bool Parser::currentTokenIs(TokenType tokenType){
-    return currToken.type == tokenType;
+    return tokens.type(curr) == tokenType;
 }
 
 bool Parser::peekTokenIs(TokenType tokenType){
-    return peekToken.type == tokenType;
+    return tokens.type(curr + 1) == tokenType;
 }
 
 bool Parser::expectPeek(TokenType tokenType){
-    if(peekToken.type != tokenType){
+    if(tokens.type(curr + 1) != tokenType){
         peekError(tokenType);
         return false;
     }
@@ -394,7 +476,7 @@ void Parser::peekError(TokenType tokenType){
     string str = format("Expected next token to be ",
         ::to_string(tokenType),
         ", but got ",
-        ::to_string(peekToken.type),
+        ::to_string(tokens.type(curr + 1)),
         " instead"
     );
     errors.push_back(str);
@@ -1,16 +1,17 @@
 #if !defined(PARSER_H)
 #define PARSER_H
 
+#include <array>
 #include <memory>
 #include <vector>
-#include <unordered_map>
-#include <functional>
 
-class Token;
-enum class TokenType;
+#include "tokens.hpp"
+
 class Lexer;
 class Program;
 class ExpressionNode;
+struct AstArena;
+enum class Opcode;
 
 enum class PrecedenceLevel {
     _, //0
@@ -24,28 +25,57 @@ enum class PrecedenceLevel {
     INDEX,       // index
 };
 
+// Where the parser puts AST nodes: one shared_ptr allocation per node, or a
+// bump arena per program released in one go.
+enum class AstAllocation {
+    HEAP,
+    ARENA,
+};
+
+// LAZY only brace-matches function bodies, they are parsed on first call
+// through parseBody so startup cost follows the code that actually runs.
+enum class FunctionBodies {
+    EAGER,
+    LAZY,
+};
+
 class Parser {
 public:
-    Parser(Lexer&);
+    Parser(Lexer&, AstAllocation = AstAllocation::ARENA, FunctionBodies = FunctionBodies::EAGER);
+    Parser(TokenStream, AstAllocation = AstAllocation::ARENA, FunctionBodies = FunctionBodies::EAGER);
     virtual ~Parser() = default;
     void nextToken();
     std::shared_ptr<Program> parseProgram();
     std::vector<std::string> getErrors();
+    std::shared_ptr<const AstArena> getArena() const { return arena; }
+
+    // Parses the body the preparser skipped, into the arena of the function.
+    // The body stays unparsed when there are errors.
+    static std::vector<std::string> parseBody(FunctionLiteral&);
 
 private:
+    Parser(TokenStream, std::shared_ptr<AstArena>, FunctionBodies);
+
     // type alias
     using ExprNode = std::shared_ptr<ExpressionNode>;
     using ExprNodeList = std::vector<ExprNode>;
-    using PrefixParseFn = std::function<ExprNode()>;
-    using InfixParseFn = std::function<ExprNode(ExprNode)>;
+    using PrefixParseFn = ExprNode (Parser::*)();
+    using InfixParseFn = ExprNode (Parser::*)(ExprNode);
 
-    Lexer lexer;
-    Token currToken;
-    Token peekToken;
+    // Pratt tables indexed by TokenType, built at compile time
+    static const std::array<PrefixParseFn, TOKEN_TYPE_COUNT> prefixParseFuncs;
+    static const std::array<InfixParseFn, TOKEN_TYPE_COUNT> infixParseFuncs;
+    static const std::array<Opcode, TOKEN_TYPE_COUNT> infixOpcodes;
+    static const std::array<int, TOKEN_TYPE_COUNT> precedences;
+
+    TokenStream tokens;
+    size_t curr; // index of the current token, peek is curr + 1
     std::vector<std::string> errors;
-    std::unordered_map<TokenType, PrefixParseFn> prefixParseFuncs;
-    std::unordered_map<TokenType, InfixParseFn> infixParseFuncs;
-    std::unordered_map<TokenType, int> precedences;
+    std::shared_ptr<AstArena> arena; // null in heap mode
+    FunctionBodies bodies;
+
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&...);
 
     std::shared_ptr<StatementNode> parseStatement();
     std::shared_ptr<LetStatement> parseLetStatement();
@@ -53,6 +83,7 @@ private:
     std::shared_ptr<ExpressionStatement> parseExpressionStatement();
     std::shared_ptr<ExpressionNode> parseExpression(int);
     std::shared_ptr<BlockStatement> parseBlockStatement();
+    bool skipBlockStatement(FunctionLiteral&);
     std::shared_ptr<std::vector<Identifier>> parseFunctionParameters();
     std::shared_ptr<ExprNodeList> parseCallArguments();
 
@@ -72,8 +103,6 @@ private:
     std::shared_ptr<ExpressionNode> parseCallExpression(std::shared_ptr<ExpressionNode>);
     std::shared_ptr<ExpressionNode> parseIndexExpression(std::shared_ptr<ExpressionNode>);
 
-    void registerPrefix(TokenType, PrefixParseFn);
-    void registerInfix(TokenType, InfixParseFn);
     int peekPrecedence();
     int currentPrecedence();
     bool currentTokenIs(TokenType);
@@ -0,0 +1,148 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <any>
+
+#include "token.hpp"
+#include "source.hpp"
+#include "lexer.hpp"
+#include "tokens.hpp"
+#include "ast.hpp"
+#include "parser.hpp"
+#include "object.hpp"
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "pipeline.hpp"
+
+using namespace std;
+
+StatementStream::StatementStream(istream& in, FunctionBodies bodies, size_t size):
+    lexer{in}, bodies{bodies}, groupSize{size}, errors{}, done{false} {
+}
+
+StatementStream::StatementStream(int fd, FunctionBodies bodies, size_t size):
+    lexer{fd}, bodies{bodies}, groupSize{size}, errors{}, done{false} {
+}
+
+shared_ptr<Program> StatementStream::next(){
+    if(done)
+        return nullptr;
+
+    // lexer views die with the next token, the group keeps its own copy of
+    // the text: tokens separated by a space, string literals requoted
+    struct Span { TokenType type; size_t offset; size_t length; double number; };
+    string text;
+    vector<Span> spans;
+    int depth = 0;
+    while(true){
+        auto view = lexer.nextToken();
+        if(view.type == TokenType::EOS){
+            done = true;
+            break;
+        }
+        bool quoted = view.type == TokenType::STRING;
+        if(quoted)
+            text += '"';
+        spans.push_back(Span{view.type, text.size(), view.literal.size(), view.number});
+        text.append(view.literal);
+        text += quoted ? "\" " : " ";
+
+        if(view.type == TokenType::LEFT_PAREN || view.type == TokenType::LEFT_BRACKET || view.type == TokenType::LEFT_BRACE)
+            depth++;
+        else if(view.type == TokenType::RIGHT_PAREN || view.type == TokenType::RIGHT_BRACKET || view.type == TokenType::RIGHT_BRACE)
+            depth--;
+        else if(view.type == TokenType::SEMICOLON && depth <= 0 && text.size() >= groupSize)
+            break;
+    }
+    if(!lexer.getError().empty()){
+        errors = {lexer.getError()};
+        done = true;
+        return nullptr;
+    }
+    if(spans.empty())
+        return nullptr;
+
+    auto src = Source::fromString(std::move(text));
+    auto all = src->text();
+    TokenStream tokens{src};
+    for(auto& span: spans)
+        tokens.push(TokenView{span.type, all.substr(span.offset, span.length), span.number});
+    tokens.push(TokenView{TokenType::EOS, all.substr(all.size()), 0});
+
+    Parser parser{std::move(tokens), AstAllocation::ARENA, bodies};
+    auto program = parser.parseProgram();
+    errors = parser.getErrors();
+    if(!errors.empty()){
+        done = true;
+        return nullptr;
+    }
+    return program;
+}
+
+Object runStream(StatementStream& stream, Evaluator& evaluator, const shared_ptr<Environment>& env, bool background){
+    Object result{ObjectType::NIL, 0.0};
+    // false once the program is over
+    auto run = [&](shared_ptr<Program> program){
+        result = evaluator.step(program, env);
+        if(result.type == ObjectType::RETURN){
+            result = any_cast<Object>(result.value);
+            return false;
+        }
+        return result.type != ObjectType::ERROR;
+    };
+
+    if(!background){
+        while(auto program = stream.next())
+            if(!run(program))
+                break;
+        return result;
+    }
+
+    // one group parsed ahead is enough to keep both threads busy
+    const size_t ahead = 2;
+    deque<shared_ptr<Program>> queue;
+    mutex lock;
+    condition_variable changed;
+    bool finished = false; // parser side
+    bool stopped = false; // evaluator side
+
+    thread parser([&](){
+        while(true){
+            auto program = stream.next();
+            unique_lock<mutex> guard{lock};
+            changed.wait(guard, [&](){ return queue.size() < ahead || stopped; });
+            if(program == nullptr || stopped){
+                finished = true;
+                changed.notify_all();
+                return;
+            }
+            queue.push_back(program);
+            changed.notify_all();
+        }
+    });
+
+    while(true){
+        shared_ptr<Program> program;
+        {
+            unique_lock<mutex> guard{lock};
+            changed.wait(guard, [&](){ return !queue.empty() || finished; });
+            if(queue.empty())
+                break;
+            program = queue.front();
+            queue.pop_front();
+            changed.notify_all();
+        }
+        if(!run(program)){
+            lock_guard<mutex> guard{lock};
+            stopped = true;
+            changed.notify_all();
+            break;
+        }
+    }
+    parser.join();
+    return result;
+}
@@ -0,0 +1,47 @@
+#if !defined(PIPELINE_H)
+#define PIPELINE_H
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <istream>
+
+#include "lexer.hpp"
+#include "parser.hpp"
+
+class Program;
+class Object;
+class Environment;
+class Evaluator;
+
+// Program read through a StreamLexer and handed out in groups of top-level
+// statements, each group cut at a ';' outside any bracket once it holds at
+// least groupSize bytes of tokens. Every group is parsed into an arena of
+// its own that lives as long as the group or a closure made from it, so
+// only the text and AST of the group at hand and of live functions stay in
+// memory.
+class StatementStream {
+public:
+    static const size_t DEFAULT_GROUP_SIZE = 64 * 1024;
+
+    StatementStream(std::istream&, FunctionBodies = FunctionBodies::LAZY, size_t = DEFAULT_GROUP_SIZE);
+    StatementStream(int, FunctionBodies = FunctionBodies::LAZY, size_t = DEFAULT_GROUP_SIZE);
+
+    // null at the end of input or after a group with parse or read errors
+    std::shared_ptr<Program> next();
+    std::vector<std::string> getErrors() const { return errors; }
+
+private:
+    StreamLexer lexer;
+    FunctionBodies bodies;
+    size_t groupSize;
+    std::vector<std::string> errors;
+    bool done;
+};
+
+// Evaluates the groups as they come against one environment and stops at a
+// top-level return, an error or a parse error. With background set the
+// next group is parsed on a second thread while the current one runs.
+Object runStream(StatementStream&, Evaluator&, const std::shared_ptr<Environment>&, bool = false);
+
+#endif // PIPELINE_H
@@ -0,0 +1,137 @@
+#include <memory>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "ast.hpp"
+#include "environment.hpp"
+#include "resolver.hpp"
+
+using namespace std;
+
+void Resolver::resolve(Program& program){
+    Resolver resolver;
+    resolver.resolve(static_cast<AstNode*>(&program));
+}
+
+void Resolver::resolveBody(FunctionLiteral& fn, const Environment* closure){
+    // the frames the function closes over, outermost first; the global
+    // environment is the only one without a parent
+    Resolver resolver;
+    for(auto env = closure; env != nullptr && env->getParent() != nullptr; env = env->getParent()){
+        Scope scope{nullptr, {}, true};
+        if(auto names = env->getNames(); names != nullptr){
+            scope.dynamic = false;
+            for(size_t slot = 0; slot < names->size(); ++slot)
+                scope.slots.emplace((*names)[slot], slot);
+        }
+        resolver.scopes.push_back(std::move(scope));
+    }
+    reverse(resolver.scopes.begin(), resolver.scopes.end());
+    resolver.resolveFunction(fn);
+}
+
+void Resolver::declare(AstNode* node, Scope& scope){
+    if(node->kind == NodeKind::FUNCTION)
+        return;
+    if(node->kind == NodeKind::LET){
+        auto symbol = static_cast<LetStatement*>(node)->name.symbol;
+        if(scope.slots.emplace(symbol, scope.names->size()).second)
+            scope.names->push_back(symbol);
+    }
+    forEachChild(node, [&](auto& child){ declare(child.get(), scope); });
+}
+
+void Resolver::resolve(AstNode* node){
+    switch(node->kind){
+    case NodeKind::IDENTIFIER:
+        bind(*static_cast<Identifier*>(node));
+        break;
+    case NodeKind::LET:
+        forEachChild(node, [&](auto& child){ resolve(child.get()); });
+        bind(static_cast<LetStatement*>(node)->name);
+        break;
+    case NodeKind::FUNCTION:
+        resolveFunction(*static_cast<FunctionLiteral*>(node));
+        break;
+    default:
+        forEachChild(node, [&](auto& child){ resolve(child.get()); });
+    }
+}
+
+void Resolver::resolveFunction(FunctionLiteral& fn){
+    // resolved on first call, once there is a body
+    if(fn.body == nullptr)
+        return;
+
+    Scope scope{make_shared<vector<Symbol>>(), {}, false};
+    if(fn.params != nullptr)
+        for(auto& param: *fn.params)
+            if(scope.slots.emplace(param.symbol, scope.names->size()).second)
+                scope.names->push_back(param.symbol);
+    declare(fn.body.get(), scope);
+
+    // past what a slot index holds the frame binds by symbol
+    if(scope.names->size() > numeric_limits<uint16_t>::max())
+        scope = Scope{nullptr, {}, true};
+    fn.locals = scope.names;
+
+    scopes.push_back(std::move(scope));
+    if(fn.params != nullptr)
+        for(auto& param: *fn.params)
+            bind(param);
+    resolve(fn.body.get());
+    scopes.pop_back();
+    markTailCalls(fn.body.get(), true);
+}
+
+// Calls whose value the function returns as is: the last expression of the
+// body or of the branches of an if there, and the value of a return
+void Resolver::markTailCalls(AstNode* node, bool tail){
+    switch(node->kind){
+    case NodeKind::BLOCK: {
+        auto& stmts = static_cast<BlockStatement*>(node)->statements;
+        for(size_t i = 0; i < stmts.size(); ++i)
+            markTailCalls(stmts[i].get(), tail && i + 1 == stmts.size());
+        break;
+    }
+    case NodeKind::EXPRESSION_STATEMENT:
+        if(auto expr = static_cast<ExpressionStatement*>(node)->expression.get())
+            markTailCalls(expr, tail);
+        break;
+    case NodeKind::RETURN:
+        if(auto value = static_cast<ReturnStatement*>(node)->value.get())
+            markTailCalls(value, true);
+        break;
+    case NodeKind::IF: {
+        auto expr = static_cast<IfExpression*>(node);
+        if(expr->consequence != nullptr)
+            markTailCalls(expr->consequence.get(), tail);
+        if(expr->alternative != nullptr)
+            markTailCalls(expr->alternative.get(), tail);
+        break;
+    }
+    case NodeKind::CALL:
+        static_cast<CallExpression*>(node)->tail = tail;
+        break;
+    default:
+        break;
+    }
+}
+
+void Resolver::bind(Identifier& ident){
+    for(size_t i = scopes.size(); i-- > 0;){
+        auto& scope = scopes[i];
+        // whatever the frame binds is only known at runtime
+        if(scope.dynamic){
+            ident.depth = Identifier::DYNAMIC;
+            return;
+        }
+        if(auto it = scope.slots.find(ident.symbol); it != scope.slots.end()){
+            ident.depth = scopes.size() - 1 - i;
+            ident.slot = it->second;
+            return;
+        }
+    }
+    ident.depth = Identifier::GLOBAL;
+}
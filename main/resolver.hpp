@@ -0,0 +1,46 @@
+#if !defined(RESOLVER_H)
+#define RESOLVER_H
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "symbols.hpp"
+
+class AstNode;
+class Program;
+class Identifier;
+class FunctionLiteral;
+class Environment;
+
+// Pass over a parsed program that gives every name used inside a function
+// the frame depth and slot of its binding. The lets of a function body are
+// hoisted into its frame, so a read before the let ran finds the slot empty
+// and the evaluator falls back to a lookup by symbol, as it did before
+// slots. Top-level names stay in the table of the global environment where
+// REPL lines and stream groups keep adding to them.
+class Resolver {
+public:
+    static void resolve(Program&);
+    // Bodies the preparser skipped are resolved on first call, against the
+    // frames of the environment the function closes over.
+    static void resolveBody(FunctionLiteral&, const Environment*);
+
+private:
+    struct Scope {
+        std::shared_ptr<std::vector<Symbol>> names;
+        std::unordered_map<Symbol, uint16_t> slots;
+        bool dynamic; // frame without a layout, names in it are only known at runtime
+    };
+
+    std::vector<Scope> scopes; // innermost last, names in none of them are global
+
+    Resolver() = default;
+    void declare(AstNode*, Scope&);
+    void resolve(AstNode*);
+    void resolveFunction(FunctionLiteral&);
+    static void markTailCalls(AstNode*, bool);
+    void bind(Identifier&);
+};
+
+#endif // RESOLVER_H
@@ -0,0 +1,95 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <any>
+
+#include "utils.hpp"
+#include "ast.hpp"
+#include "object.hpp"
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "optimizer.hpp"
+#include "runtime.hpp"
+
+using namespace std;
+
+static const Object NIL_OBJ = Object{ObjectType::NIL, 0.0};
+
+// no program of its own, only the tables and builtins are used
+Runtime::Runtime(): evaluator{nullptr, Optimization::OFF} {}
+
+Object Runtime::prefix(Opcode op, string_view oprator, const Object& right){
+    return evaluator.evalPrefixExpression(op, oprator, right);
+}
+
+Object Runtime::infix(Opcode op, string_view oprator, const Object& left, const Object& right){
+    return evaluator.evalInfixExpression(op, oprator, left, right);
+}
+
+Object Runtime::index(const Object& left, const Object& idx){
+    return evaluator.evalIndexExpression(left, idx);
+}
+
+Object Runtime::call(const Object& func, vector<Object> args){
+    return evaluator.applyFunction(func, std::move(args));
+}
+
+bool Runtime::truthy(const Object& obj){
+    return evaluator.isTruthy(obj);
+}
+
+Object Runtime::hashKey(const Object& key){
+    if(key.type != ObjectType::NUMBER && key.type != ObjectType::STRING && key.type != ObjectType::BOOLEAN)
+        return Evaluator::raiseError(format("unusable as hash key: ", key.getType()));
+    return key;
+}
+
+Object Runtime::hash(vector<pair<Object, Object>> pairs){
+    auto entries = unordered_map<string, pair<Object, Object>>{};
+    for(auto& [key, value]: pairs)
+        entries[key.hashKey()] = make_pair(std::move(key), std::move(value));
+    return Object{ObjectType::HASH, entries};
+}
+
+Object Runtime::function(const shared_ptr<Environment>& env, const Shape& shape, Body body){
+    auto obj = Object{ObjectType::BUILTIN_FUNCTION, Object::BuiltInFunction{
+        [this, env, &shape, body](vector<Object> args) -> Object {
+            auto frame = shape.locals != nullptr ? make_shared<Environment>(env, shape.locals) : make_shared<Environment>(env);
+            for(size_t i = 0; i < shape.params.size(); ++i){
+                auto& param = shape.params[i];
+                auto value = i < args.size() ? std::move(args[i]) : NIL_OBJ;
+                if(param.slotted)
+                    frame->at(param.slot) = std::move(value);
+                else
+                    frame->set(param.symbol, std::move(value));
+            }
+            return body(*this, frame);
+        }
+    }};
+    obj._tag = "fn";
+    return obj;
+}
+
+Object Runtime::lookup(const Environment& env, Symbol symbol, string_view name){
+    auto value = env.get(symbol);
+    if(value.type != ObjectType::UNDEFINED)
+        return value;
+    return builtin(symbol, name);
+}
+
+Object Runtime::global(const Environment& env, Symbol symbol, string_view name){
+    if(auto bound = env.findGlobal(symbol))
+        return *bound;
+    return builtin(symbol, name);
+}
+
+Object Runtime::builtin(Symbol symbol, string_view name){
+    auto& builtins = Evaluator::builtinTable();
+    if(auto found = builtins.find(symbol); found != builtins.end()){
+        auto& obj = found->second;
+        return obj.type == ObjectType::BUILTIN_OBJECT ? *any_cast<Object>(&obj.value) : obj;
+    }
+    return Evaluator::raiseError(format("identifier not found: ", name));
+}
@@ -0,0 +1,57 @@
+#if !defined(RUNTIME_H)
+#define RUNTIME_H
+
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "symbols.hpp"
+
+// What C++ the Transpiler generated runs on: the evaluator's operator
+// tables, builtins and calls, over the same values and environments. Code
+// only reaches here where it could not prove the types involved.
+class Runtime {
+public:
+    // body of a function literal, run against its new frame
+    using Body = Object (*)(Runtime&, const std::shared_ptr<Environment>&);
+
+    struct Param {
+        Symbol symbol;
+        bool slotted; // bound in a slot of the frame, not by symbol
+        uint16_t slot;
+    };
+    // frame layout of a function literal, as the resolver made it
+    struct Shape {
+        std::shared_ptr<const std::vector<Symbol>> locals;
+        std::vector<Param> params;
+    };
+
+    Runtime();
+
+    Object prefix(Opcode, std::string_view, const Object&);
+    Object infix(Opcode, std::string_view, const Object&, const Object&);
+    Object index(const Object&, const Object&);
+    Object call(const Object&, std::vector<Object>);
+    bool truthy(const Object&);
+    // a hashable key is returned as is, anything else is an error
+    Object hashKey(const Object&);
+    Object hash(std::vector<std::pair<Object, Object>>);
+    // functions are builtin functions of the runtime, closing over env
+    Object function(const std::shared_ptr<Environment>&, const Shape&, Body);
+
+    // names a slot did not bind, then the global table, then the builtins
+    Object lookup(const Environment&, Symbol, std::string_view);
+    Object global(const Environment&, Symbol, std::string_view);
+    // a name bound nowhere, an error unless it is a builtin
+    Object builtin(Symbol, std::string_view);
+
+private:
+    Evaluator evaluator;
+};
+
+#endif // RUNTIME_H
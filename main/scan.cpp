@@ -0,0 +1,200 @@
+#include <cstdint>
+
+#include "scan.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAS_X86_SIMD
+#endif
+
+namespace {
+
+// character classes, scalar and vector forms must agree byte for byte
+struct Whitespace {
+    static bool match(unsigned char c){
+        return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+    }
+#if defined(HAS_X86_SIMD)
+    static __m128i match(__m128i v){
+        auto ctl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        auto isCtl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8('\r' - '\t')), ctl);
+        return _mm_or_si128(isCtl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    }
+    __attribute__((target("avx2")))
+    static __m256i match(__m256i v){
+        auto ctl = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+        auto isCtl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8('\r' - '\t')), ctl);
+        return _mm256_or_si256(isCtl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    }
+#endif
+};
+
+struct Letter {
+    static bool match(unsigned char c){
+        return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || c == '_';
+    }
+#if defined(HAS_X86_SIMD)
+    static __m128i match(__m128i v){
+        auto lower = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        auto isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(lower, _mm_set1_epi8('z' - 'a')), lower);
+        return _mm_or_si128(isAlpha, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+    __attribute__((target("avx2")))
+    static __m256i match(__m256i v){
+        auto lower = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        auto isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(lower, _mm256_set1_epi8('z' - 'a')), lower);
+        return _mm256_or_si256(isAlpha, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    }
+#endif
+};
+
+struct Digit {
+    static bool match(unsigned char c){
+        return (unsigned char)(c - '0') <= 9;
+    }
+#if defined(HAS_X86_SIMD)
+    static __m128i match(__m128i v){
+        auto d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    }
+    __attribute__((target("avx2")))
+    static __m256i match(__m256i v){
+        auto d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    }
+#endif
+};
+
+// everything but the closing quote belongs to a string literal
+struct NotQuote {
+    static bool match(unsigned char c){
+        return c != '"';
+    }
+#if defined(HAS_X86_SIMD)
+    static __m128i match(__m128i v){
+        return _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_set1_epi8(-1));
+    }
+    __attribute__((target("avx2")))
+    static __m256i match(__m256i v){
+        return _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_set1_epi8(-1));
+    }
+#endif
+};
+
+template <typename Class>
+const char* skipScalar(const char* p, const char* end){
+    while(p < end && Class::match((unsigned char)*p))
+        p++;
+    return p;
+}
+
+#if defined(HAS_X86_SIMD)
+template <typename Class>
+const char* skipSse2(const char* p, const char* end){
+    while(end - p >= 16){
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~(unsigned)_mm_movemask_epi8(Class::match(block)) & 0xFFFF;
+        if(miss)
+            return p + __builtin_ctz(miss);
+        p += 16;
+    }
+    return skipScalar<Class>(p, end);
+}
+
+template <typename Class>
+__attribute__((target("avx2")))
+const char* skipAvx2(const char* p, const char* end){
+    // most runs are short, settle them with one 16 byte block first
+    if(end - p >= 16){
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~(unsigned)_mm_movemask_epi8(Class::match(block)) & 0xFFFF;
+        if(miss)
+            return p + __builtin_ctz(miss);
+        p += 16;
+    }
+    while(end - p >= 32){
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned miss = ~(unsigned)_mm256_movemask_epi8(Class::match(block));
+        if(miss)
+            return p + __builtin_ctz(miss);
+        p += 32;
+    }
+    return skipSse2<Class>(p, end);
+}
+#endif
+
+using SkipFn = const char* (*)(const char*, const char*);
+
+struct ScanTable {
+    ScanPath path;
+    SkipFn whitespace;
+    SkipFn letters;
+    SkipFn digits;
+    SkipFn string;
+};
+
+template <typename Class>
+SkipFn skipFor(ScanPath path){
+#if defined(HAS_X86_SIMD)
+    if(path == ScanPath::AVX2)
+        return skipAvx2<Class>;
+    if(path == ScanPath::SSE2)
+        return skipSse2<Class>;
+#endif
+    return skipScalar<Class>;
+}
+
+ScanPath bestPath(){
+#if defined(HAS_X86_SIMD)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return ScanPath::AVX2;
+    return ScanPath::SSE2; // part of the x86-64 baseline
+#else
+    return ScanPath::SCALAR;
+#endif
+}
+
+ScanTable makeTable(ScanPath path){
+    return ScanTable{
+        path,
+        skipFor<Whitespace>(path),
+        skipFor<Letter>(path),
+        skipFor<Digit>(path),
+        skipFor<NotQuote>(path),
+    };
+}
+
+ScanTable& table(){
+    static ScanTable scan = makeTable(bestPath());
+    return scan;
+}
+
+} // namespace
+
+const char* skipWhitespaceRun(const char* begin, const char* end){
+    return table().whitespace(begin, end);
+}
+
+const char* skipLetterRun(const char* begin, const char* end){
+    return table().letters(begin, end);
+}
+
+const char* skipDigitRun(const char* begin, const char* end){
+    return table().digits(begin, end);
+}
+
+const char* findQuote(const char* begin, const char* end){
+    return table().string(begin, end);
+}
+
+ScanPath scanPath(){
+    return table().path;
+}
+
+ScanPath setScanPath(ScanPath path){
+    if(static_cast<int>(path) > static_cast<int>(bestPath()))
+        path = bestPath();
+    table() = makeTable(path);
+    return path;
+}
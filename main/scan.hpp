@@ -0,0 +1,24 @@
+#if !defined(SCAN_H)
+#define SCAN_H
+
+// Block classifiers used by the lexer hot loops. Each one returns the first
+// position in [begin, end) that does not belong to the scanned run, or end.
+// Character classes follow the "C" locale: isspace, isalpha + '_', isdigit.
+
+enum class ScanPath {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+const char* skipWhitespaceRun(const char*, const char*);
+const char* skipLetterRun(const char*, const char*);
+const char* skipDigitRun(const char*, const char*);
+const char* findQuote(const char*, const char*);
+
+// The fastest path the cpu supports is picked on first use, setScanPath
+// lets tests and benchmarks force another one (clamped to what is supported).
+ScanPath scanPath();
+ScanPath setScanPath(ScanPath);
+
+#endif // SCAN_H
@@ -0,0 +1,61 @@
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAS_MMAP
+#endif
+
+#include "source.hpp"
+
+using namespace std;
+
+Source::Source(string text): owned{std::move(text)}, mapped{false} {
+    data = owned.data();
+    size = owned.size();
+}
+
+Source::Source(const char* addr, size_t len): owned{}, data{addr}, size{len}, mapped{true} {
+}
+
+Source::~Source(){
+#if defined(HAS_MMAP)
+    if(mapped)
+        munmap(const_cast<char*>(data), size);
+#endif
+}
+
+shared_ptr<Source> Source::fromString(string text){
+    return make_shared<Source>(std::move(text));
+}
+
+shared_ptr<Source> Source::fromFile(const string& path){
+#if defined(HAS_MMAP)
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr != MAP_FAILED){
+            close(fd);
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            return make_shared<Source>(static_cast<const char*>(addr), (size_t)st.st_size);
+        }
+    }
+    close(fd);
+#endif
+    // empty files, pipes and platforms without mmap are read the plain way
+    ifstream in{path, ios::binary};
+    if(!in)
+        return nullptr;
+    stringstream ss;
+    ss << in.rdbuf();
+    return fromString(ss.str());
+}
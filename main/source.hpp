@@ -0,0 +1,32 @@
+#if !defined(SOURCE_H)
+#define SOURCE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+// Immutable program text shared by the lexer and everything built on top of it.
+// The text either lives in an owned string or in a read-only memory mapping.
+class Source {
+public:
+    Source(std::string);
+    Source(const char*, size_t); // takes ownership of a mapping
+    ~Source();
+
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+
+    static std::shared_ptr<Source> fromString(std::string);
+    static std::shared_ptr<Source> fromFile(const std::string&); // nullptr on failure
+
+    std::string_view text() const { return std::string_view{data, size}; }
+    bool isMapped() const { return mapped; }
+
+private:
+    std::string owned;
+    const char* data;
+    size_t size;
+    bool mapped;
+};
+
+#endif // SOURCE_H
@@ -0,0 +1,296 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <utility>
+#include <unordered_map>
+#include <any>
+
+#include "utils.hpp"
+#include "ast.hpp"
+#include "object.hpp"
+#include "fobject.hpp"
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "stackmachine.hpp"
+
+using namespace std;
+
+static const Object NIL_OBJ = Object{ObjectType::NIL, 0.0};
+
+Object StackMachine::run(AstNode* root, const shared_ptr<Environment>& env){
+    calls.push_back(Call{env, nullptr});
+    failed = false;
+    push(root);
+    while(!work.empty() && !failed)
+        step();
+
+    auto result = failed ? failure : values.back();
+    work.clear();
+    values.clear();
+    calls.clear();
+    failure = NIL_OBJ;
+    return result;
+}
+
+// Leaves are evaluated right away, anything with children gets a frame
+void StackMachine::push(AstNode* node){
+    if(node == nullptr)
+        return produce(NIL_OBJ);
+    switch(node->kind){
+    case NodeKind::IDENTIFIER:
+    case NodeKind::CONSTANT:
+    case NodeKind::NUMBER:
+    case NodeKind::STRING:
+    case NodeKind::BOOLEAN:
+    case NodeKind::FUNCTION:
+        return produce(evaluator.eval(node, calls.back().env));
+    default:
+        work.push_back(Frame{node, 0, static_cast<uint32_t>(values.size())});
+    }
+}
+
+// errors end the run, as they end every evaluation they happen in
+void StackMachine::produce(Object value){
+    if(value.type == ObjectType::ERROR)
+        return fail(std::move(value));
+    values.push_back(std::move(value));
+}
+
+// value of the top frame, in place of what its children left
+void StackMachine::finish(Object value){
+    values.erase(values.begin() + work.back().base, values.end());
+    work.pop_back();
+    produce(std::move(value));
+}
+
+void StackMachine::fail(Object error){
+    failure = std::move(error);
+    failed = true;
+}
+
+// Unwinds to the call being returned from, a return in code run outside
+// any function ends it as a RETURN unless that code is a whole program
+void StackMachine::returning(Object value){
+    while(!work.empty() && work.back().node->kind != NodeKind::FUNCTION && work.back().node->kind != NodeKind::PROGRAM)
+        work.pop_back();
+    if(work.empty()){
+        values.clear();
+        values.push_back(Object{ObjectType::RETURN, value});
+        return;
+    }
+    if(work.back().node->kind == NodeKind::FUNCTION)
+        calls.pop_back();
+    finish(std::move(value));
+}
+
+void StackMachine::step(){
+    // copied, pushing may move the stack
+    auto frame = work.back();
+    work.back().state++;
+    auto node = frame.node;
+    auto state = frame.state;
+    auto& env = calls.back().env;
+
+    switch(node->kind){
+    case NodeKind::PROGRAM: {
+        auto& stmts = static_cast<Program*>(node)->statements;
+        if(stmts.empty())
+            return finish(NIL_OBJ);
+        if(state > 0 && state < stmts.size())
+            values.pop_back();
+        if(state < stmts.size())
+            return push(stmts[state].get());
+        work.pop_back(); // the last statement's value is the program's
+        return;
+    }
+
+    // the last statement takes the block's place
+    case NodeKind::BLOCK: {
+        auto& stmts = static_cast<BlockStatement*>(node)->statements;
+        if(stmts.empty())
+            return finish(NIL_OBJ);
+        if(state > 0)
+            values.pop_back();
+        if(state + 1 == stmts.size())
+            work.pop_back();
+        return push(stmts[state].get());
+    }
+
+    case NodeKind::EXPRESSION_STATEMENT:
+        work.pop_back();
+        return push(static_cast<ExpressionStatement*>(node)->expression.get());
+
+    case NodeKind::LET: {
+        auto letStmt = static_cast<LetStatement*>(node);
+        if(state == 0)
+            return push(letStmt->value.get());
+        if(letStmt->name.depth == 0)
+            env->at(letStmt->name.slot) = values.back();
+        else
+            env->set(letStmt->name.symbol, values.back());
+        work.pop_back();
+        return;
+    }
+
+    case NodeKind::RETURN: {
+        if(state == 0)
+            return push(static_cast<ReturnStatement*>(node)->value.get());
+        auto value = values.back();
+        values.pop_back();
+        return returning(std::move(value));
+    }
+
+    case NodeKind::IF: {
+        auto expr = static_cast<IfExpression*>(node);
+        if(state == 0)
+            return push(expr->condition.get());
+        auto& condition = values.back();
+        bool truthy = expr->booleanCondition ? *any_cast<bool>(&condition.value) : evaluator.isTruthy(condition);
+        values.pop_back();
+        work.pop_back();
+        if(truthy)
+            return push(expr->consequence.get());
+        if(expr->alternative != nullptr)
+            return push(expr->alternative.get());
+        return produce(NIL_OBJ);
+    }
+
+    case NodeKind::PREFIX: {
+        auto expr = static_cast<PrefixExpression*>(node);
+        if(state == 0)
+            return push(expr->right.get());
+        return finish(evaluator.evalPrefixExpression(expr, values.back()));
+    }
+
+    case NodeKind::INFIX: {
+        auto expr = static_cast<InfixExpression*>(node);
+        if(state == 0)
+            return push(expr->left.get());
+        if(state == 1)
+            return push(expr->right.get());
+        return finish(evaluator.evalInfixExpression(expr, values[values.size() - 2], values.back()));
+    }
+
+    case NodeKind::INDEX: {
+        auto expr = static_cast<IndexExpression*>(node);
+        if(state == 0)
+            return push(expr->left.get());
+        if(state == 1)
+            return push(expr->index.get());
+        return finish(evaluator.evalIndexExpression(expr, values[values.size() - 2], values.back()));
+    }
+
+    case NodeKind::ARRAY: {
+        auto& items = static_cast<ArrayLiteral*>(node)->items;
+        if(state < items.size())
+            return push(items[state].get());
+        return finish(Object{ObjectType::ARRAY, vector<Object>(values.begin() + frame.base, values.end())});
+    }
+
+    // keys and values of the entries in turn, a key checked before its value
+    case NodeKind::HASH: {
+        auto& entries = static_cast<HashLiteral*>(node)->entries;
+        if(state < 2 * entries.size()){
+            auto entry = next(entries.begin(), state / 2);
+            if(state % 2 == 0)
+                return push(entry->first.get());
+            auto& key = values.back();
+            if(key.type != ObjectType::NUMBER && key.type != ObjectType::STRING && key.type != ObjectType::BOOLEAN)
+                return fail(Evaluator::raiseError(format("unusable as hash key: ", key.getType())));
+            return push(entry->second.get());
+        }
+        auto hash = unordered_map<string, pair<Object, Object>>{};
+        for(size_t i = frame.base; i < values.size(); i += 2)
+            hash[values[i].hashKey()] = make_pair(values[i], values[i + 1]);
+        return finish(Object{ObjectType::HASH, hash});
+    }
+
+    case NodeKind::CALL: {
+        auto callExpr = static_cast<CallExpression*>(node);
+        if(state == 0)
+            return push(callExpr->function.get());
+        auto& arguments = *callExpr->arguments;
+        if(state <= arguments.size())
+            return push(arguments[state - 1].get());
+        return call(callExpr, frame.base);
+    }
+
+    // arguments go to the slots the copied body reads
+    case NodeKind::INLINE: {
+        auto inlined = static_cast<InlineCall*>(node);
+        if(state == 0){
+            auto callee = static_cast<Identifier*>(inlined->call->function.get());
+            auto bound = callee->depth >= 0 ? &env->at(callee->depth, callee->slot) : env->findGlobal(callee->symbol);
+            auto funcObject = bound != nullptr && bound->type == ObjectType::FUNCTION ?
+                any_cast<FunctionObject>(&bound->value) : nullptr;
+            if(funcObject == nullptr || funcObject->func.get() != inlined->function.get()){
+                work.pop_back();
+                return push(inlined->call.get());
+            }
+        }
+        auto& arguments = *inlined->call->arguments;
+        if(state < arguments.size())
+            return push(arguments[state].get());
+        for(size_t i = 0; i < arguments.size(); ++i)
+            env->at(inlined->slot + i) = values[frame.base + i];
+        values.erase(values.begin() + frame.base, values.end());
+        work.pop_back();
+        return push(inlined->body.get());
+    }
+
+    // a call in progress, its body's value is the call's
+    case NodeKind::FUNCTION: {
+        if(state == 0)
+            return push(static_cast<FunctionLiteral*>(node)->body.get());
+        auto value = values.back();
+        calls.pop_back();
+        return finish(std::move(value));
+    }
+
+    default:
+        return finish(NIL_OBJ);
+    }
+}
+
+// The function and its arguments are on the value stack from base. A
+// function literal's frame takes the place of the call's, a tail call's
+// that of the call it ends.
+void StackMachine::call(CallExpression* callExpr, uint32_t base){
+    auto function = values[base];
+    auto args = vector<Object>(values.begin() + base + 1, values.end());
+
+    if(function.type == ObjectType::FUNCTION){
+        auto funcObject = any_cast<FunctionObject>(&function.value);
+        Object error;
+        if(!evaluator.prepare(*funcObject, error))
+            return fail(std::move(error));
+
+        size_t at = work.size() - 1;
+        if(callExpr->tail){
+            while(at > 0 && work[at].node->kind != NodeKind::FUNCTION)
+                --at;
+        }
+        shared_ptr<Environment> reused;
+        if(work[at].node->kind == NodeKind::FUNCTION){
+            reused = std::move(calls.back().env);
+            calls.pop_back();
+            work.resize(at + 1);
+        } else if(calls.size() > maxDepth){
+            return fail(Evaluator::raiseError("stack overflow"));
+        } else {
+            at = work.size() - 1;
+        }
+        values.erase(values.begin() + work[at].base, values.end());
+        calls.push_back(Call{evaluator.enter(*funcObject, args, reused), funcObject->func});
+        work[at] = Frame{funcObject->func.get(), 0, work[at].base};
+        return;
+    }
+
+    if(function.type == ObjectType::BUILTIN_FUNCTION){
+        auto funcLamda = any_cast<Object::BuiltInFunction>(&function.value);
+        return finish((*funcLamda)(std::move(args)));
+    }
+
+    return fail(Evaluator::raiseError(format("not a function ", function.getType())));
+}
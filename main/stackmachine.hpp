@@ -0,0 +1,62 @@
+#if !defined(STACKMACHINE_H)
+#define STACKMACHINE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "object.hpp"
+
+class AstNode;
+class CallExpression;
+class FunctionLiteral;
+class Environment;
+class Evaluator;
+
+// The tree-walker without its recursion: every node still being evaluated
+// is a small Frame on a work stack, the values its children produced wait
+// on a value stack next to it. Both live on the heap, so how deep calls go
+// is a setting and going past it is an error instead of a crash. Nodes,
+// operators, values and environments are the Evaluator's own.
+class StackMachine {
+public:
+    static constexpr size_t DEFAULT_MAX_DEPTH = 100000; // calls in progress
+
+    StackMachine(Evaluator& evaluator, size_t maxDepth = DEFAULT_MAX_DEPTH):
+        evaluator{evaluator}, maxDepth{maxDepth} {};
+    // a return outside any function comes back as a RETURN object unless
+    // the node is the whole program
+    Object run(AstNode*, const std::shared_ptr<Environment>&);
+    void setMaxDepth(size_t depth){ maxDepth = depth; }
+
+private:
+    struct Frame {
+        AstNode* node; // a function literal stands for a call of it
+        uint32_t state; // steps taken, mostly children evaluated
+        uint32_t base; // height of the value stack when it started
+    };
+
+    // a call in progress, the literal kept alive while its body runs
+    struct Call {
+        std::shared_ptr<Environment> env;
+        std::shared_ptr<FunctionLiteral> function; // null for the code run
+    };
+
+    Evaluator& evaluator;
+    size_t maxDepth;
+    std::vector<Frame> work;
+    std::vector<Object> values;
+    std::vector<Call> calls; // innermost last
+    Object failure;
+    bool failed = false;
+
+    void step();
+    void push(AstNode*);
+    void produce(Object);
+    void finish(Object);
+    void call(CallExpression*, uint32_t);
+    void returning(Object);
+    void fail(Object);
+};
+
+#endif // STACKMACHINE_H
@@ -0,0 +1,45 @@
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "symbols.hpp"
+
+using namespace std;
+
+// names never move once stored, the index and the views handed out point
+// into them
+struct SymbolTable {
+    mutex lock;
+    deque<string> names;
+    unordered_map<string_view, Symbol> index;
+};
+
+static SymbolTable& symbols(){
+    static SymbolTable table;
+    return table;
+}
+
+Symbol intern(string_view name){
+    auto& table = symbols();
+    lock_guard<mutex> guard{table.lock};
+    if(auto it = table.index.find(name); it != table.index.end())
+        return it->second;
+    Symbol symbol = table.names.size();
+    table.names.emplace_back(name);
+    table.index.emplace(table.names.back(), symbol);
+    return symbol;
+}
+
+string_view symbolName(Symbol symbol){
+    auto& table = symbols();
+    lock_guard<mutex> guard{table.lock};
+    return table.names[symbol];
+}
+
+size_t symbolCount(){
+    auto& table = symbols();
+    lock_guard<mutex> guard{table.lock};
+    return table.names.size();
+}
@@ -0,0 +1,21 @@
+#if !defined(SYMBOLS_H)
+#define SYMBOLS_H
+
+#include <cstdint>
+#include <string_view>
+
+// Identifier names interned once for the whole process, everything past the
+// lexer refers to them by this id. Ids are dense and handed out in order of
+// first use, equal names always get the same id.
+using Symbol = uint32_t;
+
+// Safe to call from any thread, the parallel lexer and the pipeline parser
+// intern concurrently with the evaluator.
+Symbol intern(std::string_view);
+
+// The returned view stays valid for the life of the process.
+std::string_view symbolName(Symbol);
+
+size_t symbolCount();
+
+#endif // SYMBOLS_H
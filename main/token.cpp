@@ -1,6 +1,7 @@
 #include <string>
 #include <sstream>
 #include <map>
+#include <charconv>
 
 #include <cstdlib>
 
@@ -85,6 +86,15 @@ std::string to_string(const TokenType& type){
     }
 }
 
+double parseNumber(string_view digits){
+    unsigned long long val = 0;
+    auto res = from_chars(digits.data(), digits.data() + digits.size(), val);
+    if(res.ec == errc{})
+        return (double)val;
+    // too large for an integer, let strtod round it
+    return strtod(string(digits).c_str(), nullptr);
+}
+
 Token makeToken(TokenType type, std::string literal){
     Token token{
         type,
@@ -94,7 +104,7 @@ Token makeToken(TokenType type, std::string literal){
         0
     };
     if(type == TokenType::NUMBER)
-        token.value = (double)atoi(literal.c_str());
+        token.value = parseNumber(literal);
     else if(type == TokenType::TRUE)
         token.value = true;
     else if(type == TokenType::FALSE)
@@ -102,6 +112,23 @@ Token makeToken(TokenType type, std::string literal){
     return token;
 }
 
+Token makeToken(const TokenView& view){
+    Token token{
+        view.type,
+        string(view.literal),
+        string(view.literal),
+        0,
+        0
+    };
+    if(view.type == TokenType::NUMBER)
+        token.value = view.number;
+    else if(view.type == TokenType::TRUE)
+        token.value = true;
+    else if(view.type == TokenType::FALSE)
+        token.value = false;
+    return token;
+}
+
 Token makeToken(TokenType type, char ch){
     return makeToken(type, string(1, ch));
 }
@@ -114,16 +141,3 @@ string tokenToString(const Token& token){
     ss << "}";
     return ss.str();
 }
-
-unordered_map<string, TokenType> makeKeywords(){
-    unordered_map<string, TokenType> words;
-    words["fn"] = TokenType::FUNC;
-    words["let"] = TokenType::LET;
-    words["true"] = TokenType::TRUE;
-    words["false"] = TokenType::FALSE;
-    words["if"] = TokenType::IF;
-    words["else"] = TokenType::ELSE;
-    words["return"] = TokenType::RETURN;
-
-    return words;
-}
\ No newline at end of file
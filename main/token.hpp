@@ -1,8 +1,10 @@
 #if !defined(TOKEN_H)
+#define TOKEN_H
 
+#include <array>
 #include <string>
+#include <string_view>
 #include <variant>
-#include <unordered_map>
 
 enum class TokenType {
     // Single-character tokens.
@@ -28,6 +30,8 @@ enum class TokenType {
     EOS
 };
 
+inline constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::EOS) + 1;
+
 struct Token {
     TokenType type;
     std::string literal;
@@ -36,14 +40,99 @@ struct Token {
     int column;
 };
 
+// Allocation free token handed out by ViewLexer, literal points into the
+// lexed buffer and stays valid as long as that buffer does.
+struct TokenView {
+    TokenType type;
+    std::string_view literal;
+    double number; // value of NUMBER tokens
+};
+
 std::string to_string(const TokenType&);
 
+double parseNumber(std::string_view);
+
 Token makeToken(TokenType, std::string);
 
+Token makeToken(const TokenView&);
+
 Token makeToken(TokenType, char);
 
 std::string tokenToString(const Token&);
 
-std::unordered_map<std::string, TokenType> makeKeywords();
+// Keywords, the only list of them. Lookup goes through a perfect hash
+// table derived from this list at compile time.
+struct Keyword {
+    std::string_view word;
+    TokenType type;
+};
+
+inline constexpr Keyword KEYWORDS[] = {
+    {"fn", TokenType::FUNC},
+    {"let", TokenType::LET},
+    {"true", TokenType::TRUE},
+    {"false", TokenType::FALSE},
+    {"if", TokenType::IF},
+    {"else", TokenType::ELSE},
+    {"return", TokenType::RETURN},
+};
+
+inline constexpr size_t KEYWORD_TABLE_SIZE = 16;
+
+constexpr size_t keywordSlot(std::string_view word, size_t multiplier){
+    return (word.size() * multiplier + (unsigned char)word[0]) % KEYWORD_TABLE_SIZE;
+}
+
+// smallest multiplier for which (length, first char) hashes without collision
+constexpr size_t findKeywordMultiplier(){
+    for(size_t multiplier = 1; multiplier < 64; ++multiplier){
+        bool used[KEYWORD_TABLE_SIZE] = {};
+        bool collision = false;
+        for(auto& keyword: KEYWORDS){
+            auto slot = keywordSlot(keyword.word, multiplier);
+            collision = collision || used[slot];
+            used[slot] = true;
+        }
+        if(!collision)
+            return multiplier;
+    }
+    return 0;
+}
+
+inline constexpr size_t KEYWORD_MULTIPLIER = findKeywordMultiplier();
+static_assert(KEYWORD_MULTIPLIER != 0, "no perfect hash for KEYWORDS, grow KEYWORD_TABLE_SIZE");
+
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> makeKeywordTable(){
+    std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+    for(auto& slot: table)
+        slot = Keyword{"", TokenType::IDENT};
+    for(auto& keyword: KEYWORDS)
+        table[keywordSlot(keyword.word, KEYWORD_MULTIPLIER)] = keyword;
+    return table;
+}
+
+inline constexpr auto KEYWORD_TABLE = makeKeywordTable();
+
+constexpr std::pair<size_t, size_t> keywordLengths(){
+    size_t shortest = KEYWORDS[0].word.size(), longest = shortest;
+    for(auto& keyword: KEYWORDS){
+        shortest = keyword.word.size() < shortest ? keyword.word.size() : shortest;
+        longest = keyword.word.size() > longest ? keyword.word.size() : longest;
+    }
+    return {shortest, longest};
+}
+
+inline constexpr auto KEYWORD_LENGTHS = keywordLengths();
+
+// IDENT unless word is a keyword, needs no allocation
+constexpr TokenType lookupKeyword(std::string_view word){
+    if(word.size() < KEYWORD_LENGTHS.first || word.size() > KEYWORD_LENGTHS.second)
+        return TokenType::IDENT;
+    auto& slot = KEYWORD_TABLE[keywordSlot(word, KEYWORD_MULTIPLIER)];
+    return slot.word == word ? slot.type : TokenType::IDENT;
+}
+
+static_assert(lookupKeyword("return") == TokenType::RETURN);
+static_assert(lookupKeyword("fnx") == TokenType::IDENT);
  
 #endif // TOKEN_H
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+
+#include "token.hpp"
+#include "source.hpp"
+#include "lexer.hpp"
+#include "tokens.hpp"
+#include "symbols.hpp"
+#include "utils.hpp"
+
+using namespace std;
+
+TokenStream::TokenStream(shared_ptr<const Source> src): source{src} {
+}
+
+TokenStream TokenStream::tokenize(shared_ptr<const Source> src){
+    return tokenize(src, 0, src->text().size());
+}
+
+TokenStream TokenStream::tokenize(shared_ptr<const Source> src, size_t begin, size_t end){
+    TokenStream stream{src};
+    if(src->text().size() > MAX_SOURCE_SIZE){
+        stream.push(TokenView{TokenType::EOS, src->text().substr(0, 0), 0});
+        return stream;
+    }
+    stream.reserve(end - begin);
+
+    ViewLexer lexer{src->text().substr(begin, end - begin)};
+    TokenView view;
+    do {
+        view = lexer.nextToken();
+        stream.push(view);
+    } while(view.type != TokenType::EOS);
+    return stream;
+}
+
+TokenStream TokenStream::tokenizeParallel(shared_ptr<const Source> src, unsigned threads, size_t minChunk){
+    auto text = src->text();
+    if(threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    threads = min<size_t>(threads, text.size() / max<size_t>(minChunk, 1));
+    // a NUL outside a string ends the program early, leave that to tokenize
+    if(threads <= 1 || text.size() > MAX_SOURCE_SIZE || memchr(text.data(), 0, text.size()) != nullptr)
+        return tokenize(src);
+
+    // quote counts per slice give the string parity at every slice start
+    vector<size_t> quotes(threads);
+    vector<size_t> bounds(threads + 1);
+    for(unsigned i = 0; i < threads; ++i)
+        bounds[i] = text.size() / threads * i;
+    bounds[threads] = text.size();
+    {
+        vector<thread> workers;
+        for(unsigned i = 0; i < threads; ++i)
+            workers.emplace_back([&, i](){
+                quotes[i] = count(text.begin() + bounds[i], text.begin() + bounds[i + 1], '"');
+            });
+        for(auto& worker: workers)
+            worker.join();
+    }
+
+    // move each split point forward to whitespace outside any string
+    // literal, no token spans such a character
+    size_t parity = 0;
+    for(unsigned i = 1; i < threads; ++i){
+        parity += quotes[i - 1];
+        size_t pos = bounds[i];
+        bool inString = parity % 2 == 1;
+        while(pos < text.size()){
+            if(text[pos] == '"')
+                inString = !inString;
+            else if(!inString && isWhitespace(text[pos]))
+                break;
+            pos++;
+        }
+        bounds[i] = pos;
+    }
+
+    vector<TokenStream> chunks(threads, TokenStream{src});
+    {
+        vector<thread> workers;
+        for(unsigned i = 0; i < threads; ++i)
+            workers.emplace_back([&, i](){
+                auto& chunk = chunks[i];
+                chunk.reserve(bounds[i + 1] - bounds[i]);
+                ViewLexer lexer{text.substr(bounds[i], bounds[i + 1] - bounds[i])};
+                for(auto view = lexer.nextToken(); view.type != TokenType::EOS; view = lexer.nextToken())
+                    chunk.push(view);
+            });
+        for(auto& worker: workers)
+            worker.join();
+    }
+
+    // every chunk is copied into its own slice of the result, identifiers
+    // are symbols already and need no renumbering
+    TokenStream stream{src};
+    vector<size_t> tokenBase(threads + 1, 0);
+    vector<uint32_t> constantBase(threads + 1, 0);
+    for(unsigned i = 0; i < threads; ++i){
+        stream.mergeIdentifiers(chunks[i]);
+        tokenBase[i + 1] = tokenBase[i] + chunks[i].size();
+        constantBase[i + 1] = constantBase[i] + chunks[i].constants.size();
+    }
+    stream.types.resize(tokenBase[threads]);
+    stream.offsets.resize(tokenBase[threads]);
+    stream.lengths.resize(tokenBase[threads]);
+    stream.payloads.resize(tokenBase[threads]);
+    stream.constants.resize(constantBase[threads]);
+    {
+        vector<thread> workers;
+        for(unsigned i = 0; i < threads; ++i)
+            workers.emplace_back([&, i](){
+                stream.copyTokens(chunks[i], tokenBase[i], constantBase[i]);
+            });
+        for(auto& worker: workers)
+            worker.join();
+    }
+    stream.push(TokenView{TokenType::EOS, text.substr(text.size()), 0});
+    return stream;
+}
+
+void TokenStream::mergeIdentifiers(const TokenStream& other){
+    for(auto& [name, symbol]: other.identifierIndex)
+        if(identifierIndex.emplace(name, symbol).second)
+            identifiers.push_back(symbol);
+}
+
+void TokenStream::copyTokens(const TokenStream& other, size_t at, uint32_t constantAt){
+    copy(other.constants.begin(), other.constants.end(), constants.begin() + constantAt);
+    copy(other.types.begin(), other.types.end(), types.begin() + at);
+    copy(other.offsets.begin(), other.offsets.end(), offsets.begin() + at);
+    copy(other.lengths.begin(), other.lengths.end(), lengths.begin() + at);
+    for(size_t i = 0; i < other.types.size(); ++i){
+        auto payload = other.payloads[i];
+        if(static_cast<TokenType>(other.types[i]) == TokenType::NUMBER)
+            payload += constantAt;
+        payloads[at + i] = payload;
+    }
+}
+
+void TokenStream::reserve(size_t bytes){
+    // roughly one token every four bytes of generated code
+    size_t expected = bytes / 4 + 1;
+    types.reserve(types.size() + expected);
+    offsets.reserve(offsets.size() + expected);
+    lengths.reserve(lengths.size() + expected);
+    payloads.reserve(payloads.size() + expected);
+}
+
+void TokenStream::push(const TokenView& view){
+    uint32_t payload = 0;
+    if(view.type == TokenType::IDENT){
+        auto it = identifierIndex.find(view.literal);
+        if(it == identifierIndex.end()){
+            payload = intern(view.literal);
+            identifiers.push_back(payload);
+            identifierIndex.emplace(view.literal, payload);
+        } else {
+            payload = it->second;
+        }
+    } else if(view.type == TokenType::NUMBER){
+        payload = constants.size();
+        constants.push_back(view.number);
+    }
+
+    types.push_back(static_cast<uint8_t>(view.type));
+    offsets.push_back(view.literal.data() - source->text().data());
+    lengths.push_back(view.literal.size());
+    payloads.push_back(payload);
+}
+
+string_view TokenStream::literal(size_t i) const {
+    i = clamp(i);
+    return source->text().substr(offsets[i], lengths[i]);
+}
+
+Token TokenStream::token(size_t i) const {
+    auto t = type(i);
+    return makeToken(TokenView{t, literal(i), t == TokenType::NUMBER ? number(i) : 0});
+}
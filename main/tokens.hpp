@@ -0,0 +1,71 @@
+#if !defined(TOKENS_H)
+#define TOKENS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "token.hpp"
+#include "symbols.hpp"
+
+class Source;
+
+// Pre-lexed program held as parallel arrays, one entry per token: a type
+// byte, a source span and a payload that is the interned Symbol of IDENT
+// tokens and indexes the constant pool for NUMBER tokens. The stream always
+// ends with EOS and indexing past the end yields that EOS, so lookahead of
+// any depth is a plain array read. Offsets are 32 bits, sources larger than
+// 4GB have to be fed in pieces.
+class TokenStream {
+public:
+    // largest source offsets reach into, a larger one tokenizes to a lone
+    // EOS and parses to an error
+    static const size_t MAX_SOURCE_SIZE = UINT32_MAX;
+
+    TokenStream(std::shared_ptr<const Source>); // empty, filled with push
+
+    static TokenStream tokenize(std::shared_ptr<const Source>);
+    // only the bytes in [begin, end) of the source
+    static TokenStream tokenize(std::shared_ptr<const Source>, size_t, size_t);
+    // Same stream as tokenize, chunks split outside string literals are
+    // lexed on separate threads and stitched back in order
+    static TokenStream tokenizeParallel(std::shared_ptr<const Source>, unsigned = 0, size_t = 1 << 20);
+
+    // views must point into the source, the last one pushed must be EOS
+    void push(const TokenView&);
+
+    size_t size() const { return types.size(); }
+    TokenType type(size_t i) const { return static_cast<TokenType>(types[clamp(i)]); }
+    std::string_view literal(size_t i) const;
+    uint32_t offset(size_t i) const { return offsets[clamp(i)]; }
+    uint32_t length(size_t i) const { return lengths[clamp(i)]; }
+    double number(size_t i) const { return constants[payloads[clamp(i)]]; }
+    Symbol identifier(size_t i) const { return payloads[clamp(i)]; }
+    std::string_view identifierName(Symbol symbol) const { return symbolName(symbol); }
+    size_t identifierCount() const { return identifiers.size(); } // distinct names in this stream
+
+    Token token(size_t) const;
+    std::shared_ptr<const Source> getSource() const { return source; }
+
+private:
+    void reserve(size_t);
+    void mergeIdentifiers(const TokenStream&);
+    void copyTokens(const TokenStream&, size_t, uint32_t);
+    size_t clamp(size_t i) const { return i < types.size() ? i : types.size() - 1; }
+
+    std::shared_ptr<const Source> source;
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> payloads;
+    std::vector<double> constants;
+    // names seen by this stream, only the first use of each goes to the
+    // global table
+    std::vector<Symbol> identifiers;
+    std::unordered_map<std::string_view, Symbol> identifierIndex;
+};
+
+#endif // TOKENS_H
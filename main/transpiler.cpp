@@ -0,0 +1,440 @@
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <any>
+#include <cstdio>
+
+#include "ast.hpp"
+#include "object.hpp"
+#include "symbols.hpp"
+#include "transpiler.hpp"
+
+using namespace std;
+
+static const char* OPCODES[] = {
+    "Opcode::ADD", "Opcode::SUB", "Opcode::MUL", "Opcode::DIV", "Opcode::GREATER",
+    "Opcode::LESS", "Opcode::EQUAL", "Opcode::NOT_EQUAL", "Opcode::NOT", "Opcode::NEGATE",
+};
+
+static const char* OPERATORS[] = {"+", "-", "*", "/", ">", "<", "==", "!=", "!", "-"};
+
+// double literal the C++ compiler reads back exactly
+static string number(double value){
+    ostringstream ss;
+    ss << setprecision(17) << value;
+    auto text = ss.str();
+    if(text.find_first_of(".e") == string::npos)
+        text += ".0";
+    return text;
+}
+
+static string cppString(string_view text){
+    string literal = "\"";
+    for(unsigned char c: text){
+        if(c == '"' || c == '\\'){
+            literal += '\\';
+            literal += c;
+        } else if(c < 0x20 || c >= 0x7f){
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\%03o", c);
+            literal += escape;
+        } else {
+            literal += c;
+        }
+    }
+    return literal + "\"";
+}
+
+string Transpiler::transpile(Program& program, const Options& options){
+    Transpiler transpiler;
+    Scope scope{nullptr, {}, {}};
+    for(auto& stmt: program.statements)
+        transpiler.countLets(stmt.get(), scope);
+    transpiler.statements(program.statements, scope, "", true);
+    auto body = transpiler.out.str();
+
+    ostringstream source;
+    source << "// Generated by mkc, do not edit.\n"
+        << "#include <memory>\n#include <vector>\n#include <iostream>\n\n"
+        << "#include \"main/runtime.hpp\"\n\n"
+        << "namespace {\n\n"
+        << "const Object NIL_OBJ = Object{ObjectType::NIL, 0.0};\n\n"
+        << "// interned on first use, not during static initialization\n"
+        << "struct Names {\n    std::vector<Symbol> symbols;\n    std::vector<Runtime::Shape> shapes;\n};\n\n"
+        << "const Names& names(){\n    static const Names table{\n        {";
+    for(size_t i = 0; i < transpiler.symbols.size(); ++i)
+        source << (i > 0 ? ", " : "") << "intern(" << cppString(symbolName(transpiler.symbols[i])) << ")";
+    source << "},\n        {\n";
+    for(auto& shape: transpiler.shapes)
+        source << "            " << shape << ",\n";
+    source << "        },\n    };\n    return table;\n}\n\n";
+    for(size_t i = 0; i < transpiler.functions.size(); ++i)
+        source << "Object fn" << i << "(Runtime&, const std::shared_ptr<Environment>&);\n";
+    source << "\n";
+    for(auto& function: transpiler.functions)
+        source << function << "\n";
+    source << "} // namespace\n\n"
+        << "Object " << options.entry << "(Runtime& rt, const std::shared_ptr<Environment>& env){\n"
+        << "    auto& S = names().symbols;\n    (void)S;\n"
+        << body
+        << "}\n";
+    if(options.main){
+        source << "\nint main(){\n"
+            << "    Runtime rt;\n"
+            << "    auto result = " << options.entry << "(rt, std::make_shared<Environment>());\n"
+            << "    if(result.type == ObjectType::ERROR){\n"
+            << "        std::cout << result.inspect() << std::endl;\n"
+            << "        return 1;\n"
+            << "    }\n"
+            << "    return 0;\n"
+            << "}\n";
+    }
+    return source.str();
+}
+
+void Transpiler::line(const string& text){
+    out << string(4 * indent, ' ') << text << "\n";
+}
+
+string Transpiler::temp(){
+    return "t" + to_string(temps++);
+}
+
+string Transpiler::symbol(Symbol sym){
+    auto found = symbolIndices.find(sym);
+    if(found == symbolIndices.end()){
+        found = symbolIndices.emplace(sym, symbols.size()).first;
+        symbols.push_back(sym);
+    }
+    return "S[" + to_string(found->second) + "]";
+}
+
+string Transpiler::box(const Value& value){
+    switch(value.type){
+    case Proven::NUMBER:
+        return "Object{ObjectType::NUMBER, double(" + value.code + ")}";
+    case Proven::BOOLEAN:
+        return "Object{ObjectType::BOOLEAN, bool(" + value.code + ")}";
+    default:
+        return value.code;
+    }
+}
+
+void Transpiler::check(const string& name){
+    line("if(" + name + ".type == ObjectType::ERROR) return " + name + ";");
+}
+
+// what a name is proven by: its slot in a function, its symbol at the top
+// level where lets bind globals
+bool Transpiler::key(const Scope& scope, const Identifier& name, uint32_t& key) const {
+    if(scope.fn != nullptr && name.depth == 0){
+        key = name.slot;
+        return true;
+    }
+    if(scope.fn == nullptr && name.depth == Identifier::GLOBAL){
+        key = name.symbol;
+        return true;
+    }
+    return false;
+}
+
+void Transpiler::countLets(AstNode* node, Scope& scope){
+    if(node->kind == NodeKind::LET){
+        uint32_t k;
+        if(key(scope, static_cast<LetStatement*>(node)->name, k))
+            ++scope.lets[k];
+    }
+    // nested function bodies are not links, their lets are theirs
+    forEachChild(node, [&](auto& child){ countLets(child.get(), scope); });
+}
+
+// definition of the C++ function running the literal's body, returns the
+// index of its Runtime::Shape and its function
+string Transpiler::function(FunctionLiteral* fn){
+    auto index = functions.size();
+    functions.emplace_back();
+
+    string shape = "Runtime::Shape{";
+    if(fn->locals != nullptr){
+        shape += "std::make_shared<const std::vector<Symbol>>(std::vector<Symbol>{";
+        for(size_t i = 0; i < fn->locals->size(); ++i)
+            shape += string(i > 0 ? ", " : "") + "intern(" + cppString(symbolName((*fn->locals)[i])) + ")";
+        shape += "})";
+    } else {
+        shape += "nullptr";
+    }
+    shape += ", {";
+    for(size_t i = 0; fn->params != nullptr && i < fn->params->size(); ++i){
+        auto& param = (*fn->params)[i];
+        shape += string(i > 0 ? ", " : "") + "{intern(" + cppString(symbolName(param.symbol)) + "), " +
+            (param.depth == 0 ? "true" : "false") + ", " + to_string(param.slot) + "}";
+    }
+    shape += "}}";
+    shapes.push_back(shape);
+
+    // the body goes to a stream of its own, the caller's resumes after
+    ostringstream body;
+    swap(out, body);
+    auto outer = indent;
+    indent = 1;
+    Scope scope{fn, {}, {}};
+    if(fn->body != nullptr){
+        countLets(fn->body.get(), scope);
+        statements(fn->body->statements, scope, "", true);
+    } else {
+        line("return NIL_OBJ;");
+    }
+    swap(out, body);
+    indent = outer;
+
+    functions[index] = "Object fn" + to_string(index) + "(Runtime& rt, const std::shared_ptr<Environment>& env){\n"
+        "    auto& S = names().symbols;\n    (void)S;\n" + body.str() + "}\n";
+    return to_string(index);
+}
+
+// the value of the last statement goes to target, or is returned when
+// there is none
+void Transpiler::statements(const vector<shared_ptr<StatementNode>>& stmts, Scope& scope, const string& target, bool body){
+    Value last{"NIL_OBJ", Proven::OBJECT};
+    for(auto& stmt: stmts){
+        last = statement(stmt.get(), scope, body);
+        if(last.type == Proven::NONE)
+            return;
+    }
+    if(target.empty())
+        line("return " + box(last) + ";");
+    else if(!stmts.empty())
+        line(target + " = " + box(last) + ";");
+}
+
+Transpiler::Value Transpiler::statement(StatementNode* node, Scope& scope, bool body){
+    switch(node->kind){
+    case NodeKind::EXPRESSION_STATEMENT:
+        return expression(static_cast<ExpressionStatement*>(node)->expression.get(), scope);
+
+    case NodeKind::RETURN: {
+        auto value = expression(static_cast<ReturnStatement*>(node)->value.get(), scope);
+        if(value.type != Proven::NONE)
+            line("return " + box(value) + ";");
+        return Value{"", Proven::NONE};
+    }
+
+    case NodeKind::LET: {
+        auto let = static_cast<LetStatement*>(node);
+        auto value = expression(let->value.get(), scope);
+        if(value.type == Proven::NONE)
+            return value;
+        uint32_t k;
+        if(body && (value.type == Proven::NUMBER || value.type == Proven::BOOLEAN) &&
+                key(scope, let->name, k) && scope.lets[k] == 1){
+            auto local = "l" + to_string(temps++);
+            line(string(value.type == Proven::NUMBER ? "const double " : "const bool ") + local + " = " + value.code + ";");
+            value.code = local;
+            scope.proven[k] = value;
+        }
+        if(let->name.depth == 0)
+            line("env->at(" + to_string(let->name.slot) + ") = " + box(value) + ";");
+        else
+            line("env->set(" + symbol(let->name.symbol) + ", " + box(value) + ");");
+        return value;
+    }
+
+    case NodeKind::BLOCK: {
+        auto result = temp();
+        line("Object " + result + " = NIL_OBJ;");
+        line("{");
+        ++indent;
+        statements(static_cast<BlockStatement*>(node)->statements, scope, result, false);
+        --indent;
+        line("}");
+        return Value{result, Proven::OBJECT};
+    }
+
+    default:
+        return Value{"NIL_OBJ", Proven::OBJECT};
+    }
+}
+
+Transpiler::Value Transpiler::expression(AstNode* node, Scope& scope){
+    switch(node->kind){
+    case NodeKind::NUMBER:
+        return Value{number(static_cast<NumberLiteral*>(node)->value), Proven::NUMBER};
+
+    case NodeKind::BOOLEAN:
+        return Value{static_cast<BooleanLiteral*>(node)->value ? "true" : "false", Proven::BOOLEAN};
+
+    case NodeKind::STRING: {
+        auto name = temp();
+        line("Object " + name + " = Object{ObjectType::STRING, std::string(" +
+            cppString(static_cast<StringLiteral*>(node)->value) + ")};");
+        return Value{name, Proven::OBJECT};
+    }
+
+    case NodeKind::CONSTANT: {
+        auto& value = static_cast<Constant*>(node)->value;
+        if(value.type == ObjectType::NUMBER)
+            return Value{number(*any_cast<double>(&value.value)), Proven::NUMBER};
+        if(value.type == ObjectType::BOOLEAN)
+            return Value{*any_cast<bool>(&value.value) ? "true" : "false", Proven::BOOLEAN};
+        return Value{"NIL_OBJ", Proven::OBJECT};
+    }
+
+    case NodeKind::IDENTIFIER:
+        return identifier(static_cast<Identifier*>(node), scope);
+
+    case NodeKind::PREFIX:
+        return prefix(static_cast<PrefixExpression*>(node), scope);
+
+    case NodeKind::INFIX:
+        return infix(static_cast<InfixExpression*>(node), scope);
+
+    case NodeKind::IF:
+        return ifExpression(static_cast<IfExpression*>(node), scope);
+
+    case NodeKind::FUNCTION: {
+        auto index = function(static_cast<FunctionLiteral*>(node));
+        auto name = temp();
+        line("Object " + name + " = rt.function(env, names().shapes[" + index + "], fn" + index + ");");
+        return Value{name, Proven::OBJECT};
+    }
+
+    case NodeKind::CALL:
+        return call(static_cast<CallExpression*>(node), scope);
+
+    case NodeKind::INLINE:
+        return call(static_cast<InlineCall*>(node)->call.get(), scope);
+
+    case NodeKind::ARRAY: {
+        vector<string> items;
+        for(auto& item: static_cast<ArrayLiteral*>(node)->items){
+            auto value = expression(item.get(), scope);
+            items.push_back(box(value));
+        }
+        auto name = temp();
+        string list;
+        for(size_t i = 0; i < items.size(); ++i)
+            list += (i > 0 ? ", " : "") + items[i];
+        line("Object " + name + " = Object{ObjectType::ARRAY, std::vector<Object>{" + list + "}};");
+        return Value{name, Proven::OBJECT};
+    }
+
+    case NodeKind::HASH: {
+        string pairs;
+        for(auto& entry: static_cast<HashLiteral*>(node)->entries){
+            auto key = temp();
+            line("Object " + key + " = rt.hashKey(" + box(expression(entry.first.get(), scope)) + ");");
+            check(key);
+            auto value = box(expression(entry.second.get(), scope));
+            pairs += (pairs.empty() ? "{" : ", {") + key + ", " + value + "}";
+        }
+        auto name = temp();
+        line("Object " + name + " = rt.hash({" + pairs + "});");
+        return Value{name, Proven::OBJECT};
+    }
+
+    case NodeKind::INDEX: {
+        auto indexExpr = static_cast<IndexExpression*>(node);
+        auto left = box(expression(indexExpr->left.get(), scope));
+        auto index = box(expression(indexExpr->index.get(), scope));
+        auto name = temp();
+        line("Object " + name + " = rt.index(" + left + ", " + index + ");");
+        check(name);
+        return Value{name, Proven::OBJECT};
+    }
+
+    default:
+        return Value{"NIL_OBJ", Proven::OBJECT};
+    }
+}
+
+Transpiler::Value Transpiler::identifier(Identifier* ident, Scope& scope){
+    uint32_t k;
+    if(key(scope, *ident, k))
+        if(auto found = scope.proven.find(k); found != scope.proven.end())
+            return found->second;
+
+    auto name = temp();
+    auto text = cppString(ident->value);
+    if(ident->depth >= 0){
+        line("Object " + name + " = env->get(" + to_string(ident->depth) + ", " + to_string(ident->slot) + ", " +
+            symbol(ident->symbol) + ");");
+        line("if(" + name + ".type == ObjectType::UNDEFINED) " + name + " = rt.builtin(" + symbol(ident->symbol) + ", " +
+            text + ");");
+    } else if(ident->depth == Identifier::GLOBAL){
+        line("Object " + name + " = rt.global(*env, " + symbol(ident->symbol) + ", " + text + ");");
+    } else {
+        line("Object " + name + " = rt.lookup(*env, " + symbol(ident->symbol) + ", " + text + ");");
+    }
+    check(name);
+    return Value{name, Proven::OBJECT};
+}
+
+Transpiler::Value Transpiler::prefix(PrefixExpression* prefixExpr, Scope& scope){
+    auto right = expression(prefixExpr->right.get(), scope);
+    if(prefixExpr->opcode == Opcode::NEGATE && right.type == Proven::NUMBER)
+        return Value{"(-" + right.code + ")", Proven::NUMBER};
+    if(prefixExpr->opcode == Opcode::NOT && right.type == Proven::BOOLEAN)
+        return Value{"(!" + right.code + ")", Proven::BOOLEAN};
+
+    auto name = temp();
+    auto op = static_cast<size_t>(prefixExpr->opcode);
+    line("Object " + name + " = rt.prefix(" + OPCODES[op] + ", " + cppString(OPERATORS[op]) + ", " + box(right) + ");");
+    check(name);
+    return Value{name, Proven::OBJECT};
+}
+
+Transpiler::Value Transpiler::infix(InfixExpression* infixExpr, Scope& scope){
+    auto left = expression(infixExpr->left.get(), scope);
+    auto right = expression(infixExpr->right.get(), scope);
+    auto op = static_cast<size_t>(infixExpr->opcode);
+    auto applied = "(" + left.code + " " + OPERATORS[op] + " " + right.code + ")";
+
+    if(left.type == Proven::NUMBER && right.type == Proven::NUMBER){
+        bool arithmetic = infixExpr->opcode <= Opcode::DIV;
+        return Value{applied, arithmetic ? Proven::NUMBER : Proven::BOOLEAN};
+    }
+    bool compares = infixExpr->opcode == Opcode::EQUAL || infixExpr->opcode == Opcode::NOT_EQUAL;
+    if(left.type == Proven::BOOLEAN && right.type == Proven::BOOLEAN && compares)
+        return Value{applied, Proven::BOOLEAN};
+
+    auto name = temp();
+    line("Object " + name + " = rt.infix(" + OPCODES[op] + ", " + cppString(OPERATORS[op]) + ", " +
+        box(left) + ", " + box(right) + ");");
+    check(name);
+    return Value{name, Proven::OBJECT};
+}
+
+Transpiler::Value Transpiler::ifExpression(IfExpression* ifExpr, Scope& scope){
+    auto condition = expression(ifExpr->condition.get(), scope);
+    auto name = temp();
+    line("Object " + name + " = NIL_OBJ;");
+    line("if(" + (condition.type == Proven::BOOLEAN ? condition.code : "rt.truthy(" + box(condition) + ")") + "){");
+    ++indent;
+    statements(ifExpr->consequence->statements, scope, name, false);
+    --indent;
+    if(ifExpr->alternative != nullptr){
+        line("} else {");
+        ++indent;
+        statements(ifExpr->alternative->statements, scope, name, false);
+        --indent;
+    }
+    line("}");
+    return Value{name, Proven::OBJECT};
+}
+
+Transpiler::Value Transpiler::call(CallExpression* callExpr, Scope& scope){
+    auto function = box(expression(callExpr->function.get(), scope));
+    string args;
+    for(auto& arg: *callExpr->arguments){
+        auto value = box(expression(arg.get(), scope));
+        args += (args.empty() ? "" : ", ") + value;
+    }
+    auto name = temp();
+    line("Object " + name + " = rt.call(" + function + ", {" + args + "});");
+    check(name);
+    return Value{name, Proven::OBJECT};
+}
@@ -0,0 +1,76 @@
+#if !defined(TRANSPILER_H)
+#define TRANSPILER_H
+
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "ast.hpp"
+#include "symbols.hpp"
+
+// Ahead-of-time translation of a resolved program into C++ that runs on the
+// Runtime. Every function literal becomes a C++ function over its frame,
+// identifiers read the slots the resolver gave them, and operators whose
+// operand types are proven while translating become plain double and bool
+// arithmetic. Values that are not proven stay Objects and go through the
+// Runtime, errors end the function they occur in as in the tree-walker.
+class Transpiler {
+public:
+    struct Options {
+        std::string entry = "monkey_program"; // name of the function running the program
+        bool main = false; // also a main() running it, printing the error it ends with
+    };
+
+    // the program has to be fully parsed, lazily skipped bodies are not
+    // translated
+    static std::string transpile(Program&, const Options&);
+
+private:
+    // C++ type a value was proven to have, a double or a bool expression;
+    // OBJECT values are held in a variable, none where control left
+    enum class Proven { OBJECT, NUMBER, BOOLEAN, NONE };
+
+    struct Value {
+        std::string code;
+        Proven type;
+    };
+
+    // function being translated; lets that bind a name once, in the
+    // statements of the body itself, make the name a proven local after
+    struct Scope {
+        FunctionLiteral* fn; // null for the top level
+        std::unordered_map<uint32_t, int> lets;
+        std::unordered_map<uint32_t, Value> proven;
+    };
+
+    std::ostringstream out;
+    int indent = 1;
+    size_t temps = 0;
+    std::vector<std::string> functions; // definitions, by literal index
+    std::vector<std::string> shapes;
+    std::vector<Symbol> symbols;
+    std::unordered_map<Symbol, size_t> symbolIndices;
+
+    void line(const std::string&);
+    std::string temp();
+    std::string symbol(Symbol);
+    static std::string box(const Value&);
+    void check(const std::string&);
+    bool key(const Scope&, const Identifier&, uint32_t&) const;
+    void countLets(AstNode*, Scope&);
+
+    std::string function(FunctionLiteral*);
+    void statements(const std::vector<std::shared_ptr<StatementNode>>&, Scope&, const std::string&, bool);
+    Value statement(StatementNode*, Scope&, bool);
+    Value expression(AstNode*, Scope&);
+    Value identifier(Identifier*, Scope&);
+    Value prefix(PrefixExpression*, Scope&);
+    Value infix(InfixExpression*, Scope&);
+    Value ifExpression(IfExpression*, Scope&);
+    Value call(CallExpression*, Scope&);
+};
+
+#endif // TRANSPILER_H
@@ -0,0 +1,470 @@
+#include <cstring>
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "object.hpp"
+#include "environment.hpp"
+#include "symbols.hpp"
+#include "bytecode.hpp"
+#include "vm.hpp"
+
+using namespace std;
+
+static inline uint16_t load16(const uint8_t* at){
+    uint16_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static inline uint32_t load32(const uint8_t* at){
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static const char* const OPERATORS[] = {"+", "-", "*", "/", ">", "<", "==", "!="};
+
+// everything but two numbers, with the results and messages of the
+// tree-walker's operator table
+static Value binary(Op op, const Value& left, const Value& right){
+    auto oprator = OPERATORS[static_cast<size_t>(op) - static_cast<size_t>(Op::ADD)];
+    if(left.type == ObjectType::STRING && right.type == ObjectType::STRING){
+        if(op == Op::ADD)
+            return Value{ObjectType::STRING, make_shared<string>(left.str() + right.str())};
+    } else if(left.type == ObjectType::BOOLEAN && right.type == ObjectType::BOOLEAN
+            && (op == Op::EQUAL || op == Op::NOT_EQUAL)){
+        return Value::boolean((left.number == right.number) == (op == Op::EQUAL));
+    } else if(op == Op::EQUAL){
+        return Value::boolean(false);
+    } else if(op == Op::NOT_EQUAL){
+        return Value::boolean(true);
+    } else if(left.type != right.type){
+        return Value::error(format("type mismatch: ", to_string(left.type), " ", oprator, " ", to_string(right.type)));
+    }
+    return Value::error(format("unknown operator: ", to_string(left.type), " ", oprator, " ", to_string(right.type)));
+}
+
+static Value index(const Value& left, const Value& idx){
+    if(left.type == ObjectType::ARRAY && idx.type == ObjectType::NUMBER){
+        auto& items = left.items();
+        auto i = (int)idx.number;
+        if(i < 0 || i >= (int)items.size())
+            return Value{};
+        return items[i];
+    }
+    if(left.type == ObjectType::HASH){
+        if(idx.type != ObjectType::NUMBER && idx.type != ObjectType::STRING && idx.type != ObjectType::BOOLEAN)
+            return Value::error(format("unusable as hash key: ", to_string(idx.type)));
+        auto& entries = left.entries();
+        auto it = entries.find(idx.hashKey());
+        return it != entries.end() ? it->second.second : Value{};
+    }
+    return Value::error(format("index operator not supported: ", to_string(left.type)));
+}
+
+VirtualMachine::VirtualMachine(): stack(1024), frames{}, globals{}, cached{}, used{0} {
+}
+
+// room for n more values above sp, moving the stack when it has to grow
+bool VirtualMachine::reserve(Value*& sp, size_t n){
+    size_t offset = sp - stack.data();
+    if(offset + n > MAX_STACK)
+        return false;
+    if(offset + n > stack.size()){
+        auto old = stack.data();
+        vector<Value> grown(min(max(stack.size() * 2, offset + n), MAX_STACK));
+        move(stack.begin(), stack.end(), grown.begin());
+        stack.swap(grown);
+        for(auto& frame: frames)
+            frame.base = stack.data() + (frame.base - old);
+        sp = stack.data() + offset;
+    }
+    used = max(used, offset + n);
+    return true;
+}
+
+Value VirtualMachine::global(Symbol name, const Environment& env){
+    Value value;
+    if(auto bound = env.findGlobal(name))
+        value = toValue(*bound);
+    else if(auto builtin = findBuiltin(name))
+        value = *builtin;
+    else
+        return Value::error(format("identifier not found: ", symbolName(name)));
+    cache(name, value);
+    return value;
+}
+
+void VirtualMachine::cache(Symbol name, const Value& value){
+    if(name >= globals.size())
+        globals.resize(name + 1, Value::undefined());
+    if(globals[name].type == ObjectType::UNDEFINED)
+        cached.push_back(name);
+    globals[name] = value;
+}
+
+Object VirtualMachine::run(const CodeObject& main, const shared_ptr<Environment>& env, bool& returned){
+    returned = false;
+    // the environment may have changed since the last run, only the names
+    // it read or wrote are forgotten so a run costs nothing per symbol
+    for(auto name: cached)
+        globals[name] = Value::undefined();
+    cached.clear();
+
+    Value result;
+    Value* sp = stack.data();
+    const CodeObject* code = &main;
+    const Closure* closure = nullptr;
+    const uint8_t* ip = main.code.data();
+    const Value* constants = main.constants.data();
+    Value* base = sp;
+    if(!reserve(sp, main.slots + main.maxStack)){
+        result = Value::error("stack overflow");
+        goto done;
+    }
+    // reserving may have moved the stack, no frame held base to relocate
+    base = sp;
+    frames.push_back(Frame{code, closure, ip, base});
+
+// dispatch through a table of label addresses where the compiler has them,
+// every instruction jumps straight to the next one's code
+#if defined(__GNUC__)
+    static const void* const labels[OP_COUNT] = {
+        &&op_CONSTANT, &&op_NIL, &&op_TRUE, &&op_FALSE, &&op_POP,
+        &&op_GET_LOCAL, &&op_GET_LOCAL_OR, &&op_SET_LOCAL,
+        &&op_GET_CELL, &&op_GET_CELL_OR, &&op_SET_CELL,
+        &&op_GET_FREE, &&op_GET_FREE_OR, &&op_GET_GLOBAL, &&op_SET_GLOBAL,
+        &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_GREATER, &&op_LESS, &&op_EQUAL, &&op_NOT_EQUAL,
+        &&op_NOT, &&op_NEGATE, &&op_JUMP, &&op_JUMP_IF_FALSE,
+        &&op_ARRAY, &&op_HASH_KEY, &&op_HASH, &&op_INDEX,
+        &&op_CLOSURE, &&op_CALL, &&op_TAIL_CALL, &&op_RETURN, &&op_HALT,
+    };
+#define TARGET(op) op_##op:
+#define DISPATCH() goto *labels[*ip++]
+    DISPATCH();
+#else
+#define TARGET(op) case Op::op:
+#define DISPATCH() continue
+    for(;;) switch(static_cast<Op>(*ip++)){
+#endif
+
+#define FAIL(value) do { result = (value); goto done; } while(false)
+
+    TARGET(CONSTANT){
+        *sp++ = constants[load32(ip)];
+        ip += 4;
+        DISPATCH();
+    }
+    TARGET(NIL){
+        *sp++ = Value{};
+        DISPATCH();
+    }
+    TARGET(TRUE){
+        *sp++ = Value::boolean(true);
+        DISPATCH();
+    }
+    TARGET(FALSE){
+        *sp++ = Value::boolean(false);
+        DISPATCH();
+    }
+    TARGET(POP){
+        (--sp)->ref.reset();
+        DISPATCH();
+    }
+
+    TARGET(GET_LOCAL){
+        *sp++ = base[load16(ip)];
+        ip += 2;
+        DISPATCH();
+    }
+    TARGET(GET_LOCAL_OR){
+        auto& slot = base[load16(ip)];
+        if(slot.type != ObjectType::UNDEFINED){
+            *sp++ = slot;
+            ip = code->code.data() + load32(ip + 2);
+        } else {
+            ip += 6;
+        }
+        DISPATCH();
+    }
+    TARGET(SET_LOCAL){
+        base[load16(ip)] = sp[-1];
+        ip += 2;
+        DISPATCH();
+    }
+
+    TARGET(GET_CELL){
+        *sp++ = base[load16(ip)].cell()->value;
+        ip += 2;
+        DISPATCH();
+    }
+    TARGET(GET_CELL_OR){
+        auto& value = base[load16(ip)].cell()->value;
+        if(value.type != ObjectType::UNDEFINED){
+            *sp++ = value;
+            ip = code->code.data() + load32(ip + 2);
+        } else {
+            ip += 6;
+        }
+        DISPATCH();
+    }
+    TARGET(SET_CELL){
+        base[load16(ip)].cell()->value = sp[-1];
+        ip += 2;
+        DISPATCH();
+    }
+
+    TARGET(GET_FREE){
+        *sp++ = closure->cells[load16(ip)]->value;
+        ip += 2;
+        DISPATCH();
+    }
+    TARGET(GET_FREE_OR){
+        auto& value = closure->cells[load16(ip)]->value;
+        if(value.type != ObjectType::UNDEFINED){
+            *sp++ = value;
+            ip = code->code.data() + load32(ip + 2);
+        } else {
+            ip += 6;
+        }
+        DISPATCH();
+    }
+
+    TARGET(GET_GLOBAL){
+        auto name = load32(ip);
+        ip += 4;
+        if(name < globals.size() && globals[name].type != ObjectType::UNDEFINED){
+            *sp++ = globals[name];
+            DISPATCH();
+        }
+        auto value = global(name, *env);
+        if(value.type == ObjectType::ERROR)
+            FAIL(value);
+        *sp++ = std::move(value);
+        DISPATCH();
+    }
+    TARGET(SET_GLOBAL){
+        auto name = load32(ip);
+        ip += 4;
+        cache(name, sp[-1]);
+        env->set(name, toObject(sp[-1]));
+        DISPATCH();
+    }
+
+// two numbers are computed in place, anything else goes through binary()
+#define BINARY(op, numeric, type_)                              \
+    TARGET(op){                                                 \
+        auto& left = sp[-2];                                    \
+        auto& right = sp[-1];                                   \
+        if(left.type == ObjectType::NUMBER && right.type == ObjectType::NUMBER){ \
+            left.number = numeric;                              \
+            left.type = type_;                                  \
+            --sp;                                               \
+            DISPATCH();                                         \
+        }                                                       \
+        left = binary(Op::op, left, right);                     \
+        right.ref.reset();                                      \
+        --sp;                                                   \
+        if(left.type == ObjectType::ERROR)                      \
+            FAIL(left);                                         \
+        DISPATCH();                                             \
+    }
+
+    BINARY(ADD, left.number + right.number, ObjectType::NUMBER)
+    BINARY(SUB, left.number - right.number, ObjectType::NUMBER)
+    BINARY(MUL, left.number * right.number, ObjectType::NUMBER)
+    BINARY(DIV, left.number / right.number, ObjectType::NUMBER)
+    BINARY(GREATER, left.number > right.number, ObjectType::BOOLEAN)
+    BINARY(LESS, left.number < right.number, ObjectType::BOOLEAN)
+    BINARY(EQUAL, left.number == right.number, ObjectType::BOOLEAN)
+    BINARY(NOT_EQUAL, left.number != right.number, ObjectType::BOOLEAN)
+#undef BINARY
+
+    TARGET(NOT){
+        auto& right = sp[-1];
+        bool value = right.type == ObjectType::BOOLEAN ? right.number == 0 : right.type == ObjectType::NIL;
+        right = Value::boolean(value);
+        DISPATCH();
+    }
+    TARGET(NEGATE){
+        auto& right = sp[-1];
+        if(right.type != ObjectType::NUMBER)
+            FAIL(Value::error(format("unknown operator: -", to_string(right.type))));
+        right.number = -right.number;
+        DISPATCH();
+    }
+
+    TARGET(JUMP){
+        ip = code->code.data() + load32(ip);
+        DISPATCH();
+    }
+    TARGET(JUMP_IF_FALSE){
+        --sp;
+        bool truthy = sp->isTruthy();
+        sp->ref.reset();
+        ip = truthy ? ip + 4 : code->code.data() + load32(ip);
+        DISPATCH();
+    }
+
+    TARGET(ARRAY){
+        auto count = load32(ip);
+        ip += 4;
+        auto items = make_shared<vector<Value>>(make_move_iterator(sp - count), make_move_iterator(sp));
+        sp -= count;
+        *sp++ = Value{ObjectType::ARRAY, std::move(items)};
+        DISPATCH();
+    }
+    TARGET(HASH_KEY){
+        auto type = sp[-1].type;
+        if(type != ObjectType::NUMBER && type != ObjectType::STRING && type != ObjectType::BOOLEAN)
+            FAIL(Value::error(format("unusable as hash key: ", to_string(type))));
+        DISPATCH();
+    }
+    TARGET(HASH){
+        auto count = load32(ip);
+        ip += 4;
+        auto entries = make_shared<Hash>();
+        for(auto entry = sp - 2 * count; entry < sp; entry += 2){
+            auto key = entry[0].hashKey();
+            (*entries)[key] = make_pair(std::move(entry[0]), std::move(entry[1]));
+        }
+        sp -= 2 * count;
+        *sp++ = Value{ObjectType::HASH, std::move(entries)};
+        DISPATCH();
+    }
+    TARGET(INDEX){
+        auto value = index(sp[-2], sp[-1]);
+        if(value.type == ObjectType::ERROR)
+            FAIL(value);
+        (--sp)->ref.reset();
+        sp[-1] = std::move(value);
+        DISPATCH();
+    }
+
+    TARGET(CLOSURE){
+        auto& fn = code->functions[load32(ip)];
+        ip += 4;
+        auto made = make_shared<Closure>();
+        made->code = fn;
+        made->cells.reserve(fn->captures.size());
+        for(auto& capture: fn->captures){
+            if(capture.local)
+                made->cells.push_back(static_pointer_cast<Cell>(base[capture.index].ref));
+            else
+                made->cells.push_back(closure->cells[capture.index]);
+        }
+        *sp++ = Value{ObjectType::FUNCTION, std::move(made)};
+        DISPATCH();
+    }
+
+    TARGET(TAIL_CALL)
+    TARGET(CALL){
+        bool tail = static_cast<Op>(ip[-1]) == Op::TAIL_CALL;
+        size_t count = load16(ip);
+        ip += 2;
+        auto callee = sp - count - 1;
+        if(callee->type == ObjectType::FUNCTION){
+            auto target = callee->closure();
+            if(target == nullptr)
+                FAIL(Value::error("function of the tree-walking evaluator called from the virtual machine"));
+            auto fn = target->code.get();
+            if(!fn->error.empty())
+                FAIL(Value::error(fn->error));
+            if(tail && frames.size() > 1){
+                // what the caller left goes, the callee and its arguments
+                // move down to where the caller's were; its RETURN then
+                // hands the value to whoever called the caller
+                for(auto value = base - 1; value < callee; ++value)
+                    value->ref.reset();
+                sp = move(callee, sp, base - 1);
+                frames.pop_back();
+            } else {
+                frames.back().ip = ip;
+            }
+            if(!reserve(sp, fn->slots + fn->maxStack))
+                FAIL(Value::error("stack overflow"));
+
+            // the arguments become the first slots of the frame
+            auto args = sp - count;
+            if(fn->directParams){
+                for(size_t i = count; i < fn->params; ++i)
+                    args[i] = Value{};
+                for(size_t i = fn->params; i < fn->slots; ++i)
+                    args[i] = Value::undefined();
+                for(size_t i = max<size_t>(fn->slots, fn->params); i < count; ++i)
+                    args[i].ref.reset();
+            } else {
+                vector<Value> passed(make_move_iterator(args), make_move_iterator(sp));
+                for(size_t i = 0; i < fn->slots; ++i)
+                    args[i] = Value::undefined();
+                for(size_t i = 0; i < fn->paramSlots.size(); ++i)
+                    args[fn->paramSlots[i]] = i < count ? std::move(passed[i]) : Value{};
+            }
+            for(auto slot: fn->cellSlots)
+                args[slot] = Value{ObjectType::NIL, make_shared<Cell>(Cell{std::move(args[slot])})};
+
+            sp = args + fn->slots;
+            code = fn;
+            closure = target;
+            ip = fn->code.data();
+            constants = fn->constants.data();
+            base = args;
+            frames.push_back(Frame{code, closure, ip, base});
+            DISPATCH();
+        }
+        if(callee->type == ObjectType::BUILTIN_FUNCTION){
+            auto value = callee->builtin()->call(sp - count, count);
+            if(value.type == ObjectType::ERROR)
+                FAIL(value);
+            while(sp > callee + 1)
+                (--sp)->ref.reset();
+            *callee = std::move(value);
+            DISPATCH();
+        }
+        FAIL(Value::error(format("not a function ", to_string(callee->type))));
+    }
+
+    TARGET(RETURN){
+        auto value = std::move(sp[-1]);
+        if(frames.size() == 1){
+            returned = true;
+            result = std::move(value);
+            goto done;
+        }
+        while(sp > base)
+            (--sp)->ref.reset();
+        // the callee is dropped, nothing of its frame is read past here
+        sp[-1] = std::move(value);
+        frames.pop_back();
+        auto& frame = frames.back();
+        code = frame.code;
+        closure = frame.closure;
+        ip = frame.ip;
+        constants = code->constants.data();
+        base = frame.base;
+        DISPATCH();
+    }
+
+    TARGET(HALT){
+        if(sp > base)
+            result = std::move(sp[-1]);
+        goto done;
+    }
+
+#if !defined(__GNUC__)
+    }
+#endif
+#undef TARGET
+#undef DISPATCH
+#undef FAIL
+
+done:
+    for(size_t i = 0; i < used; ++i)
+        stack[i].ref.reset();
+    used = 0;
+    frames.clear();
+    return toObject(result);
+}
@@ -0,0 +1,47 @@
+#if !defined(VM_H)
+#define VM_H
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "object.hpp"
+#include "bytecode.hpp"
+
+class Environment;
+
+// Stack machine running what the Compiler produced. Frames sit on one value
+// stack, a function's slots first then its operands; the callee stays just
+// below the slots and takes the result on return. Top-level names live in
+// the Environment passed in, values read from it are kept per symbol for
+// the rest of the run. The first error stops the run and is its result.
+class VirtualMachine {
+public:
+    // past this many values deep recursion fails with a stack overflow
+    static constexpr size_t MAX_STACK = 1 << 20;
+
+    VirtualMachine();
+
+    // returned is set when top-level code ran into a return statement
+    Object run(const CodeObject&, const std::shared_ptr<Environment>&, bool& returned);
+
+private:
+    struct Frame {
+        const CodeObject* code;
+        const Closure* closure; // null for top-level code
+        const uint8_t* ip;
+        Value* base;
+    };
+
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<Value> globals; // by symbol, UNDEFINED when not read yet
+    std::vector<Symbol> cached; // names with a value in globals
+    size_t used; // values the run reserved, released when it ends
+
+    bool reserve(Value*&, size_t);
+    Value global(Symbol, const Environment&);
+    void cache(Symbol, const Value&);
+};
+
+#endif // VM_H
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "main/source.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/transpiler.hpp"
+
+using namespace std;
+
+
+// mkc [--main] [--entry <name>] <script> <output.cpp>
+// Translates a Monkey script into C++ to link with the monkey runtime
+// library, --main adds a main() running it
+int main(int argc, char const *argv[]){
+	Transpiler::Options options;
+	for(; argc > 1; argv++, argc--){
+		if(string(argv[1]) == "--main")
+			options.main = true;
+		else if(string(argv[1]) == "--entry" && argc > 2){
+			options.entry = argv[2];
+			argv++, argc--;
+		} else
+			break;
+	}
+	if(argc != 3){
+		cerr << "usage: mkc [--main] [--entry <name>] <script> <output.cpp>" << endl;
+		return 2;
+	}
+
+	auto source = Source::fromFile(argv[1]);
+	if(source == nullptr){
+		cerr << "Could not read file: " << argv[1] << endl;
+		return 1;
+	}
+	// every body is translated, none may be left to a lazy parse
+	Lexer lexer{source};
+	Parser parser{lexer, AstAllocation::ARENA, FunctionBodies::EAGER};
+	auto program = parser.parseProgram();
+	if(parser.getErrors().size() > 0){
+		for(auto str : parser.getErrors())
+			cerr << argv[1] << ": " << str << endl;
+		return 1;
+	}
+
+	ofstream out{argv[2], ios::binary};
+	out << Transpiler::transpile(*program, options);
+	if(!out){
+		cerr << "Could not write file: " << argv[2] << endl;
+		return 1;
+	}
+	return 0;
+}
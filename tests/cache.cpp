@@ -0,0 +1,127 @@
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdio>
+#include <filesystem>
+
+
+#include "vendor/catch2.hpp"
+
+#include "main/source.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/object.hpp"
+#include "main/environment.hpp"
+#include "main/evaluator.hpp"
+#include "main/cache.hpp"
+
+using namespace std;
+
+static const char* SCRIPT = R"(
+let add = fn(a, b) { a + b };
+let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+let pick = fn(xs, key) { let h = {"one": 1, "two": 2, true: 3}; xs[h[key]] };
+let twice = fn(f) { fn(x) { f(f(x)) } };
+let r = fn() { return -add(1, 2); };
+twice(fn(x) { x * 2 })(fib(10)) + pick([10, 20, 30], "two") + r() + len("abc");
+)";
+
+static shared_ptr<Program> parse(shared_ptr<const Source> source){
+    Lexer lexer{source};
+    Parser parser{lexer, AstAllocation::ARENA, FunctionBodies::LAZY};
+    auto program = parser.parseProgram();
+    REQUIRE(parser.getErrors().empty());
+    return program;
+}
+
+static string imagePath(){
+    return (filesystem::temp_directory_path() / "monkey-cache-test.mkc").string();
+}
+
+static string readFile(const string& path){
+    ifstream in{path, ios::binary};
+    return string{istreambuf_iterator<char>{in}, istreambuf_iterator<char>{}};
+}
+
+static void writeFile(const string& path, const string& bytes){
+    ofstream out{path, ios::binary | ios::trunc};
+    out.write(bytes.data(), bytes.size());
+}
+
+TEST_CASE("Test Script Cache Round Trip", "[cache]"){
+    auto source = Source::fromString(SCRIPT);
+    auto path = imagePath();
+    auto parsed = parse(source);
+    REQUIRE(ScriptCache::store(path, *parsed, *source));
+
+    auto loaded = ScriptCache::load(path, source);
+    REQUIRE(loaded != nullptr);
+    auto text = parsed->toString();
+    REQUIRE(loaded->toString() == text);
+
+    Evaluator fresh{parsed};
+    Evaluator cached{loaded};
+    auto expected = fresh.execute(make_shared<Environment>());
+    auto evaluated = cached.execute(make_shared<Environment>());
+    REQUIRE(expected.type == ObjectType::NUMBER);
+    REQUIRE(evaluated.inspect() == expected.inspect());
+
+    // the image is not touched by bodies parsed and optimized on first call
+    REQUIRE(ScriptCache::load(path, source)->toString() == text);
+    remove(path.c_str());
+}
+
+TEST_CASE("Test Script Cache Rejects Stale Images", "[cache]"){
+    auto source = Source::fromString(SCRIPT);
+    auto path = imagePath();
+    REQUIRE(ScriptCache::store(path, *parse(source), *source));
+    auto image = readFile(path);
+
+    SECTION("other text"){
+        auto edited = Source::fromString(string(SCRIPT) + "1;");
+        REQUIRE(ScriptCache::load(path, edited) == nullptr);
+    }
+    SECTION("other version"){
+        auto bytes = image;
+        bytes[4] ^= 0x7f;
+        writeFile(path, bytes);
+        REQUIRE(ScriptCache::load(path, source) == nullptr);
+    }
+    SECTION("truncated"){
+        for(size_t size: {size_t{0}, size_t{3}, image.size() / 2, image.size() - 1}){
+            writeFile(path, image.substr(0, size));
+            REQUIRE(ScriptCache::load(path, source) == nullptr);
+        }
+    }
+    SECTION("corrupt"){
+        // every byte flipped in turn either fails to load or still loads a
+        // tree that prints, never reads outside the image
+        for(size_t i = 0; i < image.size(); ++i){
+            auto bytes = image;
+            bytes[i] = ~bytes[i];
+            writeFile(path, bytes);
+            if(auto program = ScriptCache::load(path, source))
+                program->toString();
+        }
+    }
+    SECTION("missing"){
+        remove(path.c_str());
+        REQUIRE(ScriptCache::load(path, source) == nullptr);
+    }
+    remove(path.c_str());
+}
+
+TEST_CASE("Test Script Cache Paths", "[cache]"){
+    auto source = Source::fromString(SCRIPT);
+    REQUIRE(ScriptCache::pathFor("dir/rules.mk", *source) == "dir/rules.mkc");
+    REQUIRE(ScriptCache::pathFor("rules.monkey", *source) == "rules.monkey.mkc");
+    REQUIRE(ScriptCache::hash("a") != ScriptCache::hash("b"));
+    REQUIRE(ScriptCache::hash("") != ScriptCache::hash(string(1, '\0')));
+    // the same bit flipped in two consecutive words does not cancel out
+    string text = "let s = \"abcdefgh12345678\";";
+    auto flipped = text;
+    flipped[15] ^= 0x80;
+    flipped[23] ^= 0x80;
+    REQUIRE(ScriptCache::hash(text) != ScriptCache::hash(flipped));
+}
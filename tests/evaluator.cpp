@@ -2,6 +2,8 @@
 #include <array>
 #include <tuple>
 #include <any>
+#include <sstream>
+#include <cstdlib>
 
 
 
@@ -17,18 +19,49 @@
 #include "main/fobject.hpp"
 #include "main/environment.hpp"
 #include "main/evaluator.hpp"
+#include "main/pipeline.hpp"
+#include "main/stackmachine.hpp"
 
 
 using namespace std;
 
 
-Object testEval(string input){
-        Lexer lexer{input};
-        Parser parser{lexer};
-        shared_ptr<Program> prog = parser.parseProgram();
-        auto env = std::make_shared<Environment>();
-        Evaluator evaluator{prog};
-        return evaluator.execute(env);
+// MONKEY_BACKEND=bytecode runs every case on the virtual machine instead,
+// MONKEY_BACKEND=closures on the ClosureCompiler's callables,
+// MONKEY_BACKEND=jit with numeric functions compiled to machine code,
+// MONKEY_BACKEND=stack on the StackMachine
+Backend backend(){
+    auto name = getenv("MONKEY_BACKEND");
+    if(name != nullptr && string(name) == "bytecode")
+        return Backend::BYTECODE;
+    if(name != nullptr && string(name) == "closures")
+        return Backend::CLOSURES;
+    if(name != nullptr && string(name) == "jit")
+        return Backend::JIT;
+    if(name != nullptr && string(name) == "stack")
+        return Backend::STACK;
+    return Backend::TREE;
+}
+
+shared_ptr<Program> testParse(string input, AstAllocation allocation = AstAllocation::ARENA,
+        FunctionBodies bodies = FunctionBodies::EAGER){
+    Lexer lexer{input};
+    Parser parser{lexer, allocation, bodies};
+    return parser.parseProgram();
+}
+
+// on the backend MONKEY_BACKEND picks unless one is given, the depth only
+// limits the StackMachine
+Object testEval(shared_ptr<Program> program, shared_ptr<Environment> env, Optimization optimization = Optimization::ON,
+        Backend back = backend(), size_t maxDepth = StackMachine::DEFAULT_MAX_DEPTH){
+    Evaluator evaluator{program, optimization, back};
+    evaluator.setMaxDepth(maxDepth);
+    return evaluator.execute(env);
+}
+
+Object testEval(string input, AstAllocation allocation = AstAllocation::ARENA, FunctionBodies bodies = FunctionBodies::EAGER,
+        Optimization optimization = Optimization::ON, Backend back = backend(), size_t maxDepth = StackMachine::DEFAULT_MAX_DEPTH){
+    return testEval(testParse(input, allocation, bodies), std::make_shared<Environment>(), optimization, back, maxDepth);
 }
 
 string hashKeyOf(ObjectType t, std::any v){
@@ -116,6 +149,25 @@ TEST_CASE("Test Eval Boolean Literal", "[evaluator]"){
 
 }
 
+TEST_CASE("Test Eval Mixed Comparisons", "[evaluator]"){
+    using TestItem = std::pair<string, bool>;
+     std::array<TestItem, 6> tests{ {
+        make_pair("true != true", false),
+        make_pair("false != false", false),
+        make_pair("1 == true", false),
+        make_pair("1 != true", true),
+        make_pair("[1] == [1]", false),
+        make_pair("\"a\" != 1", true)
+    }};
+
+    for(auto test : tests){
+        Object evaluated = testEval(test.first);
+
+        REQUIRE(evaluated.type == ObjectType::BOOLEAN);
+        REQUIRE(any_cast<bool>(evaluated.value ) == test.second);
+    }
+}
+
 TEST_CASE("Test Eval Bang Operator", "[evaluator]"){
     using TestItem = std::pair<string, bool>;
      std::array<TestItem, 6> tests{ {
@@ -382,4 +434,252 @@ TEST_CASE("Test Hash Index Expression Evaluation", "[evaluator]"){
         REQUIRE(any_cast<double>(evaluated.value) == any_cast<double>(test.second.value));
     }
 	
-}
\ No newline at end of file
+}
+
+TEST_CASE("Test Eval Lazy Function Bodies", "[evaluator]"){
+    auto fib = testEval("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(15)",
+        AstAllocation::ARENA, FunctionBodies::LAZY);
+    REQUIRE(fib.type == ObjectType::NUMBER);
+    REQUIRE(any_cast<double>(fib.value) == 610);
+
+    auto closure = testEval("let newAdder = fn(x) { fn(y) { x + y } }; let addTwo = newAdder(2); addTwo(3);",
+        AstAllocation::ARENA, FunctionBodies::LAZY);
+    REQUIRE(closure.type == ObjectType::NUMBER);
+    REQUIRE(any_cast<double>(closure.value) == 5);
+
+    // a broken body only matters once it is called
+    auto unused = testEval("let broken = fn() { let = 1; }; 7", AstAllocation::ARENA, FunctionBodies::LAZY);
+    REQUIRE(unused.type == ObjectType::NUMBER);
+    auto called = testEval("let broken = fn() { let = 1; }; broken()", AstAllocation::ARENA, FunctionBodies::LAZY);
+    REQUIRE(called.type == ObjectType::ERROR);
+}
+
+TEST_CASE("Test Eval Resolved Scopes", "[evaluator]"){
+    using TestItem = std::pair<string, double>;
+    std::array<TestItem, 7> tests{ {
+        make_pair("let x = 1; let f = fn(x) { x * 10 }; f(2) + x", 21),
+        // x is the global until the let of the frame has run
+        make_pair("let x = 5; let f = fn() { let y = x; let x = 2; y + x }; f()", 7),
+        make_pair("let f = fn() { let g = fn() { y }; let y = 3; g() }; f()", 3),
+        make_pair("let add = fn(a) { fn(b) { fn(c) { a + b + c } } }; add(1)(2)(3)", 6),
+        make_pair("let f = fn(n) { if (n > 0) { let m = n * 2; }; m }; f(4)", 8),
+        make_pair("let f = fn(a, a) { a }; f(1, 2)", 2),
+        make_pair("let mk = fn(a) { let k = 10; fn(b) { a + b + k } }; mk(1)(2)", 13),
+    }};
+
+    for(auto bodies : {FunctionBodies::EAGER, FunctionBodies::LAZY}){
+        for(auto test : tests){
+            auto evaluated = testEval(test.first, AstAllocation::ARENA, bodies);
+            REQUIRE(evaluated.type == ObjectType::NUMBER);
+            REQUIRE(any_cast<double>(evaluated.value) == test.second);
+        }
+    }
+
+    // globals defined line by line, as in the REPL
+    auto env = std::make_shared<Environment>();
+    Object evaluated;
+    for(string line : {"let x = 4;", "let f = fn() { x * 2 };", "let x = 5;", "f()"})
+        evaluated = testEval(testParse(line), env);
+    REQUIRE(any_cast<double>(evaluated.value) == 10);
+}
+
+TEST_CASE("Test Streaming Execution", "[evaluator]"){
+    auto streamEval = [](string input, bool background){
+        istringstream in{input};
+        // every statement in a group of its own
+        StatementStream stream{in, FunctionBodies::LAZY, 0};
+        Evaluator evaluator{nullptr, Optimization::ON, backend()};
+        return runStream(stream, evaluator, std::make_shared<Environment>(), background);
+    };
+
+    using TestItem = std::pair<string, double>;
+    std::array<TestItem, 5> tests{ {
+        make_pair("let newAdder = fn(x) { fn(y) { x + y }; }; let addTwo = newAdder(2); addTwo(3);", 5),
+        make_pair("let f = fn(n) { if (n < 2) { return n; } f(n - 1) + f(n - 2) }; f(10);", 55),
+        make_pair("let h = {\"a;b\": fn() { 1; 2 }}; 4; return 7; 9;", 7),
+        make_pair("let a = 1; let b = a + 1;\nb * 10", 20),
+        // globals read in one group are read again after the next rebinds them
+        make_pair("let a = 1; let f = fn() { a }; f(); let a = 5; f() + a;", 10)
+    }};
+
+    for(auto background : {false, true}){
+        for(auto test : tests){
+            Object evaluated = streamEval(test.first, background);
+            REQUIRE(evaluated.type == ObjectType::NUMBER);
+            REQUIRE(any_cast<double>(evaluated.value) == test.second);
+            REQUIRE(any_cast<double>(testEval(test.first).value) == test.second);
+        }
+
+        auto error = streamEval("let a = 1; a + true; 5;", background);
+        REQUIRE(error.type == ObjectType::ERROR);
+    }
+
+    istringstream in{"let a = 1; let = 2; let c = 3;"};
+    StatementStream stream{in, FunctionBodies::LAZY, 0};
+    REQUIRE(stream.next() != nullptr);
+    REQUIRE(stream.next() == nullptr);
+    REQUIRE(stream.getErrors().size() > 0);
+}
+
+TEST_CASE("Test Backends Agree", "[evaluator]"){
+    auto run = [](string input, Backend backend){
+        return testEval(input, AstAllocation::ARENA, FunctionBodies::LAZY, Optimization::ON, backend);
+    };
+
+    std::array<string, 19> tests{ {
+        "let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(20)",
+        "let counter = fn(a) { let b = a * 2; [fn() { a }, fn() { b }] }; let c = counter(4); c[0]() + c[1]()",
+        "let f = fn() { let g = fn() { y }; let y = 3; g() }; f()",
+        "let x = 1; let f = fn() { let g = fn() { x }; let r = g(); let x = 2; [r, g()] }; f()",
+        "let add = fn(a) { fn(b) { fn(c) { fn(d) { a + b + c + d } } } }; add(1)(2)(3)(4)",
+        "let f = fn(a, a) { a }; f(1, 2)",
+        "let f = fn(a, b) { a }; f(1, 2, 3)",
+        "let h = {\"a\": [1, 2], 3: true, false: \"f\"}; [h[\"a\"][1], h[3], h[false], h[\"b\"]]",
+        "let a = push([1], 2); [len(a), first(a), last(a), len(\"abc\")]",
+        "let s = fn(x) { if (!x) { \"no\" } else { \"yes\" + \"!\" } }; [s(true), s(false), s(0)]",
+        "let f = fn() { 1 }; f(2) + PI",
+        "[1 == true, \"a\" != 1, !5, !!false, 1 / 0 > 100]",
+        "len(1)",
+        "-\"a\"",
+        "let f = fn() { 5 + true }; f()",
+        "let f = 1; f()",
+        "let broken = fn() { let = 1; }; broken()",
+        "let loop = fn(n, acc) { if (n == 0) { return acc; }; loop(n - 1, acc + 1) }; loop(100000, 0)",
+        "let even = fn(n) { if (n == 0) { return true; }; odd(n - 1) }; let odd = fn(n) { if (n == 0) { return false; }; even(n - 1) }; even(100001)",
+    } };
+
+    for(auto test : tests){
+        auto tree = run(test, Backend::TREE);
+        for(auto other : {Backend::CLOSURES, Backend::BYTECODE, Backend::JIT, Backend::STACK}){
+            auto evaluated = run(test, other);
+            REQUIRE(evaluated.type == tree.type);
+            REQUIRE(evaluated.inspect() == tree.inspect());
+        }
+    }
+
+    // top-level code needing more than the virtual machine's first stack
+    string wide = "len([";
+    for(int i = 0; i < 3000; ++i)
+        wide += to_string(i) + ", ";
+    REQUIRE(run(wide + "0])", Backend::BYTECODE).inspect() == "3001");
+
+    // the virtual machine and the StackMachine keep their frames off the
+    // native stack, calls other than tail calls run out of them
+    for(auto other : {Backend::BYTECODE, Backend::STACK}){
+        auto deep = run("let f = fn(n) { f(n + 1) + 1 }; f(0)", other);
+        REQUIRE(deep.type == ObjectType::ERROR);
+        REQUIRE(any_cast<string>(deep.value) == "stack overflow");
+    }
+}
+
+TEST_CASE("Test Eval Type Feedback", "[evaluator]"){
+    // always on the tree-walker, the nodes it specialized are checked
+    auto evalTree = [](shared_ptr<Program> program, shared_ptr<Environment> env){
+        return testEval(program, env, Optimization::ON, Backend::TREE);
+    };
+    auto bodyOf = [](shared_ptr<Program> program) -> BlockStatement* {
+        auto let = static_cast<LetStatement*>(program->statements[0].get());
+        return static_cast<FunctionLiteral*>(let->value.get())->body.get();
+    };
+    auto expressionOf = [](StatementNode* stmt){
+        return static_cast<ExpressionStatement*>(stmt)->expression.get();
+    };
+
+    // operands type inference cannot prove, only numbers flow in
+    auto program = testParse("let f = fn(a, b) { a + b }; let xs = [1, 2]; f(xs[0], xs[1]) + f(xs[1], xs[1])");
+    auto result = evalTree(program, make_shared<Environment>());
+    REQUIRE(any_cast<double>(result.value) == 7);
+    auto add = static_cast<InfixExpression*>(expressionOf(bodyOf(program)->statements[0].get()));
+    REQUIRE(add->feedback == Feedback::SPECIALIZED);
+
+    // strings break the guard, the site goes generic for good
+    program = testParse("let f = fn(a, b) { a + b }; let x = f(1, 2); let y = f(\"a\", \"b\"); let z = f(3, 4); [x, y, z]");
+    result = evalTree(program, make_shared<Environment>());
+    REQUIRE(result.inspect() == "[3, ab, 7]");
+    add = static_cast<InfixExpression*>(expressionOf(bodyOf(program)->statements[0].get()));
+    REQUIRE(add->feedback == Feedback::GENERIC);
+
+    // a call site that always calls the same function, then another one;
+    // not a tail call, those leave the frame before the call
+    program = testParse("let apply = fn(h, x) { h(x) * 1 }; let inc = fn(x) { x + 1 }; let dec = fn(x) { x - 1 };"
+        "let a = apply(inc, 1); let b = apply(inc, a); [b, apply(dec, b)]");
+    result = evalTree(program, make_shared<Environment>());
+    REQUIRE(result.inspect() == "[3, 2]");
+    auto mul = static_cast<InfixExpression*>(expressionOf(bodyOf(program)->statements[0].get()));
+    auto call = static_cast<CallExpression*>(mul->left.get());
+    REQUIRE(call->feedback == Feedback::GENERIC);
+
+    // a builtin cached by a global name stops counting once a line binds it
+    auto env = make_shared<Environment>();
+    auto size = testParse("let size = fn(a) { len(a) };");
+    evalTree(size, env);
+    REQUIRE(any_cast<double>(evalTree(testParse("size([1, 2, 3])"), env).value) == 3);
+    auto lenCall = static_cast<CallExpression*>(expressionOf(bodyOf(size)->statements[0].get()));
+    REQUIRE(static_cast<Identifier*>(lenCall->function.get())->builtin != nullptr);
+    evalTree(testParse("let len = fn(a) { 42 };"), env);
+    REQUIRE(any_cast<double>(evalTree(testParse("size([1, 2, 3])"), env).value) == 42);
+}
+
+TEST_CASE("Test Eval Tail Calls", "[evaluator]"){
+    // on the tree-walker, whose frames would be native ones; Backends Agree
+    // runs deep tail loops on the others
+    auto run = [](string input, Optimization optimization, Backend backend){
+        return testEval(input, AstAllocation::ARENA, FunctionBodies::EAGER, optimization, backend);
+    };
+
+    using TestItem = std::pair<string, string>;
+    std::array<TestItem, 8> tests{ {
+        make_pair("let loop = fn(n, acc) { if (n == 0) { acc } else { loop(n - 1, acc + n) } }; loop(100000, 0) == 5000050000", "True"),
+        make_pair("let down = fn(n) { if (n == 0) { return \"done\"; } return down(n - 1); }; down(100000)", "done"),
+        make_pair("let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };"
+            "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; even(100001)", "False"),
+        make_pair("let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; sum(100)", "5050"),
+        make_pair("let mk = fn(n, fs) { if (n == 0) { fs } else { mk(n - 1, push(fs, fn() { n })) } };"
+            "let fs = mk(3, []); [fs[0](), fs[1](), fs[2]()]", "[3, 2, 1]"),
+        make_pair("let f = fn(x) { len(x) }; f(\"abc\")", "3"),
+        make_pair("let f = fn(a, b) { if (a == 0) { b } else { f(a - 1) } }; f(2, 5)", "Nil"),
+        make_pair("let f = fn(n) { g(n) }; f(1)", "identifier not found: g"),
+    } };
+
+    for(auto optimization: {Optimization::OFF, Optimization::ON}){
+        for(auto& [input, expected]: tests)
+            REQUIRE(run(input, optimization, Backend::TREE).inspect() == expected);
+    }
+    // past what the virtual machine's value stack holds
+    REQUIRE(run("let loop = fn(n, acc) { if (n == 0) { acc } else { loop(n - 1, acc + n) } }; loop(1000000, 0)",
+        Optimization::ON, Backend::BYTECODE).inspect() == "5e+11");
+
+    // only calls whose value the function returns are marked
+    auto program = testParse("let f = fn(n) { if (n > 0) { return f(n - 1); }; [f(n)]; n + f(n) }");
+    testEval(program, make_shared<Environment>(), Optimization::OFF, Backend::TREE);
+    auto let = static_cast<LetStatement*>(program->statements[0].get());
+    auto& stmts = static_cast<FunctionLiteral*>(let->value.get())->body->statements;
+    auto ifExpr = static_cast<IfExpression*>(static_cast<ExpressionStatement*>(stmts[0].get())->expression.get());
+    auto ret = static_cast<ReturnStatement*>(ifExpr->consequence->statements[0].get());
+    REQUIRE(static_cast<CallExpression*>(ret->value.get())->tail);
+    auto array = static_cast<ArrayLiteral*>(static_cast<ExpressionStatement*>(stmts[1].get())->expression.get());
+    REQUIRE_FALSE(static_cast<CallExpression*>(array->items[0].get())->tail);
+    auto add = static_cast<InfixExpression*>(static_cast<ExpressionStatement*>(stmts[2].get())->expression.get());
+    REQUIRE_FALSE(static_cast<CallExpression*>(add->right.get())->tail);
+}
+
+TEST_CASE("Test Eval Explicit Stack", "[evaluator]"){
+    auto run = [](string input, size_t maxDepth){
+        return testEval(input, AstAllocation::ARENA, FunctionBodies::EAGER, Optimization::ON, Backend::STACK, maxDepth);
+    };
+
+    // far past what the tree-walker's native stack takes
+    auto sum = "let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; sum(";
+    REQUIRE(run(string(sum) + "50000)", 100000).inspect() == "1.25002e+09");
+    REQUIRE(run(string(sum) + "499)", 500).inspect() == "124750");
+    auto deep = run(string(sum) + "500)", 500);
+    REQUIRE(deep.type == ObjectType::ERROR);
+    REQUIRE(any_cast<string>(deep.value) == "stack overflow");
+
+    // returns leave the nodes they are in, errors the whole program
+    REQUIRE(run("let f = fn(n) { let a = [1, if (n > 0) { return n * 2; }]; a }; [f(4), f(0)]", 10).inspect()
+        == "[8, [1, Nil]]");
+    REQUIRE(run("let f = fn(n) { [n, {n: g(n)}] }; let g = fn(n) { n + \"a\" }; f(1)", 10).inspect()
+        == "type mismatch: NUMBER + STRING");
+    REQUIRE(run("return 3; 4", 10).inspect() == "3");
+}
@@ -0,0 +1,96 @@
+#include <string>
+#include <memory>
+#include <any>
+
+
+#include "vendor/catch2.hpp"
+
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/object.hpp"
+#include "main/environment.hpp"
+#include "main/evaluator.hpp"
+#include "main/jit.hpp"
+
+using namespace std;
+
+static Object run(shared_ptr<Program> program, Backend backend, shared_ptr<Environment> env = make_shared<Environment>()){
+    Evaluator evaluator{program, Optimization::ON, backend};
+    return evaluator.execute(env);
+}
+
+static shared_ptr<Program> parse(string input){
+    Lexer lexer{input};
+    Parser parser{lexer};
+    return parser.parseProgram();
+}
+
+// literal of the function the first statement binds
+static FunctionLiteral* functionOf(shared_ptr<Program> program, size_t statement = 0){
+    auto let = static_cast<LetStatement*>(program->statements[statement].get());
+    return static_cast<FunctionLiteral*>(let->value.get());
+}
+
+TEST_CASE("Test Jit Agrees With Interpreter", "[jit]"){
+    string tests[] = {
+        "let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(20)",
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(15)",
+        "let poly = fn(x) { ((3 * x + 2) * x - 5) * x + 7 }; poly(3 / 2)",
+        "let sign = fn(x) { if (x > 0) { 1 } else { if (x == 0) { 0 } else { -1 } } }; [sign(-2), sign(0), sign(3)]",
+        "let ne = fn(a, b) { if (a != b) { 1 } else { 0 } }; [ne(1, 2), ne(2, 2), ne(0 / 0, 0 / 0)]",
+        "let lt = fn(a, b) { if (a < b) { 1 } else { 0 } }; [lt(1, 2), lt(2, 1), lt(0 / 0, 1)]",
+        "let even = fn(n) { if (n == 0) { 1 } else { odd(n - 1) } }; let odd = fn(n) { if (n == 0) { 0 } else { even(n - 1) } }; even(10)",
+        "let sq = fn(x) { x * x }; let hyp = fn(a, b) { sq(a) + sq(b) }; hyp(3, 4)",
+        "let f = fn(a, b, c, d) { a - b / c * -d }; f(1, 2, 3, 4)",
+        "let f = fn(n) { if (n > 10) { return 1; } 2 }; [f(5), f(20)]",
+        "let f = fn(x) { x * 2 }; [f(2), f(\"a\"), f(3)]",
+        "let f = fn(x) { x }; [f(1, 2), f(true)]",
+        "let f = fn(x) { let y = x + 1; y }; f(1)",
+        "let f = fn(x) { if (x) { 1 } else { 2 } }; f(0)",
+        "let loop = fn(n, acc) { if (n == 0) { acc } else { loop(n - 1, acc + n) } }; loop(100000, 0)",
+        "let even = fn(n) { if (n == 0) { 1 } else { odd(n - 1) } }; let odd = fn(n) { if (n == 0) { 0 } else { even(n - 1) } }; even(100001)",
+        "let f = fn(a, b) { if (a > 0) { return g(a - 1); } b }; let g = fn(a) { f(a, a + 10) }; f(3, 0)",
+    };
+
+    for(auto& test: tests){
+        auto tree = run(parse(test), Backend::TREE);
+        auto jit = run(parse(test), Backend::JIT);
+        REQUIRE(jit.type == tree.type);
+        REQUIRE(jit.inspect() == tree.inspect());
+    }
+}
+
+TEST_CASE("Test Jit Compiles Numeric Functions", "[jit]"){
+    if(!Jit::available())
+        return;
+
+    auto program = parse("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(10)");
+    REQUIRE(any_cast<double>(run(program, Backend::JIT).value) == 55);
+    REQUIRE(functionOf(program)->native != nullptr);
+
+    // strings, lets and truthy conditions stay with the interpreter
+    for(auto input: {"let f = fn(x) { x + \"a\" }; f(\"b\")", "let f = fn(x) { let y = x; y }; f(1)",
+            "let f = fn(x) { if (x) { 1 } else { 2 } }; f(1)", "let f = fn(x) { [x] }; f(1)"}){
+        program = parse(input);
+        run(program, Backend::JIT);
+        REQUIRE(functionOf(program)->jitTried);
+        REQUIRE(functionOf(program)->native == nullptr);
+    }
+
+    // a callee rebound after compiling sends the call back to the interpreter
+    auto env = make_shared<Environment>();
+    program = parse("let g = fn(x) { x + 1 }; let f = fn(x) { g(x) * 2 }; f(1)");
+    REQUIRE(any_cast<double>(run(program, Backend::JIT, env).value) == 4);
+    REQUIRE(functionOf(program, 1)->native != nullptr);
+    auto rebound = run(parse("let g = fn(x) { x + 10 }; f(1)"), Backend::JIT, env);
+    REQUIRE(any_cast<double>(rebound.value) == 22);
+
+    // REPL lines rebinding a callee twice: the first line's literal is freed
+    // by then, the last one's may take its place in memory
+    env = make_shared<Environment>();
+    REQUIRE(any_cast<double>(run(parse("let f = fn(x) { x * 2 }; let g = fn(y) { f(y) + 1 }; g(4)"),
+        Backend::JIT, env).value) == 9);
+    REQUIRE(any_cast<double>(run(parse("let f = fn(x) { x * 3 }; g(4)"), Backend::JIT, env).value) == 13);
+    REQUIRE(any_cast<double>(run(parse("let f = fn(x) { x * 5 }; g(4)"), Backend::JIT, env).value) == 21);
+}
@@ -1,8 +1,21 @@
 #include "vendor/catch2.hpp"
 
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "main/core.hpp"
+#include "main/source.hpp"
 #include "main/token.hpp"
 #include "main/lexer.hpp"
+#include "main/scan.hpp"
+#include "main/tokens.hpp"
+#include "main/symbols.hpp"
 
 using namespace std;
 
@@ -164,4 +177,208 @@ if (5 < 10) {
         REQUIRE(expect.literal == tok.literal);
     }
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("View lexing", "[lexer]"){
+    string input = R"STRING(let big = 12345678901; let s = "foo bar"; if (big != 1) { fn(x) { x == 2 } })STRING";
+
+    Lexer lexer{input};
+    ViewLexer viewLexer{input};
+    while(true){
+        auto tok = lexer.nextToken();
+        auto view = viewLexer.nextToken();
+        REQUIRE(tok.type == view.type);
+        REQUIRE(tok.literal == view.literal);
+        // views point into the lexed buffer, no copy is made
+        REQUIRE(view.literal.data() >= input.data());
+        REQUIRE(view.literal.data() <= input.data() + input.size());
+        if(view.type == TokenType::NUMBER)
+            REQUIRE(std::get<double>(tok.value) == view.number);
+        if(tok.type == TokenType::EOS)
+            break;
+    }
+
+    ViewLexer numbers{"12345678901"};
+    REQUIRE(numbers.nextToken().number == 12345678901.0);
+
+    ViewLexer unterminated{"\"foo"};
+    auto str = unterminated.nextToken();
+    REQUIRE(str.type == TokenType::STRING);
+    REQUIRE(str.literal == "foo");
+    REQUIRE(unterminated.nextToken().type == TokenType::EOS);
+}
+
+TEST_CASE("Mapped source lexing", "[lexer]"){
+    string path = "mapped_source_test.mk";
+    {
+        ofstream out{path};
+        out << "let five = 5;";
+    }
+
+    auto source = Source::fromFile(path);
+    REQUIRE(source != nullptr);
+    REQUIRE(source->text() == "let five = 5;");
+
+    Lexer lexer{source};
+    REQUIRE(lexer.nextToken().type == TokenType::LET);
+    REQUIRE(lexer.nextToken().literal == "five");
+    std::remove(path.c_str());
+
+    REQUIRE(Source::fromFile("does/not/exist.mk") == nullptr);
+}
+
+TEST_CASE("Scan paths agree", "[lexer]"){
+    // every byte value at every offset of a block, with runs crossing block edges
+    string bytes;
+    for(int i = 0; i < 256; ++i)
+        bytes += string(i % 40 + 1, 'a') + string(i % 7 + 1, ' ') + "\t\n1234567890" + (char)i;
+
+    string script;
+    for(int i = 0; i < 200; ++i)
+        script += "let very_long_identifier_name_number_" + string(i % 50, 'x') +
+            " = \"" + string(i % 70, 'q') + "\";\n    12345678901234567890" + string(i % 33, ' ') + "== !=;\n";
+
+    auto tokenize = [](const string& input){
+        vector<pair<TokenType, string_view>> tokens;
+        ViewLexer lexer{input};
+        for(auto tok = lexer.nextToken(); tok.type != TokenType::EOS; tok = lexer.nextToken())
+            tokens.push_back(make_pair(tok.type, tok.literal));
+        return tokens;
+    };
+
+    auto original = scanPath();
+    setScanPath(ScanPath::SCALAR);
+    auto expectTokens = tokenize(script);
+    vector<const char*> expectRuns;
+    const char* end = bytes.data() + bytes.size();
+    for(const char* p = bytes.data(); p < end; ++p){
+        expectRuns.push_back(skipWhitespaceRun(p, end));
+        expectRuns.push_back(skipLetterRun(p, end));
+        expectRuns.push_back(skipDigitRun(p, end));
+        expectRuns.push_back(findQuote(p, end));
+    }
+
+    for(auto path: {ScanPath::SSE2, ScanPath::AVX2}){
+        if(setScanPath(path) != path)
+            continue;
+        REQUIRE(tokenize(script) == expectTokens);
+        size_t i = 0;
+        for(const char* p = bytes.data(); p < end; ++p){
+            REQUIRE(skipWhitespaceRun(p, end) == expectRuns[i++]);
+            REQUIRE(skipLetterRun(p, end) == expectRuns[i++]);
+            REQUIRE(skipDigitRun(p, end) == expectRuns[i++]);
+            REQUIRE(findQuote(p, end) == expectRuns[i++]);
+        }
+    }
+    setScanPath(original);
+}
+
+TEST_CASE("Keyword lookup", "[lexer]"){
+    for(auto& keyword: KEYWORDS)
+        REQUIRE(lookupKeyword(keyword.word) == keyword.type);
+
+    string misses[] = {"", "f", "fnn", "lett", "tru", "False", "iff", "els", "returns", "x", "elsewhere"};
+    for(auto& word: misses)
+        REQUIRE(lookupKeyword(word) == TokenType::IDENT);
+}
+
+TEST_CASE("Token stream", "[lexer]"){
+    auto source = Source::fromString("let x = 42; x + x;");
+    auto stream = TokenStream::tokenize(source);
+
+    Lexer lexer{source};
+    for(size_t i = 0; i < stream.size(); ++i){
+        auto tok = lexer.nextToken();
+        REQUIRE(stream.type(i) == tok.type);
+        REQUIRE(stream.literal(i) == tok.literal);
+        REQUIRE(stream.token(i).literal == tok.literal);
+    }
+
+    REQUIRE(stream.size() == 10);
+    REQUIRE(stream.number(3) == 42);
+    // both uses of x share one identifier entry
+    REQUIRE(stream.identifierCount() == 1);
+    REQUIRE(stream.identifier(1) == stream.identifier(5));
+    REQUIRE(stream.identifierName(stream.identifier(7)) == "x");
+    // lookahead past the end keeps yielding EOS
+    REQUIRE(stream.type(stream.size() + 5) == TokenType::EOS);
+}
+
+TEST_CASE("Symbol interning", "[lexer]"){
+    auto first = TokenStream::tokenize(Source::fromString("let counter = total + 1;"));
+    auto second = TokenStream::tokenize(Source::fromString("total * counter"));
+
+    // the same name gets the same symbol in every stream
+    REQUIRE(first.identifier(1) == second.identifier(2));
+    REQUIRE(first.identifier(3) == second.identifier(0));
+    REQUIRE(first.identifier(1) != first.identifier(3));
+    REQUIRE(intern("counter") == first.identifier(1));
+    REQUIRE(symbolName(second.identifier(0)) == "total");
+    REQUIRE(first.identifierName(first.identifier(3)) == "total");
+
+    auto count = symbolCount();
+    REQUIRE(intern(string("tot") + "al") == first.identifier(3));
+    REQUIRE(symbolCount() == count);
+}
+
+TEST_CASE("Stream lexing across chunk boundaries", "[lexer]"){
+    string input = R"STRING(let add = fn(first_value, second) { first_value + second == 12345 };
+let message = "a string literal longer than a chunk"; !true != false; add(1, 2);)STRING";
+
+    vector<pair<TokenType, string>> expect;
+    ViewLexer viewLexer{input};
+    for(auto tok = viewLexer.nextToken(); tok.type != TokenType::EOS; tok = viewLexer.nextToken())
+        expect.push_back(make_pair(tok.type, string(tok.literal)));
+
+    for(size_t chunk: {1, 2, 3, 7, 16, 4096}){
+        istringstream in{input};
+        StreamLexer lexer{in, chunk};
+        vector<pair<TokenType, string>> tokens;
+        for(auto tok = lexer.nextToken(); tok.type != TokenType::EOS; tok = lexer.nextToken())
+            tokens.push_back(make_pair(tok.type, string(tok.literal)));
+        REQUIRE(tokens == expect);
+        // only the longest token forces the buffer past a chunk
+        REQUIRE(lexer.capacity() <= chunk + 40);
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_CASE("Stream lexing reports read errors", "[lexer]"){
+    // reading a directory fails with EISDIR, which is not the end of input
+    int fd = ::open(".", O_RDONLY);
+    REQUIRE(fd >= 0);
+    StreamLexer lexer{fd};
+    REQUIRE(lexer.nextToken().type == TokenType::EOS);
+    REQUIRE(lexer.getError().rfind("read error: ", 0) == 0);
+    ::close(fd);
+
+    istringstream in{"let x = 1;"};
+    StreamLexer fine{in};
+    while(fine.nextToken().type != TokenType::EOS);
+    REQUIRE(fine.getError().empty());
+}
+#endif
+
+TEST_CASE("Parallel tokenizing", "[lexer]"){
+    string script;
+    for(int i = 0; i < 300; ++i)
+        script += "let rule_" + to_string(i % 17) + " = {\"name\": \"rule " + string(i % 29, ' ') + "number\", \"limit\": " +
+            to_string(i) + "};\nlet f = fn(x) { x == \"a b c\" };\n";
+    auto source = Source::fromString(script);
+    auto expect = TokenStream::tokenize(source);
+
+    for(unsigned threads: {2, 3, 5, 8, 13}){
+        auto stream = TokenStream::tokenizeParallel(source, threads, 1);
+        REQUIRE(stream.size() == expect.size());
+        REQUIRE(stream.identifierCount() == expect.identifierCount());
+        for(size_t i = 0; i < expect.size(); ++i){
+            REQUIRE(stream.type(i) == expect.type(i));
+            REQUIRE(stream.offset(i) == expect.offset(i));
+            REQUIRE(stream.length(i) == expect.length(i));
+            if(expect.type(i) == TokenType::IDENT)
+                REQUIRE(stream.identifier(i) == expect.identifier(i));
+            if(expect.type(i) == TokenType::NUMBER)
+                REQUIRE(stream.number(i) == expect.number(i));
+        }
+    }
+}
@@ -0,0 +1,303 @@
+#include <iostream>
+#include <array>
+#include <any>
+
+
+#include "vendor/catch2.hpp"
+
+#include "main/core.hpp"
+#include "main/token.hpp"
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/object.hpp"
+#include "main/environment.hpp"
+#include "main/evaluator.hpp"
+#include "main/optimizer.hpp"
+
+using namespace std;
+
+// Optimized program, nodes are only valid while it lives
+shared_ptr<Program> optimize(string input, AstAllocation allocation = AstAllocation::ARENA,
+        FunctionBodies bodies = FunctionBodies::EAGER){
+    Lexer lexer{input};
+    Parser parser{lexer, allocation, bodies};
+    auto program = parser.parseProgram();
+    REQUIRE(parser.getErrors().empty());
+    PassManager{Optimization::ON}.run(*program);
+    return program;
+}
+
+// expression of the last statement
+shared_ptr<ExpressionNode> lastExpression(const shared_ptr<Program>& program){
+    auto stmt = program->statements.back();
+    if(auto let = dynamic_pointer_cast<LetStatement>(stmt))
+        return let->value;
+    return dynamic_pointer_cast<ExpressionStatement>(stmt)->expression;
+}
+
+// folded value or a literal that was already there
+void checkConstant(shared_ptr<ExpressionNode> expr, double value){
+    if(auto number = dynamic_pointer_cast<NumberLiteral>(expr)){
+        REQUIRE(number->value == value);
+        return;
+    }
+    auto constant = dynamic_pointer_cast<Constant>(expr);
+    REQUIRE(constant != nullptr);
+    REQUIRE(constant->value.type == ObjectType::NUMBER);
+    REQUIRE(any_cast<double>(constant->value.value) == value);
+}
+
+TEST_CASE("Test Constant Folding", "[optimizer]"){
+    for(auto allocation : {AstAllocation::ARENA, AstAllocation::HEAP}){
+        auto sumProgram = optimize("1 + 2 * 3", allocation);
+        checkConstant(lastExpression(sumProgram), 7);
+        auto negatedProgram = optimize("-(4 - 6) * 2", allocation);
+        checkConstant(lastExpression(negatedProgram), 4);
+        auto propagatedProgram = optimize("let a = 2; let b = a * 3; b + 1", allocation);
+        checkConstant(lastExpression(propagatedProgram), 7);
+
+        auto concatProgram = optimize("\"a\" + \"b\"", allocation);
+        auto comparison = dynamic_pointer_cast<Constant>(lastExpression(concatProgram));
+        REQUIRE(comparison != nullptr);
+        REQUIRE(any_cast<string>(comparison->value.value) == "ab");
+    }
+
+    // errors are left to runtime
+    auto errorProgram = optimize("1 + true");
+    REQUIRE(lastExpression(errorProgram)->kind == NodeKind::INFIX);
+    // rebound and unknown names stay reads
+    auto reboundProgram = optimize("let a = 1; let a = 2; a");
+    REQUIRE(lastExpression(reboundProgram)->kind == NodeKind::IDENTIFIER);
+    auto conditionalProgram = optimize("if (x) { let a = 1; }; a");
+    REQUIRE(lastExpression(conditionalProgram)->kind == NodeKind::IDENTIFIER);
+}
+
+TEST_CASE("Test Constant Propagation Into Functions", "[optimizer]"){
+    // a global may be rebound by a later REPL line before the function runs
+    auto global = optimize("let a = 1; let f = fn() { a + 1 };");
+    auto fn = dynamic_pointer_cast<FunctionLiteral>(lastExpression(global));
+    auto body = dynamic_pointer_cast<ExpressionStatement>(fn->body->statements[0])->expression;
+    REQUIRE(body->kind == NodeKind::INFIX);
+
+    // locals are bound once per call, closures made after the let see it
+    auto local = optimize("let f = fn(n) { let k = 3; fn() { k * 2 } };");
+    fn = dynamic_pointer_cast<FunctionLiteral>(lastExpression(local));
+    auto inner = dynamic_pointer_cast<FunctionLiteral>(
+        dynamic_pointer_cast<ExpressionStatement>(fn->body->statements[1])->expression);
+    checkConstant(dynamic_pointer_cast<ExpressionStatement>(inner->body->statements[0])->expression, 6);
+
+    // a read before the let still falls back to the outer binding
+    auto early = optimize("let f = fn() { let y = x; let x = 2; y + x };");
+    fn = dynamic_pointer_cast<FunctionLiteral>(lastExpression(early));
+    auto y = dynamic_pointer_cast<LetStatement>(fn->body->statements[0]);
+    REQUIRE(y->value->kind == NodeKind::IDENTIFIER);
+    auto sum = dynamic_pointer_cast<InfixExpression>(dynamic_pointer_cast<ExpressionStatement>(fn->body->statements[2])->expression);
+    REQUIRE(sum->left->kind == NodeKind::IDENTIFIER);
+    checkConstant(sum->right, 2);
+
+    // parameters change from call to call
+    auto param = optimize("let f = fn(n) { n + 1 };");
+    fn = dynamic_pointer_cast<FunctionLiteral>(lastExpression(param));
+    REQUIRE(dynamic_pointer_cast<ExpressionStatement>(fn->body->statements[0])->expression->kind == NodeKind::INFIX);
+}
+
+TEST_CASE("Test Dead Branch Elimination", "[optimizer]"){
+    auto takenProgram = optimize("if (1 < 2) { 10 } else { 20 }");
+    checkConstant(lastExpression(takenProgram), 10);
+    auto flagProgram = optimize("let debug = false; if (debug) { 10 } else { 20 }");
+    checkConstant(lastExpression(flagProgram), 20);
+
+    auto noneProgram = optimize("if (false) { 10 }");
+    auto none = dynamic_pointer_cast<Constant>(lastExpression(noneProgram));
+    REQUIRE(none != nullptr);
+    REQUIRE(none->value.type == ObjectType::NIL);
+
+    // blocks of more than one expression keep their own evaluation
+    auto blockProgram = optimize("if (false) { 1 } else { let a = 2; a }");
+    auto block = dynamic_pointer_cast<IfExpression>(lastExpression(blockProgram));
+    REQUIRE(block != nullptr);
+    REQUIRE(block->alternative == nullptr);
+    REQUIRE(block->consequence->statements.size() == 2);
+
+    auto unknownProgram = optimize("if (x) { 1 } else { 2 }");
+    REQUIRE(lastExpression(unknownProgram)->kind == NodeKind::IF);
+}
+
+TEST_CASE("Test Literal Hoisting", "[optimizer]"){
+    auto arrayProgram = optimize("[1, 2 * 2, [\"a\"]]");
+    auto array = dynamic_pointer_cast<Constant>(lastExpression(arrayProgram));
+    REQUIRE(array != nullptr);
+    REQUIRE(array->value.type == ObjectType::ARRAY);
+    REQUIRE(any_cast<vector<Object>>(array->value.value).size() == 3);
+
+    auto hashProgram = optimize("{\"one\": 1, true: [2]}");
+    auto hash = dynamic_pointer_cast<Constant>(lastExpression(hashProgram));
+    REQUIRE(hash != nullptr);
+    REQUIRE(hash->value.type == ObjectType::HASH);
+
+    auto partialProgram = optimize("[1, x]");
+    REQUIRE(lastExpression(partialProgram)->kind == NodeKind::ARRAY);
+    auto functionProgram = optimize("{\"a\": fn() { 1 }}");
+    REQUIRE(lastExpression(functionProgram)->kind == NodeKind::HASH);
+}
+
+// expression the body of the function bound by the last let evaluates to
+shared_ptr<ExpressionNode> bodyExpression(const shared_ptr<Program>& program){
+    auto fn = dynamic_pointer_cast<FunctionLiteral>(lastExpression(program));
+    REQUIRE(fn != nullptr);
+    REQUIRE(fn->body != nullptr);
+    return dynamic_pointer_cast<ExpressionStatement>(fn->body->statements.back())->expression;
+}
+
+TEST_CASE("Test Function Inlining", "[optimizer]"){
+    for(auto allocation : {AstAllocation::ARENA, AstAllocation::HEAP}){
+        auto helperProgram = optimize("let add = fn(a, b) { a + b }; let f = fn(x) { add(x, 1) };", allocation);
+        auto inlined = dynamic_pointer_cast<InlineCall>(bodyExpression(helperProgram));
+        REQUIRE(inlined != nullptr);
+        REQUIRE(inlined->toString() == "add(x, 1)");
+        REQUIRE(inlined->body->kind == NodeKind::INFIX);
+        // arguments go after the one local of f
+        REQUIRE(inlined->slot == 1);
+        auto f = dynamic_pointer_cast<FunctionLiteral>(lastExpression(helperProgram));
+        REQUIRE(f->locals->size() == 3);
+    }
+
+    // skipped top-level helpers are parsed ahead to be inlined
+    auto lazyProgram = optimize("let add = fn(a, b) { a + b }; let f = fn(x) { add(x, 1) };",
+        AstAllocation::ARENA, FunctionBodies::LAZY);
+    REQUIRE(bodyExpression(lazyProgram)->kind == NodeKind::INLINE);
+
+    const char* kept[] = {
+        // recursive
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) } }; let f = fn(x) { fib(x) };",
+        // over the budget
+        "let big = fn(a) { a + a + a + a + a + a + a + a + a + a + a + a + a }; let f = fn(x) { big(x) };",
+        // bound twice
+        "let add = fn(a, b) { a + b }; let add = fn(a, b) { a - b }; let f = fn(x) { add(x, 1) };",
+        // a frame of its own
+        "let add = fn(a, b) { let c = a; c + b }; let f = fn(x) { add(x, 1) };",
+        // wrong argument count
+        "let add = fn(a, b) { a + b }; let f = fn(x) { add(x) };",
+        // reads k of its frame, that f shadows
+        "let make = fn(k) { let add = fn(x) { x + k }; fn(k) { add(k) } };",
+    };
+    for(auto input : kept){
+        auto program = optimize(input);
+        auto body = bodyExpression(program);
+        if(body->kind == NodeKind::FUNCTION)
+            body = dynamic_pointer_cast<ExpressionStatement>(
+                dynamic_pointer_cast<FunctionLiteral>(body)->body->statements.back())->expression;
+        REQUIRE(body->kind == NodeKind::CALL);
+    }
+
+    // no slots for the arguments at top level
+    auto topProgram = optimize("let add = fn(a, b) { a + b }; add(1, 2)");
+    REQUIRE(lastExpression(topProgram)->kind == NodeKind::CALL);
+
+    // a later line rebinding the helper gets the call back
+    auto env = make_shared<Environment>();
+    Lexer first{string{"let add = fn(a, b) { a + b }; let f = fn(x) { add(x, 1) };"}};
+    Parser firstParser{first};
+    Evaluator{firstParser.parseProgram()}.execute(env);
+    Lexer second{string{"let add = fn(a, b) { a * b }; f(5)"}};
+    Parser secondParser{second};
+    auto result = Evaluator{secondParser.parseProgram()}.execute(env);
+    REQUIRE(any_cast<double>(result.value) == 5);
+}
+
+TEST_CASE("Test Type Inference", "[optimizer]"){
+    auto fibProgram = optimize("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(10)");
+    auto fib = dynamic_pointer_cast<FunctionLiteral>(
+        dynamic_pointer_cast<LetStatement>(fibProgram->statements[0])->value);
+    auto branch = dynamic_pointer_cast<IfExpression>(
+        dynamic_pointer_cast<ExpressionStatement>(fib->body->statements[0])->expression);
+    REQUIRE(branch->booleanCondition);
+    REQUIRE(dynamic_pointer_cast<InfixExpression>(branch->condition)->numeric);
+    auto sum = dynamic_pointer_cast<InfixExpression>(
+        dynamic_pointer_cast<ExpressionStatement>(branch->alternative->statements[0])->expression);
+    // a global may be rebound before the recursive call returns
+    REQUIRE_FALSE(sum->numeric);
+    auto call = dynamic_pointer_cast<CallExpression>(sum->left);
+    REQUIRE(dynamic_pointer_cast<InfixExpression>((*call->arguments)[0])->numeric);
+    REQUIRE(fib->signature == vector<uint32_t>{1u << static_cast<size_t>(ObjectType::NUMBER)});
+    REQUIRE(fib->assumptions != nullptr);
+
+    // results of local functions are known, inlined or not
+    auto localProgram = optimize("let g = fn(x) { let sq = fn(y) { y * y }; -sq(x) + 1 }; g(3)");
+    auto local = dynamic_pointer_cast<FunctionLiteral>(
+        dynamic_pointer_cast<LetStatement>(localProgram->statements[0])->value);
+    auto localSum = dynamic_pointer_cast<InfixExpression>(
+        dynamic_pointer_cast<ExpressionStatement>(local->body->statements[1])->expression);
+    REQUIRE(localSum->numeric);
+    REQUIRE(dynamic_pointer_cast<PrefixExpression>(localSum->left)->specialized);
+
+    auto mixedProgram = optimize("let f = fn(x) { x + 1 }; f(1); f(\"a\");");
+    auto mixed = dynamic_pointer_cast<FunctionLiteral>(
+        dynamic_pointer_cast<LetStatement>(mixedProgram->statements[0])->value);
+    REQUIRE_FALSE(dynamic_pointer_cast<InfixExpression>(
+        dynamic_pointer_cast<ExpressionStatement>(mixed->body->statements[0])->expression)->numeric);
+
+    // a read before the let may see an outer binding of any type
+    auto earlyProgram = optimize("let f = fn() { let y = x; let x = 2; y + x }; f()");
+    auto early = dynamic_pointer_cast<FunctionLiteral>(
+        dynamic_pointer_cast<LetStatement>(earlyProgram->statements[0])->value);
+    REQUIRE_FALSE(dynamic_pointer_cast<InfixExpression>(
+        dynamic_pointer_cast<ExpressionStatement>(early->body->statements[2])->expression)->numeric);
+
+    // a call the inference did not see drops every specialization
+    Lexer lexer{string{"let f = fn(x) { x * 2 }; let a = f(1); let fs = [f]; fs[0](true)"}};
+    Parser parser{lexer};
+    auto program = parser.parseProgram();
+    auto f = dynamic_pointer_cast<FunctionLiteral>(dynamic_pointer_cast<LetStatement>(program->statements[0])->value);
+    auto product = dynamic_pointer_cast<InfixExpression>(
+        dynamic_pointer_cast<ExpressionStatement>(f->body->statements[0])->expression);
+    auto result = Evaluator{program}.execute(make_shared<Environment>());
+    REQUIRE(result.type == ObjectType::ERROR);
+    REQUIRE_FALSE(product->numeric);
+    REQUIRE(f->signature.empty());
+    REQUIRE(f->assumptions == nullptr);
+}
+
+TEST_CASE("Test Optimized And Plain Runs Agree", "[optimizer]"){
+    const char* programs[] = {
+        "let a = 5; let b = a * 2; let f = fn(x) { x + b }; f(1)",
+        "let f = fn(n) { let k = {\"a\": [1, 2, 3]}; k[\"a\"][n] }; f(1) + f(2)",
+        "let x = 5; let f = fn() { let y = x; let x = 2; y + x }; f()",
+        "let t = if (1 > 2) { 1 } else { let z = 4; z * z }; t",
+        "let f = fn(n) { if (true) { return n; }; 0 }; f(9)",
+        "let s = \"ab\" + \"cd\"; len(s)",
+        "if (false) { 1 }",
+        "1 + true",
+        "-true",
+        "let add = fn(a, b) { a + b }; let f = fn(x) { add(x, 1) * add(x, 2) }; f(3)",
+        "let add = fn(a, b) { a + b }; let f = fn(x) { add(add(x, 1), add(x, 2)) }; f(1)",
+        "let sq = fn(x) { x * x }; let f = fn(n) { sq(n + 1) }; f(3)",
+        "let pick = fn(a, b) { b }; let f = fn() { pick(1 + true, 2) }; f()",
+        "let sign = fn(x) { if (x < 0) { -1 } else { [1][0] } }; let f = fn(n) { sign(n) + sign(-n) }; f(4)",
+        "let make = fn(k) { let add = fn(x) { x + k }; add(1) + add(2) }; make(10)",
+        "let make = fn(k) { let add = fn(x) { x + k }; let g = fn(k) { add(k) }; g(5) }; make(10)",
+        "let f = fn(x) { x * 2 }; let a = f(1); let fs = [f]; fs[0](true)",
+        "let f = fn(x) { x * 2 }; let fs = [f]; fs[0](3) + f(4) + fs[0](\"a\")",
+        "let f = fn(b) { if (b) { 1 } else { 2 } }; f(true) + f(false) + [f][0](0)",
+        "let f = fn(a, i) { a[i] }; f([1, 2], 1) + f([3], 5)",
+    };
+
+    for(auto input : programs){
+        for(auto bodies : {FunctionBodies::EAGER, FunctionBodies::LAZY}){
+            Object results[2];
+            for(auto optimization : {Optimization::OFF, Optimization::ON}){
+                Lexer lexer{string{input}};
+                Parser parser{lexer, AstAllocation::ARENA, bodies};
+                Evaluator evaluator{parser.parseProgram(), optimization};
+                results[static_cast<int>(optimization)] = evaluator.execute(std::make_shared<Environment>());
+            }
+            REQUIRE(results[0].type == results[1].type);
+            REQUIRE(results[0].inspect() == results[1].inspect());
+        }
+    }
+
+    REQUIRE(PassManager{Optimization::OFF}.names().empty());
+    REQUIRE(PassManager{Optimization::ON}.names() ==
+        vector<string>{"inline-functions", "fold-constants", "prune-branches", "hoist-literals", "infer-types"});
+}
@@ -477,4 +477,176 @@ TEST_CASE("Test Index Expression", "[parser]"){
 
     auto idx = dynamic_pointer_cast<InfixExpression>(indexExpr->index);
     REQUIRE(idx != nullptr);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Test Arena And Heap Trees Agree", "[parser]"){
+    const char* input = R"STRING(
+let add = fn(a, b) { a + b * -c; };
+let s = "hello";
+if (x < 10) { return [1, 2][0]; } else { {"k": add(1, 2)}; }
+    )STRING";
+
+    Lexer arenaLexer{string{input}};
+    Parser arenaParser{arenaLexer, AstAllocation::ARENA};
+    auto arenaProg = arenaParser.parseProgram();
+    checkParseError(arenaParser);
+
+    Lexer heapLexer{string{input}};
+    Parser heapParser{heapLexer, AstAllocation::HEAP};
+    auto heapProg = heapParser.parseProgram();
+    checkParseError(heapParser);
+
+    REQUIRE(arenaProg->statements.size() == 3);
+    REQUIRE(arenaProg->toString() == heapProg->toString());
+}
+
+TEST_CASE("Test Function Literal Outlives Program", "[parser]"){
+    shared_ptr<FunctionLiteral> fn;
+    {
+        Lexer lexer{string{"fn(x, y) { x + y; }"}};
+        Parser parser{lexer};
+        auto prog = parser.parseProgram();
+        checkParseError(parser);
+
+        auto stmt = std::dynamic_pointer_cast<ExpressionStatement>(prog->statements[0]);
+        auto literal = std::dynamic_pointer_cast<FunctionLiteral>(stmt->expression);
+        REQUIRE(literal != nullptr);
+        auto owner = literal->owner.lock();
+        REQUIRE(owner != nullptr);
+        fn = shared_ptr<FunctionLiteral>(owner, literal.get());
+    }
+    REQUIRE(fn->params->size() == 2);
+    REQUIRE((*fn->params)[1].toString() == "y");
+    REQUIRE(fn->body->toString() == "(x + y)");
+}
+
+TEST_CASE("Test Operator Opcodes", "[parser]"){
+    using TestItem = std::pair<string, Opcode>;
+    std::array<TestItem, 8> infixTests{ {
+        make_pair("a + b", Opcode::ADD),
+        make_pair("a - b", Opcode::SUB),
+        make_pair("a * b", Opcode::MUL),
+        make_pair("a / b", Opcode::DIV),
+        make_pair("a > b", Opcode::GREATER),
+        make_pair("a < b", Opcode::LESS),
+        make_pair("a == b", Opcode::EQUAL),
+        make_pair("a != b", Opcode::NOT_EQUAL)
+    } };
+
+    for(auto test : infixTests){
+        Lexer lexer{test.first};
+        Parser parser{lexer};
+        auto prog = parser.parseProgram();
+        checkParseError(parser);
+
+        auto stmt = std::dynamic_pointer_cast<ExpressionStatement>(prog->statements[0]);
+        auto expr = std::dynamic_pointer_cast<InfixExpression>(stmt->expression);
+        REQUIRE(expr != nullptr);
+        REQUIRE(expr->opcode == test.second);
+    }
+
+    Lexer lexer{string{"!-a"}};
+    Parser parser{lexer};
+    auto prog = parser.parseProgram();
+    checkParseError(parser);
+    auto stmt = std::dynamic_pointer_cast<ExpressionStatement>(prog->statements[0]);
+    auto bang = std::dynamic_pointer_cast<PrefixExpression>(stmt->expression);
+    REQUIRE(bang->opcode == Opcode::NOT);
+    auto minus = std::dynamic_pointer_cast<PrefixExpression>(bang->right);
+    REQUIRE(minus->opcode == Opcode::NEGATE);
+}
+
+TEST_CASE("Test Lazy Function Body Parsing", "[parser]"){
+    const char* input = R"STRING(
+let f = fn(x, y) { let g = fn(z) { {"k": z} }; g(x + y) };
+    )STRING";
+
+    Lexer eagerLexer{string{input}};
+    Parser eagerParser{eagerLexer};
+    auto eagerProg = eagerParser.parseProgram();
+    checkParseError(eagerParser);
+
+    Lexer lexer{string{input}};
+    Parser parser{lexer, AstAllocation::ARENA, FunctionBodies::LAZY};
+    auto prog = parser.parseProgram();
+    checkParseError(parser);
+
+    auto stmt = std::dynamic_pointer_cast<LetStatement>(prog->statements[0]);
+    auto fn = std::dynamic_pointer_cast<FunctionLiteral>(stmt->value);
+    REQUIRE(fn != nullptr);
+    REQUIRE(fn->isLazy());
+    REQUIRE(fn->body == nullptr);
+    REQUIRE(fn->params->size() == 2);
+    REQUIRE(fn->toString() == "fn(x,y){ let g = fn(z) { {\"k\": z} }; g(x + y) }");
+
+    REQUIRE(Parser::parseBody(*fn).empty());
+    REQUIRE_FALSE(fn->isLazy());
+
+    // nested functions are preparsed again
+    auto inner = std::dynamic_pointer_cast<LetStatement>(fn->body->statements[0]);
+    auto g = std::dynamic_pointer_cast<FunctionLiteral>(inner->value);
+    REQUIRE(g != nullptr);
+    REQUIRE(g->isLazy());
+    REQUIRE(Parser::parseBody(*g).empty());
+    REQUIRE(prog->toString() == eagerProg->toString());
+}
+
+TEST_CASE("Test Lazy Function Body Errors", "[parser]"){
+    Lexer lexer{string{"fn(x) { let = x; }"}};
+    Parser parser{lexer, AstAllocation::HEAP, FunctionBodies::LAZY};
+    auto prog = parser.parseProgram();
+    checkParseError(parser);
+
+    auto stmt = std::dynamic_pointer_cast<ExpressionStatement>(prog->statements[0]);
+    auto fn = std::dynamic_pointer_cast<FunctionLiteral>(stmt->expression);
+    REQUIRE(fn->isLazy());
+    REQUIRE_FALSE(Parser::parseBody(*fn).empty());
+    REQUIRE(fn->isLazy());
+
+    // unbalanced bodies are left to the full parser
+    Lexer unbalanced{string{"fn(x) { x"}};
+    Parser unbalancedParser{unbalanced, AstAllocation::ARENA, FunctionBodies::LAZY};
+    auto unbalancedProg = unbalancedParser.parseProgram();
+    stmt = std::dynamic_pointer_cast<ExpressionStatement>(unbalancedProg->statements[0]);
+    fn = std::dynamic_pointer_cast<FunctionLiteral>(stmt->expression);
+    REQUIRE_FALSE(fn->isLazy());
+    REQUIRE(fn->body != nullptr);
+}
+
+TEST_CASE("Test Scope Resolution", "[parser]"){
+    Lexer lexer{string{"let g = 1; let f = fn(a, b) { let c = a + g; fn(x) { x + c + a } };"}};
+    Parser parser{lexer};
+    auto prog = parser.parseProgram();
+    checkParseError(parser);
+
+    auto global = std::dynamic_pointer_cast<LetStatement>(prog->statements[0]);
+    REQUIRE(global->name.depth == Identifier::GLOBAL);
+
+    auto fn = std::dynamic_pointer_cast<FunctionLiteral>(std::dynamic_pointer_cast<LetStatement>(prog->statements[1])->value);
+    REQUIRE(fn->locals != nullptr);
+    REQUIRE(fn->locals->size() == 3);
+    REQUIRE((*fn->params)[1].depth == 0);
+    REQUIRE((*fn->params)[1].slot == 1);
+
+    auto let = std::dynamic_pointer_cast<LetStatement>(fn->body->statements[0]);
+    REQUIRE(let->name.depth == 0);
+    REQUIRE(let->name.slot == 2);
+    auto sum = std::dynamic_pointer_cast<InfixExpression>(let->value);
+    auto a = std::dynamic_pointer_cast<Identifier>(sum->left);
+    REQUIRE(a->depth == 0);
+    REQUIRE(a->slot == 0);
+    REQUIRE(std::dynamic_pointer_cast<Identifier>(sum->right)->depth == Identifier::GLOBAL);
+
+    // x + c + a parses as (x + c) + a
+    auto inner = std::dynamic_pointer_cast<FunctionLiteral>(
+        std::dynamic_pointer_cast<ExpressionStatement>(fn->body->statements[1])->expression);
+    auto outer = std::dynamic_pointer_cast<InfixExpression>(
+        std::dynamic_pointer_cast<ExpressionStatement>(inner->body->statements[0])->expression);
+    auto left = std::dynamic_pointer_cast<InfixExpression>(outer->left);
+    auto x = std::dynamic_pointer_cast<Identifier>(left->left);
+    auto c = std::dynamic_pointer_cast<Identifier>(left->right);
+    auto outerA = std::dynamic_pointer_cast<Identifier>(outer->right);
+    REQUIRE((x->depth == 0 && x->slot == 0));
+    REQUIRE((c->depth == 1 && c->slot == 2));
+    REQUIRE((outerA->depth == 1 && outerA->slot == 0));
+}
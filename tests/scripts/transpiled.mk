@@ -0,0 +1,14 @@
+let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };
+let secondsPerDay = 60 * 60 * 24;
+let greet = fn(name) { "hello " + name };
+let h = {"a": [1, 2], 3: true};
+let twice = fn(f) { fn(x) { f(f(x)) } };
+print(fib(20));
+print(secondsPerDay / 3600);
+print(greet("mkc"));
+print(h["a"][1]);
+print(twice(fn(x) { x * 3 })(2));
+let f = fn() { let g = fn() { y }; let y = 3; g() };
+print(f());
+print(len("abc"), PI);
+print(-"a");
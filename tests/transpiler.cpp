@@ -0,0 +1,63 @@
+#include <string>
+#include <memory>
+
+
+#include "vendor/catch2.hpp"
+
+#include "main/lexer.hpp"
+#include "main/ast.hpp"
+#include "main/parser.hpp"
+#include "main/transpiler.hpp"
+
+using namespace std;
+
+static string transpile(string input, Transpiler::Options options = {}){
+    Lexer lexer{input};
+    Parser parser{lexer};
+    auto program = parser.parseProgram();
+    REQUIRE(parser.getErrors().empty());
+    return Transpiler::transpile(*program, options);
+}
+
+static size_t count(const string& text, const string& part){
+    size_t found = 0;
+    for(auto at = text.find(part); at != string::npos; at = text.find(part, at + 1))
+        ++found;
+    return found;
+}
+
+TEST_CASE("Test Transpile Proven Types", "[transpiler]"){
+    // numbers from literals stay doubles, the let makes a local of them
+    auto source = transpile("let day = 60 * 60 * 24; let hours = day / 3600; hours > 12");
+    REQUIRE(source.find("const double l0 = ((60.0 * 60.0) * 24.0);") != string::npos);
+    REQUIRE(source.find("const double l1 = (l0 / 3600.0);") != string::npos);
+    REQUIRE(source.find("return Object{ObjectType::BOOLEAN, bool((l1 > 12.0))};") != string::npos);
+    REQUIRE(count(source, "rt.infix") == 0);
+
+    // parameters may be anything, their operators go through the runtime
+    source = transpile("let f = fn(a) { let b = 2 * 3; a + b }; f(1)");
+    REQUIRE(source.find("const double l") != string::npos);
+    REQUIRE(count(source, "rt.infix(Opcode::ADD") == 1);
+    REQUIRE(count(source, "rt.call(") == 1);
+
+    // a name bound twice, or in a branch, is not proven
+    source = transpile("let x = 1; let x = x + 1; if (true) { let y = 2; y * 2 }");
+    REQUIRE(source.find("const double") == string::npos);
+    REQUIRE(count(source, "rt.infix(Opcode::MUL") == 1);
+}
+
+TEST_CASE("Test Transpile Resolved Names", "[transpiler]"){
+    auto source = transpile("let mk = fn(a) { fn(b) { a + b } }; mk(1)(2)");
+    // the inner function reads its parameter and the outer one by slot
+    REQUIRE(source.find("env->get(1, 0, S[") != string::npos);
+    REQUIRE(source.find("env->get(0, 0, S[") != string::npos);
+    REQUIRE(source.find("rt.global(*env, S[") != string::npos);
+    REQUIRE(count(source, "rt.function(env, names().shapes[") == 2);
+
+    Transpiler::Options options;
+    options.entry = "run_script";
+    REQUIRE(transpile("1", options).find("Object run_script(Runtime& rt") != string::npos);
+    REQUIRE(transpile("1", options).find("int main()") == string::npos);
+    options.main = true;
+    REQUIRE(transpile("1", options).find("int main()") != string::npos);
+}